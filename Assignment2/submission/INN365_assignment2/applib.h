@@ -5,6 +5,7 @@
 #include <stdlib.h> 
 #include <string.h> 
 #include <stdbool.h>
+#include "internlib.h"
 
 /// Max buffer size of csv single line 
 #define MAX_LINE_BUFFER 512
@@ -22,6 +23,8 @@
 #define APPLIB_ERR_REMOVE -3
 /// Implemantation status: file rename error
 #define APPLIB_ERR_RENAME -4
+/// Implemantation status: memory allocation error
+#define APPLIB_ERR_MEMORY -5
 
 /// Comma
 #define STR_COMMA ","
@@ -30,7 +33,9 @@
 typedef struct foodInfo foodinfo_t;
 struct foodInfo
 {
+	/// interned (shared by the food info of the same name, not freed one by one)
 	char *name;
+	/// interned (a few kinds of measure are shared by all food info)
 	char *measure;
 	int weight;
 	int kCal;
@@ -80,7 +85,7 @@ void writeCSV(char *fileName, foodinfo_t **saveData, int count)
 		return;
     }
 	int commentCount = getCommentLineCount(fp, MAX_LINE_BUFFER);
-	char **comment = (char **)calloc(commentCount, sizeof(char));
+	char **comment = (char **)calloc(commentCount, sizeof(char *));
 	
 	int i;
     char *ret;
@@ -95,7 +100,7 @@ void writeCSV(char *fileName, foodinfo_t **saveData, int count)
     		//add comment line (the line that has "#" in the first char)
     		if(ret - readLine == 0)
     		{
-    			line = (char *)calloc(strlen(readLine), sizeof(char));
+    			line = (char *)calloc(strlen(readLine) + 1, sizeof(char));
     			strcpy(line, readLine);
     			comment[index++] = line;
     		}
@@ -116,7 +121,9 @@ void writeCSV(char *fileName, foodinfo_t **saveData, int count)
 	{
 		//printf("comment[%d] = %s\n", i, comment[i]);
 		fprintf(fp2, "%s", comment[i]);
+		free(comment[i]);
 	}
+	free(comment);
 	for(i = 0; i < count; i++)
 	{
 		//write single line
@@ -169,7 +176,7 @@ foodinfo_t **readCSV(int *count, char *fileName)
 
 	//initialize foodList
 	lineCount = getLineCount(fp, MAX_LINE_BUFFER);
-	foodinfo_t **foodList = (foodinfo_t **)calloc(lineCount, sizeof(foodinfo_t));
+	foodinfo_t **foodList = (foodinfo_t **)calloc(lineCount, sizeof(foodinfo_t *));
 	
 	int index = 0;
 	*count = lineCount;
@@ -184,6 +191,15 @@ foodinfo_t **readCSV(int *count, char *fileName)
     	}
     	
     	foodinfo_t *info = getFoodInfo(readLine);
+		if(info == NULL)
+		{
+			//food info read so far is freed (interned strings are kept)
+			while(index > 0) free(foodList[--index]);
+			free(foodList);
+			fclose(fp);
+			gCSVResult = APPLIB_ERR_MEMORY;
+			return NULL;
+		}
 		foodList[index++] = info;
     }
     fclose(fp);
@@ -195,7 +211,7 @@ foodinfo_t **readCSV(int *count, char *fileName)
  * Get single food information.
  *
  *	@param infoText Single food information in csv file
- *	@return Single food information
+ *	@return Single food information, NULL when no memory is left
  */
 foodinfo_t *getFoodInfo(char *infoText)
 {
@@ -203,7 +219,8 @@ foodinfo_t *getFoodInfo(char *infoText)
 	//get the number of comma in infoText variable so that 
 	//the value in infoText can be split by comma into an array
 	int cnt = getCharCount(infoText, STR_COMMA);
-	char *oneLine[cnt];
+	//cnt + 1 fields and the terminating NULL
+	char *oneLine[cnt + 2];
 	int i = 0;
 	
 	//split current line by comma and place in an array
@@ -219,7 +236,8 @@ foodinfo_t *getFoodInfo(char *infoText)
 	//if the name does not contain comma, the variable offset should be 1.
 	int offset = cnt - INT_DEFAULT_SPLIT_COUNT + 1;
 	int nameBufSize = getFoodNameLength(oneLine, offset);
-	char *foodName = (char *)calloc((nameBufSize), sizeof(char));
+	char foodName[nameBufSize];
+	foodName[0] = '\0';
 	
 	for(i = 0; i < offset; i++)
 	{
@@ -227,13 +245,18 @@ foodinfo_t *getFoodInfo(char *infoText)
 		strcat(foodName, oneLine[i]);
 		if(i != offset - 1) strcat(foodName, STR_COMMA);
 	}
-	char *measure = (char *)calloc((strlen(oneLine[offset]) + 1), sizeof(char));
-	strcat(measure, oneLine[offset]);
 	
 	i = offset + 1;
 	foodinfo_t *info = (foodinfo_t *)malloc(sizeof(foodinfo_t));
-	info->name = foodName;
-	info->measure = measure;
+	if(info == NULL) return NULL;
+	//names and measures repeat in the catalog, so they are stored once
+	info->name = internString(foodName);
+	info->measure = internString(oneLine[offset]);
+	if(info->name == NULL || info->measure == NULL)
+	{
+		free(info);
+		return NULL;
+	}
 	info->weight = atoi(oneLine[i++]);
 	info->kCal = atoi(oneLine[i++]);
 	info->fat = atoi(oneLine[i++]);
@@ -0,0 +1,442 @@
+/// distcomserver.c is included so that its search path is measured as it is built
+/// (main() of the server is excluded)
+#define DISTCOM_NO_MAIN
+#include "distcomserver.c"
+#include "benchlib.h"
+
+/// csv file used by readCSV()/writeCSV() benchmarks.
+/// It has to be in the current directory because writeCSV() renames "temp.csv" to it.
+#define STR_BENCH_CSV_FILE_NAME "bench_catalog.csv"
+/// Comment line written at the beginning of the csv file
+#define STR_BENCH_CSV_COMMENT "# Food,Measure,Weight (g),kCal,Fat (g),Carbo(g),Protein (g)\n"
+/// Seed of generated catalog
+#define INT_BENCH_SEED 365
+
+/// Catalog sizes
+int gBenchSizes[] = {1000, 10000, 100000};
+/// Words used to generate food names (the first word decides how many names a search hits)
+char *gBenchWords[] = {
+	"apple", "apricots", "banana", "bread", "butter", "cheese", "chicken", "chocolate",
+	"cream", "egg", "flour", "juice", "milk", "oatmeal", "pie", "raw", "dried", "canned",
+	"frozen", "whole", "white", "cheddar", "roasted", "salted", "unsalted", "sweetened"
+};
+/// Measures used in generated catalog
+char *gBenchMeasures[] = {"1 cup", "1 oz", "1 medium", "1 slice", "1 tbsp", "1/2 cup"};
+/// Search benchmarks: name and search word
+char *gBenchSearches[][2] = {
+	{"broad", "Apple"},
+	{"narrow", "Apple juice"},
+	{"miss", "Zucchini"}
+};
+
+/// Data shared by benchmark functions
+typedef struct benchData benchData_t;
+struct benchData
+{
+	/// generated catalog
+	foodinfo_t **list;
+	int count;
+	/// catalog as csv lines
+	char **lines;
+	/// search word
+	char *word;
+	/// food info matched by the broad search
+	foodinfo_t **hitList;
+	int hitCount;
+	/// buffer for createFoodInfoText()
+	char *text;
+	/// lower case name of each food info (in the order of the catalog)
+	char **lowerNames;
+};
+
+/// State of random number generator (xorshift, so the catalog is the same on any libc)
+unsigned int gBenchRandom;
+
+/// ----- Function definitions
+unsigned int nextBenchRandom();
+void createCatalog(benchData_t*, int);
+void writeCatalogFile(benchData_t*);
+void freeCatalog(benchData_t*);
+long benchReadCSV(void*);
+long benchGetFoodInfo(void*);
+long benchGetFoodInfoCold(void*);
+long benchCreateFoodInfoText(void*);
+long benchWriteCSV(void*);
+long benchSearch(void*);
+long benchIsTargetFood(void*);
+long benchBuildExactIndex(void*);
+long benchExactHash(void*);
+long benchExactSorted(void*);
+void freeSortedIndex();
+
+
+/**
+ * Main function.
+ *	Generate catalogs of several sizes and measure applib.h functions and
+ *	the search path of the server. One result line is written per benchmark.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user
+ *				(-r <repetitions>, -f <text in benchmark name>)
+ */
+int main(int argc, char *argv[])
+{
+	int opt;
+	int i, j;
+	char name[64];
+	while((opt = getopt(argc, argv, "r:f:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'r':
+			gBenchReps = atoi(optarg);
+			break;
+		case 'f':
+			gBenchFilter = optarg;
+			break;
+		default:
+			printf("Usage: %s [-r <repetitions>] [-f <text in benchmark name>]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(gBenchReps <= 0) gBenchReps = INT_BENCH_DEFAULT_REPS;
+	//search() writes debug log only
+	gLogLevel = LOG_LEVEL_ERROR;
+
+	printf("# bench reps=%d\n", gBenchReps);
+	for(i = 0; i < (int)(sizeof(gBenchSizes) / sizeof(int)); i++)
+	{
+		benchData_t data;
+		createCatalog(&data, gBenchSizes[i]);
+		writeCatalogFile(&data);
+		gFoodList = data.list;
+		gFoodListCount = data.count;
+
+		runBench("readCSV", data.count, benchReadCSV, &data);
+		runBench("getFoodInfo", data.count, benchGetFoodInfo, &data);
+		runBench("getFoodInfo.cold", data.count, benchGetFoodInfoCold, &data);
+		runBench("createFoodInfoText", data.count, benchCreateFoodInfoText, &data);
+		runBench("writeCSV", data.count, benchWriteCSV, &data);
+		for(j = 0; j < (int)(sizeof(gBenchSearches) / sizeof(gBenchSearches[0])); j++)
+		{
+			data.word = gBenchSearches[j][1];
+			sprintf(name, "search.%s", gBenchSearches[j][0]);
+			runBench(name, data.count, benchSearch, &data);
+			sprintf(name, "isTargetFood.%s", gBenchSearches[j][0]);
+			runBench(name, data.count, benchIsTargetFood, &data);
+		}
+		if(isBenchEnabled("exact"))
+		{
+			//names are looked up in the order of the catalog, not in the order of the index
+			buildSortedIndex();
+			runBench("exact.build", data.count, benchBuildExactIndex, &data);
+			runBench("exact.hash", data.count, benchExactHash, &data);
+			runBench("exact.sorted", data.count, benchExactSorted, &data);
+			freeSortedIndex();
+		}
+		freeCatalog(&data);
+	}
+	remove(STR_BENCH_CSV_FILE_NAME);
+	return 0;
+}
+
+/**
+ * readCSV() of the catalog file. Time per row.
+ */
+long benchReadCSV(void *arg)
+{
+	int i;
+	int count = 0;
+	(void)arg;
+	foodinfo_t **list = readCSV(&count, STR_BENCH_CSV_FILE_NAME);
+	for(i = 0; i < count; i++)
+	{
+		dispose(list[i]);
+	}
+	free(list);
+	return count;
+}
+
+/**
+ * getFoodInfo() of each csv line. Time per row.
+ *	getFoodInfo() modifies the line, so it is copied first.
+ */
+long benchGetFoodInfo(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	char line[MAX_LINE_BUFFER];
+	int i;
+	for(i = 0; i < data->count; i++)
+	{
+		strcpy(line, data->lines[i]);
+		dispose(getFoodInfo(line));
+	}
+	return data->count;
+}
+
+/**
+ * getFoodInfo() of each csv line on empty intern table, so every new name and measure
+ *	is inserted. Time per row (including freeInternTable() at the end).
+ *	The interned strings of the catalog are put aside and given back after the run.
+ */
+long benchGetFoodInfoCold(void *arg)
+{
+	internTable_t *table = &gInternTable;
+	internSlot_t *slots = table->slots;
+	int capacity = table->capacity;
+	int count = table->count;
+	long bytes = table->bytes;
+	internBlock_t *blocks = table->blocks;
+	table->slots = NULL;
+	table->capacity = 0;
+	table->count = 0;
+	table->bytes = 0;
+	table->blocks = NULL;
+
+	long ret = benchGetFoodInfo(arg);
+	freeInternTable();
+
+	table->slots = slots;
+	table->capacity = capacity;
+	table->count = count;
+	table->bytes = bytes;
+	table->blocks = blocks;
+	return ret;
+}
+
+/**
+ * createFoodInfoText() of all food info hit by the broad search, as the server
+ *	creates the response. Time per row (grows with the response size).
+ */
+long benchCreateFoodInfoText(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	char number[5][INT_MAX_SIZE];
+	int i;
+	data->text[0] = '\0';
+	for(i = 0; i < data->hitCount; i++)
+	{
+		foodinfo_t *info = data->hitList[i];
+		sprintf(number[0], "%d", info->weight);
+		sprintf(number[1], "%d", info->kCal);
+		sprintf(number[2], "%d", info->fat);
+		sprintf(number[3], "%d", info->carbo);
+		sprintf(number[4], "%d", info->protein);
+		createFoodInfoText(data->text, info->name, info->measure, number[0], number[1],
+			number[2], number[3], number[4]);
+	}
+	return data->hitCount > 0 ? data->hitCount : 1;
+}
+
+/**
+ * writeCSV() of the catalog. Time per row.
+ */
+long benchWriteCSV(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	writeCSV(STR_BENCH_CSV_FILE_NAME, data->list, data->count);
+	if(gCSVResult != APPLIB_SUCCESS)
+	{
+		printf("writeCSV() failed. Result = %d\n", gCSVResult);
+		exit(EXIT_FAILURE);
+	}
+	return data->count;
+}
+
+/**
+ * Single search request as handleRequest() runs it. Time per request.
+ */
+long benchSearch(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	int length = 0;
+	int hitCount = 0;
+	search(data->word, NULL, &length, &hitCount, true);
+	char *foodInfo = (char *)calloc(length, sizeof(char));
+	search(data->word, foodInfo, &length, &hitCount, false);
+	free(foodInfo);
+	return 1;
+}
+
+/**
+ * isTargetFood() of all food info with the query prepared once, as search() does.
+ *	Time per row.
+ */
+long benchIsTargetFood(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	foodquery_t query;
+	volatile int hit = 0;
+	int i;
+	prepareFoodQuery(&query, data->word);
+	for(i = 0; i < data->count; i++)
+	{
+		if(isTargetFood(&query, data->list[i])) hit++;
+	}
+	return data->count;
+}
+
+/**
+ * buildExactIndex() from the sorted index. Time per food info.
+ */
+long benchBuildExactIndex(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	buildExactIndex();
+	return data->count;
+}
+
+/**
+ * Look up every name of the catalog by perfect hash (exact match). Time per name.
+ */
+long benchExactHash(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	volatile int found = 0;
+	int i;
+	for(i = 0; i < data->count; i++)
+	{
+		if(findPerfectHash(&gExactHash, data->lowerNames[i], strlen(data->lowerNames[i])) >= 0) found++;
+	}
+	return data->count;
+}
+
+/**
+ * Look up every name of the catalog by binary search of the sorted index. Time per name.
+ */
+long benchExactSorted(void *arg)
+{
+	benchData_t *data = (benchData_t *)arg;
+	volatile int found = 0;
+	int i;
+	for(i = 0; i < data->count; i++)
+	{
+		int pos = findSortedIndex(data->lowerNames[i]);
+		if(pos < gSortedIndexCount && strcmp(gSortedIndex[pos].lowerName, data->lowerNames[i]) == 0) found++;
+	}
+	return data->count;
+}
+
+/**
+ * Free the sorted index and exact match index built from the catalog.
+ */
+void freeSortedIndex()
+{
+	//lower case names are interned, they are freed with the catalog
+	freeExactIndex();
+	free(gSortedIndex);
+	gSortedIndex = NULL;
+	gSortedIndexCount = 0;
+}
+
+/**
+ * Get next random number.
+ */
+unsigned int nextBenchRandom()
+{
+	gBenchRandom ^= gBenchRandom << 13;
+	gBenchRandom ^= gBenchRandom >> 17;
+	gBenchRandom ^= gBenchRandom << 5;
+	return gBenchRandom;
+}
+
+/**
+ * Generate catalog. Names have 1 - 5 words and some have a comma after the first word.
+ *
+ *	@param data		Data to store the catalog
+ *	@param count	The number of food info
+ */
+void createCatalog(benchData_t *data, int count)
+{
+	int i, j;
+	int wordCount = sizeof(gBenchWords) / sizeof(char *);
+	int measureCount = sizeof(gBenchMeasures) / sizeof(char *);
+	char line[MAX_LINE_BUFFER];
+	gBenchRandom = INT_BENCH_SEED;
+	data->count = count;
+	data->list = (foodinfo_t **)calloc(count, sizeof(foodinfo_t *));
+	data->lines = (char **)calloc(count, sizeof(char *));
+	data->lowerNames = (char **)calloc(count, sizeof(char *));
+	for(i = 0; i < count; i++)
+	{
+		int parts = 1 + nextBenchRandom() % 5;
+		line[0] = '\0';
+		for(j = 0; j < parts; j++)
+		{
+			if(j == 1 && nextBenchRandom() % 2 == 0) strcat(line, ", ");
+			else if(j > 0) strcat(line, " ");
+			strcat(line, gBenchWords[nextBenchRandom() % wordCount]);
+		}
+		line[0] = toupper(line[0]);
+		sprintf(line + strlen(line), ",%s,%u,%u,%u,%u,%u\n", gBenchMeasures[nextBenchRandom() % measureCount],
+			nextBenchRandom() % 500, nextBenchRandom() % 900, nextBenchRandom() % 50,
+			nextBenchRandom() % 100, nextBenchRandom() % 60);
+		data->lines[i] = (char *)calloc(strlen(line) + 1, sizeof(char));
+		strcpy(data->lines[i], line);
+		strcpy(line, data->lines[i]);
+		data->list[i] = getFoodInfo(line);
+		if(data->list[i] == NULL)
+		{
+			printf("Memory allocation error.\n");
+			exit(EXIT_FAILURE);
+		}
+		data->lowerNames[i] = (char *)calloc(strlen(data->list[i]->name) + 1, sizeof(char));
+		convertToLowerChar(data->list[i]->name, data->lowerNames[i]);
+	}
+
+	//food info hit by the broad search and buffer to create the response
+	foodquery_t query;
+	int length = 1;
+	prepareFoodQuery(&query, gBenchSearches[0][1]);
+	data->hitList = (foodinfo_t **)calloc(count, sizeof(foodinfo_t *));
+	data->hitCount = 0;
+	for(i = 0; i < count; i++)
+	{
+		if(!isTargetFood(&query, data->list[i])) continue;
+		data->hitList[data->hitCount++] = data->list[i];
+		length += strlen(data->lines[i]);
+	}
+	data->text = (char *)calloc(length, sizeof(char));
+}
+
+/**
+ * Write the catalog in csv file with a comment line.
+ */
+void writeCatalogFile(benchData_t *data)
+{
+	int i;
+	FILE *fp = fopen(STR_BENCH_CSV_FILE_NAME, STR_FILE_OPEN_MODE_WRITE);
+	if(fp == NULL)
+	{
+		printf("File open error. File name = %s\n", STR_BENCH_CSV_FILE_NAME);
+		exit(EXIT_FAILURE);
+	}
+	fprintf(fp, "%s", STR_BENCH_CSV_COMMENT);
+	for(i = 0; i < data->count; i++)
+	{
+		fprintf(fp, "%s", data->lines[i]);
+	}
+	fclose(fp);
+}
+
+/**
+ * Free the catalog.
+ */
+void freeCatalog(benchData_t *data)
+{
+	int i;
+	for(i = 0; i < data->count; i++)
+	{
+		dispose(data->list[i]);
+		free(data->lines[i]);
+		free(data->lowerNames[i]);
+	}
+	free(data->list);
+	free(data->lines);
+	free(data->lowerNames);
+	free(data->hitList);
+	free(data->text);
+	freeInternTable();
+	gFoodList = NULL;
+	gFoodListCount = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef BENCHLIB_H
+#define BENCHLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+/// Default number of measured repetitions
+#define INT_BENCH_DEFAULT_REPS 31
+/// Min warm-up time before measuring (nano seconds)
+#define DOUBLE_BENCH_WARMUP_NSEC 5e7
+/// Min number of warm-up repetitions
+#define INT_BENCH_MIN_WARMUP 2
+
+/// Function measured. Runs one repetition and returns the number of operations in it,
+/// so that results are reported per operation (e.g. per row).
+typedef long (*benchFunc_t)(void *arg);
+
+/// Number of measured repetitions
+int gBenchReps = INT_BENCH_DEFAULT_REPS;
+/// Only benchmarks whose name contains this text are run (NULL: all)
+char *gBenchFilter;
+
+/// ----- Function definitions
+double getBenchTimeNsec();
+bool isBenchEnabled(char*);
+void runBench(char*, int, benchFunc_t, void*);
+int compareBenchSample(const void*, const void*);
+
+
+/**
+ * Get monotonic time.
+ *
+ *	@return Time in nano seconds
+ */
+double getBenchTimeNsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * Check the benchmark name against the filter.
+ *
+ *	@param name	Benchmark name
+ *	@return true: the benchmark is run
+ */
+bool isBenchEnabled(char *name)
+{
+	return gBenchFilter == NULL || strstr(name, gBenchFilter) != NULL;
+}
+
+/**
+ * Measure function and write single result line:
+ *	"bench <name> size=<size> reps=<reps> median_ns=<ns> p90_ns=<ns> p99_ns=<ns>"
+ *	Time is per operation. Percentiles are nearest-rank over repetitions.
+ *	The format is kept stable so that results can be diffed between commits.
+ *
+ *	@param name	Benchmark name (no space)
+ *	@param size	Catalog size used in the benchmark
+ *	@param func	Function measured
+ *	@param arg	Argument of func
+ */
+void runBench(char *name, int size, benchFunc_t func, void *arg)
+{
+	int i;
+	if(!isBenchEnabled(name)) return;
+
+	//warm up caches, branch predictors and allocator
+	double start = getBenchTimeNsec();
+	for(i = 0; i < INT_BENCH_MIN_WARMUP || getBenchTimeNsec() - start < DOUBLE_BENCH_WARMUP_NSEC; i++)
+	{
+		func(arg);
+	}
+
+	double *sample = (double *)calloc(gBenchReps, sizeof(double));
+	for(i = 0; i < gBenchReps; i++)
+	{
+		double repStart = getBenchTimeNsec();
+		long ops = func(arg);
+		sample[i] = (getBenchTimeNsec() - repStart) / (ops > 0 ? ops : 1);
+	}
+	qsort(sample, gBenchReps, sizeof(double), compareBenchSample);
+	printf("bench %s size=%d reps=%d median_ns=%.1f p90_ns=%.1f p99_ns=%.1f\n", name, size, gBenchReps,
+		sample[(gBenchReps - 1) / 2], sample[(gBenchReps * 90 + 99) / 100 - 1],
+		sample[(gBenchReps * 99 + 99) / 100 - 1]);
+	fflush(stdout);
+	free(sample);
+}
+
+/**
+ * Compare function for qsort().
+ */
+int compareBenchSample(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+
+/// Default number of rows
+#define LONG_DEFAULT_ROW_COUNT 10000
+/// Default seed
+#define LONG_DEFAULT_SEED 365
+/// Default number of rows between comment lines (0: header only)
+#define LONG_DEFAULT_COMMENT_INTERVAL 100000
+/// Skew of word frequency (Zipf exponent). Larger value shares prefixes more.
+#define DOUBLE_DEFAULT_ZIPF_SKEW 1.1
+/// Output buffer size
+#define INT_OUTPUT_BUFFER_SIZE (1 << 20)
+/// Max length of single line (readCSV() reads lines up to 512 bytes)
+#define INT_MAX_LINE_SIZE 256
+/// Header comment (the same as calories.csv)
+#define STR_HEADER "# Food,Measure,Weight (g),kCal,Fat (g),Carbo(g),Protein (g)\n"
+/// Command line usage
+#define STR_USAGE "Usage: ./catgen [-n <rows>] [-s <seed>] [-c <rows between comments>] " \
+	"[-z <skew>] [-o <file>]\n"
+
+/// Food names start with one of these. Earlier words are chosen more often (Zipf),
+/// so many names share the same first word as in the real catalog.
+char *gBaseWords[] = {
+	"Cheese", "Chicken", "Beef", "Bread", "Milk", "Apple", "Beans", "Pork", "Cereal", "Cookies",
+	"Fish", "Potatoes", "Soup", "Crackers", "Yogurt", "Rice", "Pasta", "Egg", "Butter", "Cake",
+	"Tomatoes", "Turkey", "Corn", "Orange", "Peas", "Carrots", "Banana", "Lamb", "Salad dressing", "Candy",
+	"Chocolate", "Cream", "Juice", "Nuts", "Oil", "Pie", "Sauce", "Sausage", "Squash", "Spinach",
+	"Apricots", "Asparagus", "Avocado", "Bacon", "Bagel", "Barley", "Biscuits", "Blueberries", "Broccoli", "Brownies",
+	"Cabbage", "Cauliflower", "Celery", "Cherries", "Clams", "Coffee", "Cornbread", "Crab", "Cucumber", "Dates",
+	"Doughnuts", "Figs", "Flour", "Frankfurter", "Grapefruit", "Grapes", "Ham", "Honey", "Ice cream", "Jam",
+	"Kale", "Lemon", "Lentils", "Lettuce", "Lime", "Lobster", "Macaroni", "Mango", "Margarine", "Melon",
+	"Muffins", "Mushrooms", "Noodles", "Oatmeal", "Okra", "Olives", "Onions", "Oysters", "Pancakes", "Papaya",
+	"Peaches", "Peanut butter", "Pears", "Peppers", "Pickles", "Pineapple", "Pizza", "Plums", "Popcorn", "Pretzels",
+	"Prunes", "Pudding", "Pumpkin", "Radishes", "Raisins", "Raspberries", "Rolls", "Salmon", "Sardines", "Shrimp",
+	"Spaghetti", "Strawberries", "Sugar", "Sweet potatoes", "Syrup", "Tofu", "Tortillas", "Tuna", "Veal", "Waffles",
+	"Walnuts", "Watermelon", "Wheat germ", "Zucchini"
+};
+/// Words following the first word ("Cheese cheddar", "Bread rye")
+char *gVarietyWords[] = {
+	"whole", "white", "wheat", "cheddar", "skim", "lowfat", "sweetened", "unsweetened", "red", "green",
+	"yellow", "rye", "french", "italian", "swiss", "american", "roasted", "smoked", "ground", "baby",
+	"mixed", "plain", "vanilla", "chocolate", "strawberry", "cottage", "cream", "light", "dark", "navy",
+	"pinto", "kidney", "black", "brown", "wild", "instant", "enriched", "fortified", "canned", "frozen",
+	"fresh", "dried", "salted", "unsalted", "spicy", "mild", "sharp", "aged", "string", "breast"
+};
+/// Words following a comma ("Apple, raw")
+char *gModifierWords[] = {
+	"raw", "cooked", "boiled", "drained", "fried", "baked", "broiled", "roasted", "steamed", "canned",
+	"frozen", "dried", "with salt", "without salt", "with skin", "without skin", "lean only", "lean and fat",
+	"prepared with milk", "prepared with water", "ready-to-eat", "unheated", "heated", "solids and liquid",
+	"chopped", "sliced", "diced", "whole", "mashed", "stewed", "commercial", "home recipe", "low sodium",
+	"regular", "diet", "enriched", "unenriched", "large", "medium", "small"
+};
+/// Measures. Commas are not allowed because getFoodInfo() takes the last 6 fields.
+char *gMeasures[] = {
+	"1 cup", "1 oz", "1 medium", "1 large", "1 small", "1 slice", "1 tbsp", "1 tsp", "1/2 cup",
+	"1 piece", "3 oz", "1 pat", "1 link", "1 egg", "1 fruit", "1 stalk", "1 muffin", "1 serving"
+};
+/// Syllables of generated brand names, which make names unique at any scale
+char *gSyllables[] = {
+	"ka", "lo", "mi", "ne", "ro", "ta", "vi", "su", "de", "ba", "zo", "pe", "ri", "go", "fa", "nu"
+};
+
+/// Output buffer
+char gOutput[INT_OUTPUT_BUFFER_SIZE];
+/// The number of bytes in gOutput
+int gOutputLength;
+/// Output file
+FILE *gOutputFile;
+/// State of random number generator
+uint64_t gRandom;
+/// Cumulative distribution of gBaseWords
+double *gBaseCdf;
+/// Cumulative distribution of gVarietyWords
+double *gVarietyCdf;
+/// Cumulative distribution of gModifierWords
+double *gModifierCdf;
+
+/// The number of elements of array
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+/// ----- Function definitions
+uint64_t nextRandom();
+int nextRandomInt(int);
+double *createZipfCdf(int, double);
+int nextZipf(double*, int);
+char *appendWord(char*, char*);
+char *appendInt(char*, unsigned int);
+int createLine(char*);
+void writeOutput(char*, int);
+void flushOutput();
+
+
+/**
+ * Main function.
+ *	Write synthetic catalog in the csv format read by readCSV().
+ *	The same seed always generates the same catalog.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user
+ */
+int main(int argc, char *argv[])
+{
+	long long rowCount = LONG_DEFAULT_ROW_COUNT;
+	long long commentInterval = LONG_DEFAULT_COMMENT_INTERVAL;
+	uint64_t seed = LONG_DEFAULT_SEED;
+	double skew = DOUBLE_DEFAULT_ZIPF_SKEW;
+	char *fileName = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "n:s:c:z:o:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n':
+			rowCount = atoll(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'c':
+			commentInterval = atoll(optarg);
+			break;
+		case 'z':
+			skew = atof(optarg);
+			break;
+		case 'o':
+			fileName = optarg;
+			break;
+		default:
+			fprintf(stderr, STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(rowCount < 0 || commentInterval < 0 || skew < 0)
+	{
+		fprintf(stderr, STR_USAGE);
+		exit(EXIT_FAILURE);
+	}
+	gOutputFile = stdout;
+	if(fileName != NULL && (gOutputFile = fopen(fileName, "w")) == NULL)
+	{
+		fprintf(stderr, "File open error. File name = %s\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+
+	//seed 0 would stop xorshift, so the seed is mixed first
+	gRandom = seed * 0x9E3779B97F4A7C15ULL + 0x2545F4914F6CDD1DULL;
+	gBaseCdf = createZipfCdf(COUNT_OF(gBaseWords), skew);
+	gVarietyCdf = createZipfCdf(COUNT_OF(gVarietyWords), skew);
+	gModifierCdf = createZipfCdf(COUNT_OF(gModifierWords), skew);
+
+	char line[INT_MAX_LINE_SIZE];
+	long long i;
+	long long bytes = strlen(STR_HEADER);
+	writeOutput(STR_HEADER, strlen(STR_HEADER));
+	for(i = 0; i < rowCount; i++)
+	{
+		if(commentInterval > 0 && i > 0 && i % commentInterval == 0)
+		{
+			int length = sprintf(line, "# rows %lld -\n", i);
+			writeOutput(line, length);
+			bytes += length;
+		}
+		int length = createLine(line);
+		writeOutput(line, length);
+		bytes += length;
+	}
+	flushOutput();
+	if(fileName != NULL) fclose(gOutputFile);
+	fprintf(stderr, "catgen rows=%lld seed=%llu bytes=%lld\n", rowCount, (unsigned long long)seed, bytes);
+	return 0;
+}
+
+/**
+ * Create single line: "<name>,<measure>,<weight>,<kCal>,<fat>,<carbo>,<protein>\n".
+ *	Name patterns follow USDA style and some of them have commas:
+ *	"Apple", "Apple, raw", "Cheese cheddar, diced", "Beans, pinto, boiled, with salt",
+ *	"Kalomi Cookies, commercial" (brand name).
+ *
+ *	@param line	Buffer (INT_MAX_LINE_SIZE bytes)
+ *	@return The length of the line
+ */
+int createLine(char *line)
+{
+	char *p = line;
+	int pattern = nextRandomInt(100);
+	if(pattern >= 95)
+	{
+		//brand name is unique enough to avoid duplicated names at hundreds of millions of rows
+		int syllables = 2 + nextRandomInt(3);
+		char *start = p;
+		int i;
+		for(i = 0; i < syllables; i++)
+		{
+			p = appendWord(p, gSyllables[nextRandomInt(COUNT_OF(gSyllables))]);
+		}
+		*start -= 'a' - 'A';
+		*p++ = ' ';
+	}
+	p = appendWord(p, gBaseWords[nextZipf(gBaseCdf, COUNT_OF(gBaseWords))]);
+	if(pattern >= 35 && pattern < 70)
+	{
+		*p++ = ' ';
+		p = appendWord(p, gVarietyWords[nextZipf(gVarietyCdf, COUNT_OF(gVarietyWords))]);
+	}
+	else if(pattern >= 70 && pattern < 85)
+	{
+		p = appendWord(p, ", ");
+		p = appendWord(p, gVarietyWords[nextZipf(gVarietyCdf, COUNT_OF(gVarietyWords))]);
+	}
+	if(pattern >= 10)
+	{
+		p = appendWord(p, ", ");
+		p = appendWord(p, gModifierWords[nextZipf(gModifierCdf, COUNT_OF(gModifierWords))]);
+	}
+	if(pattern >= 70 && pattern < 85)
+	{
+		p = appendWord(p, ", ");
+		p = appendWord(p, gModifierWords[nextZipf(gModifierCdf, COUNT_OF(gModifierWords))]);
+	}
+
+	//nutrition is roughly consistent with weight
+	unsigned int weight = 5 + nextRandomInt(400);
+	unsigned int fat = nextRandomInt(weight / 4 + 1);
+	unsigned int carbo = nextRandomInt(weight / 2 + 1);
+	unsigned int protein = nextRandomInt(weight / 4 + 1);
+	unsigned int kCal = fat * 9 + (carbo + protein) * 4;
+	*p++ = ',';
+	p = appendWord(p, gMeasures[nextRandomInt(COUNT_OF(gMeasures))]);
+	*p++ = ',';
+	p = appendInt(p, weight);
+	*p++ = ',';
+	p = appendInt(p, kCal);
+	*p++ = ',';
+	p = appendInt(p, fat);
+	*p++ = ',';
+	p = appendInt(p, carbo);
+	*p++ = ',';
+	p = appendInt(p, protein);
+	*p++ = '\n';
+	return (int)(p - line);
+}
+
+/**
+ * Get next random number (xorshift64*).
+ */
+uint64_t nextRandom()
+{
+	gRandom ^= gRandom >> 12;
+	gRandom ^= gRandom << 25;
+	gRandom ^= gRandom >> 27;
+	return gRandom * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Get random number in 0 .. max - 1.
+ */
+int nextRandomInt(int max)
+{
+	return (int)(((nextRandom() >> 32) * (uint64_t)max) >> 32);
+}
+
+/**
+ * Create cumulative distribution where the i-th word has weight 1 / (i + 1)^skew.
+ *
+ *	@param count	The number of words
+ *	@param skew		Zipf exponent (0: uniform)
+ *	@return Cumulative distribution (the last entry is 1.0)
+ */
+double *createZipfCdf(int count, double skew)
+{
+	int i;
+	double sum = 0;
+	double *cdf = (double *)calloc(count, sizeof(double));
+	for(i = 0; i < count; i++)
+	{
+		sum += 1.0 / pow(i + 1, skew);
+		cdf[i] = sum;
+	}
+	for(i = 0; i < count; i++)
+	{
+		cdf[i] /= sum;
+	}
+	cdf[count - 1] = 1.0;
+	return cdf;
+}
+
+/**
+ * Choose word by cumulative distribution (binary search).
+ *
+ *	@return Index of the word
+ */
+int nextZipf(double *cdf, int count)
+{
+	double u = (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+	int low = 0;
+	int high = count - 1;
+	while(low < high)
+	{
+		int mid = (low + high) / 2;
+		if(cdf[mid] <= u) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/**
+ * Copy word without '\0'.
+ *
+ *	@return Position after the word
+ */
+char *appendWord(char *p, char *word)
+{
+	while(*word != '\0') *p++ = *word++;
+	return p;
+}
+
+/**
+ * Write decimal number without '\0'.
+ *
+ *	@return Position after the number
+ */
+char *appendInt(char *p, unsigned int value)
+{
+	char digits[10];
+	int count = 0;
+	do
+	{
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while(value > 0);
+	while(count > 0) *p++ = digits[--count];
+	return p;
+}
+
+/**
+ * Write data through output buffer.
+ */
+void writeOutput(char *data, int length)
+{
+	if(gOutputLength + length > INT_OUTPUT_BUFFER_SIZE) flushOutput();
+	memcpy(gOutput + gOutputLength, data, length);
+	gOutputLength += length;
+}
+
+/**
+ * Write output buffer to the file.
+ */
+void flushOutput()
+{
+	if(gOutputLength > 0 && fwrite(gOutput, 1, gOutputLength, gOutputFile) != (size_t)gOutputLength)
+	{
+		fprintf(stderr, "Write error.\n");
+		exit(EXIT_FAILURE);
+	}
+	gOutputLength = 0;
+}
@@ -6,9 +6,13 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <ctype.h>
 #include "applib.h"
+#include "distcomlib.h"
 
 /// Max input size
 #define INT_MAX_INPUT_TOTAL_BUF 256
@@ -18,25 +22,197 @@
 #define INT_MAX_INPUT_FOOD_MEASURE_BUF 50
 /// Max size of weight, kCal, fat, carbo, protein
 #define INT_MAX_INPUT_FOOD_NUM_BUF 6
-/// Max size of receive data sent from server
-#define INT_MAX_RECV_DATA_SIZE 4096
+/// Request prefix: autocomplete ("#complete <count> <partial name>")
+#define STR_CMD_COMPLETE "#complete "
+/// The number of names requested by autocomplete
+#define INT_COMPLETE_COUNT 10
+/// Request prefix: pagination ("#page <limit> <cursor> <food name>")
+#define STR_CMD_PAGE "#page "
+/// Response trailer: cursor of the next page ("#next <cursor>")
+#define STR_PAGE_NEXT "#next "
+/// Cursor of the first page
+#define STR_PAGE_FIRST "-"
+/// The number of food info in a page
+#define INT_PAGE_COUNT 5
+/// Max length of cursor
+#define INT_MAX_CURSOR_SIZE 32
+/// Response when server is busy ("#busy <retry after milli seconds>")
+#define STR_STATUS_BUSY "#busy "
+/// Max number of servers (primary and replicas)
+#define INT_MAX_SERVER_COUNT INT_DISTCOM_MAX_SERVERS
+/// Request option: stamp the response with catalog version ("#v <request>")
+#define STR_OPT_VERSION "#v "
+/// Request option: reply "#notmod" when catalog version is not changed ("#if <version> <request>")
+#define STR_OPT_IF_VERSION "#if "
+/// Response header of catalog version ("#version <version>\n")
+#define STR_VERSION_HEADER "#version "
+/// The number of entries in response cache (a request uses the entry of its hash)
+#define INT_CACHE_SIZE 1024
+/// Default number of connections in batch mode
+#define INT_DEFAULT_BATCH_JOBS 4
+/// Max number of connections in batch mode
+#define INT_MAX_BATCH_JOBS INT_DISTCOM_MAX_CONNECTIONS
+/// Max number of requests in flight in batch mode (the rest of the file is not read yet)
+#define INT_MAX_BATCH_IN_FLIGHT 4096
+/// Batch file name to read requests from stdin
+#define STR_BATCH_STDIN "-"
+/// Batch request prefix: add ("a <name>,<measure>,<weight>,<kCal>,<fat>,<carbo>,<protein>")
+#define STR_BATCH_ADD "a "
+/// Batch request prefix: autocomplete ("c <partial name>")
+#define STR_BATCH_COMPLETE "c "
+/// Max size of single request in batch mode
+#define INT_MAX_BATCH_REQUEST_SIZE (MAX_LINE_BUFFER + 32)
+/// Header of each result in batch mode ("## <line number> <request>")
+#define STR_BATCH_RESULT_HEADER "## "
+/// Size of the buffer food info is formatted in before it is written to stdout
+#define INT_DISPLAY_BUFFER_SIZE 65536
+/// The number of fields of food info (name, measure, weight, kCal, fat, carbo, protein)
+#define INT_FOOD_FIELD_COUNT 7
+/// Max size of UDP response
+#define INT_MAX_DATAGRAM_SIZE 1472
+/// Time to wait for UDP response before the request is sent again (milli seconds)
+#define INT_DATAGRAM_TIMEOUT_MSEC 200
+/// The number of times UDP request is sent again
+#define INT_MAX_DATAGRAM_RETRY 2
+/// Command line options (getopt)
+#define STR_OPTIONS "R:b:j:c:u"
+/// Command line usage
+#define STR_USAGE "Command line parameter error. Usage: [-R <host>:<port>[,<host>:<port>...]] " \
+	"[-b <file> [-j <count>]] [-c <ms>] [-u] <Server IP address> <port number> | <socket path>\n" \
+	"  -R  read replicas (<host>:<port> or <socket path>). searches are sent to replicas in turn,\n" \
+	"      new food is sent to the server\n" \
+	"  -b  batch mode. requests are read from <file> (\"-\": stdin), one per line\n" \
+	"  -j  the number of connections per server used in batch mode (default 4)\n" \
+	"  -c  cache responses. cached response is used for <ms> without asking the server\n" \
+	"  -u  send searches by UDP first (servers run with -d), large results are received by TCP\n"
+
+/// Cached response of single request
+typedef struct cacheEntry cacheEntry_t;
+struct cacheEntry
+{
+	/// normalized request (NULL: not used)
+	char *key;
+	/// response without catalog version
+	char *response;
+	/// catalog version of the response
+	unsigned long long version;
+	/// time when the response was received or the server told it is not modified
+	long checkedMsec;
+};
+
+/// Food info formatted for display (written to stdout when the buffer is full)
+typedef struct displayBuffer displayBuffer_t;
+struct displayBuffer
+{
+	char data[INT_DISPLAY_BUFFER_SIZE];
+	/// the size of data formatted
+	int length;
+	/// the number of food info displayed
+	int count;
+	/// true: food info has been displayed while it is received
+	bool isStarted;
+};
 
 //global variables
-int gServerPortNum;
+/// Server addresses: [0] is the server given by <Server IP address> <port number> (primary),
+/// the rest are read replicas
+struct sockaddr_in gServerList[INT_MAX_SERVER_COUNT];
+/// The number of entries in gServerList
+int gServerCount;
+/// Replica to which the next UDP request is sent
+int gNextReplica;
+/// Connections to all servers (TCP and Unix domain socket)
+distcomClient_t *gClient;
+/// Batch file name (NULL: interactive mode)
+char *gBatchFileName;
+/// The number of connections per server in batch mode
+int gBatchJobs = INT_DEFAULT_BATCH_JOBS;
+/// Batch file being read
+FILE *gBatchFile;
+/// The number of lines read from gBatchFile
+int gBatchLineCount;
+/// The number of requests sent in batch mode
+int gBatchRequestCount;
+/// The number of requests failed in batch mode
+int gBatchErrorCount;
+/// The number of requests sent and not finished in batch mode
+int gBatchInFlight;
+/// Time cached response is used without asking the server (milli seconds, -1: no cache)
+int gCacheTtlMsec = -1;
+/// Response cache
+cacheEntry_t gCache[INT_CACHE_SIZE];
+/// The number of requests answered from the cache without asking the server
+int gCacheHitCount;
+/// The number of requests the server answered "#notmod"
+int gCacheNotModifiedCount;
+/// true: read only requests are sent by UDP first (-u)
+bool gUseDatagram;
+/// true: the server does not answer UDP (the server is asked by TCP only)
+bool gDatagramDisabled[INT_MAX_SERVER_COUNT];
 char STR_MSG_FOOD_NOT_FOUND[] = "No food item found.\nPlease check your spelling and try again.\n";
+char STR_MSG_SERVER_BUSY[] = "Server is busy.\nPlease try again later.\n";
+char STR_MSG_REQUEST_FAILED[] = "#failed ";
 char STR_ADD_STATUS_SUCCESS[] = "success";
 char STR_NO_FOOD_FOUND[] = "0";
+char STR_PAGE_STATUS_STALE[] = "#stale";
+char STR_ADD_STATUS_READONLY[] = "#readonly";
+char STR_STATUS_NOT_MODIFIED[] = "#notmod";
+char STR_STATUS_USE_TCP[] = "#tcp";
+/// Labels of food info fields (in the order of the csv format)
+char *STR_FOOD_FIELD_LABELS[INT_FOOD_FIELD_COUNT] = {
+	"Food: ", "Measure: ", "Weight (g): ", "kCal: ", "Fat (g): ", "Carbo (g): ", "Protein (g): "
+};
 char STR_KEY_QUIT[] = "q";
 char STR_KEY_ADD[] = "a";
+char STR_KEY_COMPLETE[] = "c";
+char STR_KEY_PAGE[] = "p";
 
+/// Single line of batch file in flight
+typedef struct batchRequest batchRequest_t;
+struct batchRequest
+{
+	int lineNumber;
+	char *line;
+	/// the request created from the line
+	char *request;
+	bool isReadOnly;
+	/// cache key (NULL: the response is not cached)
+	char *key;
+	/// catalog version of the cached response when the request was sent
+	unsigned long long cachedVersion;
+};
 
 
 /// Function definition
-void checkParameter(int, char**, struct hostent**);
-void initializeConnection(int*, struct sockaddr_in*, int*);
-void sendRequest(int*, char*);
-void *getResponse(int*, char*);
+void checkParameter(int, char**);
+bool addServer(char*, char*);
+bool addLocalServer(char*);
+void displayStream(void*, char*, int);
 void display(char*);
+void initializeDisplay(displayBuffer_t*);
+int displayFoodLines(displayBuffer_t*, char*, int, bool);
+void displayFoodInfo(displayBuffer_t*, char*, int);
+void appendDisplay(displayBuffer_t*, char*, int);
+void flushDisplay(displayBuffer_t*);
+void displayCompletion(char*);
+bool getCompleteRequest(char*);
+char *requestServer(char*, bool, int*, displayBuffer_t*);
+char *requestDatagram(char*, int);
+int getServerIndex(int, int, int);
+char *requestCached(char*, bool, int*);
+char *getCachedResponse(char*, char*, char*, unsigned long long*);
+char *updateCache(char*, unsigned long long, char*);
+void normalizeRequest(char*, char*);
+unsigned int getCacheIndex(char*);
+void expireCache();
+long getCurrentMsec();
+void runBatch();
+bool readBatchLine();
+bool createBatchRequest(char*, char*);
+void sendBatchRequest(batchRequest_t*, bool);
+void finishBatchRequest(void*, int, char*, int, int);
+void writeBatchResult(batchRequest_t*, char*, int);
+void searchByPage();
 bool getInputChar(char*, int);
 
 //char *addNewFood();
@@ -49,22 +225,24 @@ bool isDigit(char*);
  *	Check parameters
  *	Wait for user's input
  *	Send a food name to find food information and display the search result
+ *	With -b, requests in the file are sent without user's input (batch mode).
  *	
  *	@param argc The number of parameter input by user
  *	@param argv Array that has parameter input by user
  */
 int main(int argc, char *argv[])
 {
-	int sockfd;
-	struct hostent *he;
-	struct sockaddr_in serverAddr;
-
-	checkParameter(argc, argv, &he);
-	gServerPortNum = atoi(argv[2]);
+	checkParameter(argc, argv);
+	if(gBatchFileName != NULL)
+	{
+		runBatch();
+		exit(gBatchErrorCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 	char inputChar[INT_MAX_INPUT_TOTAL_BUF];
 	while(true)
 	{
-		printf("Enter the food name to search for, or 'q' to quit or 'a' to add new food data.\n");
+		printf("Enter the food name to search for, or 'q' to quit or 'a' to add new food data"
+			" or 'c' to complete food name or 'p' to search page by page.\n");
 		if(!getInputChar(inputChar, INT_MAX_INPUT_TOTAL_BUF))
 		{
 			printf("Enter food name within %d characters.\n\n", INT_MAX_INPUT_TOTAL_BUF);
@@ -81,24 +259,47 @@ int main(int argc, char *argv[])
 			//add new food info
 			if(!addNewFood(&newFood)) continue;
 		}
+		bool isComplete = false;
+		if(strcmp(inputChar, STR_KEY_COMPLETE) == 0)
+		{
+			//complete partial food name
+			if(!getCompleteRequest(inputChar)) continue;
+			isComplete = true;
+		}
+		if(strcmp(inputChar, STR_KEY_PAGE) == 0)
+		{
+			//search and display the result page by page
+			searchByPage();
+			continue;
+		}
 		
-		serverAddr.sin_family = AF_INET;
-		serverAddr.sin_port = htons(gServerPortNum);
-		serverAddr.sin_addr = *((struct in_addr *)he->h_addr);
-		bzero(&(serverAddr.sin_zero), 8);
-
-		//initialize connection
-		initializeConnection(&sockfd, &serverAddr, &gServerPortNum);
-		if(strcmp(inputChar, STR_KEY_ADD) == 0)
+		bool isAdd = strcmp(inputChar, STR_KEY_ADD) == 0;
+		if(isAdd)
 		{
 			strcpy(inputChar, newFood);
+			free(newFood);
 		}
-		sendRequest(&sockfd, inputChar);
-		char buf[INT_MAX_RECV_DATA_SIZE];
-		getResponse(&sockfd, buf);
-		display(buf);
-		
-		close(sockfd);
+		//new food is sent to the primary, searches may be sent to replicas
+		int server = -1;
+		char *buf;
+		if(!isAdd && !isComplete && gCacheTtlMsec < 0)
+		{
+			//food info is displayed while it is received
+			displayBuffer_t stream;
+			initializeDisplay(&stream);
+			buf = requestServer(inputChar, true, &server, &stream);
+			if(stream.isStarted)
+			{
+				flushDisplay(&stream);
+				printf("%d food items found.\n\n", stream.count);
+				free(buf);
+				continue;
+			}
+		}
+		else buf = requestCached(inputChar, !isAdd, &server);
+		if(isComplete) displayCompletion(buf);
+		else display(buf);
+		free(buf);
 	}
 	//close(sockfd);
 }
@@ -242,6 +443,24 @@ bool addNewFood(char **newFood)
 	return ret;
 }
 
+/**
+ * Get partial food name and create autocomplete request.
+ *
+ *	@param ret	The request to be sent to server.
+ *	@return true: process successfully finished
+ */
+bool getCompleteRequest(char *ret)
+{
+	char prefix[INT_MAX_INPUT_FOOD_NAME_BUF];
+	printf("Enter the beginning of the food name.\n");
+	while(!getInputChar(prefix, INT_MAX_INPUT_FOOD_NAME_BUF))
+	{
+		printf("*** Error *** Enter %s witin %d characters.\n", "food name", INT_MAX_INPUT_FOOD_NAME_BUF);
+	}
+	sprintf(ret, "%s%d %s", STR_CMD_COMPLETE, INT_COMPLETE_COUNT, prefix);
+	return true;
+}
+
 /**
  * Check if target character are digits.
  *
@@ -279,6 +498,12 @@ void display(char *response)
 		printf("%s\n", STR_MSG_FOOD_NOT_FOUND);
 		return;
 	}
+	if(strncmp(response, STR_STATUS_BUSY, strlen(STR_STATUS_BUSY)) == 0)
+	{
+		printf("\n");
+		printf("%s\n", STR_MSG_SERVER_BUSY);
+		return;
+	}
 	//when new food was added
 	if(strcmp(response, STR_ADD_STATUS_SUCCESS) == 0)
 	{
@@ -287,128 +512,818 @@ void display(char *response)
 		printf("\n");
 		return;
 	}
+	if(strcmp(response, STR_ADD_STATUS_READONLY) == 0)
+	{
+		printf("\n");
+		printf("The server is a read replica. Add new food to the primary server.\n");
+		printf("\n");
+		return;
+	}
 	// the number of the result
 	int hitCount = getCharCount(response, STR_CR) - 1;
+	printf("\n%d food items found.\n\n", hitCount);
+	
+	displayBuffer_t out;
+	initializeDisplay(&out);
+	displayFoodLines(&out, response, strlen(response), true);
+	flushDisplay(&out);
+}
+
+/**
+ * Initialize food info display.
+ *
+ *	@param out	Display buffer
+ */
+void initializeDisplay(displayBuffer_t *out)
+{
+	out->length = 0;
+	out->count = 0;
+	out->isStarted = false;
+}
+
+/**
+ * Display food info lines in the data (in place, no memory is allocated).
+ *
+ *	@param out		Display buffer
+ *	@param data		Food info in the csv format (does not have to end with '\0')
+ *	@param length	The size of data
+ *	@param isLast	true: the data after the last '\n' is displayed as well
+ *	@return The size of data displayed (the rest is an incomplete line)
+ */
+int displayFoodLines(displayBuffer_t *out, char *data, int length, bool isLast)
+{
+	int used = 0;
+	char *newLine;
+	while((newLine = memchr(data + used, '\n', length - used)) != NULL)
+	{
+		displayFoodInfo(out, data + used, newLine - (data + used));
+		used = newLine + 1 - data;
+	}
+	if(isLast && used < length)
+	{
+		displayFoodInfo(out, data + used, length - used);
+		used = length;
+	}
+	return used;
+}
 
-	int idx = 0;
-	int index = 0;
-	char *splitChar;
-	char *foodList[hitCount];
-	splitChar = strtok(response, STR_CR);
+/**
+ * Display single food info.
+ *	Food name may contain comma, so the fields are found from the end of the line.
+ *	The fields are copied as they are (the server sends the numbers in digits).
+ *
+ *	@param out		Display buffer
+ *	@param line		Single food info in the csv format (without '\n')
+ *	@param length	The size of line
+ */
+void displayFoodInfo(displayBuffer_t *out, char *line, int length)
+{
+	if(length == 0) return;
+	//start[i]: the beginning of field i, start[INT_FOOD_FIELD_COUNT]: after the end of line
+	int start[INT_FOOD_FIELD_COUNT + 1];
+	int field = INT_FOOD_FIELD_COUNT;
+	int i;
+	start[0] = 0;
+	start[field] = length + 1;
+	for(i = length - 1; i >= 0 && field > 1; i--)
+	{
+		if(line[i] == ',') start[--field] = i + 1;
+	}
+	if(field > 1)
+	{
+		//not food info
+		appendDisplay(out, line, length);
+		appendDisplay(out, STR_CR, 1);
+		return;
+	}
+	for(i = 0; i < INT_FOOD_FIELD_COUNT; i++)
+	{
+		appendDisplay(out, STR_FOOD_FIELD_LABELS[i], strlen(STR_FOOD_FIELD_LABELS[i]));
+		appendDisplay(out, line + start[i], start[i + 1] - 1 - start[i]);
+		appendDisplay(out, STR_CR, 1);
+	}
+	appendDisplay(out, STR_CR, 1);
+	out->count++;
+}
+
+/**
+ * Add data in the display buffer. The buffer is written to stdout when it is full.
+ *
+ *	@param out		Display buffer
+ *	@param data		Data to be displayed
+ *	@param length	The size of data
+ */
+void appendDisplay(displayBuffer_t *out, char *data, int length)
+{
+	if(out->length + length > INT_DISPLAY_BUFFER_SIZE) flushDisplay(out);
+	if(length > INT_DISPLAY_BUFFER_SIZE)
+	{
+		fwrite(data, 1, length, stdout);
+		return;
+	}
+	memcpy(out->data + out->length, data, length);
+	out->length += length;
+}
+
+/**
+ * Write the display buffer to stdout.
+ *
+ *	@param out	Display buffer
+ */
+void flushDisplay(displayBuffer_t *out)
+{
+	fwrite(out->data, 1, out->length, stdout);
+	out->length = 0;
+}
+
+/**
+ * Display food info lines while the response is received (data callback of distcomlib.h).
+ *
+ *	@param arg		Display buffer
+ *	@param data		Food info lines
+ *	@param length	The size of data
+ */
+void displayStream(void *arg, char *data, int length)
+{
+	displayBuffer_t *stream = (displayBuffer_t *)arg;
+	if(!stream->isStarted)
+	{
+		stream->isStarted = true;
+		printf("\n");
+	}
+	displayFoodLines(stream, data, length, true);
+}
+
+/**
+ * Display autocomplete result.
+ *
+ *	@param response	Food names sent by server (one name per line)
+ */
+void displayCompletion(char *response)
+{
+	if(response == NULL || strcmp(response, STR_NO_FOOD_FOUND) == 0
+		|| strncmp(response, STR_STATUS_BUSY, strlen(STR_STATUS_BUSY)) == 0)
+	{
+		display(response);
+		return;
+	}
+	printf("\n");
+	char *splitChar = strtok(response, STR_CR);
 	while(splitChar != NULL)
 	{
-		foodList[idx++] = splitChar;
+		printf("  %s\n", splitChar);
 		splitChar = strtok(NULL, STR_CR);
 	}
+	printf("\n");
+}
+
+/**
+ * Search food and display the result page by page.
+ *	All pages are requested from the same server because the cursor is valid 
+ *	only on the server which issued it.
+ */
+void searchByPage()
+{
+	int server = -1;
+	char word[INT_MAX_INPUT_FOOD_NAME_BUF];
+	char cursor[INT_MAX_CURSOR_SIZE] = "";
+	char request[INT_MAX_INPUT_TOTAL_BUF];
+	char *buf;
+	char answer[3];
 	
-	printf("\n%d food items found.\n\n", hitCount);
-	for(index = 0; index < hitCount; index++)
+	printf("Enter the food name to search for.\n");
+	while(!getInputChar(word, INT_MAX_INPUT_FOOD_NAME_BUF))
 	{
-		foodinfo_t *info = getFoodInfo(foodList[index]);
-
-		printf("Food: %s\n", info->name);
-		printf("Measure: %s\n", info->measure);
-		printf("Weight (g): %d\n", info->weight);
-		printf("kCal: %d\n", info->kCal);
-		printf("Fat (g): %d\n", info->fat);
-		printf("Carbo (g): %d\n", info->carbo);
-		printf("Protein (g): %d\n", info->protein);
-		printf("\n");
-		free(info->name);
-		free(info->measure);
-		free(info);
+		printf("*** Error *** Enter %s witin %d characters.\n", "food name", INT_MAX_INPUT_FOOD_NAME_BUF);
+	}
+	strcpy(cursor, STR_PAGE_FIRST);
+	while(true)
+	{
+		snprintf(request, sizeof(request), "%s%d %s %s", STR_CMD_PAGE, INT_PAGE_COUNT, cursor, word);
+		buf = requestCached(request, true, &server);
+		if(strcmp(buf, STR_PAGE_STATUS_STALE) == 0)
+		{
+			//food has been added since the previous page
+			printf("The result has been updated. Search from the first page again.\n\n");
+			free(buf);
+			break;
+		}
+		
+		//cut off the cursor of the next page
+		char *next = strstr(buf, STR_PAGE_NEXT);
+		if(next != NULL)
+		{
+			*next = '\0';
+			next += strlen(STR_PAGE_NEXT);
+			next[strcspn(next, STR_CR)] = '\0';
+			snprintf(cursor, sizeof(cursor), "%s", next);
+		}
+		display(buf);
+		free(buf);
+		if(next == NULL) break;
+		
+		printf("Do you want to see the next page? Enter y or n \n");
+		while(!getInputChar(answer, 3)) printf("***Error*** Enter y or n \n");
+		if(strcmp(answer, "y") != 0) break;
 	}
 }
 
 /**
- * Get response from server.
+ * Send a request to server and receive the response.
+ *	Servers are connected by distcomlib.h: the connection is kept for the next request,
+ *	compressed response is accepted unless the response is displayed while it is 
+ *	received (stream).
+ *	Read only requests are sent to replicas in turn. When the replica is down or busy, 
+ *	the next replica (and the primary at last) is tried.
+ *	When all servers are busy, the request is sent again after the time server specified.
+ *	With -u, read only request is sent by UDP first, and by TCP when the response is too
+ *	large for UDP.
  *
- *	@param fd	server information
- *	@param buf	buffer for receiving the data
+ *	@param request		The data to be sent to server
+ *	@param isReadOnly	true: the request can be sent to replica (false: primary only)
+ *	@param server		Server to be used (-1: select server), the server which responded 
+ *						is stored
+ *	@param stream		Display buffer to display food info while it is received 
+ *						(NULL: the whole response is returned)
+ *	@return The response (has to be freed by caller), empty when it has been displayed
  */
-void *getResponse(int *fd, char *buf)
+char *requestServer(char *request, bool isReadOnly, int *server, displayBuffer_t *stream)
 {
-	int numbytes = 0;
-	if ((numbytes = recv(*fd, buf, INT_MAX_RECV_DATA_SIZE, 0)) == -1)
+	int i;
+	char *buf;
+	if(gUseDatagram && isReadOnly)
+	{
+		int first = *server >= 0 ? *server : 0;
+		int tryCount = 1;
+		if(*server < 0 && gServerCount > 1)
+		{
+			first = 1 + gNextReplica++ % (gServerCount - 1);
+			tryCount = gServerCount;
+		}
+		//small response is received without connection
+		for(i = 0; i < tryCount; i++)
+		{
+			int index = getServerIndex(first, tryCount, i);
+			if((buf = requestDatagram(request, index)) == NULL) continue;
+			*server = index;
+			return buf;
+		}
+	}
+	buf = requestDistcom(gClient, request, isReadOnly, server, stream != NULL ? displayStream : NULL, stream);
+	if(buf == NULL)
 	{
-		printf("recv() error. Error code = %d\n", errno);
-		perror("recv()");
+		printf("connection() failed. Error code = %d\n", errno);
+		perror("connection()");
 		exit(EXIT_FAILURE);
 	}
-	buf[numbytes] = '\0';
+	return buf;
 }
 
+/**
+ * Send a request by UDP and receive the response.
+ *	The request is sent again when the response does not arrive within the timeout.
+ *	When the server does not answer at all, UDP is not used for the server any more.
+ *
+ *	@param request	The data to be sent to server
+ *	@param index	Index of gServerList
+ *	@return The response (has to be freed by caller), NULL when the request has to be 
+ *			sent by TCP
+ */
+char *requestDatagram(char *request, int index)
+{
+	if(gDatagramDisabled[index]) return NULL;
+	int fd;
+	//connected UDP socket receives only from the server (and gets ECONNREFUSED)
+	if((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1
+		|| connect(fd, (struct sockaddr *)&gServerList[index], sizeof(struct sockaddr_in)) == -1)
+	{
+		if(fd != -1) close(fd);
+		return NULL;
+	}
+	struct timeval timeout;
+	timeout.tv_sec = INT_DATAGRAM_TIMEOUT_MSEC / 1000;
+	timeout.tv_usec = INT_DATAGRAM_TIMEOUT_MSEC % 1000 * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	
+	char *buf = (char *)malloc(INT_MAX_DATAGRAM_SIZE + 1);
+	int length = strlen(request);
+	int retry;
+	for(retry = 0; retry <= INT_MAX_DATAGRAM_RETRY; retry++)
+	{
+		if(send(fd, request, length, 0) != length) break;
+		int numbytes = recv(fd, buf, INT_MAX_DATAGRAM_SIZE, 0);
+		if(numbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+		if(numbytes == -1) break;
+		close(fd);
+		buf[numbytes] = '\0';
+		if(strcmp(buf, STR_STATUS_USE_TCP) != 0) return buf;
+		free(buf);
+		return NULL;
+	}
+	close(fd);
+	free(buf);
+	gDatagramDisabled[index] = true;
+	return NULL;
+}
 
 /**
- * Send a request to server
+ * Send a request and receive the response through the response cache (-c).
+ *	Within the TTL, the cached response is used without asking the server.
+ *	After the TTL, the request is sent with "#if <cached version>" and the cached 
+ *	response is used again when the server answers "#notmod".
+ *	New food makes all cached responses expire, so the food added by this client is 
+ *	searched at once.
  *
- *	@param fd		server information
- *	@param sendData	The data to be sent to server
+ *	@param request		The data to be sent to server
+ *	@param isReadOnly	true: the request can be sent to replica and cached
+ *	@param server		Server to be used (see requestServer())
+ *	@return The response (has to be freed by caller)
  */
-void sendRequest(int *fd, char *sendData)
+char *requestCached(char *request, bool isReadOnly, int *server)
 {
-	int sendLen = send(*fd, sendData, strlen(sendData), 0);
-	if(sendLen == -1)
+	char *buf;
+	if(gCacheTtlMsec < 0 || !isReadOnly)
 	{
-		printf("send() error. Error code = %d\n", errno);
-		printf("Data Length = %d\n", strlen(sendData));
-		if(errno == EMSGSIZE) printf("The data may be too big to send.\n");
-		perror("send()");
-		exit(EXIT_FAILURE);
+		buf = requestServer(request, isReadOnly, server, NULL);
+		if(gCacheTtlMsec >= 0 && strcmp(buf, STR_ADD_STATUS_SUCCESS) == 0) expireCache();
+		return buf;
 	}
+	
+	char key[strlen(request) + 1];
+	char versionRequest[strlen(STR_OPT_IF_VERSION) + INT_MAX_CURSOR_SIZE + strlen(request) + 1];
+	unsigned long long cachedVersion;
+	normalizeRequest(request, key);
+	if((buf = getCachedResponse(request, key, versionRequest, &cachedVersion)) != NULL) return buf;
+	buf = requestServer(versionRequest, isReadOnly, server, NULL);
+	char *ret = updateCache(key, cachedVersion, buf);
+	if(ret != NULL) return ret;
+	//the entry has been replaced by another request in the meantime
+	sprintf(versionRequest, "%s%s", STR_OPT_VERSION, request);
+	return updateCache(key, cachedVersion, requestServer(versionRequest, isReadOnly, server, NULL));
 }
 
+/**
+ * Get the cached response, or create the request sent to the server.
+ *
+ *	@param request			Read only request
+ *	@param key				Cache key of the request
+ *	@param versionRequest	"#if <cached version> <request>" or "#v <request>" is stored
+ *							(the size has to be strlen(request) + INT_MAX_CURSOR_SIZE + 5)
+ *	@param cachedVersion	Catalog version of the cached response (passed to updateCache())
+ *	@return The cached response within the TTL (has to be freed by caller), NULL when
+ *			versionRequest has to be sent
+ */
+char *getCachedResponse(char *request, char *key, char *versionRequest, unsigned long long *cachedVersion)
+{
+	cacheEntry_t *entry = &gCache[getCacheIndex(key)];
+	bool isCached = entry->key != NULL && strcmp(entry->key, key) == 0;
+	if(isCached && getCurrentMsec() - entry->checkedMsec < gCacheTtlMsec)
+	{
+		gCacheHitCount++;
+		return strdup(entry->response);
+	}
+	if(isCached) sprintf(versionRequest, "%s%llu %s", STR_OPT_IF_VERSION, entry->version, request);
+	else sprintf(versionRequest, "%s%s", STR_OPT_VERSION, request);
+	*cachedVersion = entry->version;
+	return NULL;
+}
 
+/**
+ * Update the cache with the response of the request created by getCachedResponse().
+ *
+ *	@param key				Cache key of the request
+ *	@param cachedVersion	Catalog version got by getCachedResponse()
+ *	@param buf				The response (freed or returned by this function)
+ *	@return The response without the catalog version (has to be freed by caller), 
+ *			NULL when the server answered "#notmod" but the entry has been replaced
+ *			(send the request with "#v")
+ */
+char *updateCache(char *key, unsigned long long cachedVersion, char *buf)
+{
+	cacheEntry_t *entry = &gCache[getCacheIndex(key)];
+	if(strcmp(buf, STR_STATUS_NOT_MODIFIED) == 0)
+	{
+		free(buf);
+		if(entry->key == NULL || strcmp(entry->key, key) != 0 || entry->version != cachedVersion) return NULL;
+		entry->checkedMsec = getCurrentMsec();
+		gCacheNotModifiedCount++;
+		return strdup(entry->response);
+	}
+	//the server which does not support version (router) sends the response only
+	char *body;
+	if(strncmp(buf, STR_VERSION_HEADER, strlen(STR_VERSION_HEADER)) != 0 
+		|| (body = strchr(buf, '\n')) == NULL)
+	{
+		return buf;
+	}
+	unsigned long long version = strtoull(buf + strlen(STR_VERSION_HEADER), NULL, 10);
+	body++;
+	memmove(buf, body, strlen(body) + 1);
+	
+	free(entry->key);
+	free(entry->response);
+	entry->key = strdup(key);
+	entry->response = strdup(buf);
+	entry->version = version;
+	entry->checkedMsec = getCurrentMsec();
+	return buf;
+}
 
 /**
- * Initialize connection to server
+ * Create cache key of the request.
+ *	Food names are not case sensitive, so the key is in lower case. Spaces are kept
+ *	because a trailing space changes the search ("apple " does not match "Apple,").
  *
- * @param sockfd		socket information
- * @param serverAddr	Server address
- * @param port			Port number
+ *	@param request	Request
+ *	@param key		Cache key (the size has to be strlen(request) + 1)
  */
-void initializeConnection(int *sockfd, struct sockaddr_in *serverAddr, int *port)
+void normalizeRequest(char *request, char *key)
 {
-	if ((*sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+	int i;
+	for(i = 0; request[i] != '\0'; i++)
 	{
-		printf("socket() failed. Error code = %d\n", errno);
-		perror("socket()");
-		exit(EXIT_FAILURE);
+		key[i] = tolower((unsigned char)request[i]);
 	}
-	if (connect(*sockfd, (struct sockaddr *)serverAddr, sizeof(struct sockaddr)) == -1)
+	key[i] = '\0';
+}
+
+/**
+ * Get the entry of the cache key (FNV-1a hash).
+ *
+ *	@param key	Cache key
+ *	@return Index of gCache
+ */
+unsigned int getCacheIndex(char *key)
+{
+	unsigned int hash = 2166136261u;
+	for(; *key != '\0'; key++)
 	{
-		printf("connection() failed. Error code = %d\n", errno);
-		perror("connection()");
+		hash ^= (unsigned char)*key;
+		hash *= 16777619u;
+	}
+	return hash % INT_CACHE_SIZE;
+}
+
+/**
+ * Make all cached responses expire. They are checked by the server at the next use.
+ */
+void expireCache()
+{
+	int i;
+	for(i = 0; i < INT_CACHE_SIZE; i++)
+	{
+		gCache[i].checkedMsec = -(long)gCacheTtlMsec - 1;
+	}
+}
+
+/**
+ * Get current time (CLOCK_MONOTONIC).
+ *
+ *	@return Current time (milli seconds)
+ */
+long getCurrentMsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * Get the server to be tried.
+ *	Replicas are tried in turn from the selected one, and the primary at last.
+ *
+ *	@param first	The server selected
+ *	@param tryCount	The number of servers to be tried (1: the selected server only)
+ *	@param i		The number of servers tried already
+ *	@return Index of gServerList
+ */
+int getServerIndex(int first, int tryCount, int i)
+{
+	if(tryCount == 1) return first;
+	return i < tryCount - 1 ? 1 + (first - 1 + i) % (gServerCount - 1) : 0;
+}
+
+/**
+ * Send all requests in the batch file and write the results to stdout.
+ *	Requests are sent by single thread: up to INT_MAX_BATCH_IN_FLIGHT requests are in
+ *	flight on gBatchJobs connections per server, each connection is kept for the next
+ *	request. Results are written in the order they arrive with "## <line number> <request>".
+ *	The summary is written to stderr.
+ */
+void runBatch()
+{
+	struct timespec start, end;
+	if(strcmp(gBatchFileName, STR_BATCH_STDIN) == 0) gBatchFile = stdin;
+	else if((gBatchFile = fopen(gBatchFileName, STR_FILE_OPEN_MODE_READ)) == NULL)
+	{
+		printf("File open error. File name = %s\n", gBatchFileName);
 		exit(EXIT_FAILURE);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	bool isEnd = false;
+	while(true)
+	{
+		while(!isEnd && gBatchInFlight < INT_MAX_BATCH_IN_FLIGHT) isEnd = !readBatchLine();
+		if(isEnd && gBatchInFlight == 0) break;
+		if(runDistcomClient(gClient, -1) == -1)
+		{
+			printf("epoll_wait() error. Error code = %d\n", errno);
+			perror("epoll_wait()");
+			exit(EXIT_FAILURE);
+		}
+	}
+	closeDistcomClient(gClient);
+	if(gBatchFile != stdin) fclose(gBatchFile);
+	fflush(stdout);
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	long elapsedMsec = (end.tv_sec - start.tv_sec) * 1000L + (end.tv_nsec - start.tv_nsec) / 1000000L;
+	fprintf(stderr, "batch requests=%d errors=%d connections=%d cache_hits=%d not_modified=%d elapsed_ms=%ld\n", 
+		gBatchRequestCount, gBatchErrorCount, gBatchJobs, gCacheHitCount, gCacheNotModifiedCount, elapsedMsec);
+}
+
+/**
+ * Read single line of the batch file and send the request.
+ *
+ *	@return false: the end of the file
+ */
+bool readBatchLine()
+{
+	char line[MAX_LINE_BUFFER];
+	char request[INT_MAX_BATCH_REQUEST_SIZE];
+	if(fgets(line, sizeof(line), gBatchFile) == NULL) return false;
+	int lineNumber = ++gBatchLineCount;
+	line[strcspn(line, "\r\n")] = '\0';
+	//empty line is not a request
+	if(line[0] == '\0') return true;
+	
+	batchRequest_t *batch = (batchRequest_t *)calloc(1, sizeof(batchRequest_t));
+	batch->lineNumber = lineNumber;
+	batch->isReadOnly = createBatchRequest(line, request);
+	batch->line = strdup(line);
+	batch->request = strdup(request);
+	if(gCacheTtlMsec >= 0 && batch->isReadOnly)
+	{
+		batch->key = (char *)malloc(strlen(request) + 1);
+		normalizeRequest(request, batch->key);
+	}
+	gBatchInFlight++;
+	sendBatchRequest(batch, false);
+	return true;
+}
+
+/**
+ * Create request from single line of the batch file.
+ *	"a <food info>" adds new food, "c <partial name>" completes food name, 
+ *	the line starting with "#" is sent as it is and the other line is searched.
+ *
+ *	@param line		Single line of the batch file
+ *	@param request	The request to be sent to server
+ *	@return true: the request can be sent to replica
+ */
+bool createBatchRequest(char *line, char *request)
+{
+	if(strncmp(line, STR_BATCH_ADD, strlen(STR_BATCH_ADD)) == 0)
+	{
+		//'\na' represents adding new food data
+		sprintf(request, "%s%s%s", line + strlen(STR_BATCH_ADD), STR_CR, STR_KEY_ADD);
+		return false;
+	}
+	if(strncmp(line, STR_BATCH_COMPLETE, strlen(STR_BATCH_COMPLETE)) == 0)
+	{
+		sprintf(request, "%s%d %s", STR_CMD_COMPLETE, INT_COMPLETE_COUNT, line + strlen(STR_BATCH_COMPLETE));
+		return true;
+	}
+	strcpy(request, line);
+	return true;
+}
+
+/**
+ * Send the request of batch mode without waiting for the response.
+ *	With -c, the cached response is written at once, or the request is sent with 
+ *	"#if <cached version>" (see requestCached()).
+ *
+ *	@param batch		Request of batch mode
+ *	@param isReplaced	true: the cache entry has been replaced while "#if" was sent
+ *						(the request is sent with "#v")
+ */
+void sendBatchRequest(batchRequest_t *batch, bool isReplaced)
+{
+	char versionRequest[strlen(STR_OPT_IF_VERSION) + INT_MAX_CURSOR_SIZE + strlen(batch->request) + 1];
+	char *request = batch->request;
+	if(batch->key != NULL && isReplaced) sprintf(versionRequest, "%s%s", STR_OPT_VERSION, batch->request);
+	if(batch->key != NULL && !isReplaced)
+	{
+		char *buf = getCachedResponse(batch->request, batch->key, versionRequest, &batch->cachedVersion);
+		if(buf != NULL)
+		{
+			writeBatchResult(batch, buf, 0);
+			return;
+		}
+	}
+	if(batch->key != NULL) request = versionRequest;
+	if(!sendDistcomRequest(gClient, request, batch->isReadOnly, -1, finishBatchRequest, NULL, batch))
+	{
+		writeBatchResult(batch, NULL, errno);
+	}
+}
+
+/**
+ * Callback of the request of batch mode.
+ *
+ *	@param arg		Request of batch mode
+ *	@param error	0 or errno value
+ *	@param response	The response (NULL when failed)
+ *	@param length	The size of response (not used, the response is '\0' terminated)
+ *	@param server	Server which responded (the last server tried when failed)
+ */
+void finishBatchRequest(void *arg, int error, char *response, int length, int server)
+{
+	batchRequest_t *batch = (batchRequest_t *)arg;
+	(void)length;
+	if(error != 0)
+	{
+		fprintf(stderr, "Request of line %d failed on server %d. Error code = %d (%s)\n", 
+			batch->lineNumber, server, error, strerror(error));
+		writeBatchResult(batch, NULL, error);
+		return;
+	}
+	if(response != NULL && batch->key != NULL && (response = updateCache(batch->key, batch->cachedVersion, response)) == NULL)
+	{
+		sendBatchRequest(batch, true);
+		return;
+	}
+	if(response != NULL && gCacheTtlMsec >= 0 && strcmp(response, STR_ADD_STATUS_SUCCESS) == 0) expireCache();
+	writeBatchResult(batch, response, 0);
+}
+
+/**
+ * Write the result of the request of batch mode and free the request.
+ *
+ *	@param batch	Request of batch mode
+ *	@param buf		The response (freed by this function), NULL when no server responded
+ *	@param error	errno value when buf is NULL (0: not known)
+ */
+void writeBatchResult(batchRequest_t *batch, char *buf, int error)
+{
+	gBatchRequestCount++;
+	printf("%s%d %s\n", STR_BATCH_RESULT_HEADER, batch->lineNumber, batch->line);
+	if(buf == NULL && error != 0)
+	{
+		gBatchErrorCount++;
+		printf("%s%s\n", STR_MSG_REQUEST_FAILED, strerror(error));
+	}
+	else if(buf == NULL)
+	{
+		gBatchErrorCount++;
+		printf("%s\n", STR_MSG_SERVER_BUSY);
+	}
+	else
+	{
+		int length = strlen(buf);
+		fwrite(buf, 1, length, stdout);
+		if(length == 0 || buf[length - 1] != '\n') printf("\n");
+	}
+	free(buf);
+	free(batch->line);
+	free(batch->request);
+	free(batch->key);
+	free(batch);
+	gBatchInFlight--;
 }
 
 /**
  * Check parameters.
+ *	The server (primary) is stored in gServerList[0], replicas of -R follow it.
+ *	A server given by path (contains '/') is connected by Unix domain socket.
+ *	gClient is created with gBatchJobs connections per server.
  *
  *	@param argc The number of parameter input by user
  *	@param argv Array that has parameter input by user
- *	@param he	Serve host name/IP address
  */
-void checkParameter(int argc, char** argv, struct hostent **he)
+void checkParameter(int argc, char** argv)
 {
-	bool ret = true;
-	if (argc != 3)
+	int opt;
+	char *replicas = NULL;
+	while((opt = getopt(argc, argv, STR_OPTIONS)) != -1)
+	{
+		if(opt == 'R') replicas = optarg;
+		else if(opt == 'b') gBatchFileName = optarg;
+		else if(opt == 'j') gBatchJobs = atoi(optarg);
+		else if(opt == 'c' && isDigit(optarg)) gCacheTtlMsec = atoi(optarg);
+		else if(opt == 'u') gUseDatagram = true;
+		else
+		{
+			printf("%s", STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(gBatchJobs <= 0 || gBatchJobs > INT_MAX_BATCH_JOBS)
+	{
+		printf("Command line parameter error: -j must be 1 to %d.\n", INT_MAX_BATCH_JOBS);
+		exit(EXIT_FAILURE);
+	}
+	if((gClient = createDistcomClient(gBatchJobs, 0, true)) == NULL)
+	{
+		printf("epoll_create() failed. Error code = %d\n", errno);
+		perror("epoll_create()");
+		exit(EXIT_FAILURE);
+	}
+	if(argc - optind == 1 && strchr(argv[optind], '/') != NULL)
+	{
+		if(!addLocalServer(argv[optind])) exit(EXIT_FAILURE);
+	}
+	else if (argc - optind != 2)
 	{
-		printf("Command line parameter error. Usage: <Server IP address> <port number> \n");
+		printf("%s", STR_USAGE);
 		exit(EXIT_FAILURE);
 	}
+	else if(!addServer(argv[optind], argv[optind + 1])) exit(EXIT_FAILURE);
 	
-	int i;
-	if(!isDigit(argv[2]))
+	//"<host>:<port>,<socket path>..."
+	char *replica = replicas != NULL ? strtok(replicas, STR_COMMA) : NULL;
+	while(replica != NULL)
+	{
+		if(strchr(replica, '/') != NULL)
+		{
+			if(!addLocalServer(replica)) exit(EXIT_FAILURE);
+			replica = strtok(NULL, STR_COMMA);
+			continue;
+		}
+		char *colon = strrchr(replica, ':');
+		if(colon == NULL)
+		{
+			printf("%s", STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+		*colon = '\0';
+		if(!addServer(replica, colon + 1)) exit(EXIT_FAILURE);
+		replica = strtok(NULL, STR_COMMA);
+	}
+}
+
+/**
+ * Add server in gServerList and gClient.
+ *
+ *	@param host	Server host name/IP address
+ *	@param port	Port number
+ *	@return false: parameter error (message is displayed)
+ */
+bool addServer(char *host, char *port)
+{
+	struct hostent *he;
+	if(gServerCount == INT_MAX_SERVER_COUNT)
+	{
+		printf("Command line parameter error: Up to %d servers can be used.\n", INT_MAX_SERVER_COUNT);
+		return false;
+	}
+	if(!isDigit(port))
 	{
 		printf("Command line parameter error: Port number is not digit.\n");
-		exit(EXIT_FAILURE);
+		return false;
 	}
-	if ((*he = gethostbyname(argv[1])) == NULL)
+	if ((he = gethostbyname(host)) == NULL)
 	{
 		printf("Command line parameter error: Invalid hostname/server IP address.\n");
-		exit(EXIT_FAILURE);
+		return false;
 	}
+	struct sockaddr_in *serverAddr = &gServerList[gServerCount++];
+	memset(serverAddr, 0, sizeof(struct sockaddr_in));
+	serverAddr->sin_family = AF_INET;
+	serverAddr->sin_port = htons(atoi(port));
+	serverAddr->sin_addr = *((struct in_addr *)he->h_addr);
+	addDistcomServer(gClient, (struct sockaddr *)serverAddr, sizeof(struct sockaddr_in));
+	return true;
+}
+
+/**
+ * Add server on the same host in gServerList and gClient (connected by Unix domain socket).
+ *	UDP is not used for the server.
+ *
+ *	@param path	Unix domain socket path of the server (-x)
+ *	@return false: parameter error (message is displayed)
+ */
+bool addLocalServer(char *path)
+{
+	struct sockaddr_un addr;
+	if(gServerCount == INT_MAX_SERVER_COUNT)
+	{
+		printf("Command line parameter error: Up to %d servers can be used.\n", INT_MAX_SERVER_COUNT);
+		return false;
+	}
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		printf("Command line parameter error: Socket path is too long.\n");
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	addDistcomServer(gClient, (struct sockaddr *)&addr, sizeof(addr));
+	memset(&gServerList[gServerCount], 0, sizeof(struct sockaddr_in));
+	gDatagramDisabled[gServerCount] = true;
+	gServerCount++;
+	return true;
 }
 
@@ -0,0 +1,1076 @@
+#ifndef DISTCOMLIB_H
+#define DISTCOMLIB_H
+
+//Non-blocking client of distcomserver and distcomrouter.
+//Single client is used by single thread (callbacks are called by runDistcomClient()).
+//A callback can close the client: it is freed when runDistcomClient() returns.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "lzlib.h"
+
+/// Max number of servers (the first is the primary, the rest are read replicas)
+#define INT_DISTCOM_MAX_SERVERS 16
+/// Max number of connections per server
+#define INT_DISTCOM_MAX_CONNECTIONS 64
+/// Default time from writing a request on a connection to its response (milli seconds)
+#define INT_DISTCOM_DEFAULT_TIMEOUT_MSEC 10000
+/// Interval of checking timeouts (milli seconds)
+#define INT_DISTCOM_TIMER_MSEC 100
+/// The number of times all servers are tried again after "#busy"
+#define INT_DISTCOM_BUSY_RETRY 3
+/// Max number of events handled by single epoll_wait()
+#define INT_DISTCOM_EVENT_COUNT 64
+/// Initial size of receive buffer (extended as needed)
+#define INT_DISTCOM_BUFFER_SIZE 4096
+/// Max size of request including options (the server receives up to 511 bytes)
+#define INT_DISTCOM_MAX_REQUEST_SIZE 512
+/// Request option: keep the connection for the next request
+#define STR_DISTCOM_KEEPALIVE "#k "
+/// Request option: accept compressed response
+#define STR_DISTCOM_COMPRESS "#z "
+/// Response header on kept-alive connection ("#size <response size>\n")
+#define STR_DISTCOM_FRAME_HEADER "#size "
+/// Compressed response header ("#lz4 <original size> <compressed size>\n")
+#define STR_DISTCOM_COMPRESS_HEADER "#lz4 "
+/// Response of busy server ("#busy <ms>", sent without "#size" and closed)
+#define STR_DISTCOM_BUSY "#busy "
+
+/// Called once when the request is finished.
+///	error: 0 or errno value (ETIMEDOUT, ECONNREFUSED etc., response is NULL)
+///	response: the response ('\0' terminated, has to be freed by the callback)
+///	server: index of the server which responded
+typedef void (*distcomCallback_t)(void *arg, int error, char *response, int length, int server);
+/// Called with food info lines as they arrive (the last call may not end with '\n')
+typedef void (*distcomDataCallback_t)(void *arg, char *data, int length);
+
+/// Request waiting for a connection or in progress
+typedef struct distcomRequest distcomRequest_t;
+struct distcomRequest
+{
+	/// request with options ("#k [#z ]<request>")
+	char *data;
+	int length;
+	/// servers tried in turn (see getDistcomServer())
+	int first;
+	int tryCount;
+	int tryIndex;
+	/// the number of rounds answered "#busy" by all servers
+	int busyCount;
+	/// true: sent again because the kept-alive connection had been closed by server
+	bool isResent;
+	/// true: a part of the response has been passed to onData (not sent again)
+	bool isStreamed;
+	/// time the request fails with ETIMEDOUT (set when it is written on a connection)
+	long deadlineMsec;
+	/// time the request is sent again after "#busy"
+	long notBeforeMsec;
+	distcomCallback_t callback;
+	distcomDataCallback_t onData;
+	void *arg;
+	distcomRequest_t *next;
+};
+
+/// Connection to server (kept alive for the next request)
+typedef struct distcomConnection distcomConnection_t;
+struct distcomConnection
+{
+	/// socket (-1: not connected)
+	int fd;
+	/// index of the server
+	int server;
+	/// true: non-blocking connect() is in progress
+	bool isConnecting;
+	/// true: a response has been received on this connection
+	bool isReused;
+	/// events registered in epoll
+	unsigned int events;
+	/// request in progress (NULL: idle)
+	distcomRequest_t *request;
+	/// the size of the request sent
+	int sent;
+	/// received data (without "#size" header)
+	char *buf;
+	int size;
+	int total;
+	/// the size of the response (-1: header has not been received)
+	long frameLength;
+	/// the size of the response passed to onData already
+	long streamed;
+	/// true: the response does not have "#size" header (received until closed)
+	bool isUnframed;
+	/// true: food info lines are passed to onData
+	bool isStreaming;
+};
+
+/// Server and its connections
+typedef struct distcomServer distcomServer_t;
+struct distcomServer
+{
+	struct sockaddr_storage addr;
+	socklen_t addrLength;
+	distcomConnection_t connections[INT_DISTCOM_MAX_CONNECTIONS];
+	/// requests waiting for a connection
+	distcomRequest_t *head;
+	distcomRequest_t *tail;
+};
+
+/// Client (connection pool of all servers)
+typedef struct distcomClient distcomClient_t;
+struct distcomClient
+{
+	int epollFd;
+	distcomServer_t servers[INT_DISTCOM_MAX_SERVERS];
+	int serverCount;
+	/// max number of connections per server
+	int maxConnections;
+	int timeoutMsec;
+	/// true: compressed responses are accepted
+	bool isCompressed;
+	/// replica to which the next read only request is sent
+	int nextReplica;
+	/// requests waiting after "#busy"
+	distcomRequest_t *delayed;
+	/// the number of requests not finished
+	int pendingCount;
+	/// true: a request has been queued since dispatchDistcomClient() started
+	bool isQueued;
+	/// time timeouts are checked next
+	long nextCheckMsec;
+	/// the number of runDistcomClient()/requestDistcom() in progress
+	int runDepth;
+	/// true: closeDistcomClient() has been called in a callback (freed when runDepth is 0)
+	bool isClosing;
+};
+
+/// Result of requestDistcom()
+typedef struct distcomResult distcomResult_t;
+struct distcomResult
+{
+	bool isDone;
+	int error;
+	char *response;
+	int server;
+	distcomDataCallback_t onData;
+	void *arg;
+};
+
+/// ----- Function definitions
+distcomClient_t *createDistcomClient(int, int, bool);
+void closeDistcomClient(distcomClient_t*);
+void freeDistcomClient(distcomClient_t*);
+bool addDistcomServer(distcomClient_t*, struct sockaddr*, socklen_t);
+bool sendDistcomRequest(distcomClient_t*, char*, bool, int, distcomCallback_t, distcomDataCallback_t, void*);
+char *requestDistcom(distcomClient_t*, char*, bool, int*, distcomDataCallback_t, void*);
+int runDistcomClient(distcomClient_t*, int);
+int getDistcomFd(distcomClient_t*);
+int getDistcomTimeout(distcomClient_t*);
+void finishDistcomResult(void*, int, char*, int, int);
+void passDistcomData(void*, char*, int);
+void dispatchDistcomClient(distcomClient_t*);
+void dispatchDistcomServer(distcomClient_t*, int);
+bool startDistcomConnection(distcomClient_t*, distcomConnection_t*);
+void handleDistcomEvent(distcomClient_t*, distcomConnection_t*, unsigned int);
+void writeDistcomConnection(distcomClient_t*, distcomConnection_t*);
+void readDistcomConnection(distcomClient_t*, distcomConnection_t*);
+void streamDistcomLines(distcomConnection_t*, bool);
+void finishDistcomResponse(distcomClient_t*, distcomConnection_t*, bool);
+char *decompressDistcomResponse(char*, int, int*);
+void failDistcomConnection(distcomClient_t*, distcomConnection_t*, int);
+void closeDistcomConnection(distcomConnection_t*);
+void setDistcomEvents(distcomClient_t*, distcomConnection_t*, unsigned int);
+void nextDistcomServer(distcomClient_t*, distcomRequest_t*, int);
+void queueDistcomRequest(distcomClient_t*, distcomRequest_t*, bool);
+int getDistcomServer(distcomClient_t*, distcomRequest_t*);
+void completeDistcomRequest(distcomClient_t*, distcomRequest_t*, int, char*, int, int);
+void checkDistcomTimers(distcomClient_t*);
+long getDistcomMsec();
+
+
+/**
+ * Create client. Add servers by addDistcomServer() before sending requests.
+ *
+ *	@param maxConnections	Max number of connections per server (1 to INT_DISTCOM_MAX_CONNECTIONS)
+ *	@param timeoutMsec		Max time from writing a request to its response, waiting for a
+ *							connection is not included (0: INT_DISTCOM_DEFAULT_TIMEOUT_MSEC)
+ *	@param isCompressed		true: compressed responses are accepted ("#z")
+ *	@return Client, NULL when failed (errno is set)
+ */
+distcomClient_t *createDistcomClient(int maxConnections, int timeoutMsec, bool isCompressed)
+{
+	int i, j;
+	if(maxConnections <= 0 || maxConnections > INT_DISTCOM_MAX_CONNECTIONS || timeoutMsec < 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	distcomClient_t *client = (distcomClient_t *)calloc(1, sizeof(distcomClient_t));
+	if(client == NULL) return NULL;
+	if((client->epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+	{
+		free(client);
+		return NULL;
+	}
+	for(i = 0; i < INT_DISTCOM_MAX_SERVERS; i++)
+	{
+		for(j = 0; j < INT_DISTCOM_MAX_CONNECTIONS; j++)
+		{
+			client->servers[i].connections[j].fd = -1;
+			client->servers[i].connections[j].server = i;
+		}
+	}
+	client->maxConnections = maxConnections;
+	client->timeoutMsec = timeoutMsec > 0 ? timeoutMsec : INT_DISTCOM_DEFAULT_TIMEOUT_MSEC;
+	client->isCompressed = isCompressed;
+	return client;
+}
+
+/**
+ * Close all connections and free the client.
+ *	Requests not finished are discarded without calling their callbacks.
+ *	When called in a callback, the client is freed when runDistcomClient() returns
+ *	(requestDistcom() returns NULL with ECANCELED).
+ *
+ *	@param client	Client
+ */
+void closeDistcomClient(distcomClient_t *client)
+{
+	if(client->runDepth > 0) client->isClosing = true;
+	else freeDistcomClient(client);
+}
+
+/**
+ * Close all connections and free the client (see closeDistcomClient()).
+ *
+ *	@param client	Client
+ */
+void freeDistcomClient(distcomClient_t *client)
+{
+	int i, j;
+	distcomRequest_t *request;
+	for(i = 0; i < client->serverCount; i++)
+	{
+		distcomServer_t *server = &client->servers[i];
+		for(j = 0; j < INT_DISTCOM_MAX_CONNECTIONS; j++)
+		{
+			distcomConnection_t *conn = &server->connections[j];
+			if(conn->request != NULL)
+			{
+				free(conn->request->data);
+				free(conn->request);
+			}
+			closeDistcomConnection(conn);
+		}
+		while((request = server->head) != NULL)
+		{
+			server->head = request->next;
+			free(request->data);
+			free(request);
+		}
+	}
+	while((request = client->delayed) != NULL)
+	{
+		client->delayed = request->next;
+		free(request->data);
+		free(request);
+	}
+	close(client->epollFd);
+	free(client);
+}
+
+/**
+ * Add server. The first server is the primary, the rest are read replicas.
+ *
+ *	@param client		Client
+ *	@param addr			TCP address or Unix domain socket address of the server
+ *	@param addrLength	The size of addr
+ *	@return false: too many servers or invalid address (errno is set)
+ */
+bool addDistcomServer(distcomClient_t *client, struct sockaddr *addr, socklen_t addrLength)
+{
+	if(client->serverCount == INT_DISTCOM_MAX_SERVERS || addrLength > sizeof(struct sockaddr_storage))
+	{
+		errno = EINVAL;
+		return false;
+	}
+	distcomServer_t *server = &client->servers[client->serverCount++];
+	memcpy(&server->addr, addr, addrLength);
+	server->addrLength = addrLength;
+	return true;
+}
+
+/**
+ * Send a request without waiting for the response.
+ *	The request is sent when runDistcomClient() is called, on an idle connection of
+ *	the server or a new one (up to maxConnections). The others wait in the order they
+ *	were sent. The protocol has no request delimiter, so a connection has single
+ *	request at a time: the next one is written as soon as the response has been read.
+ *	Read only requests are sent to replicas in turn. When the server is down or busy,
+ *	the next replica (and the primary at last) is tried.
+ *
+ *	@param client		Client
+ *	@param request		Request (search, new food, "#complete", "#page" etc.)
+ *	@param isReadOnly	true: the request can be sent to replica (false: primary only)
+ *	@param server		Server to be used (-1: select server)
+ *	@param callback		Called when the request is finished
+ *	@param onData		Called with food info lines as they arrive (NULL: the whole
+ *						response is passed to callback). The response is not compressed.
+ *	@param arg			Passed to callback and onData
+ *	@return false: the request was not sent (errno is set, EMSGSIZE: too large)
+ */
+bool sendDistcomRequest(distcomClient_t *client, char *request, bool isReadOnly, int server,
+	distcomCallback_t callback, distcomDataCallback_t onData, void *arg)
+{
+	bool isCompressed = client->isCompressed && onData == NULL;
+	int length = strlen(STR_DISTCOM_KEEPALIVE) + (isCompressed ? strlen(STR_DISTCOM_COMPRESS) : 0) + strlen(request);
+	if(length >= INT_DISTCOM_MAX_REQUEST_SIZE || server >= client->serverCount || client->serverCount == 0)
+	{
+		errno = length >= INT_DISTCOM_MAX_REQUEST_SIZE ? EMSGSIZE : EINVAL;
+		return false;
+	}
+	distcomRequest_t *req = (distcomRequest_t *)calloc(1, sizeof(distcomRequest_t));
+	if(req == NULL || (req->data = (char *)malloc(length + 1)) == NULL)
+	{
+		free(req);
+		errno = ENOMEM;
+		return false;
+	}
+	sprintf(req->data, "%s%s%s", STR_DISTCOM_KEEPALIVE, isCompressed ? STR_DISTCOM_COMPRESS : "", request);
+	req->length = length;
+	req->tryCount = 1;
+	if(server >= 0) req->first = server;
+	else if(isReadOnly && client->serverCount > 1)
+	{
+		//the primary is the last candidate of read only request
+		req->first = 1 + client->nextReplica++ % (client->serverCount - 1);
+		req->tryCount = client->serverCount;
+	}
+	req->callback = callback;
+	req->onData = onData;
+	req->arg = arg;
+	client->pendingCount++;
+	queueDistcomRequest(client, req, false);
+	return true;
+}
+
+/**
+ * Send a request and wait for the response.
+ *	Other requests of the client progress while waiting.
+ *
+ *	@param client		Client
+ *	@param request		Request
+ *	@param isReadOnly	true: the request can be sent to replica (false: primary only)
+ *	@param server		Server to be used (-1: select server), the server which responded
+ *						is stored
+ *	@param onData		Called with food info lines as they arrive (NULL: not used)
+ *	@param arg			Passed to onData
+ *	@return The response (has to be freed by caller), empty when it has been passed to
+ *			onData, NULL when failed (errno is set, the rows passed to onData are not
+ *			sent again to another server)
+ */
+char *requestDistcom(distcomClient_t *client, char *request, bool isReadOnly, int *server,
+	distcomDataCallback_t onData, void *arg)
+{
+	distcomResult_t result;
+	memset(&result, 0, sizeof(result));
+	result.onData = onData;
+	result.arg = arg;
+	if(!sendDistcomRequest(client, request, isReadOnly, *server, finishDistcomResult,
+		onData != NULL ? passDistcomData : NULL, &result))
+	{
+		return NULL;
+	}
+	//the request finishes by ETIMEDOUT at the latest
+	client->runDepth++;
+	while(!result.isDone && !client->isClosing) runDistcomClient(client, -1);
+	bool isClosed = client->isClosing;
+	if(--client->runDepth == 0 && isClosed) freeDistcomClient(client);
+	if(isClosed)
+	{
+		//closed by onData or by a callback of other request
+		free(result.response);
+		errno = ECANCELED;
+		return NULL;
+	}
+	*server = result.server;
+	errno = result.error;
+	return result.response;
+}
+
+/**
+ * Send requests, receive responses and call callbacks.
+ *	Call this when the fd of getDistcomFd() is readable, or when the time of
+ *	getDistcomTimeout() has passed (event loop), or in a loop with timeoutMsec.
+ *
+ *	@param client		Client
+ *	@param timeoutMsec	Max time to wait for events (-1: until something happens, 0: do not wait)
+ *	@return The number of requests not finished, -1 when epoll_wait() failed or the client
+ *			has been closed by a callback (ECANCELED, the client must not be used any more)
+ */
+int runDistcomClient(distcomClient_t *client, int timeoutMsec)
+{
+	int i;
+	int count = 0;
+	struct epoll_event events[INT_DISTCOM_EVENT_COUNT];
+	//callbacks may close the client, it is freed at the end
+	client->runDepth++;
+	checkDistcomTimers(client);
+	if(!client->isClosing) dispatchDistcomClient(client);
+	if(!client->isClosing && client->pendingCount > 0)
+	{
+		int waitMsec = getDistcomTimeout(client);
+		if(timeoutMsec >= 0 && (waitMsec == -1 || timeoutMsec < waitMsec)) waitMsec = timeoutMsec;
+		count = epoll_wait(client->epollFd, events, INT_DISTCOM_EVENT_COUNT, waitMsec);
+		int error = errno;
+		for(i = 0; i < count && !client->isClosing; i++)
+		{
+			//connections closed by the previous events are not reused until the next dispatch
+			distcomConnection_t *conn = (distcomConnection_t *)events[i].data.ptr;
+			if(conn->fd != -1) handleDistcomEvent(client, conn, events[i].events);
+		}
+		if(!client->isClosing) checkDistcomTimers(client);
+		if(!client->isClosing) dispatchDistcomClient(client);
+		errno = error;
+	}
+	bool isClosed = client->isClosing;
+	if(--client->runDepth == 0 && isClosed) freeDistcomClient(client);
+	if(isClosed)
+	{
+		errno = ECANCELED;
+		return -1;
+	}
+	if(count == -1 && errno != EINTR) return -1;
+	return client->pendingCount;
+}
+
+/**
+ * Get file descriptor which becomes readable when runDistcomClient() has something to do.
+ *
+ *	@param client	Client
+ *	@return epoll file descriptor
+ */
+int getDistcomFd(distcomClient_t *client)
+{
+	return client->epollFd;
+}
+
+/**
+ * Get time until runDistcomClient() has to be called even if nothing is received
+ * (timeouts and retries after "#busy").
+ *
+ *	@param client	Client
+ *	@return Time (milli seconds), -1: no request is in progress
+ */
+int getDistcomTimeout(distcomClient_t *client)
+{
+	if(client->pendingCount == 0) return -1;
+	long now = getDistcomMsec();
+	long wait = client->nextCheckMsec - now;
+	distcomRequest_t *request;
+	for(request = client->delayed; request != NULL; request = request->next)
+	{
+		if(request->notBeforeMsec - now < wait) wait = request->notBeforeMsec - now;
+	}
+	return wait < 0 ? 0 : (int)wait;
+}
+
+/**
+ * Callback of requestDistcom().
+ *
+ *	@param arg		Result
+ *	@param error	0 or errno value
+ *	@param response	Response
+ *	@param length	The size of response (not used, the response is '\0' terminated)
+ *	@param server	Server which responded
+ */
+void finishDistcomResult(void *arg, int error, char *response, int length, int server)
+{
+	distcomResult_t *result = (distcomResult_t *)arg;
+	(void)length;
+	result->isDone = true;
+	result->error = error;
+	result->response = response;
+	result->server = server;
+}
+
+/**
+ * Data callback of requestDistcom().
+ *
+ *	@param arg		Result
+ *	@param data		Food info lines
+ *	@param length	The size of data
+ */
+void passDistcomData(void *arg, char *data, int length)
+{
+	distcomResult_t *result = (distcomResult_t *)arg;
+	result->onData(result->arg, data, length);
+}
+
+/**
+ * Assign queued requests to connections of all servers.
+ *	A request moved to another server while dispatching is dispatched as well.
+ *
+ *	@param client	Client
+ */
+void dispatchDistcomClient(distcomClient_t *client)
+{
+	int i;
+	do
+	{
+		client->isQueued = false;
+		for(i = 0; i < client->serverCount; i++) dispatchDistcomServer(client, i);
+	} while(client->isQueued);
+}
+
+/**
+ * Assign queued requests to idle connections, and new connections up to maxConnections.
+ *
+ *	@param client	Client
+ *	@param index	Index of the server
+ */
+void dispatchDistcomServer(distcomClient_t *client, int index)
+{
+	int i;
+	distcomServer_t *server = &client->servers[index];
+	//a callback of failed request may close the client
+	while(server->head != NULL && !client->isClosing)
+	{
+		distcomConnection_t *conn = NULL;
+		distcomConnection_t *unused = NULL;
+		for(i = 0; conn == NULL && i < client->maxConnections; i++)
+		{
+			distcomConnection_t *candidate = &server->connections[i];
+			if(candidate->fd == -1 && unused == NULL) unused = candidate;
+			else if(candidate->fd != -1 && candidate->request == NULL) conn = candidate;
+		}
+		if(conn == NULL) conn = unused;
+		if(conn == NULL) break;
+
+		distcomRequest_t *request = server->head;
+		server->head = request->next;
+		if(server->head == NULL) server->tail = NULL;
+		if(conn->buf == NULL)
+		{
+			if((conn->buf = (char *)malloc(INT_DISTCOM_BUFFER_SIZE)) == NULL)
+			{
+				completeDistcomRequest(client, request, ENOMEM, NULL, 0, index);
+				continue;
+			}
+			conn->size = INT_DISTCOM_BUFFER_SIZE;
+		}
+		request->deadlineMsec = getDistcomMsec() + client->timeoutMsec;
+		conn->request = request;
+		conn->sent = 0;
+		conn->total = 0;
+		conn->frameLength = -1;
+		conn->streamed = 0;
+		conn->isUnframed = false;
+		conn->isStreaming = false;
+		if(conn->fd == -1 && !startDistcomConnection(client, conn))
+		{
+			failDistcomConnection(client, conn, errno);
+			continue;
+		}
+		if(!conn->isConnecting) writeDistcomConnection(client, conn);
+	}
+}
+
+/**
+ * Connect to the server of the connection (non-blocking).
+ *
+ *	@param client	Client
+ *	@param conn		Connection (not connected)
+ *	@return false: failed (errno is set)
+ */
+bool startDistcomConnection(distcomClient_t *client, distcomConnection_t *conn)
+{
+	int on = 1;
+	distcomServer_t *server = &client->servers[conn->server];
+	conn->fd = socket(server->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(conn->fd == -1) return false;
+	//requests are small, they are sent at once
+	if(server->addr.ss_family == AF_INET)
+	{
+		setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		//with the cookie of the server, connect() returns at once and the request is sent
+		//in SYN by the first send() (TCP Fast Open, ignored by the kernel without it)
+		setsockopt(conn->fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+	}
+	conn->isReused = false;
+	conn->isConnecting = false;
+	if(connect(conn->fd, (struct sockaddr *)&server->addr, server->addrLength) == -1)
+	{
+		if(errno != EINPROGRESS) return false;
+		conn->isConnecting = true;
+	}
+	struct epoll_event event;
+	conn->events = conn->isConnecting ? EPOLLOUT : EPOLLIN;
+	event.events = conn->events;
+	event.data.ptr = conn;
+	return epoll_ctl(client->epollFd, EPOLL_CTL_ADD, conn->fd, &event) == 0;
+}
+
+/**
+ * Handle event of single connection.
+ *
+ *	@param client	Client
+ *	@param conn		Connection
+ *	@param events	Events returned by epoll_wait()
+ */
+void handleDistcomEvent(distcomClient_t *client, distcomConnection_t *conn, unsigned int events)
+{
+	if(conn->isConnecting)
+	{
+		int error = 0;
+		socklen_t errorLength = sizeof(error);
+		getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &errorLength);
+		if(error != 0)
+		{
+			failDistcomConnection(client, conn, error);
+			return;
+		}
+		conn->isConnecting = false;
+		writeDistcomConnection(client, conn);
+		return;
+	}
+	if(conn->request != NULL && conn->sent < conn->request->length)
+	{
+		if(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) writeDistcomConnection(client, conn);
+		return;
+	}
+	if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readDistcomConnection(client, conn);
+}
+
+/**
+ * Send the rest of the request. The response is waited for by EPOLLIN.
+ *
+ *	@param client	Client
+ *	@param conn		Connection which has the request
+ */
+void writeDistcomConnection(distcomClient_t *client, distcomConnection_t *conn)
+{
+	distcomRequest_t *request = conn->request;
+	while(conn->sent < request->length)
+	{
+		int numbytes = send(conn->fd, request->data + conn->sent, request->length - conn->sent, MSG_NOSIGNAL);
+		if(numbytes == -1 && errno == EINTR) continue;
+		//EINPROGRESS: connect() deferred by TCP Fast Open has sent SYN without the data
+		if(numbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS))
+		{
+			setDistcomEvents(client, conn, EPOLLOUT);
+			return;
+		}
+		if(numbytes == -1)
+		{
+			failDistcomConnection(client, conn, errno);
+			return;
+		}
+		conn->sent += numbytes;
+	}
+	setDistcomEvents(client, conn, EPOLLIN);
+}
+
+/**
+ * Receive the response until no data is left in the socket.
+ *	"#size <response size>\n" is removed. The response without the header ("#busy")
+ *	is received until the server closes the connection.
+ *
+ *	@param client	Client
+ *	@param conn		Connection
+ */
+void readDistcomConnection(distcomClient_t *client, distcomConnection_t *conn)
+{
+	while(true)
+	{
+		//keep the last byte for '\0'
+		if(conn->total == conn->size - 1)
+		{
+			char *buf = (char *)realloc(conn->buf, conn->size * 2);
+			if(buf == NULL)
+			{
+				failDistcomConnection(client, conn, ENOMEM);
+				return;
+			}
+			conn->buf = buf;
+			conn->size *= 2;
+		}
+		int numbytes = recv(conn->fd, conn->buf + conn->total, conn->size - 1 - conn->total, 0);
+		if(numbytes == -1 && errno == EINTR) continue;
+		if(numbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+		if(numbytes <= 0 || conn->request == NULL)
+		{
+			//the response without the header ends here
+			if(numbytes == 0 && conn->request != NULL && conn->isUnframed)
+			{
+				conn->buf[conn->total] = '\0';
+				finishDistcomResponse(client, conn, true);
+				return;
+			}
+			//idle connection closed by server (idle timeout or upgrade) is closed as well
+			failDistcomConnection(client, conn, numbytes == 0 || conn->request == NULL ? ECONNRESET : errno);
+			return;
+		}
+		conn->total += numbytes;
+		conn->buf[conn->total] = '\0';
+		if(conn->isUnframed) continue;
+		if(conn->frameLength == -1)
+		{
+			int headerLength = strlen(STR_DISTCOM_FRAME_HEADER);
+			if(strncmp(conn->buf, STR_DISTCOM_FRAME_HEADER,
+				conn->total < headerLength ? conn->total : headerLength) != 0)
+			{
+				conn->isUnframed = true;
+				continue;
+			}
+			char *newLine = strchr(conn->buf, '\n');
+			if(newLine == NULL) continue;
+			conn->frameLength = atol(conn->buf + headerLength);
+			//remove the header
+			headerLength = newLine + 1 - conn->buf;
+			conn->total -= headerLength;
+			memmove(conn->buf, newLine + 1, conn->total + 1);
+		}
+		bool isLast = conn->streamed + conn->total >= conn->frameLength;
+		if(conn->request->onData != NULL) streamDistcomLines(conn, isLast);
+		//onData has closed the client
+		if(client->isClosing) return;
+		if(isLast)
+		{
+			finishDistcomResponse(client, conn, false);
+			return;
+		}
+	}
+}
+
+/**
+ * Pass complete food info lines in the buffer to onData.
+ *	Streaming starts when the response has a line and does not start with '#'
+ *	(status responses such as "0" and "#stale" are passed to callback as usual).
+ *
+ *	@param conn		Connection which has the request
+ *	@param isLast	true: the whole response has been received (the rest is passed)
+ */
+void streamDistcomLines(distcomConnection_t *conn, bool isLast)
+{
+	if(!conn->isStreaming)
+	{
+		if(conn->total == 0 || conn->buf[0] == '#' || strchr(conn->buf, '\n') == NULL) return;
+		conn->isStreaming = true;
+	}
+	int used = conn->total;
+	if(!isLast)
+	{
+		char *newLine = strrchr(conn->buf, '\n');
+		used = newLine == NULL ? 0 : newLine + 1 - conn->buf;
+	}
+	if(used == 0) return;
+	conn->request->isStreamed = true;
+	conn->request->onData(conn->request->arg, conn->buf, used);
+	conn->total -= used;
+	conn->streamed += used;
+	memmove(conn->buf, conn->buf + used, conn->total + 1);
+}
+
+/**
+ * Finish the response received on the connection.
+ *	The connection is kept for the next request unless the server closed it.
+ *	"#busy" makes the request sent to the next server, or again after the time the
+ *	server specified (INT_DISTCOM_BUSY_RETRY rounds).
+ *
+ *	@param client	Client
+ *	@param conn		Connection which has the request
+ *	@param isClosed	true: the server has closed the connection
+ */
+void finishDistcomResponse(distcomClient_t *client, distcomConnection_t *conn, bool isClosed)
+{
+	distcomRequest_t *request = conn->request;
+	int server = conn->server;
+	//the buffer is passed to callback (empty when streamed), the next request allocates a new one
+	char *response = conn->buf;
+	int length = conn->total;
+	conn->buf = NULL;
+	conn->size = 0;
+	conn->request = NULL;
+	conn->isReused = true;
+	if(isClosed) closeDistcomConnection(conn);
+
+	if(strncmp(response, STR_DISTCOM_COMPRESS_HEADER, strlen(STR_DISTCOM_COMPRESS_HEADER)) == 0
+		&& (response = decompressDistcomResponse(response, length, &length)) == NULL)
+	{
+		//the connection may have the rest of broken response
+		closeDistcomConnection(conn);
+		completeDistcomRequest(client, request, EPROTO, NULL, 0, server);
+		return;
+	}
+	if(strncmp(response, STR_DISTCOM_BUSY, strlen(STR_DISTCOM_BUSY)) != 0)
+	{
+		completeDistcomRequest(client, request, 0, response, length, server);
+		return;
+	}
+	if(request->tryIndex + 1 < request->tryCount)
+	{
+		free(response);
+		request->tryIndex++;
+		queueDistcomRequest(client, request, false);
+	}
+	else if(request->busyCount < INT_DISTCOM_BUSY_RETRY)
+	{
+		//all servers are busy, try from the first one after the time server specified
+		request->busyCount++;
+		request->tryIndex = 0;
+		request->notBeforeMsec = getDistcomMsec() + atoi(response + strlen(STR_DISTCOM_BUSY));
+		free(response);
+		request->next = client->delayed;
+		client->delayed = request;
+	}
+	else completeDistcomRequest(client, request, 0, response, length, server);
+}
+
+/**
+ * Decompress response ("#lz4 <original size> <compressed size>\n<data>").
+ *
+ *	@param buf			Compressed response (freed by this function)
+ *	@param length		The size of buf
+ *	@param retLength	The size of decompressed response
+ *	@return Decompressed response (has to be freed by caller), NULL when it is broken
+ */
+char *decompressDistcomResponse(char *buf, int length, int *retLength)
+{
+	int originalLength;
+	int compLength;
+	char *ret = NULL;
+	char *body = strchr(buf, '\n');
+	if(body != NULL && sscanf(buf + strlen(STR_DISTCOM_COMPRESS_HEADER), "%d %d", &originalLength, &compLength) == 2
+		&& compLength == length - (++body - buf) && originalLength >= 0
+		&& (ret = (char *)malloc(originalLength + 1)) != NULL
+		&& lzDecompress(body, compLength, ret, originalLength) != originalLength)
+	{
+		free(ret);
+		ret = NULL;
+	}
+	if(ret != NULL)
+	{
+		ret[originalLength] = '\0';
+		*retLength = originalLength;
+	}
+	free(buf);
+	return ret;
+}
+
+/**
+ * Close the connection which failed, and send its request again.
+ *	When the kept-alive connection has been closed by server before the response,
+ *	the request is sent to the same server once more on a new connection. Otherwise
+ *	the next server is tried. The request whose rows have been passed to onData
+ *	is finished with the error (the rows would be passed twice).
+ *
+ *	@param client	Client
+ *	@param conn		Connection
+ *	@param error	errno value
+ */
+void failDistcomConnection(distcomClient_t *client, distcomConnection_t *conn, int error)
+{
+	distcomRequest_t *request = conn->request;
+	bool isResendable = conn->isReused && conn->total == 0 && conn->frameLength == -1;
+	conn->request = NULL;
+	closeDistcomConnection(conn);
+	if(request == NULL) return;
+	if(isResendable && !request->isResent && !request->isStreamed)
+	{
+		request->isResent = true;
+		queueDistcomRequest(client, request, true);
+	}
+	else nextDistcomServer(client, request, error);
+}
+
+/**
+ * Close the connection. The buffer is freed.
+ *
+ *	@param conn	Connection
+ */
+void closeDistcomConnection(distcomConnection_t *conn)
+{
+	if(conn->fd != -1) close(conn->fd);
+	conn->fd = -1;
+	conn->isConnecting = false;
+	conn->isReused = false;
+	free(conn->buf);
+	conn->buf = NULL;
+	conn->size = 0;
+}
+
+/**
+ * Change the events of the connection registered in epoll.
+ *
+ *	@param client	Client
+ *	@param conn		Connection
+ *	@param events	EPOLLIN or EPOLLOUT
+ */
+void setDistcomEvents(distcomClient_t *client, distcomConnection_t *conn, unsigned int events)
+{
+	if(conn->events == events) return;
+	struct epoll_event event;
+	event.events = events;
+	event.data.ptr = conn;
+	epoll_ctl(client->epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+	conn->events = events;
+}
+
+/**
+ * Send the request to the next server, or finish it with the error when all servers
+ * have been tried or a part of the response has been passed to onData.
+ *
+ *	@param client	Client
+ *	@param request	Request
+ *	@param error	errno value of the last server
+ */
+void nextDistcomServer(distcomClient_t *client, distcomRequest_t *request, int error)
+{
+	if(!request->isStreamed && ++request->tryIndex < request->tryCount) queueDistcomRequest(client, request, false);
+	else completeDistcomRequest(client, request, error, NULL, 0, getDistcomServer(client, request));
+}
+
+/**
+ * Queue the request on the server it is sent to next.
+ *
+ *	@param client	Client
+ *	@param request	Request
+ *	@param isFirst	true: the request is sent first (sent again), false: sent last
+ */
+void queueDistcomRequest(distcomClient_t *client, distcomRequest_t *request, bool isFirst)
+{
+	distcomServer_t *server = &client->servers[getDistcomServer(client, request)];
+	request->next = NULL;
+	if(server->head == NULL)
+	{
+		server->head = request;
+		server->tail = request;
+	}
+	else if(isFirst)
+	{
+		request->next = server->head;
+		server->head = request;
+	}
+	else
+	{
+		server->tail->next = request;
+		server->tail = request;
+	}
+	client->isQueued = true;
+}
+
+/**
+ * Get the server the request is sent to.
+ *	Replicas are tried in turn from the selected one, and the primary at last.
+ *
+ *	@param client	Client
+ *	@param request	Request
+ *	@return Index of the server
+ */
+int getDistcomServer(distcomClient_t *client, distcomRequest_t *request)
+{
+	if(request->tryCount == 1) return request->first;
+	if(request->tryIndex >= request->tryCount - 1) return 0;
+	return 1 + (request->first - 1 + request->tryIndex) % (client->serverCount - 1);
+}
+
+/**
+ * Finish the request and call its callback.
+ *	After the client has been closed by a callback, the callback is not called.
+ *
+ *	@param client	Client
+ *	@param request	Request (freed by this function)
+ *	@param error	0 or errno value
+ *	@param response	Response (passed to callback, freed when the callback is not called)
+ *	@param length	The size of response
+ *	@param server	Server which responded
+ */
+void completeDistcomRequest(distcomClient_t *client, distcomRequest_t *request, int error, char *response,
+	int length, int server)
+{
+	distcomCallback_t callback = request->callback;
+	void *arg = request->arg;
+	free(request->data);
+	free(request);
+	client->pendingCount--;
+	if(client->isClosing)
+	{
+		free(response);
+		return;
+	}
+	//the callback can send the next request or close the client
+	callback(arg, error, response, length, server);
+}
+
+/**
+ * Send requests again after "#busy" when the time has come. The requests on connections
+ * which have passed the timeout are sent to the next server, or finished with ETIMEDOUT
+ * (checked every INT_DISTCOM_TIMER_MSEC).
+ *
+ *	@param client	Client
+ */
+void checkDistcomTimers(distcomClient_t *client)
+{
+	int i, j;
+	long now = getDistcomMsec();
+	distcomRequest_t *expired = NULL;
+	distcomRequest_t **link = &client->delayed;
+	while(*link != NULL)
+	{
+		distcomRequest_t *request = *link;
+		if(request->notBeforeMsec <= now)
+		{
+			*link = request->next;
+			queueDistcomRequest(client, request, false);
+		}
+		else link = &request->next;
+	}
+	if(now >= client->nextCheckMsec)
+	{
+		client->nextCheckMsec = now + INT_DISTCOM_TIMER_MSEC;
+		for(i = 0; i < client->serverCount; i++)
+		{
+			distcomServer_t *server = &client->servers[i];
+			for(j = 0; j < INT_DISTCOM_MAX_CONNECTIONS; j++)
+			{
+				distcomConnection_t *conn = &server->connections[j];
+				if(conn->request == NULL || conn->request->deadlineMsec > now) continue;
+				//the response may arrive later, the connection cannot be used any more
+				conn->request->next = expired;
+				expired = conn->request;
+				conn->request = NULL;
+				closeDistcomConnection(conn);
+			}
+		}
+	}
+	//callbacks are called after the connections have been updated
+	while(expired != NULL)
+	{
+		distcomRequest_t *request = expired;
+		expired = request->next;
+		nextDistcomServer(client, request, ETIMEDOUT);
+	}
+}
+
+/**
+ * Get current time (CLOCK_MONOTONIC).
+ *
+ *	@return Current time (milli seconds)
+ */
+long getDistcomMsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+#endif
@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include "benchlib.h"
+#include "shmlib.h"
+
+/// Default number of measured requests per target
+#define INT_DEFAULT_LOAD_REQUESTS 2000
+/// Default number of connections (threads) per target
+#define INT_DEFAULT_LOAD_CONNECTIONS 1
+/// Max number of connections per target
+#define INT_MAX_LOAD_CONNECTIONS 64
+/// Number of requests each connection sends before measuring
+#define INT_LOAD_WARMUP_REQUESTS 20
+/// Default request
+#define STR_DEFAULT_LOAD_REQUEST "apple"
+/// Request option: keep the connection for the next request ("#k <request>")
+#define STR_OPT_KEEPALIVE "#k "
+/// Response header on kept-alive connection ("#size <response size>\n")
+#define STR_FRAME_HEADER "#size "
+/// Response of shared memory channel when the response is too large
+#define STR_STATUS_USE_TCP "#tcp"
+/// Receive buffer size
+#define INT_LOAD_BUFFER_SIZE 65536
+/// Max size of request
+#define INT_MAX_LOAD_REQUEST_SIZE 512
+/// Command line options (getopt)
+#define STR_OPTIONS "n:c:kfw:"
+/// Prefix of shared memory channel target ("shm:<name>")
+#define STR_SHM_TARGET "shm:"
+/// Command line usage
+#define STR_USAGE "Usage: ./distcomload [-n <requests>] [-c <connections>] [-k] [-f] [-w <request>] " \
+	"<host>:<port>|<socket path>|shm:<name> [...]\n" \
+	"  -n  the number of requests measured per target (default 2000)\n" \
+	"  -c  the number of connections sending requests in parallel (default 1)\n" \
+	"  -k  keep connections alive (\"#k\"), otherwise one connection per request\n" \
+	"      (shared memory channel of server -m does not use connections)\n" \
+	"  -f  send the request in SYN by TCP Fast Open (the first connection gets the cookie)\n" \
+	"  -w  request sent to the server (default \"apple\")\n"
+
+/// Server to be measured
+typedef struct loadTarget loadTarget_t;
+struct loadTarget
+{
+	/// target as given in command line
+	char *name;
+	/// TCP address or Unix domain socket address
+	struct sockaddr_storage addr;
+	socklen_t addrLength;
+	/// shared memory channel (NULL: socket is used)
+	shmChannel_t *shm;
+};
+
+/// Single connection (thread) sending requests
+typedef struct loadWorker loadWorker_t;
+struct loadWorker
+{
+	loadTarget_t *target;
+	/// the number of requests measured
+	int count;
+	/// latency of each request (nano seconds)
+	double *sample;
+	/// the number of failed requests
+	int errorCount;
+	/// kept-alive connection (-1: not connected)
+	int fd;
+	pthread_t thread;
+};
+
+//global variables
+/// The number of measured requests per target
+int gLoadRequests = INT_DEFAULT_LOAD_REQUESTS;
+/// The number of connections per target
+int gLoadConnections = INT_DEFAULT_LOAD_CONNECTIONS;
+/// true: connections are kept alive
+bool gIsKeepAlive;
+/// true: TCP connections are made by TCP Fast Open
+bool gIsFastOpen;
+/// Request sent to the server (with "#k " when gIsKeepAlive)
+char gLoadRequest[INT_MAX_LOAD_REQUEST_SIZE];
+
+
+/// Function definition
+void checkParameter(int, char**);
+bool resolveTarget(char*, loadTarget_t*);
+void runLoad(loadTarget_t*);
+void *loadWorker(void*);
+bool sendLoadRequest(loadWorker_t*, char*);
+int connectTarget(loadTarget_t*);
+bool receiveAll(int, char*);
+bool receiveFrame(int, char*);
+
+
+/**
+ * Main function.
+ *	Send the same request to each target and write single result line per target:
+ *	"load <target> requests=<n> conns=<c> keepalive=<0|1> fastopen=<0|1> errors=<n> median_us=<us>
+ *	p90_us=<us> p99_us=<us> rps=<requests per second>"
+ *	Run the same server on TCP, Unix domain socket (-x) and shared memory (-m) to compare
+ *	the transports.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user
+ */
+int main(int argc, char *argv[])
+{
+	int i;
+	checkParameter(argc, argv);
+	for(i = optind; i < argc; i++)
+	{
+		loadTarget_t target;
+		if(!resolveTarget(argv[i], &target))
+		{
+			printf("Invalid target: %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		runLoad(&target);
+		if(target.shm != NULL) closeShmChannel(target.shm);
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Check parameters.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user
+ */
+void checkParameter(int argc, char **argv)
+{
+	int opt;
+	char *request = STR_DEFAULT_LOAD_REQUEST;
+	while((opt = getopt(argc, argv, STR_OPTIONS)) != -1)
+	{
+		if(opt == 'n') gLoadRequests = atoi(optarg);
+		else if(opt == 'c') gLoadConnections = atoi(optarg);
+		else if(opt == 'k') gIsKeepAlive = true;
+		else if(opt == 'f') gIsFastOpen = true;
+		else if(opt == 'w') request = optarg;
+		else
+		{
+			printf("%s", STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(optind == argc || gLoadRequests <= 0 || gLoadConnections <= 0
+		|| gLoadConnections > INT_MAX_LOAD_CONNECTIONS
+		|| strlen(request) + strlen(STR_OPT_KEEPALIVE) >= INT_MAX_LOAD_REQUEST_SIZE)
+	{
+		printf("%s", STR_USAGE);
+		exit(EXIT_FAILURE);
+	}
+	sprintf(gLoadRequest, "%s%s", gIsKeepAlive ? STR_OPT_KEEPALIVE : "", request);
+}
+
+/**
+ * Get address of the target.
+ *
+ *	@param name		"<host>:<port>", Unix domain socket path (contains '/') or 
+ *					"shm:<name>" (shared memory channel of the server)
+ *	@param target	Target
+ *	@return false: invalid target
+ */
+bool resolveTarget(char *name, loadTarget_t *target)
+{
+	memset(target, 0, sizeof(loadTarget_t));
+	target->name = name;
+	if(strncmp(name, STR_SHM_TARGET, strlen(STR_SHM_TARGET)) == 0)
+	{
+		//"shm:/<name>" and "shm:<name>" are the same channel
+		char *channel = name + strlen(STR_SHM_TARGET);
+		if(channel[0] == '/') channel++;
+		char shmName[strlen(channel) + 2];
+		sprintf(shmName, "/%s", channel);
+		return (target->shm = openShmChannel(shmName)) != NULL;
+	}
+	if(strchr(name, '/') != NULL)
+	{
+		struct sockaddr_un *addr = (struct sockaddr_un *)&target->addr;
+		if(strlen(name) >= sizeof(addr->sun_path)) return false;
+		addr->sun_family = AF_UNIX;
+		strcpy(addr->sun_path, name);
+		target->addrLength = sizeof(struct sockaddr_un);
+		return true;
+	}
+	char host[strlen(name) + 1];
+	strcpy(host, name);
+	char *colon = strrchr(host, ':');
+	struct hostent *he;
+	if(colon == NULL) return false;
+	*colon = '\0';
+	if((he = gethostbyname(host)) == NULL) return false;
+	struct sockaddr_in *addr = (struct sockaddr_in *)&target->addr;
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(atoi(colon + 1));
+	addr->sin_addr = *((struct in_addr *)he->h_addr);
+	target->addrLength = sizeof(struct sockaddr_in);
+	return true;
+}
+
+/**
+ * Send requests to single target by gLoadConnections threads and write the result.
+ *
+ *	@param target	Target
+ */
+void runLoad(loadTarget_t *target)
+{
+	int i;
+	loadWorker_t workers[gLoadConnections];
+	double *sample = (double *)calloc(gLoadRequests, sizeof(double));
+	int offset = 0;
+	for(i = 0; i < gLoadConnections; i++)
+	{
+		//the rest of the requests are sent by the first threads
+		workers[i].target = target;
+		workers[i].count = gLoadRequests / gLoadConnections + (i < gLoadRequests % gLoadConnections);
+		workers[i].sample = sample + offset;
+		workers[i].errorCount = 0;
+		workers[i].fd = -1;
+		offset += workers[i].count;
+	}
+	double start = getBenchTimeNsec();
+	for(i = 0; i < gLoadConnections; i++) pthread_create(&workers[i].thread, NULL, loadWorker, &workers[i]);
+	int errorCount = 0;
+	for(i = 0; i < gLoadConnections; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		errorCount += workers[i].errorCount;
+	}
+	double elapsed = getBenchTimeNsec() - start;
+
+	qsort(sample, gLoadRequests, sizeof(double), compareBenchSample);
+	printf("load %s requests=%d conns=%d keepalive=%d fastopen=%d errors=%d median_us=%.1f p90_us=%.1f p99_us=%.1f rps=%.0f\n",
+		target->name, gLoadRequests, gLoadConnections, gIsKeepAlive, gIsFastOpen, errorCount,
+		sample[(gLoadRequests - 1) / 2] / 1000, sample[(gLoadRequests * 90 + 99) / 100 - 1] / 1000,
+		sample[(gLoadRequests * 99 + 99) / 100 - 1] / 1000, gLoadRequests / (elapsed / 1e9));
+	fflush(stdout);
+	free(sample);
+}
+
+/**
+ * Send requests of single connection. The first requests are not measured.
+ *
+ *	@param arg	Worker
+ */
+void *loadWorker(void *arg)
+{
+	loadWorker_t *worker = (loadWorker_t *)arg;
+	char *buf = (char *)malloc(INT_LOAD_BUFFER_SIZE);
+	int i;
+	for(i = 0; i < INT_LOAD_WARMUP_REQUESTS; i++) sendLoadRequest(worker, buf);
+	for(i = 0; i < worker->count; i++)
+	{
+		double start = getBenchTimeNsec();
+		if(!sendLoadRequest(worker, buf)) worker->errorCount++;
+		worker->sample[i] = getBenchTimeNsec() - start;
+	}
+	if(worker->fd != -1) close(worker->fd);
+	free(buf);
+	return NULL;
+}
+
+/**
+ * Send single request and receive the response.
+ *	On kept-alive connection, the connection is made again when it has been closed.
+ *	"#tcp" from shared memory channel (the response is too large) is counted as failure.
+ *
+ *	@param worker	Worker
+ *	@param buf		Receive buffer (INT_LOAD_BUFFER_SIZE)
+ *	@return false: the request failed
+ */
+bool sendLoadRequest(loadWorker_t *worker, char *buf)
+{
+	int length = strlen(gLoadRequest);
+	if(worker->target->shm != NULL)
+	{
+		length = requestShmChannel(worker->target->shm, gLoadRequest, buf, INT_LOAD_BUFFER_SIZE);
+		return length != -1 && strcmp(buf, STR_STATUS_USE_TCP) != 0;
+	}
+	if(worker->fd == -1 && (worker->fd = connectTarget(worker->target)) == -1) return false;
+	bool ret = send(worker->fd, gLoadRequest, length, MSG_NOSIGNAL) == length;
+	if(ret && gIsKeepAlive) ret = receiveFrame(worker->fd, buf);
+	else if(ret) ret = receiveAll(worker->fd, buf);
+	if(!ret || !gIsKeepAlive)
+	{
+		close(worker->fd);
+		worker->fd = -1;
+	}
+	return ret;
+}
+
+/**
+ * Connect to the target.
+ *	With -f, connect() returns at once when the client has the cookie of the server, and
+ *	SYN is sent with the request by the first send().
+ *
+ *	@param target	Target
+ *	@return Socket, -1 when failed
+ */
+int connectTarget(loadTarget_t *target)
+{
+	int fd;
+	int on = 1;
+	if((fd = socket(target->addr.ss_family, SOCK_STREAM, 0)) == -1) return -1;
+	if(gIsFastOpen && target->addr.ss_family == AF_INET)
+	{
+		setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+	}
+	if(connect(fd, (struct sockaddr *)&target->addr, target->addrLength) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Receive until the server closes the connection.
+ *
+ *	@param fd	Connection
+ *	@param buf	Receive buffer (the response is not kept)
+ *	@return false: nothing was received
+ */
+bool receiveAll(int fd, char *buf)
+{
+	long total = 0;
+	int numbytes;
+	while((numbytes = recv(fd, buf, INT_LOAD_BUFFER_SIZE, 0)) != 0)
+	{
+		if(numbytes == -1 && errno == EINTR) continue;
+		if(numbytes == -1) return false;
+		total += numbytes;
+	}
+	return total > 0;
+}
+
+/**
+ * Receive "#size <response size>\n" and the response on kept-alive connection.
+ *
+ *	@param fd	Connection
+ *	@param buf	Receive buffer (the response is not kept)
+ *	@return false: the connection is broken or the response is not framed ("#busy")
+ */
+bool receiveFrame(int fd, char *buf)
+{
+	long total = 0;
+	long frameEnd = -1;
+	int headerLength = 0;
+	while(frameEnd == -1 || total < frameEnd)
+	{
+		//only the header is kept at the beginning of buf
+		int offset = frameEnd == -1 ? total : 0;
+		if(offset >= INT_LOAD_BUFFER_SIZE - 1) return false;
+		int numbytes = recv(fd, buf + offset, INT_LOAD_BUFFER_SIZE - 1 - offset, 0);
+		if(numbytes == -1 && errno == EINTR) continue;
+		if(numbytes <= 0) return false;
+		total += numbytes;
+		if(frameEnd != -1) continue;
+		buf[total] = '\0';
+		char *newLine = strchr(buf, '\n');
+		if(newLine == NULL) continue;
+		if(strncmp(buf, STR_FRAME_HEADER, strlen(STR_FRAME_HEADER)) != 0) return false;
+		headerLength = newLine + 1 - buf;
+		frameEnd = headerLength + atol(buf + strlen(STR_FRAME_HEADER));
+	}
+	return true;
+}
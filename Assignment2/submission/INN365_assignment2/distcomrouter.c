@@ -0,0 +1,1976 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "applib.h"
+#include "matchlib.h"
+#include "lzlib.h"
+#include "statlib.h"
+#include "loglib.h"
+#include "timerlib.h"
+
+/// Default back log of listening socket (capped by net.core.somaxconn)
+#define INT_DEFAULT_LISTEN_BACKLOG 1024
+/// Maximum receive data size
+#define INT_MAX_RECV_DATA_SIZE 512
+/// Max int size
+#define INT_MAX_SIZE 10
+/// Character: " " (space)
+#define STR_SPACE " "
+/// Max number of shards
+#define INT_MAX_SHARDS 64
+/// Default number of worker threads
+#define INT_DEFAULT_WORKER_COUNT 16
+/// Default max time of single call to shard (milli seconds)
+#define INT_DEFAULT_SHARD_TIMEOUT_MSEC 2000
+/// Max time to receive request from/send response to client (milli seconds)
+/// (also the idle time of connection waiting for request in accepter)
+#define INT_CLIENT_TIMEOUT_MSEC 5000
+/// Max number of connections waiting for request in accepter
+#define INT_MAX_PENDING_CLIENTS 1024
+/// Retry time sent to client when the router has too many connections (milli seconds)
+#define INT_FULL_RETRY_MSEC 100
+/// Retry time sent to client when a shard is not available (milli seconds)
+#define INT_SHARD_DOWN_RETRY_MSEC 500
+/// Initial size of response buffer of single shard
+#define INT_INITIAL_RESPONSE_SIZE 4096
+/// The number of commas after food name in single food info line (measure and 5 numbers)
+#define INT_FIELD_COMMA_COUNT 6
+/// The number of food info read from shard at once when food is moved
+#define INT_DUMP_PAGE_COUNT 1000
+/// Max number of retries of a dump page when shard is busy or not available
+#define INT_MAX_DUMP_RETRY 5
+/// Command line options (getopt)
+#define STR_OPTIONS "m:e:t:n:l:L:"
+/// Command line usage
+#define STR_USAGE "Command line parameter error. Usage: ./distcomrouter [options] -m <shard map> <Port number> \n" \
+	"       ./distcomrouter -m <shard map> -e <lower bound> > calories.csv\n" \
+	"  -m <file>   shard map: one shard per line \"<host>:<port> <lower bound of food name>\"\n" \
+	"              (the first shard has \"-\"), SIGHUP reloads it and moves food to new owners\n" \
+	"  -e <bound>  write food info from <bound> to the next lower bound in csv (to seed new shard)\n" \
+	"  -t <ms>     max time of single call to shard (default 2000)\n" \
+	"  -n <count>  the number of worker threads (default 16)\n" \
+	"  -l <count>  back log of listening socket (default 1024)\n" \
+	"  -L <level>  log level: error, info or debug (default info)\n"
+/// Lower bound of the first shard in shard map
+#define STR_FIRST_BOUND "-"
+/// Header of csv written by -e
+#define STR_CSV_HEADER "# Food,Measure,Weight (g),kCal,Fat (g),Carbo(g),Protein (g)\n"
+
+/// Request option: client accepts compressed response ("#z <request>")
+#define STR_OPT_COMPRESS "#z "
+/// Request option flag: compress
+#define INT_OPTION_COMPRESS 0x01
+/// Response header of compressed data ("#lz4 <original size> <compressed size>\n")
+#define STR_COMPRESS_HEADER "#lz4 "
+/// Max length of compressed data header
+#define INT_MAX_COMPRESS_HEADER_SIZE 32
+/// Responses larger than this size are compressed
+#define INT_COMPRESS_THRESHOLD 1024
+/// Request option: keep the connection for the next request ("#k <request>")
+#define STR_OPT_KEEPALIVE "#k "
+/// Request option flag: keep-alive
+#define INT_OPTION_KEEPALIVE 0x02
+/// Response header on kept-alive connection ("#size <response size>\n")
+#define STR_FRAME_HEADER "#size "
+/// Max length of response header on kept-alive connection
+#define INT_MAX_FRAME_HEADER_SIZE 32
+/// Request option: catalog version ("#v <request>"), not supported by router
+#define STR_OPT_VERSION "#v "
+/// Request option: "#if <version> <request>", not supported by router
+#define STR_OPT_IF_VERSION "#if "
+/// Request prefix: autocomplete ("#complete <count> <partial name>")
+#define STR_CMD_COMPLETE "#complete "
+/// Default number of names returned by autocomplete
+#define INT_DEFAULT_COMPLETE_COUNT 10
+/// Max number of names returned by autocomplete
+#define INT_MAX_COMPLETE_COUNT 50
+/// Max autocomplete response size
+#define INT_MAX_COMPLETE_DATA_SIZE 1400
+/// Request prefix: pagination ("#page <limit> <cursor> <food name>")
+#define STR_CMD_PAGE "#page "
+/// Request prefix: exact match ("#exact <food name>")
+#define STR_CMD_EXACT "#exact "
+/// Response trailer: cursor of the next page ("#next <cursor>")
+#define STR_PAGE_NEXT "#next "
+/// Cursor of the first page
+#define STR_PAGE_FIRST "-"
+/// Default number of food info in a page
+#define INT_DEFAULT_PAGE_COUNT 20
+/// Max number of food info in a page
+#define INT_MAX_PAGE_COUNT 100
+/// Max length of cursor
+#define INT_MAX_CURSOR_SIZE 64
+/// Request: stats
+#define STR_CMD_STATS "#stats"
+/// Request prefix: dump ("#dump <limit> <cursor> <lower case name to start from>", shard returns
+///	"#next <cursor> <name>" to resume from)
+#define STR_CMD_DUMP "#dump "
+/// Response when server is busy ("#busy <retry after milli seconds>")
+#define STR_STATUS_BUSY "#busy "
+/// Hit count of status reply (response is sent as it is)
+#define INT_HIT_COUNT_STATUS -2
+
+/// Single shard. It has the food whose lower case name is in
+/// [lowerBound, lowerBound of the next shard).
+typedef struct shard shard_t;
+struct shard
+{
+	/// lower case name ("" for the first shard)
+	char *lowerBound;
+	/// "<host>:<port>" written in shard map
+	char *address;
+	struct sockaddr_in addr;
+};
+
+/// Shards ordered by lower bound. Replaced as a whole when shard map is reloaded.
+typedef struct shardMap shardMap_t;
+struct shardMap
+{
+	shard_t shards[INT_MAX_SHARDS];
+	int count;
+	/// incremented by reload (page cursors of the previous map become stale)
+	unsigned int generation;
+	/// the number of requests using this map (freed when 0 after replaced)
+	int refCount;
+};
+
+/// Single request to shard and its response
+typedef struct shardCall shardCall_t;
+struct shardCall
+{
+	int shardIndex;
+	int fd;
+	char *request;
+	int sent;
+	/// response ('\0' terminated)
+	char *response;
+	int length;
+	int capacity;
+};
+
+/// Connection waiting for request in accepter
+typedef struct pendingClient pendingClient_t;
+struct pendingClient
+{
+	int fd;
+	/// true: kept-alive connection returned by worker
+	bool isReused;
+	/// idle deadline
+	timerEntry_t timer;
+	/// position in gPollList
+	int pollIndex;
+};
+
+/// Food info line in shard response
+typedef struct resultRow resultRow_t;
+struct resultRow
+{
+	/// line without '\n' (points into shard response)
+	char *line;
+	char *lowerName;
+	/// order of the line in all responses (keeps order of the same name)
+	int order;
+};
+
+/// Rows collected from shards
+typedef struct rowList rowList_t;
+struct rowList
+{
+	resultRow_t *rows;
+	int count;
+	int capacity;
+};
+
+/// Listening port number
+int gPortNum;
+/// Shard map file
+char *gShardMapPath;
+/// Lower bound to be exported by -e (NULL: serve clients)
+char *gExportBound;
+/// Max time of single call to shard (milli seconds)
+int gShardTimeoutMsec = INT_DEFAULT_SHARD_TIMEOUT_MSEC;
+/// The number of worker threads
+int gWorkerCount = INT_DEFAULT_WORKER_COUNT;
+/// Back log of listening socket (-l)
+int gListenBacklog = INT_DEFAULT_LISTEN_BACKLOG;
+/// Shard map in use
+shardMap_t *gShardMap;
+/// Server log header: info
+char STR_PRINT_INFO[] = "[info ]";
+/// Server log header: error
+char STR_PRINT_ERR[]  = "[error]";
+/// No food found
+char STR_NO_FOOD_FOUND[] = "0";
+/// Message from shard when food info is successfully added
+char STR_ADD_STATUS_SUCCESS[] = "success";
+/// Message when the page cursor is no longer valid
+char STR_PAGE_STATUS_STALE[] = "#stale";
+
+/// socket information
+int sockfd;
+/// Pipe to wake up accepter when workers return kept-alive connections
+int gWakePipe[2];
+/// Poll list of accepter (listening socket, wake pipe and pending clients)
+struct pollfd *gPollList;
+/// Pending client of each entry in gPollList (NULL for listening socket and wake pipe)
+pendingClient_t **gPendingList;
+/// The number of entries in gPollList
+int gPollCount;
+/// Unused pending client entries
+pendingClient_t **gPendingFreeList;
+int gPendingFreeCount;
+/// Idle deadlines of pending clients
+timerWheel_t gIdleTimers;
+/// Kept-alive connections returned by workers (moved to gPollList by accepter)
+int *gReturnList;
+/// The number of entries in gReturnList
+int gReturnCount;
+/// Connections which have a request, served by workers (ring buffer)
+int *gClientQueue;
+int gQueueHead;
+int gQueueCount;
+
+//pthread object
+pthread_mutex_t mapMutex;
+/// Lock of gClientQueue and gReturnList
+pthread_mutex_t queueMutex;
+/// The number of connections in gClientQueue
+sem_t full;
+pthread_t *pIdList;
+pthread_t acceptThread;
+
+
+/// Function definition
+void checkParameter(int, char**);
+void initializeSocket(int*, char*);
+shardMap_t *loadShardMap(char*);
+shardMap_t *acquireShardMap();
+void releaseShardMap(shardMap_t*);
+void reloadShardMap();
+int findShard(shardMap_t*, char*);
+bool isInShard(shardMap_t*, int, char*);
+int findCandidateShards(shardMap_t*, char*, int*);
+bool serveClient(int);
+void acceptClient();
+void dispatchClient(int);
+void returnClient(int);
+void acceptReturned();
+void initializePending();
+void addPending(int, bool);
+void removePending(pendingClient_t*);
+void sendBusy(int);
+char *handleRequest(char*, int*);
+char *routeSearch(shardMap_t*, char*, int*);
+char *routeAdd(shardMap_t*, char*, int*);
+char *routeComplete(shardMap_t*, char*, int*);
+char *routePage(shardMap_t*, char*, int*);
+char *routeExact(shardMap_t*, char*, int*);
+bool callShards(shardMap_t*, shardCall_t*, int);
+char *callShard(shardMap_t*, int, char*);
+void freeShardCalls(shardCall_t*, int);
+int getBusyMsec(char*);
+char *createBusyText(int);
+char *createStatusText(char*);
+void collectRows(shardMap_t*, int, char*, rowList_t*, char**);
+void freeRows(rowList_t*);
+char *joinRows(rowList_t*, char*);
+void getLowerName(char*, char*, int);
+void convertToLowerChar(char*, char*);
+int compareRow(const void*, const void*);
+int compareLine(const void*, const void*);
+int dumpRange(shardMap_t*, int, char*, char*, char***);
+void exportRange(shardMap_t*, char*);
+void moveFood(shardMap_t*, shardMap_t*);
+void moveRange(shardMap_t*, int, shardMap_t*, int, char*, char*);
+bool sendResponse(int, char*, int, int);
+bool sendFrame(int, char*, int, int);
+bool sendAll(int, char*, int);
+void setSocketTimeouts(int, int);
+long getElapsedUsec(struct timespec*);
+
+/// pthread functions
+void *accepter();
+void *worker();
+
+
+/**
+ * Main function.
+ *	Load shard map, start accepter and workers and wait for signals.
+ *	SIGHUP reloads shard map, SIGINT stops the router.
+ *	With -e, food info of a range is written in csv and the process exits.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user
+ */
+int main(int argc, char *argv[])
+{
+	checkParameter(argc, argv);
+	pthread_mutex_init(&mapMutex, NULL);
+	if((gShardMap = loadShardMap(gShardMapPath)) == NULL) exit(EXIT_FAILURE);
+	gShardMap->refCount = 1;
+	if(gExportBound != NULL)
+	{
+		exportRange(gShardMap, gExportBound);
+		return 0;
+	}
+
+	initializeSocket(&sockfd, argv[optind]);
+	printf("%s %d shards, shard timeout = %dms \n", STR_PRINT_INFO, gShardMap->count, gShardTimeoutMsec);
+	initializeStats();
+	fflush(stdout);
+	initializeLog(gLogLevel);
+
+	//signals are received only by sigwait() below
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_mutex_init(&queueMutex, NULL);
+	sem_init(&full, 0, 0);
+	if(pipe(gWakePipe) == -1)
+	{
+		logError("pipe() failed. Error code = %d (%s)", errno, strerror(errno));
+		stopLog();
+		exit(EXIT_FAILURE);
+	}
+	initializePending();
+
+	int i;
+	pIdList = (pthread_t *)calloc(gWorkerCount, sizeof(pthread_t));
+	for(i = 0; i < gWorkerCount; i++)
+	{
+		pthread_create(&pIdList[i], NULL, worker, NULL);
+	}
+	pthread_create(&acceptThread, NULL, accepter, NULL);
+
+	while(true)
+	{
+		int signalNumber;
+		if(sigwait(&signals, &signalNumber) != 0) continue;
+		if(signalNumber == SIGHUP)
+		{
+			reloadShardMap();
+			continue;
+		}
+		logInfo("Router stopped.");
+		stopLog();
+		exit(0);
+	}
+}
+
+/**
+ * Route requests of connections passed by accepter.
+ *	Kept-alive connection is returned to accepter after each response,
+ *	so a worker is not held by a client between its requests.
+ */
+void *worker()
+{
+	int clientFd;
+
+	while(true)
+	{
+		sem_wait(&full);
+		pthread_mutex_lock(&queueMutex);
+		clientFd = gClientQueue[gQueueHead];
+		gQueueHead = (gQueueHead + 1) % INT_MAX_PENDING_CLIENTS;
+		gQueueCount--;
+		pthread_mutex_unlock(&queueMutex);
+		if(serveClient(clientFd)) returnClient(clientFd);
+		else close(clientFd);
+	}
+	return NULL;
+}
+
+/**
+ * Accept clients and wait for their requests.
+ *	poll() blocks until a connection comes, a request arrives, an idle deadline
+ *	comes or a worker returns kept-alive connection.
+ *	For every readable connection, a worker serves it.
+ */
+void *accepter()
+{
+	int i;
+	pendingClient_t *pending;
+	timerEntry_t *timer;
+
+	while(true)
+	{
+		int timeout = getTimerWaitMsec(&gIdleTimers, getMonotonicMsec());
+		if(poll(gPollList, gPollCount, timeout) == -1)
+		{
+			if(errno != EINTR) logError("poll() error. Error code = %d (%s)", errno, strerror(errno));
+			continue;
+		}
+		if(gPollList[1].revents & POLLIN)
+		{
+			char wake[INT_MAX_SIZE];
+			read(gWakePipe[0], wake, sizeof(wake));
+			acceptReturned();
+		}
+
+		//pass readable (or closed) connections to workers.
+		//removePending() moves the last entry, so check from the end
+		for(i = gPollCount - 1; i >= 2; i--)
+		{
+			if(gPollList[i].revents == 0) continue;
+			pending = gPendingList[i];
+			int fd = pending->fd;
+			removePending(pending);
+			dispatchClient(fd);
+		}
+
+		//close connections which sent nothing within the idle timeout
+		for(timer = expireTimers(&gIdleTimers, getMonotonicMsec()); timer != NULL; timer = timer->next)
+		{
+			pending = (pendingClient_t *)timer->data;
+			//kept-alive connection which is not used any more is not an error
+			if(!pending->isReused) statCount(STAT_COUNT_TIMEOUT);
+			close(pending->fd);
+			removePending(pending);
+		}
+
+		if(gPollList[0].revents & POLLIN) acceptClient();
+	}
+	return NULL;
+}
+
+/**
+ * Accept connection and wait for its request.
+ */
+void acceptClient()
+{
+	struct sockaddr_in clientAddr;
+	socklen_t size = sizeof(clientAddr);
+	int clientFd;
+	if((clientFd = accept(sockfd, (struct sockaddr *)&clientAddr, &size)) == -1)
+	{
+		if(errno != EINTR) logError("accept() error. Error code = %d (%s)", errno, strerror(errno));
+		return;
+	}
+	logDebug("Connection from %s", inet_ntoa(clientAddr.sin_addr));
+	if(gPendingFreeCount == 0)
+	{
+		logInfo("Too many connections. Reject %s", inet_ntoa(clientAddr.sin_addr));
+		statCount(STAT_COUNT_REJECT_FULL);
+		sendBusy(clientFd);
+		close(clientFd);
+		return;
+	}
+	addPending(clientFd, false);
+}
+
+/**
+ * Pass connection which has a request to workers.
+ *	The queue has as many entries as pending clients, so it is never full.
+ *
+ *	@param fd	Socket of the client
+ */
+void dispatchClient(int fd)
+{
+	pthread_mutex_lock(&queueMutex);
+	gClientQueue[(gQueueHead + gQueueCount) % INT_MAX_PENDING_CLIENTS] = fd;
+	gQueueCount++;
+	pthread_mutex_unlock(&queueMutex);
+	sem_post(&full);
+}
+
+/**
+ * Return kept-alive connection to accepter to wait for the next request.
+ *	Accepter is woken up when the list was empty.
+ *
+ *	@param fd	Socket of the client
+ */
+void returnClient(int fd)
+{
+	pthread_mutex_lock(&queueMutex);
+	if(gReturnCount == INT_MAX_PENDING_CLIENTS)
+	{
+		pthread_mutex_unlock(&queueMutex);
+		close(fd);
+		return;
+	}
+	gReturnList[gReturnCount] = fd;
+	bool isWake = gReturnCount++ == 0;
+	pthread_mutex_unlock(&queueMutex);
+	if(isWake) write(gWakePipe[1], "r", 1);
+}
+
+/**
+ * Move connections returned by workers to the poll list of accepter.
+ *	Called only by accepter.
+ */
+void acceptReturned()
+{
+	int i;
+	pthread_mutex_lock(&queueMutex);
+	for(i = 0; i < gReturnCount; i++)
+	{
+		if(gPendingFreeCount == 0) close(gReturnList[i]);
+		else addPending(gReturnList[i], true);
+	}
+	gReturnCount = 0;
+	pthread_mutex_unlock(&queueMutex);
+}
+
+/**
+ * Initialize poll list of accepter, pending client entries and queue of workers.
+ *	gPollList[0] is listening socket and gPollList[1] is wake pipe.
+ */
+void initializePending()
+{
+	int i;
+	gPollList = (struct pollfd *)calloc(INT_MAX_PENDING_CLIENTS + 2, sizeof(struct pollfd));
+	gPendingList = (pendingClient_t **)calloc(INT_MAX_PENDING_CLIENTS + 2, sizeof(pendingClient_t *));
+	gPendingFreeList = (pendingClient_t **)calloc(INT_MAX_PENDING_CLIENTS, sizeof(pendingClient_t *));
+	pendingClient_t *entries = (pendingClient_t *)calloc(INT_MAX_PENDING_CLIENTS, sizeof(pendingClient_t));
+	for(i = 0; i < INT_MAX_PENDING_CLIENTS; i++)
+	{
+		gPendingFreeList[i] = &entries[i];
+	}
+	gPendingFreeCount = INT_MAX_PENDING_CLIENTS;
+	gReturnList = (int *)calloc(INT_MAX_PENDING_CLIENTS, sizeof(int));
+	gReturnCount = 0;
+	gClientQueue = (int *)calloc(INT_MAX_PENDING_CLIENTS, sizeof(int));
+	gQueueHead = 0;
+	gQueueCount = 0;
+	gPollList[0].fd = sockfd;
+	gPollList[0].events = POLLIN;
+	gPollList[1].fd = gWakePipe[0];
+	gPollList[1].events = POLLIN;
+	gPollCount = 2;
+	initializeTimerWheel(&gIdleTimers);
+}
+
+/**
+ * Start waiting for request of the client. Caller has to check gPendingFreeCount.
+ *
+ *	@param fd		Socket of the client
+ *	@param isReused	true: kept-alive connection returned by worker
+ */
+void addPending(int fd, bool isReused)
+{
+	pendingClient_t *pending = gPendingFreeList[--gPendingFreeCount];
+	pending->fd = fd;
+	pending->isReused = isReused;
+	pending->pollIndex = gPollCount;
+	gPollList[gPollCount].fd = fd;
+	gPollList[gPollCount].events = POLLIN;
+	gPollList[gPollCount].revents = 0;
+	gPendingList[gPollCount] = pending;
+	gPollCount++;
+	addTimer(&gIdleTimers, &pending->timer, getMonotonicMsec() + INT_CLIENT_TIMEOUT_MSEC, pending);
+}
+
+/**
+ * Stop waiting for request of the client. The socket is not closed.
+ *	The last entry of gPollList is moved to the removed position.
+ *
+ *	@param pending	Pending client
+ */
+void removePending(pendingClient_t *pending)
+{
+	int last = gPollCount - 1;
+	int index = pending->pollIndex;
+	removeTimer(&gIdleTimers, &pending->timer);
+	gPollList[index] = gPollList[last];
+	gPendingList[index] = gPendingList[last];
+	gPendingList[index]->pollIndex = index;
+	gPollCount--;
+	gPendingFreeList[gPendingFreeCount++] = pending;
+}
+
+/**
+ * Send "#busy <retry after milli seconds>" to client.
+ *
+ *	@param fd	Socket of the client
+ */
+void sendBusy(int fd)
+{
+	char data[INT_MAX_SIZE + sizeof(STR_STATUS_BUSY)];
+	int length = sprintf(data, "%s%d", STR_STATUS_BUSY, INT_FULL_RETRY_MSEC);
+	//do not wait for slow client
+	send(fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/**
+ * Receive single request, route it to shards and send the response.
+ *
+ *	@param fd	Socket of the client
+ *	@return true: the client keeps the connection for the next request
+ */
+bool serveClient(int fd)
+{
+	struct timespec acceptTime;
+	struct timespec stageStart;
+	char recvData[INT_MAX_RECV_DATA_SIZE];
+	int option = 0;
+	int hitCount = 0;
+	clock_gettime(CLOCK_MONOTONIC, &acceptTime);
+	setSocketTimeouts(fd, INT_CLIENT_TIMEOUT_MSEC);
+
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	int recvSize = recv(fd, recvData, INT_MAX_RECV_DATA_SIZE - 1, 0);
+	statRecord(STAT_STAGE_RECV, getElapsedUsec(&stageStart));
+	if(recvSize <= 0)
+	{
+		if(recvSize == -1) statCount(errno == EAGAIN ? STAT_COUNT_TIMEOUT : STAT_COUNT_ERROR);
+		return false;
+	}
+	recvData[recvSize] = '\0';
+	while(true)
+	{
+		int optionLength = 0;
+		if(strncmp(recvData, STR_OPT_COMPRESS, strlen(STR_OPT_COMPRESS)) == 0)
+		{
+			option |= INT_OPTION_COMPRESS;
+			optionLength = strlen(STR_OPT_COMPRESS);
+		}
+		else if(strncmp(recvData, STR_OPT_KEEPALIVE, strlen(STR_OPT_KEEPALIVE)) == 0)
+		{
+			option |= INT_OPTION_KEEPALIVE;
+			optionLength = strlen(STR_OPT_KEEPALIVE);
+		}
+		else if(strncmp(recvData, STR_OPT_VERSION, strlen(STR_OPT_VERSION)) == 0)
+		{
+			//shards have their own versions, so the response is sent without version
+			//and the client does not cache it
+			optionLength = strlen(STR_OPT_VERSION);
+		}
+		else if(strncmp(recvData, STR_OPT_IF_VERSION, strlen(STR_OPT_IF_VERSION)) == 0
+			&& sscanf(recvData + strlen(STR_OPT_IF_VERSION), "%*u %n", &optionLength) == 0
+			&& optionLength > 0)
+		{
+			optionLength += strlen(STR_OPT_IF_VERSION);
+		}
+		else break;
+		memmove(recvData, recvData + optionLength, strlen(recvData) - optionLength + 1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	char *response = handleRequest(recvData, &hitCount);
+	statRecord(STAT_STAGE_SEARCH, getElapsedUsec(&stageStart));
+	statCount(STAT_COUNT_REQUEST);
+	if(hitCount > 0) statCount(STAT_COUNT_HIT);
+	else if(hitCount == 0) statCount(STAT_COUNT_MISS);
+
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	bool isSent = sendResponse(fd, response, hitCount, option);
+	statRecord(STAT_STAGE_SEND, getElapsedUsec(&stageStart));
+	statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&acceptTime));
+	free(response);
+	return isSent && (option & INT_OPTION_KEEPALIVE);
+}
+
+/**
+ * Route single request with the current shard map.
+ *
+ *	@param recvData	Request data (options are already removed)
+ *	@param hitCount	The number of food info found
+ *					(-1: food added, INT_HIT_COUNT_STATUS: the response is status reply)
+ *	@return Response data (has to be freed by caller)
+ */
+char *handleRequest(char *recvData, int *hitCount)
+{
+	char *response;
+	*hitCount = 0;
+	if(strcmp(recvData, STR_CMD_STATS) == 0)
+	{
+		//stats of the router itself
+		response = (char *)calloc(INT_STAT_TEXT_SIZE, sizeof(char));
+		createStatsText(response, INT_STAT_TEXT_SIZE);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return response;
+	}
+
+	if(strncmp(recvData, STR_CMD_DUMP, strlen(STR_CMD_DUMP)) == 0)
+	{
+		//dump is sent to each shard by the router itself
+		return createStatusText(STR_NO_FOOD_FOUND);
+	}
+
+	shardMap_t *map = acquireShardMap();
+	if(strchr(recvData, '\n') != NULL) response = routeAdd(map, recvData, hitCount);
+	else if(strncmp(recvData, STR_CMD_COMPLETE, strlen(STR_CMD_COMPLETE)) == 0)
+	{
+		response = routeComplete(map, recvData + strlen(STR_CMD_COMPLETE), hitCount);
+	}
+	else if(strncmp(recvData, STR_CMD_PAGE, strlen(STR_CMD_PAGE)) == 0)
+	{
+		response = routePage(map, recvData + strlen(STR_CMD_PAGE), hitCount);
+	}
+	else if(strncmp(recvData, STR_CMD_EXACT, strlen(STR_CMD_EXACT)) == 0)
+	{
+		response = routeExact(map, recvData, hitCount);
+	}
+	else response = routeSearch(map, recvData, hitCount);
+	releaseShardMap(map);
+
+	logInfo("Request = %s, Hit = %d", recvData, *hitCount);
+	return response;
+}
+
+/**
+ * Search on the shards whose range can have names starting with the search word,
+ *	and merge the results in the order of lower case name.
+ *
+ *	@param map			Shard map
+ *	@param searchWord	Search word
+ *	@param hitCount		The number of food info found
+ *	@return Response data (has to be freed by caller)
+ */
+char *routeSearch(shardMap_t *map, char *searchWord, int *hitCount)
+{
+	//all matched names start with the prepared word (lower case, without the last comma)
+	foodquery_t query;
+	prepareFoodQuery(&query, searchWord);
+	int indexes[INT_MAX_SHARDS];
+	int count = query.length > 0 ? findCandidateShards(map, query.word, indexes) : 0;
+	if(count == 0) return createStatusText(STR_NO_FOOD_FOUND);
+
+	int i;
+	shardCall_t calls[count];
+	for(i = 0; i < count; i++)
+	{
+		calls[i].shardIndex = indexes[i];
+		calls[i].request = searchWord;
+	}
+	int busyMsec = callShards(map, calls, count) ? 0 : INT_SHARD_DOWN_RETRY_MSEC;
+	for(i = 0; i < count && busyMsec == 0; i++)
+	{
+		busyMsec = getBusyMsec(calls[i].response);
+	}
+	if(busyMsec > 0)
+	{
+		//partial result is never returned, the client retries
+		freeShardCalls(calls, count);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return createBusyText(busyMsec);
+	}
+
+	rowList_t list = {NULL, 0, 0};
+	for(i = 0; i < count; i++)
+	{
+		collectRows(map, calls[i].shardIndex, calls[i].response, &list, NULL);
+	}
+	//each shard returns its own csv order, so all rows are sorted here
+	qsort(list.rows, list.count, sizeof(resultRow_t), compareRow);
+	*hitCount = list.count;
+	char *response = list.count > 0 ? joinRows(&list, NULL) : createStatusText(STR_NO_FOOD_FOUND);
+	freeRows(&list);
+	freeShardCalls(calls, count);
+	return response;
+}
+
+/**
+ * Send new food info to the shard which owns the name.
+ *
+ *	@param map		Shard map
+ *	@param request	"<csv line>\na"
+ *	@param hitCount	-1 (status of the shard is returned as it is)
+ *	@return Response data (has to be freed by caller)
+ */
+char *routeAdd(shardMap_t *map, char *request, int *hitCount)
+{
+	char lowerName[MAX_LINE_BUFFER];
+	char line[INT_MAX_RECV_DATA_SIZE];
+	strcpy(line, request);
+	line[strcspn(line, STR_CR)] = '\0';
+	getLowerName(line, lowerName, sizeof(lowerName));
+
+	*hitCount = -1;
+	int index = findShard(map, lowerName);
+	char *response = callShard(map, index, request);
+	if(response == NULL)
+	{
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return createBusyText(INT_SHARD_DOWN_RETRY_MSEC);
+	}
+	logDebug("routeAdd() %s -> %s", lowerName, map->shards[index].address);
+	return response;
+}
+
+/**
+ * Send exact match to the shard which owns the name (the name is in single shard).
+ *
+ *	@param map		Shard map
+ *	@param request	"#exact <food name>"
+ *	@param hitCount	The number of food info found
+ *	@return Response data (has to be freed by caller)
+ */
+char *routeExact(shardMap_t *map, char *request, int *hitCount)
+{
+	char lowerName[INT_MAX_RECV_DATA_SIZE];
+	convertToLowerChar(request + strlen(STR_CMD_EXACT), lowerName);
+
+	int index = findShard(map, lowerName);
+	shardCall_t call;
+	call.shardIndex = index;
+	call.request = request;
+	int busyMsec = callShards(map, &call, 1) ? getBusyMsec(call.response) : INT_SHARD_DOWN_RETRY_MSEC;
+	if(busyMsec > 0)
+	{
+		freeShardCalls(&call, 1);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return createBusyText(busyMsec);
+	}
+
+	rowList_t list = {NULL, 0, 0};
+	collectRows(map, index, call.response, &list, NULL);
+	*hitCount = list.count;
+	char *response = list.count > 0 ? joinRows(&list, NULL) : createStatusText(STR_NO_FOOD_FOUND);
+	freeRows(&list);
+	freeShardCalls(&call, 1);
+	logDebug("routeExact() %s -> %s", lowerName, map->shards[index].address);
+	return response;
+}
+
+/**
+ * Autocomplete on the shards whose range can have names starting with the prefix.
+ *	Names of each shard are sorted and ranges are ordered, so the names are merged
+ *	by taking the shards in order.
+ *
+ *	@param map		Shard map
+ *	@param args		"<count> <partial name>"
+ *	@param hitCount	The number of names
+ *	@return Response data (has to be freed by caller)
+ */
+char *routeComplete(shardMap_t *map, char *args, int *hitCount)
+{
+	int maxCount = atoi(args);
+	if(maxCount <= 0) maxCount = INT_DEFAULT_COMPLETE_COUNT;
+	if(maxCount > INT_MAX_COMPLETE_COUNT) maxCount = INT_MAX_COMPLETE_COUNT;
+	char *prefix = strchr(args, STR_SPACE[0]);
+	if(prefix == NULL) return createStatusText(STR_NO_FOOD_FOUND);
+	prefix++;
+
+	char lowerPrefix[strlen(prefix) + 1];
+	convertToLowerChar(prefix, lowerPrefix);
+	int indexes[INT_MAX_SHARDS];
+	int count = findCandidateShards(map, lowerPrefix, indexes);
+	if(count == 0) return createStatusText(STR_NO_FOOD_FOUND);
+
+	int i;
+	char request[INT_MAX_RECV_DATA_SIZE];
+	snprintf(request, sizeof(request), "%s%d %s", STR_CMD_COMPLETE, maxCount, prefix);
+	shardCall_t calls[count];
+	for(i = 0; i < count; i++)
+	{
+		calls[i].shardIndex = indexes[i];
+		calls[i].request = request;
+	}
+	int busyMsec = callShards(map, calls, count) ? 0 : INT_SHARD_DOWN_RETRY_MSEC;
+	for(i = 0; i < count && busyMsec == 0; i++)
+	{
+		busyMsec = getBusyMsec(calls[i].response);
+	}
+	if(busyMsec > 0)
+	{
+		freeShardCalls(calls, count);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return createBusyText(busyMsec);
+	}
+
+	char *response = (char *)calloc(INT_MAX_COMPLETE_DATA_SIZE + 1, sizeof(char));
+	char lowerName[MAX_LINE_BUFFER];
+	char lastName[MAX_LINE_BUFFER] = "";
+	int length = 0;
+	int nameCount = 0;
+	for(i = 0; i < count && nameCount < maxCount; i++)
+	{
+		if(strcmp(calls[i].response, STR_NO_FOOD_FOUND) == 0) continue;
+		char *savePtr;
+		char *name = strtok_r(calls[i].response, STR_CR, &savePtr);
+		for(; name != NULL && nameCount < maxCount; name = strtok_r(NULL, STR_CR, &savePtr))
+		{
+			convertToLowerChar(name, lowerName);
+			if(!isInShard(map, calls[i].shardIndex, lowerName) || strcmp(lowerName, lastName) == 0) continue;
+			int nameLength = strlen(name);
+			if(length + nameLength + 1 > INT_MAX_COMPLETE_DATA_SIZE) break;
+			memcpy(response + length, name, nameLength);
+			length += nameLength;
+			response[length++] = STR_CR[0];
+			strcpy(lastName, lowerName);
+			nameCount++;
+		}
+	}
+	freeShardCalls(calls, count);
+	*hitCount = nameCount;
+	if(nameCount > 0) return response;
+	free(response);
+	return createStatusText(STR_NO_FOOD_FOUND);
+}
+
+/**
+ * Get a single page from the shards in order of range.
+ *	Router cursor is "<map generation>.<shard index>.<shard cursor>", so the next page
+ *	starts from the shard and its cursor. The cursor becomes stale when the map is reloaded.
+ *
+ *	@param map		Shard map
+ *	@param args		"<limit> <cursor> <food name>"
+ *	@param hitCount	The number of food info in the page
+ *	@return Response data (has to be freed by caller)
+ */
+char *routePage(shardMap_t *map, char *args, int *hitCount)
+{
+	int maxCount = atoi(args);
+	if(maxCount <= 0) maxCount = INT_DEFAULT_PAGE_COUNT;
+	if(maxCount > INT_MAX_PAGE_COUNT) maxCount = INT_MAX_PAGE_COUNT;
+	char *cursor = strchr(args, STR_SPACE[0]);
+	char *word = cursor == NULL ? NULL : strchr(cursor + 1, STR_SPACE[0]);
+	if(word == NULL || word[1] == '\0') return createStatusText(STR_NO_FOOD_FOUND);
+	cursor++;
+	*word++ = '\0';
+
+	foodquery_t query;
+	prepareFoodQuery(&query, word);
+	int indexes[INT_MAX_SHARDS];
+	int count = findCandidateShards(map, query.word, indexes);
+
+	//find the shard to start from
+	int position = 0;
+	char shardCursor[INT_MAX_CURSOR_SIZE];
+	strcpy(shardCursor, STR_PAGE_FIRST);
+	if(strcmp(cursor, STR_PAGE_FIRST) != 0)
+	{
+		unsigned int generation;
+		int index;
+		int offset;
+		if(sscanf(cursor, "%x.%x.%n", &generation, &index, &offset) != 2 || generation != map->generation
+			|| strlen(cursor + offset) >= INT_MAX_CURSOR_SIZE)
+		{
+			*hitCount = INT_HIT_COUNT_STATUS;
+			return createStatusText(STR_PAGE_STATUS_STALE);
+		}
+		strcpy(shardCursor, cursor + offset);
+		while(position < count && indexes[position] != index) position++;
+	}
+
+	rowList_t list = {NULL, 0, 0};
+	char *responses[INT_MAX_SHARDS * 2];
+	int responseCount = 0;
+	char *response = NULL;
+	char nextCursor[INT_MAX_CURSOR_SIZE * 2] = "";
+	while(position < count)
+	{
+		char request[INT_MAX_RECV_DATA_SIZE];
+		char *next = NULL;
+		int index = indexes[position];
+		if(responseCount == INT_MAX_SHARDS * 2)
+		{
+			//too many food out of range, the rest is in the next page
+			snprintf(nextCursor, sizeof(nextCursor), "%x.%x.%s", map->generation, index, shardCursor);
+			break;
+		}
+		snprintf(request, sizeof(request), "%s%d %s %s", STR_CMD_PAGE, maxCount - list.count, shardCursor, word);
+		char *shardResponse = callShard(map, index, request);
+		if(shardResponse == NULL || getBusyMsec(shardResponse) > 0
+			|| strcmp(shardResponse, STR_PAGE_STATUS_STALE) == 0)
+		{
+			if(shardResponse == NULL) response = createBusyText(INT_SHARD_DOWN_RETRY_MSEC);
+			else if(getBusyMsec(shardResponse) > 0) response = createBusyText(getBusyMsec(shardResponse));
+			else response = createStatusText(STR_PAGE_STATUS_STALE);
+			free(shardResponse);
+			break;
+		}
+		responses[responseCount++] = shardResponse;
+		collectRows(map, index, shardResponse, &list, &next);
+
+		if(next != NULL)
+		{
+			//the shard has more food
+			snprintf(shardCursor, sizeof(shardCursor), "%s", next);
+			if(list.count < maxCount) continue;
+			snprintf(nextCursor, sizeof(nextCursor), "%x.%x.%s", map->generation, index, shardCursor);
+			break;
+		}
+		strcpy(shardCursor, STR_PAGE_FIRST);
+		position++;
+		if(list.count >= maxCount && position < count)
+		{
+			snprintf(nextCursor, sizeof(nextCursor), "%x.%x.%s", map->generation, indexes[position], shardCursor);
+			break;
+		}
+	}
+
+	if(response != NULL)
+	{
+		*hitCount = INT_HIT_COUNT_STATUS;
+	}
+	else if(list.count > 0 || nextCursor[0] != '\0')
+	{
+		*hitCount = list.count > 0 ? list.count : 1;
+		response = joinRows(&list, nextCursor);
+	}
+	else response = createStatusText(STR_NO_FOOD_FOUND);
+	freeRows(&list);
+	while(responseCount > 0) free(responses[--responseCount]);
+	return response;
+}
+
+/**
+ * Send requests to shards in parallel and receive all responses.
+ *	Each shard closes the connection after the response.
+ *
+ *	@param map		Shard map
+ *	@param calls	Requests (shardIndex and request are set by caller)
+ *	@param count	The number of calls
+ *	@return true: all responses received (responses are freed by freeShardCalls())
+ */
+bool callShards(shardMap_t *map, shardCall_t *calls, int count)
+{
+	struct pollfd fds[count];
+	struct timespec start;
+	int i;
+	int active = 0;
+	bool ret = true;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(i = 0; i < count; i++)
+	{
+		calls[i].sent = 0;
+		calls[i].length = 0;
+		calls[i].capacity = INT_INITIAL_RESPONSE_SIZE;
+		calls[i].response = (char *)calloc(calls[i].capacity + 1, sizeof(char));
+		calls[i].fd = -1;
+		fds[i].fd = -1;
+	}
+	for(i = 0; i < count; i++)
+	{
+		calls[i].fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		struct sockaddr_in *addr = &map->shards[calls[i].shardIndex].addr;
+		if(calls[i].fd == -1
+			|| (connect(calls[i].fd, (struct sockaddr *)addr, sizeof(*addr)) == -1 && errno != EINPROGRESS))
+		{
+			logError("connect() to shard %s failed. Error code = %d (%s)",
+				map->shards[calls[i].shardIndex].address, errno, strerror(errno));
+			ret = false;
+			break;
+		}
+		fds[i].fd = calls[i].fd;
+		fds[i].events = POLLOUT;
+		active++;
+	}
+
+	while(ret && active > 0)
+	{
+		int waitMsec = gShardTimeoutMsec - getElapsedUsec(&start) / 1000;
+		if(waitMsec <= 0 || poll(fds, count, waitMsec) == 0)
+		{
+			logError("Shard did not respond within %dms.", gShardTimeoutMsec);
+			statCount(STAT_COUNT_TIMEOUT);
+			ret = false;
+			break;
+		}
+		for(i = 0; i < count && ret; i++)
+		{
+			shardCall_t *call = &calls[i];
+			if(fds[i].fd == -1 || fds[i].revents == 0) continue;
+			if(fds[i].events == POLLOUT)
+			{
+				//connected (or failed), send the whole request
+				int error = 0;
+				socklen_t size = sizeof(error);
+				getsockopt(call->fd, SOL_SOCKET, SO_ERROR, &error, &size);
+				int length = strlen(call->request);
+				int sendLen = error != 0 ? -1
+					: send(call->fd, call->request + call->sent, length - call->sent, MSG_NOSIGNAL);
+				if(sendLen == -1 && error == 0 && errno == EAGAIN) continue;
+				if(sendLen == -1)
+				{
+					logError("Request to shard %s failed. Error code = %d",
+						map->shards[call->shardIndex].address, error != 0 ? error : errno);
+					ret = false;
+					break;
+				}
+				call->sent += sendLen;
+				if(call->sent == length) fds[i].events = POLLIN;
+				continue;
+			}
+			if(call->length == call->capacity)
+			{
+				char *temp = (char *)realloc(call->response, call->capacity * 2 + 1);
+				if(temp == NULL)
+				{
+					ret = false;
+					break;
+				}
+				call->response = temp;
+				call->capacity *= 2;
+			}
+			int recvLen = recv(call->fd, call->response + call->length, call->capacity - call->length, 0);
+			if(recvLen == -1 && errno == EAGAIN) continue;
+			if(recvLen == -1)
+			{
+				logError("Response from shard %s failed. Error code = %d (%s)",
+					map->shards[call->shardIndex].address, errno, strerror(errno));
+				ret = false;
+				break;
+			}
+			call->length += recvLen;
+			call->response[call->length] = '\0';
+			if(recvLen == 0)
+			{
+				fds[i].fd = -1;
+				active--;
+			}
+		}
+	}
+	if(!ret) statCount(STAT_COUNT_ERROR);
+	for(i = 0; i < count; i++)
+	{
+		if(calls[i].fd != -1) close(calls[i].fd);
+		calls[i].fd = -1;
+	}
+	return ret;
+}
+
+/**
+ * Send single request to single shard.
+ *
+ *	@param map		Shard map
+ *	@param index	Shard index
+ *	@param request	Request data
+ *	@return Response (has to be freed by caller), NULL when failed
+ */
+char *callShard(shardMap_t *map, int index, char *request)
+{
+	shardCall_t call;
+	call.shardIndex = index;
+	call.request = request;
+	if(!callShards(map, &call, 1))
+	{
+		free(call.response);
+		return NULL;
+	}
+	return call.response;
+}
+
+/**
+ * Free responses of callShards().
+ */
+void freeShardCalls(shardCall_t *calls, int count)
+{
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		free(calls[i].response);
+		calls[i].response = NULL;
+	}
+}
+
+/**
+ * Get retry time of "#busy <retry after milli seconds>".
+ *
+ *	@param response	Response of shard
+ *	@return Retry time, 0 when the response is not busy
+ */
+int getBusyMsec(char *response)
+{
+	if(strncmp(response, STR_STATUS_BUSY, strlen(STR_STATUS_BUSY)) != 0) return 0;
+	int msec = atoi(response + strlen(STR_STATUS_BUSY));
+	return msec > 0 ? msec : INT_SHARD_DOWN_RETRY_MSEC;
+}
+
+/**
+ * Create "#busy <retry after milli seconds>".
+ */
+char *createBusyText(int msec)
+{
+	char *text = (char *)calloc(strlen(STR_STATUS_BUSY) + INT_MAX_SIZE + 1, sizeof(char));
+	sprintf(text, "%s%d", STR_STATUS_BUSY, msec);
+	return text;
+}
+
+/**
+ * Copy status text so that every response can be freed.
+ */
+char *createStatusText(char *status)
+{
+	char *text = (char *)calloc(strlen(status) + 1, sizeof(char));
+	strcpy(text, status);
+	return text;
+}
+
+/**
+ * Collect food info lines of shard response.
+ *	Lines out of the shard's range are skipped. They are left in the shard after
+ *	the food was moved to another shard by rebalance.
+ *	Response is modified ('\n' is replaced with '\0').
+ *
+ *	@param map			Shard map
+ *	@param shardIndex	Shard which sent the response
+ *	@param response		Response of the shard
+ *	@param list			List to append rows
+ *	@param next			Cursor of "#next <cursor>" (NULL: not needed)
+ */
+void collectRows(shardMap_t *map, int shardIndex, char *response, rowList_t *list, char **next)
+{
+	char lowerName[MAX_LINE_BUFFER];
+	if(next != NULL) *next = NULL;
+	if(strcmp(response, STR_NO_FOOD_FOUND) == 0) return;
+
+	char *line = response;
+	while(*line != '\0')
+	{
+		char *end = strchr(line, STR_CR[0]);
+		if(end != NULL) *end = '\0';
+		if(strncmp(line, STR_PAGE_NEXT, strlen(STR_PAGE_NEXT)) == 0)
+		{
+			if(next != NULL) *next = line + strlen(STR_PAGE_NEXT);
+		}
+		else if(line[0] != '\0')
+		{
+			getLowerName(line, lowerName, sizeof(lowerName));
+			if(isInShard(map, shardIndex, lowerName))
+			{
+				if(list->count == list->capacity)
+				{
+					list->capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+					list->rows = (resultRow_t *)realloc(list->rows, sizeof(resultRow_t) * list->capacity);
+				}
+				resultRow_t *row = &list->rows[list->count];
+				row->line = line;
+				row->lowerName = strdup(lowerName);
+				row->order = list->count++;
+			}
+		}
+		if(end == NULL) break;
+		line = end + 1;
+	}
+}
+
+/**
+ * Free rows collected by collectRows().
+ */
+void freeRows(rowList_t *list)
+{
+	int i;
+	for(i = 0; i < list->count; i++)
+	{
+		free(list->rows[i].lowerName);
+	}
+	free(list->rows);
+	list->rows = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+/**
+ * Join rows into response data.
+ *
+ *	@param list		Rows
+ *	@param cursor	Cursor of the next page (NULL or empty: no "#next" line)
+ *	@return Response data (has to be freed by caller)
+ */
+char *joinRows(rowList_t *list, char *cursor)
+{
+	int i;
+	int length = 1;
+	bool hasNext = cursor != NULL && cursor[0] != '\0';
+	for(i = 0; i < list->count; i++)
+	{
+		length += strlen(list->rows[i].line) + 1;
+	}
+	if(hasNext) length += strlen(STR_PAGE_NEXT) + strlen(cursor) + 1;
+
+	char *text = (char *)malloc(length);
+	char *p = text;
+	for(i = 0; i < list->count; i++)
+	{
+		int lineLength = strlen(list->rows[i].line);
+		memcpy(p, list->rows[i].line, lineLength);
+		p += lineLength;
+		*p++ = STR_CR[0];
+	}
+	if(hasNext) p += sprintf(p, "%s%s\n", STR_PAGE_NEXT, cursor);
+	*p = '\0';
+	return text;
+}
+
+/**
+ * Get lower case food name of food info line.
+ *	Name may have commas, so it is the part before the last INT_FIELD_COMMA_COUNT commas.
+ *
+ *	@param line	Food info line without '\n'
+ *	@param ret	Buffer to store the name
+ *	@param size	The size of ret
+ */
+void getLowerName(char *line, char *ret, int size)
+{
+	int length = strlen(line);
+	int commaCount = 0;
+	int i;
+	for(i = length - 1; i >= 0; i--)
+	{
+		if(line[i] == STR_COMMA[0] && ++commaCount == INT_FIELD_COMMA_COUNT) break;
+	}
+	if(i < 0) i = length;
+	if(i > size - 1) i = size - 1;
+	int j;
+	for(j = 0; j < i; j++)
+	{
+		ret[j] = tolower((unsigned char)line[j]);
+	}
+	ret[i] = '\0';
+}
+
+/**
+ * Convert character to lower case.
+ *
+ *	@param target	The character to be converted.
+ *	@param ret		The character converted to lower case.
+ */
+void convertToLowerChar(char *target, char *ret)
+{
+	int i;
+	for(i = 0; target[i] != '\0'; i++)
+	{
+		ret[i] = tolower((unsigned char)target[i]);
+	}
+	ret[i] = '\0';
+}
+
+/**
+ * Compare function for qsort(). Order by lower case name, then by received order.
+ */
+int compareRow(const void *a, const void *b)
+{
+	const resultRow_t *x = (const resultRow_t *)a;
+	const resultRow_t *y = (const resultRow_t *)b;
+	int ret = strcmp(x->lowerName, y->lowerName);
+	if(ret != 0) return ret;
+	return x->order - y->order;
+}
+
+/**
+ * Compare function for qsort() of lines.
+ */
+int compareLine(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/**
+ * Find the shard which owns the name (the last shard whose lower bound is not greater).
+ *
+ *	@param map			Shard map
+ *	@param lowerName	Lower case food name
+ *	@return Shard index
+ */
+int findShard(shardMap_t *map, char *lowerName)
+{
+	int low = 0;
+	int high = map->count - 1;
+	while(low < high)
+	{
+		int mid = (low + high + 1) / 2;
+		if(strcmp(map->shards[mid].lowerBound, lowerName) <= 0) low = mid;
+		else high = mid - 1;
+	}
+	return low;
+}
+
+/**
+ * Check whether the name is in the range of the shard.
+ */
+bool isInShard(shardMap_t *map, int index, char *lowerName)
+{
+	if(strcmp(lowerName, map->shards[index].lowerBound) < 0) return false;
+	return index == map->count - 1 || strcmp(lowerName, map->shards[index + 1].lowerBound) < 0;
+}
+
+/**
+ * Find the shards whose range can have names starting with the prefix.
+ *	The names are in [prefix, the first name after all names with the prefix),
+ *	and the shards which overlap the range are next to each other.
+ *
+ *	@param map			Shard map
+ *	@param lowerPrefix	Lower case prefix
+ *	@param indexes		Buffer to store shard indexes (INT_MAX_SHARDS entries), in range order
+ *	@return The number of shards
+ */
+int findCandidateShards(shardMap_t *map, char *lowerPrefix, int *indexes)
+{
+	int count = 0;
+	int length = strlen(lowerPrefix);
+	int i;
+	for(i = findShard(map, lowerPrefix); i < map->count; i++)
+	{
+		//the shard starts after all names with the prefix
+		if(strcmp(map->shards[i].lowerBound, lowerPrefix) > 0
+			&& strncmp(map->shards[i].lowerBound, lowerPrefix, length) != 0) break;
+		indexes[count++] = i;
+	}
+	return count;
+}
+
+/**
+ * Send response to client. Large food info is compressed when the client accepts it.
+ *
+ *	@param fd		Socket of the client
+ *	@param data		Response data
+ *	@param hitCount	The number of food info (only food info is compressed)
+ *	@param option	Request option flags
+ *	@return true: sent successfully
+ */
+bool sendResponse(int fd, char *data, int hitCount, int option)
+{
+	int length = strlen(data);
+	if(hitCount <= 0 || !(option & INT_OPTION_COMPRESS) || length <= INT_COMPRESS_THRESHOLD)
+	{
+		return sendFrame(fd, data, length, option);
+	}
+
+	int bound = lzCompressBound(length);
+	char *buf = (char *)malloc(INT_MAX_COMPRESS_HEADER_SIZE + bound);
+	if(buf == NULL) return sendFrame(fd, data, length, option);
+	char *body = buf + INT_MAX_COMPRESS_HEADER_SIZE;
+	int compLength = lzCompress(data, length, body, bound);
+	bool ret;
+	if(compLength > 0 && compLength < length)
+	{
+		//put header just before the compressed data so that single send() is needed
+		char header[INT_MAX_COMPRESS_HEADER_SIZE];
+		int headerLength = sprintf(header, "%s%d %d\n", STR_COMPRESS_HEADER, length, compLength);
+		memcpy(body - headerLength, header, headerLength);
+		ret = sendFrame(fd, body - headerLength, headerLength + compLength, option);
+	}
+	else ret = sendFrame(fd, data, length, option);
+	free(buf);
+	return ret;
+}
+
+/**
+ * Send response to client with "#size <response size>\n" on kept-alive connection.
+ *
+ *	@param fd		Socket of the client
+ *	@param data		Response data
+ *	@param length	The size of data
+ *	@param option	Request option flags
+ *	@return true: sent successfully
+ */
+bool sendFrame(int fd, char *data, int length, int option)
+{
+	if(!(option & INT_OPTION_KEEPALIVE)) return sendAll(fd, data, length);
+	char header[INT_MAX_FRAME_HEADER_SIZE];
+	int headerLength = sprintf(header, "%s%d\n", STR_FRAME_HEADER, length);
+	char *frame = (char *)malloc(headerLength + length);
+	if(frame == NULL) return false;
+	memcpy(frame, header, headerLength);
+	memcpy(frame + headerLength, data, length);
+	bool ret = sendAll(fd, frame, headerLength + length);
+	free(frame);
+	return ret;
+}
+
+/**
+ * Send all data to client.
+ *
+ *	@param fd		Socket of the client
+ *	@param data		The data to be sent
+ *	@param length	The size of data
+ *	@return true: sent successfully
+ */
+bool sendAll(int fd, char *data, int length)
+{
+	int sent = 0;
+	while(sent < length)
+	{
+		int sendLen = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+		if(sendLen == -1 && errno == EINTR) continue;
+		if(sendLen == -1)
+		{
+			statCount(errno == EAGAIN ? STAT_COUNT_TIMEOUT : STAT_COUNT_ERROR);
+			logError("send() error. Error code = %d (%s) Sent = %d/%d", errno, strerror(errno), sent, length);
+			return false;
+		}
+		sent += sendLen;
+	}
+	return true;
+}
+
+/**
+ * Set receive/send timeout of socket.
+ *
+ *	@param fd	Socket
+ *	@param msec	Timeout (milli seconds)
+ */
+void setSocketTimeouts(int fd, int msec)
+{
+	struct timeval timeout;
+	timeout.tv_sec = msec / 1000;
+	timeout.tv_usec = (msec % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Read all food info whose lower case name is in [from, to) from the shard.
+ *	Food info is read in pages of "#dump". Each page is asked from the name and the cursor
+ *	of "#next" of the previous page, so food added during the read does not restart it.
+ *	When the shard is busy or not available, the page is retried.
+ *
+ *	@param map		Shard map
+ *	@param index	Shard index
+ *	@param from		Lower case name to start from
+ *	@param to		Lower case name to stop at (NULL: the last food)
+ *	@param lines	Food info lines (each line and the array have to be freed by caller)
+ *	@return The number of lines, -1 when failed
+ */
+int dumpRange(shardMap_t *map, int index, char *from, char *to, char ***lines)
+{
+	char request[INT_MAX_RECV_DATA_SIZE];
+	char next[INT_MAX_CURSOR_SIZE + MAX_LINE_BUFFER];
+	char lowerName[MAX_LINE_BUFFER];
+	int count = 0;
+	int capacity = 0;
+	int retry = 0;
+	bool isDone = false;
+	*lines = NULL;
+	//"<cursor> <name>" of the next page
+	snprintf(next, sizeof(next), "%s %s", STR_PAGE_FIRST, from);
+
+	while(!isDone)
+	{
+		snprintf(request, sizeof(request), "%s%d %s", STR_CMD_DUMP, INT_DUMP_PAGE_COUNT, next);
+		char *response = callShard(map, index, request);
+		int busyMsec = response == NULL ? INT_SHARD_DOWN_RETRY_MSEC : getBusyMsec(response);
+		if(response != NULL && strcmp(response, STR_PAGE_STATUS_STALE) == 0)
+		{
+			//the cursor is not known by the shard (older server)
+			logError("Dump cursor was rejected by shard %s.", map->shards[index].address);
+			free(response);
+			break;
+		}
+		if(busyMsec > 0)
+		{
+			free(response);
+			if(++retry > INT_MAX_DUMP_RETRY) break;
+			usleep(busyMsec * 1000);
+			continue;
+		}
+
+		retry = 0;
+		isDone = true;
+		char *line = strcmp(response, STR_NO_FOOD_FOUND) == 0 ? "" : response;
+		while(*line != '\0')
+		{
+			char *end = strchr(line, STR_CR[0]);
+			if(end != NULL) *end = '\0';
+			if(strncmp(line, STR_PAGE_NEXT, strlen(STR_PAGE_NEXT)) == 0)
+			{
+				snprintf(next, sizeof(next), "%s", line + strlen(STR_PAGE_NEXT));
+				isDone = false;
+			}
+			else if(line[0] != '\0')
+			{
+				getLowerName(line, lowerName, sizeof(lowerName));
+				if(to != NULL && strcmp(lowerName, to) >= 0)
+				{
+					isDone = true;
+					break;
+				}
+				if(count == capacity)
+				{
+					capacity = capacity > 0 ? capacity * 2 : INT_DUMP_PAGE_COUNT;
+					*lines = (char **)realloc(*lines, sizeof(char *) * capacity);
+				}
+				(*lines)[count++] = strdup(line);
+			}
+			if(end == NULL) break;
+			line = end + 1;
+		}
+		free(response);
+	}
+	if(isDone) return count;
+
+	logError("Dump from shard %s failed.", map->shards[index].address);
+	while(count > 0) free((*lines)[--count]);
+	free(*lines);
+	*lines = NULL;
+	return -1;
+}
+
+/**
+ * Write food info from the bound to the next lower bound in the shard map in csv
+ *	(stdout), so that new shard for the range can be started with it.
+ *
+ *	@param map		Shard map
+ *	@param bound	Lower bound of new shard
+ */
+void exportRange(shardMap_t *map, char *bound)
+{
+	char lowerBound[strlen(bound) + 1];
+	convertToLowerChar(bound, lowerBound);
+	int index = findShard(map, lowerBound);
+	char *to = index + 1 < map->count ? map->shards[index + 1].lowerBound : NULL;
+
+	char **lines;
+	int count = dumpRange(map, index, lowerBound, to, &lines);
+	if(count == -1)
+	{
+		fprintf(stderr, "%s Food info could not be read from %s\n", STR_PRINT_ERR, map->shards[index].address);
+		exit(EXIT_FAILURE);
+	}
+	int i;
+	printf("%s", STR_CSV_HEADER);
+	for(i = 0; i < count; i++)
+	{
+		printf("%s\n", lines[i]);
+		free(lines[i]);
+	}
+	free(lines);
+	fprintf(stderr, "%s %d food info exported from %s\n", STR_PRINT_INFO, count, map->shards[index].address);
+}
+
+/**
+ * Reload shard map. Requests being routed keep using the previous map.
+ *	After the new map is in use, food whose owner changed is moved (see moveFood()).
+ */
+void reloadShardMap()
+{
+	shardMap_t *map = loadShardMap(gShardMapPath);
+	if(map == NULL)
+	{
+		logError("Shard map %s could not be reloaded. The previous map is used.", gShardMapPath);
+		return;
+	}
+	pthread_mutex_lock(&mapMutex);
+	shardMap_t *old = gShardMap;
+	map->generation = old->generation + 1;
+	map->refCount = 1;
+	gShardMap = map;
+	pthread_mutex_unlock(&mapMutex);
+	logInfo("Shard map reloaded: %d shards", map->count);
+
+	//the reference of gShardMap to the previous map is released after the move
+	//(the new map is replaced only by this thread)
+	moveFood(old, map);
+	releaseShardMap(old);
+}
+
+/**
+ * Move food whose owner changed from the previous owner to the new owner.
+ *	New shard is expected to be started with the csv written by -e, so only food
+ *	the new owner does not have (added after the export) is sent as new food.
+ *	The previous owner keeps the food, but it is no longer returned (out of range).
+ *
+ *	@param old	Previous shard map
+ *	@param map	New shard map
+ */
+void moveFood(shardMap_t *old, shardMap_t *map)
+{
+	int i, j;
+	for(j = 0; j < map->count; j++)
+	{
+		char *newFrom = map->shards[j].lowerBound;
+		char *newTo = j + 1 < map->count ? map->shards[j + 1].lowerBound : NULL;
+		for(i = 0; i < old->count; i++)
+		{
+			char *oldFrom = old->shards[i].lowerBound;
+			char *oldTo = i + 1 < old->count ? old->shards[i + 1].lowerBound : NULL;
+			struct sockaddr_in *oldAddr = &old->shards[i].addr;
+			struct sockaddr_in *newAddr = &map->shards[j].addr;
+			if(oldAddr->sin_addr.s_addr == newAddr->sin_addr.s_addr && oldAddr->sin_port == newAddr->sin_port) continue;
+
+			//overlap of the ranges
+			char *from = strcmp(oldFrom, newFrom) > 0 ? oldFrom : newFrom;
+			char *to = oldTo == NULL ? newTo : newTo == NULL ? oldTo : strcmp(oldTo, newTo) < 0 ? oldTo : newTo;
+			if(to != NULL && strcmp(from, to) >= 0) continue;
+			moveRange(old, i, map, j, from, to);
+		}
+	}
+}
+
+/**
+ * Send food in [from, to) which the new owner does not have yet.
+ *
+ *	@param old		Previous shard map
+ *	@param oldIndex	Previous owner
+ *	@param map		New shard map
+ *	@param newIndex	New owner
+ *	@param from		Lower case name to start from
+ *	@param to		Lower case name to stop at (NULL: the last food)
+ */
+void moveRange(shardMap_t *old, int oldIndex, shardMap_t *map, int newIndex, char *from, char *to)
+{
+	char **oldLines;
+	char **newLines;
+	int oldCount = dumpRange(old, oldIndex, from, to, &oldLines);
+	int newCount = oldCount == -1 ? -1 : dumpRange(map, newIndex, from, to, &newLines);
+	if(newCount == -1)
+	{
+		logError("Food from \"%s\" could not be moved from %s to %s.", from,
+			old->shards[oldIndex].address, map->shards[newIndex].address);
+		if(oldCount != -1)
+		{
+			while(oldCount > 0) free(oldLines[--oldCount]);
+			free(oldLines);
+		}
+		return;
+	}
+
+	//lines of both shards are compared in byte order (the same line may be there twice)
+	qsort(oldLines, oldCount, sizeof(char *), compareLine);
+	qsort(newLines, newCount, sizeof(char *), compareLine);
+	int i;
+	int j = 0;
+	int moved = 0;
+	int failed = 0;
+	char request[MAX_LINE_BUFFER + 3];
+	for(i = 0; i < oldCount; i++)
+	{
+		while(j < newCount && strcmp(newLines[j], oldLines[i]) < 0) j++;
+		if(j < newCount && strcmp(newLines[j], oldLines[i]) == 0)
+		{
+			j++;
+			continue;
+		}
+		snprintf(request, sizeof(request), "%s\n%s", oldLines[i], "a");
+		char *response = callShard(map, newIndex, request);
+		if(response != NULL && strcmp(response, STR_ADD_STATUS_SUCCESS) == 0) moved++;
+		else failed++;
+		free(response);
+	}
+	logInfo("Moved %d food (%d failed) from \"%s\": %s -> %s", moved, failed, from,
+		old->shards[oldIndex].address, map->shards[newIndex].address);
+
+	for(i = 0; i < oldCount; i++) free(oldLines[i]);
+	for(i = 0; i < newCount; i++) free(newLines[i]);
+	free(oldLines);
+	free(newLines);
+}
+
+/**
+ * Load shard map.
+ *	Each line is "<host>:<port> <lower bound>". The lower bound is the rest of the line
+ *	(may have spaces) and the first shard has "-". Lines are ordered by lower bound.
+ *	Empty lines and lines which start with '#' are ignored.
+ *
+ *	@param path	Shard map file
+ *	@return Shard map, NULL when the file is invalid
+ */
+shardMap_t *loadShardMap(char *path)
+{
+	FILE *fp = fopen(path, STR_FILE_OPEN_MODE_READ);
+	if(fp == NULL)
+	{
+		printf("%s Shard map open error. File name = %s\n", STR_PRINT_ERR, path);
+		return NULL;
+	}
+	shardMap_t *map = (shardMap_t *)calloc(1, sizeof(shardMap_t));
+	char line[MAX_LINE_BUFFER];
+	bool isValid = true;
+	while(isValid && fgets(line, sizeof(line), fp) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if(line[0] == '\0' || line[0] == STR_COMMENT_CHAR[0]) continue;
+		char *bound = strchr(line, STR_SPACE[0]);
+		char *port = strrchr(line, ':');
+		if(bound == NULL || port == NULL || port > bound || map->count == INT_MAX_SHARDS)
+		{
+			printf("%s Invalid shard map line: %s\n", STR_PRINT_ERR, line);
+			isValid = false;
+			break;
+		}
+		*bound++ = '\0';
+
+		shard_t *shard = &map->shards[map->count];
+		shard->address = strdup(line);
+		*port++ = '\0';
+		struct hostent *he = gethostbyname(line);
+		if(he == NULL || atoi(port) <= 0)
+		{
+			printf("%s Invalid shard address: %s\n", STR_PRINT_ERR, shard->address);
+			isValid = false;
+		}
+		else
+		{
+			shard->addr.sin_family = AF_INET;
+			shard->addr.sin_port = htons(atoi(port));
+			shard->addr.sin_addr = *((struct in_addr *)he->h_addr);
+		}
+
+		shard->lowerBound = (char *)calloc(strlen(bound) + 1, sizeof(char));
+		if(map->count > 0 || strcmp(bound, STR_FIRST_BOUND) != 0) convertToLowerChar(bound, shard->lowerBound);
+		map->count++;
+		if(map->count == 1 && shard->lowerBound[0] != '\0')
+		{
+			printf("%s The first shard must have lower bound \"%s\".\n", STR_PRINT_ERR, STR_FIRST_BOUND);
+			isValid = false;
+		}
+		else if(map->count > 1 && strcmp(map->shards[map->count - 2].lowerBound, shard->lowerBound) >= 0)
+		{
+			printf("%s Shards are not ordered by lower bound: %s\n", STR_PRINT_ERR, bound);
+			isValid = false;
+		}
+	}
+	fclose(fp);
+	if(isValid && map->count == 0)
+	{
+		printf("%s No shard in %s\n", STR_PRINT_ERR, path);
+		isValid = false;
+	}
+	if(isValid) return map;
+
+	map->refCount = 1;
+	releaseShardMap(map);
+	return NULL;
+}
+
+/**
+ * Get the shard map in use. Has to be released by releaseShardMap().
+ */
+shardMap_t *acquireShardMap()
+{
+	pthread_mutex_lock(&mapMutex);
+	shardMap_t *map = gShardMap;
+	map->refCount++;
+	pthread_mutex_unlock(&mapMutex);
+	return map;
+}
+
+/**
+ * Release shard map. The map is freed when nobody uses it.
+ */
+void releaseShardMap(shardMap_t *map)
+{
+	pthread_mutex_lock(&mapMutex);
+	bool isUnused = --map->refCount == 0;
+	pthread_mutex_unlock(&mapMutex);
+	if(!isUnused) return;
+
+	int i;
+	for(i = 0; i < map->count; i++)
+	{
+		free(map->shards[i].lowerBound);
+		free(map->shards[i].address);
+	}
+	free(map);
+}
+
+/**
+ * Check parameters.
+ *	If inappropriate values are entered, shows error message and exit program.
+ *
+ *	@param argc	The number of parameters.
+ *	@param argv	Array of parameters.
+ */
+void checkParameter(int argc, char** argv)
+{
+	int opt;
+	while((opt = getopt(argc, argv, STR_OPTIONS)) != -1)
+	{
+		switch(opt)
+		{
+		case 'm':
+			gShardMapPath = optarg;
+			break;
+		case 'e':
+			gExportBound = optarg;
+			break;
+		case 't':
+			gShardTimeoutMsec = atoi(optarg);
+			break;
+		case 'n':
+			gWorkerCount = atoi(optarg);
+			break;
+		case 'l':
+			gListenBacklog = atoi(optarg);
+			break;
+		case 'L':
+			if((gLogLevel = getLogLevel(optarg)) < 0)
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			printf("%s", STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+	}
+	//port number is not needed for export
+	int portCount = argc - optind;
+	if(gShardMapPath == NULL || portCount > 1 || (portCount == 0 && gExportBound == NULL)
+		|| gShardTimeoutMsec <= 0 || gWorkerCount <= 0 || gWorkerCount > INT_STAT_MAX_THREADS
+		|| gListenBacklog <= 0)
+	{
+		printf("%s", STR_USAGE);
+		exit(EXIT_FAILURE);
+	}
+	if(portCount == 0) return;
+
+	int i;
+	char *port = argv[optind];
+	for(i = 0; port[i] != '\0'; i++)
+	{
+		if(!isdigit(*(port + i)))
+		{
+			printf("Command line parameter error: Port number is not digit.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(atoi(port) < 1024)
+	{
+		printf("Note: The port number is in the range of well-known port.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Initialize listening socket.
+ *
+ *	@param sockfd	Socket information
+ *	@param port		Port number
+ */
+void initializeSocket(int *sockfd, char *port)
+{
+	struct sockaddr_in addr;
+	int on = 1;
+	gPortNum = atoi(port);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(gPortNum);
+	addr.sin_addr.s_addr = INADDR_ANY;
+
+	if((*sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1
+		|| setsockopt(*sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1
+		|| bind(*sockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+		|| listen(*sockfd, gListenBacklog) == -1)
+	{
+		printf("%s Port %d could not be opened. Error code = %d\n", STR_PRINT_ERR, gPortNum, errno);
+		perror("socket");
+		exit(EXIT_FAILURE);
+	}
+	printf("%s Router is listening on port %d (back log = %d)..... \n", STR_PRINT_INFO, gPortNum, gListenBacklog);
+}
+
+/**
+ * Get elapsed time from start.
+ *
+ *	@param start	Start time (CLOCK_MONOTONIC)
+ *	@return Elapsed time in micro seconds
+ */
+long getElapsedUsec(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
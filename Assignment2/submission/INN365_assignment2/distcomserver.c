@@ -1,3 +1,5 @@
+//memfd_create() is used to hand over catalog at upgrade
+#define _GNU_SOURCE
 #include <semaphore.h>
 #include <pthread.h>
 #include <sched.h>
@@ -14,12 +16,30 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/random.h>
 #include "applib.h"
+#include "matchlib.h"
+#include "segmentlib.h"
+#include "lzlib.h"
+#include "statlib.h"
+#include "loglib.h"
+#include "handofflib.h"
+#include "timerlib.h"
+#include "uringlib.h"
+#include "shmlib.h"
+#include "phashlib.h"
 
 /// Default port number
 #define INT_DEFAULT_PORT 12345
-/// Back log
+/// Back log (stats socket)
 #define BACKLOG 10
+/// Default back log of listening sockets (capped by net.core.somaxconn)
+#define INT_DEFAULT_LISTEN_BACKLOG 1024
 /// Maximum receive data size
 #define INT_MAX_RECV_DATA_SIZE 512
 /// Csv file name
@@ -30,10 +50,219 @@
 #define INT_MAX_SIZE 10
 /// Max client number to be connected to server at once
 #define INT_MAX_CLIENT_NUMBER 10
+/// Command line options (getopt)
+#define STR_OPTIONS "q:w:s:L:S:u:U:i:r:o:p:f:dx:e:m:l:t:"
+/// Command line usage
+#define STR_USAGE "Command line parameter error. Usage: ./<This file name> [options] <Port number> \n" \
+	"       ./<This file name> [options] -U <path> (port is taken over)\n" \
+	"  -q <depth>  max number of clients waiting for executor (default 64)\n" \
+	"  -w <ms>     max time a client waits for executor (default 500)\n" \
+	"  -s <port>   port number to serve stats (default: stats port is not used)\n" \
+	"  -L <level>  log level: error, info or debug (default info)\n" \
+	"  -S <rate>   write per-request info log once in every <rate> requests (default 1)\n" \
+	"  -u <path>   Unix socket path on which the next process can take over this server\n" \
+	"  -U <path>   take over listening socket and food info from the process on <path>\n" \
+	"  -i <ms>     max time from connect to the first byte of request (default 10000)\n" \
+	"  -r <ms>     max time to receive request (default 2000)\n" \
+	"  -o <ms>     max time to send response (default 5000)\n" \
+	"  -p <host>:<port>  run as read replica of the primary server on <host>:<port>\n" \
+	"  -f <ms>     send search results from sorted catalog file by sendfile(), food added\n" \
+	"              by user is merged in the file every <ms>\n" \
+	"  -d          answer searches, completion and pages by UDP on the same port number\n" \
+	"  -x <path>   listen on Unix domain socket <path> as well (clients on the same host)\n" \
+	"  -e <backend>  poll (default): accepter and executors, uring: io_uring workers\n" \
+	"  -m <name>   answer requests by shared memory channel /<name> as well (same host)\n" \
+	"  -l <count>  back log of listening sockets (default 1024)\n" \
+	"  -t <list>   TCP options separated by ',': fastopen, defer, nodelay, quickack or none\n" \
+	"              (default fastopen,defer,nodelay)\n"
 /// Function type: search
 #define INT_TYPE_SEARCH 0
 /// Function type: add new food information
 #define INT_TYPE_ADD 1
+/// Function type: autocomplete food name
+#define INT_TYPE_COMPLETE 2
+/// Request prefix: autocomplete ("#complete <count> <partial name>")
+#define STR_CMD_COMPLETE "#complete "
+/// Default number of names returned by autocomplete
+#define INT_DEFAULT_COMPLETE_COUNT 10
+/// Max number of names returned by autocomplete
+#define INT_MAX_COMPLETE_COUNT 50
+/// Max autocomplete response size (fits in a single TCP segment)
+#define INT_MAX_COMPLETE_DATA_SIZE 1400
+/// Time budget of single autocomplete request (micro seconds)
+#define INT_COMPLETE_BUDGET_USEC 2000
+/// Function type: search with pagination
+#define INT_TYPE_PAGE 3
+/// Request prefix: pagination ("#page <limit> <cursor> <food name>", cursor is "-" for the first page)
+#define STR_CMD_PAGE "#page "
+/// Response trailer: cursor of the next page ("#next <cursor>")
+#define STR_PAGE_NEXT "#next "
+/// Cursor of the first page
+#define STR_PAGE_FIRST "-"
+/// Default number of food info in a page
+#define INT_DEFAULT_PAGE_COUNT 20
+/// Max number of food info in a page
+#define INT_MAX_PAGE_COUNT 100
+/// Max length of cursor
+#define INT_MAX_CURSOR_SIZE 32
+/// Function type: dump food info in name order (used by router to move food between shards)
+#define INT_TYPE_DUMP 5
+/// Request prefix: dump ("#dump <limit> <cursor> <lower case name to start from>", cursor is the number of food
+///	of the name already read, and "#next <cursor> <name>" is returned to resume from)
+#define STR_CMD_DUMP "#dump "
+/// Max number of food info in a dump page
+#define INT_MAX_DUMP_COUNT 1000
+/// Hit count of status reply (sendData is sent as it is)
+#define INT_HIT_COUNT_STATUS -2
+/// Request option: client accepts compressed response ("#z <request>")
+#define STR_OPT_COMPRESS "#z "
+/// Request option flag: compress
+#define INT_OPTION_COMPRESS 0x01
+/// Response header of compressed data ("#lz4 <original size> <compressed size>\n")
+#define STR_COMPRESS_HEADER "#lz4 "
+/// Max length of compressed data header
+#define INT_MAX_COMPRESS_HEADER_SIZE 32
+/// Responses larger than this size are compressed
+#define INT_COMPRESS_THRESHOLD 1024
+/// Request option: keep the connection for the next request ("#k <request>")
+#define STR_OPT_KEEPALIVE "#k "
+/// Request option flag: keep-alive
+#define INT_OPTION_KEEPALIVE 0x02
+/// Response header on kept-alive connection ("#size <response size>\n")
+#define STR_FRAME_HEADER "#size "
+/// Max length of response header on kept-alive connection
+#define INT_MAX_FRAME_HEADER_SIZE 32
+/// Request option: stamp the response with catalog version ("#v <request>")
+#define STR_OPT_VERSION "#v "
+/// Request option flag: version
+#define INT_OPTION_VERSION 0x04
+/// Request option: reply "#notmod" when catalog version is not changed ("#if <version> <request>")
+#define STR_OPT_IF_VERSION "#if "
+/// Request option flag: if version is changed
+#define INT_OPTION_IF_VERSION 0x08
+/// Response header of catalog version ("#version <version>\n")
+#define STR_VERSION_HEADER "#version "
+/// Max length of catalog version header
+#define INT_MAX_VERSION_HEADER_SIZE 32
+/// Function type: stats
+#define INT_TYPE_STATS 4
+/// Request: stats
+#define STR_CMD_STATS "#stats"
+/// Default max number of clients waiting for executor
+#define INT_DEFAULT_QUEUE_DEPTH 64
+/// Default max time a client waits for executor (milli seconds)
+#define INT_DEFAULT_MAX_QUEUE_DELAY_MSEC 500
+/// Response when server is busy ("#busy <retry after milli seconds>")
+#define STR_STATUS_BUSY "#busy "
+/// Initial capacity of sorted index
+#define INT_INDEX_INITIAL_CAPACITY 64
+/// Handoff message: catalog snapshot (memfd is attached)
+#define STR_HANDOFF_SNAPSHOT "snapshot"
+/// Handoff message: new process has loaded the snapshot
+#define STR_HANDOFF_READY "ready"
+/// Handoff message: listening socket ("socket <port> <flags> <catalog id> <generation>",
+/// listening socket, delta memfd, and stats socket, Unix domain listening socket and
+/// shared memory object in flags are attached)
+#define STR_HANDOFF_SOCKET "socket "
+/// Handoff message: new process has started accepting
+#define STR_HANDOFF_DONE "done"
+/// Header of catalog snapshot ("#snapshot <loaded food count> <added food count>\n")
+#define STR_SNAPSHOT_HEADER "#snapshot "
+/// Interval to check whether in-flight requests are drained (micro seconds)
+#define INT_DRAIN_CHECK_USEC 1000
+/// Default max time from connect to the first byte of request (milli seconds)
+#define INT_DEFAULT_IDLE_TIMEOUT_MSEC 10000
+/// Default max time to receive request (milli seconds)
+#define INT_DEFAULT_READ_TIMEOUT_MSEC 2000
+/// Default max time to send response (milli seconds)
+#define INT_DEFAULT_WRITE_TIMEOUT_MSEC 5000
+/// Max number of connections waiting for request in accepter
+#define INT_MAX_PENDING_CLIENTS 1024
+/// Function type: follow food info added to primary (used by replica)
+#define INT_TYPE_REPLICATE 6
+/// Request prefix: replicate ("#replicate <loaded food count> <added food count>", "0 0" for 
+/// the first time). snapshot is sent first, then food info added by user line by line
+#define STR_CMD_REPLICATE "#replicate "
+/// Line sent to replica when no food info is added within the heartbeat interval
+#define STR_REPLICA_HEARTBEAT "#heartbeat"
+/// Interval of heartbeat (milli seconds)
+#define INT_REPLICA_HEARTBEAT_MSEC 1000
+/// Replica reconnects when nothing arrives from primary within this time (milli seconds)
+#define INT_REPLICA_TIMEOUT_MSEC 3000
+/// Interval to reconnect to primary (milli seconds)
+#define INT_REPLICA_RETRY_MSEC 1000
+/// Wait after accept() on stats port failed (milli seconds)
+#define INT_STATS_RETRY_MSEC 100
+/// Receive buffer size of replication stream
+#define INT_REPLICA_BUFFER_SIZE 65536
+/// Result of syncPrimary(): primary has different food info (replica cannot continue)
+#define INT_SYNC_STALE -1
+/// Result of syncPrimary(): connection failed (retry later)
+#define INT_SYNC_FAILED 0
+/// Result of syncPrimary(): food info is up to date
+#define INT_SYNC_OK 1
+/// Catalog segment file name (food info sorted by name, used with -f)
+#define STR_SEGMENT_FILE_NAME "calories.seg"
+/// Max size of UDP response (IPv4 payload of 1500 bytes Ethernet frame, never fragmented)
+#define INT_MAX_DATAGRAM_SIZE 1472
+/// Position of Unix domain listening socket in gPollList (-x)
+#define INT_POLL_LOCAL 2
+/// Handoff flag of "socket <port> <flags>": stats socket is attached
+#define INT_HANDOFF_HAS_STATS 0x01
+/// Handoff flag of "socket <port> <flags>": Unix domain listening socket is attached
+#define INT_HANDOFF_HAS_LOCAL 0x02
+/// Handoff flag of "socket <port> <flags>": shared memory object of the channel is attached
+#define INT_HANDOFF_HAS_SHM 0x04
+/// Backend of -e: io_uring workers accept, receive and send by themselves
+#define STR_BACKEND_URING "uring"
+/// Backend of -e: accepter polls connections and executors serve them (default)
+#define STR_BACKEND_POLL "poll"
+/// The number of submission queue entries of each io_uring worker
+#define INT_RING_ENTRIES 256
+/// The number of receive buffers provided by each io_uring worker (power of 2)
+#define INT_RING_BUFFER_COUNT 256
+/// Buffer group ID of receive buffers
+#define INT_RING_BUFFER_GROUP 0
+/// Operation of io_uring worker in the low bits of user_data (the rest is the connection,
+/// or the listening socket for accept)
+#define INT_RING_OP_ACCEPT 0
+#define INT_RING_OP_RECV 1
+#define INT_RING_OP_SEND 2
+#define INT_RING_OP_CLOSE 3
+#define INT_RING_OP_TIMEOUT 4
+#define INT_RING_OP_BITS 3
+#define INT_RING_OP_MASK 0x07
+/// The number of threads serving shared memory channel (-m)
+#define INT_SHM_SERVER_COUNT 4
+/// TCP option of -t: accept request in SYN (TCP Fast Open)
+#define STR_TCP_FASTOPEN "fastopen"
+/// TCP option of -t: accept() returns only when the request has arrived
+#define STR_TCP_DEFER_ACCEPT "defer"
+/// TCP option of -t: send response without waiting for ACK of the previous segment
+#define STR_TCP_NODELAY "nodelay"
+/// TCP option of -t: ACK request at once
+#define STR_TCP_QUICKACK "quickack"
+/// TCP option of -t: no option
+#define STR_TCP_NONE "none"
+/// TCP option flags
+#define INT_TCP_FASTOPEN 0x01
+#define INT_TCP_DEFER_ACCEPT 0x02
+#define INT_TCP_NODELAY 0x04
+#define INT_TCP_QUICKACK 0x08
+/// Default TCP options
+#define INT_DEFAULT_TCP_OPTIONS (INT_TCP_FASTOPEN | INT_TCP_DEFER_ACCEPT | INT_TCP_NODELAY)
+/// Max length of TCP Fast Open queue (requests in SYN not accepted yet)
+#define INT_MAX_FASTOPEN_QUEUE 256
+/// Setting of TCP Fast Open (bit 0x02: enabled for servers)
+#define STR_FASTOPEN_SYSCTL "/proc/sys/net/ipv4/tcp_fastopen"
+/// Function type: exact match of food name
+#define INT_TYPE_EXACT 7
+/// Request prefix: exact match ("#exact <food name>", case is ignored)
+#define STR_CMD_EXACT "#exact "
+/// Min number of food info added by user before exact match index is rebuilt
+/// (food info is counted, not names; the limit is this plus a quarter of the names in
+/// the perfect hash)
+#define INT_EXACT_MIN_OVERFLOW 1024
 
 /// socket information
 typedef struct socketInfo socketInfo_t;
@@ -42,6 +271,133 @@ struct socketInfo
 	int fd;
 	struct sockaddr_in addr;
 	socklen_t size;
+	/// time when the connection was accepted (CLOCK_MONOTONIC)
+	struct timespec acceptTime;
+	/// time when the request became readable and the client was queued (CLOCK_MONOTONIC)
+	struct timespec readyTime;
+	/// true: the connection has been kept alive after the previous request
+	bool isReused;
+};
+
+/// Request being served
+typedef struct clientRequest clientRequest_t;
+struct clientRequest
+{
+	/// request data (options are removed by parseClientData())
+	char data[INT_MAX_RECV_DATA_SIZE];
+	/// function type
+	int type;
+	/// request option flags
+	int option;
+	/// catalog version of "#if <version>"
+	unsigned long long ifVersion;
+	/// catalog version when the request was handled
+	unsigned long long version;
+	/// the number of food info found (-1: food added, INT_HIT_COUNT_STATUS: status reply)
+	int hitCount;
+	/// response data (empty when the rows are sent from catalog segment)
+	char *response;
+	/// catalog segment of the rows found (NULL: segment is not used)
+	segment_t *segment;
+	segmentRange_t ranges[INT_SEGMENT_MAX_RANGES];
+	int rangeCount;
+};
+
+/// Connection waiting for request in accepter
+typedef struct pendingClient pendingClient_t;
+struct pendingClient
+{
+	socketInfo_t client;
+	/// idle deadline
+	timerEntry_t timer;
+	/// position in gPollList
+	int pollIndex;
+};
+
+/// Connection served by io_uring worker
+typedef struct ringClient ringClient_t;
+struct ringClient
+{
+	socketInfo_t client;
+	clientRequest_t request;
+	/// data being sent and its buffer (see createResponseData())
+	char *sendData;
+	int sendLength;
+	char *sendBuffer;
+	/// time when the send was submitted (CLOCK_MONOTONIC)
+	struct timespec sendTime;
+	/// the number of operations submitted and not completed
+	int inflight;
+	/// true: close has been submitted or the connection has been handed over
+	/// (freed when inflight becomes 0)
+	bool isClosed;
+	/// true: SO_RCVTIMEO/SO_SNDTIMEO are set (needed by blocking sendfile() only)
+	bool hasTimeouts;
+};
+
+/// io_uring worker: serves connections accepted by itself without other threads
+typedef struct ringWorker ringWorker_t;
+struct ringWorker
+{
+	uring_t uring;
+	uringBuffers_t buffers;
+	/// linked timeout of recv (-i) and send (-o)
+	struct __kernel_timespec idleTimeout;
+	struct __kernel_timespec writeTimeout;
+	/// the number of connections
+	int clientCount;
+	/// time when the current completions were got (CLOCK_MONOTONIC)
+	struct timespec batchTime;
+	pthread_t thread;
+};
+
+/// Buffered line reader of replication stream
+typedef struct lineReader lineReader_t;
+struct lineReader
+{
+	int fd;
+	char buf[INT_REPLICA_BUFFER_SIZE];
+	/// the first unread byte in buf
+	int start;
+	/// the end of received data in buf
+	int end;
+};
+
+/// Replica connected to this server
+typedef struct replica replica_t;
+struct replica
+{
+	int fd;
+	/// food info the replica already has ("#replicate <loadedCount> <addedCount>")
+	int loadedCount;
+	int addedCount;
+};
+
+/// Entry of sorted index (food info ordered by lower case name)
+typedef struct indexEntry indexEntry_t;
+struct indexEntry
+{
+	/// interned lower case name
+	char *lowerName;
+	foodinfo_t *info;
+};
+
+/// Food info of single name in exact match index (count entries of gExactInfos from first)
+typedef struct exactGroup exactGroup_t;
+struct exactGroup
+{
+	int first;
+	int count;
+};
+
+/// Food info added after exact match index was built (chained by hash of the name)
+typedef struct exactOverflow exactOverflow_t;
+struct exactOverflow
+{
+	/// lowerName of the entry of gSortedIndex
+	char *lowerName;
+	foodinfo_t *info;
+	exactOverflow_t *next;
 };
 
 /// The number of food info
@@ -52,20 +408,27 @@ int gNewFoodListCount;
 int gSaveFoodListCount;
 /// Listening port number
 int gPortNum;
-/// true: debug false: normal
-bool gIsDebug = false;
+/// Per-request info log is written once in every gLogSampleRate requests
+int gLogSampleRate = 1;
 /// true: SIGINT has been issued
 bool gIsCancel = false;
 /// Server log header: info
 char STR_PRINT_INFO[] = "[info ]";
 /// Server log header: error
 char STR_PRINT_ERR[]  = "[error]";
-/// Server log header: debug
-char STR_PRINT_DEBUG[]  = "[debug]";
 /// No food found
 char STR_NO_FOOD_FOUND[] = "0";
 /// Message for client when food info sent by user successfully added 
 char STR_ADD_STATUS_SUCCESS[] = "success";
+/// Message for client when the page cursor is no longer valid
+char STR_PAGE_STATUS_STALE[] = "#stale";
+/// Message for client when catalog version is the same as "#if <version>"
+char STR_STATUS_NOT_MODIFIED[] = "#notmod";
+/// Message for client when food info is added to replica (add to primary instead)
+char STR_ADD_STATUS_READONLY[] = "#readonly";
+/// Message for UDP client when the response does not fit in a datagram or the request
+/// is not served by UDP (send the request by TCP instead)
+char STR_STATUS_USE_TCP[] = "#tcp";
 
 /// Array of food info
 foodinfo_t **gFoodList;
@@ -73,8 +436,120 @@ foodinfo_t **gFoodList;
 foodinfo_t **gNewFoodList;
 /// Array of all food info (used when SIGINT is issued)
 foodinfo_t **gSaveFoodList;
-/// Socket info
+/// Socket info waiting for executor (ring buffer of gQueueDepth)
 socketInfo_t *gClientList;
+/// Max number of clients waiting for executor
+int gQueueDepth = INT_DEFAULT_QUEUE_DEPTH;
+/// Max time a client waits for executor (milli seconds)
+int gMaxQueueDelayMsec = INT_DEFAULT_MAX_QUEUE_DELAY_MSEC;
+/// Stats port number (0: not used)
+int gStatsPortNum;
+/// Socket of stats port
+int gStatsSockfd = -1;
+/// The first position of gClientList
+int gQueueHead;
+/// The number of clients in gClientList
+int gQueueCount;
+/// The number of clients being served by executors
+int gActiveCount;
+/// Unix socket path to accept the next process (NULL: upgrade is disabled)
+char *gUpgradePath;
+/// Unix socket path of the previous process to take over (NULL: start normally)
+char *gTakeOverPath;
+/// Socket to accept the next process
+int gUpgradeSockfd = -1;
+/// true: accepter stops to hand over listening socket
+bool gIsUpgrading = false;
+/// Pipe to wake accepter up from poll()
+int gWakePipe[2];
+/// Max time from connect to the first byte of request (milli seconds)
+int gIdleTimeoutMsec = INT_DEFAULT_IDLE_TIMEOUT_MSEC;
+/// Max time to receive request (milli seconds)
+int gReadTimeoutMsec = INT_DEFAULT_READ_TIMEOUT_MSEC;
+/// Max time to send response (milli seconds)
+int gWriteTimeoutMsec = INT_DEFAULT_WRITE_TIMEOUT_MSEC;
+/// Sockets polled by accepter: listening socket, wake pipe and pending clients
+struct pollfd *gPollList;
+/// Pending client of each entry in gPollList (NULL for listening socket and wake pipe)
+pendingClient_t **gPendingList;
+/// The number of entries in gPollList
+int gPollCount;
+/// Free pending client entries
+pendingClient_t **gPendingFreeList;
+/// The number of entries in gPendingFreeList
+int gPendingFreeCount;
+/// Idle deadlines of pending clients (used only by accepter)
+timerWheel_t gIdleTimers;
+/// Kept-alive connections returned from executors to accepter
+socketInfo_t *gReturnList;
+/// The number of entries in gReturnList
+int gReturnCount;
+/// Sorted index of all food info (loaded and added by user)
+indexEntry_t *gSortedIndex;
+/// The number of entries in gSortedIndex
+int gSortedIndexCount;
+/// The capacity of gSortedIndex
+int gSortedIndexCapacity;
+/// Incremented whenever gSortedIndex is modified, i.e. food info is registered
+/// (invalidates page cursor, also used as catalog version of "#v"/"#if")
+unsigned int gSortedIndexGeneration;
+/// Id of the catalog (random at startup, carried through handover). Catalog version is
+/// "<id> << 32 | gSortedIndexGeneration", so versions of other servers or of the previous
+/// run do not match.
+unsigned int gCatalogId;
+/// Minimal perfect hash of the names in gSortedIndex when it was built (guarded by indexLock)
+perfectHash_t gExactHash;
+/// false: gExactHash could not be built, exact match searches gSortedIndex
+bool gIsExactHashBuilt;
+/// Keys of gExactHash (lowerName of gSortedIndex)
+char **gExactNames;
+/// Food info of each name in gExactNames
+exactGroup_t *gExactGroups;
+/// Food info grouped by name (in the order of gSortedIndex)
+foodinfo_t **gExactInfos;
+/// Food info added after gExactHash was built (chain of each bucket)
+exactOverflow_t **gExactOverflow;
+/// The number of buckets of gExactOverflow (power of 2)
+int gExactOverflowBuckets;
+/// The number of food info in gExactOverflow
+int gExactOverflowCount;
+/// "<host>:<port>" of primary (NULL: this server is primary)
+char *gPrimaryName;
+/// Address of primary
+struct sockaddr_in gPrimaryAddr;
+/// Connection to primary (fd is -1 when disconnected)
+lineReader_t gPrimaryReader = { -1, {0}, 0, 0 };
+/// Interval to merge food added by user in catalog segment (milli seconds, 0: segment is not used)
+int gSegmentMergeMsec;
+/// Catalog segment searches are sent from (replaced by merger thread)
+segment_t *gSegment;
+/// true: requests are answered by UDP as well (-d)
+bool gUseDatagram;
+/// UDP socket
+int gDatagramSockfd = -1;
+/// Unix domain socket path to listen on (NULL: not used)
+char *gLocalPath;
+/// Unix domain listening socket
+int gLocalSockfd = -1;
+/// Position of the first pending client in gPollList (listening sockets and wake pipe are 
+/// before it)
+int gPollFirstClient = 2;
+/// true: requests are served by io_uring workers (-e uring)
+bool gUseUring;
+/// io_uring workers (INT_MAX_CLIENT_NUMBER)
+ringWorker_t *gRingWorkers;
+/// Name of shared memory channel ("/<name>", NULL: not used)
+char *gShmName;
+/// Shared memory channel
+shmChannel_t *gShmChannel;
+/// Shared memory object of the channel (handed over to the next process, -1: not used)
+int gShmFd = -1;
+/// The number of shared memory requests being served (handover waits until it is 0)
+int gShmServingCount;
+/// Back log of listening sockets (-l)
+int gListenBacklog = INT_DEFAULT_LISTEN_BACKLOG;
+/// TCP options of listening socket and clients (-t, INT_TCP_*)
+int gTcpOptions = INT_DEFAULT_TCP_OPTIONS;
 
 /// socket information
 int sockfd;
@@ -83,13 +558,21 @@ struct sockaddr_in serverAddr;
 //pthread object
 pthread_mutex_t mutex;
 pthread_t acceptor;
+pthread_t statsThread;
+pthread_t upgradeThread;
+pthread_t followerThread;
+pthread_t mergerThread;
+pthread_t datagramThread;
+pthread_t shmThreads[INT_SHM_SERVER_COUNT];
 pthread_t *pIdList;
 pthread_attr_t attr;
 pthread_cond_t cond;
+pthread_rwlock_t indexLock;
+pthread_mutex_t segmentLock;
 
 //semaphore object
-sem_t empty;
 sem_t full;
+sem_t acceptStopped;
 
 
 
@@ -98,11 +581,90 @@ void initializeSignalHandler();
 void sigHandler();
 void checkParameter(int, char**);
 void initializeSocket(int*, struct sockaddr_in*, char*);
-int receiveClientData(int*, int*, char*);
-bool isTargetFood(char*, foodinfo_t*);
+int parseTcpOptions(char*);
+int startListening(int);
+void setClientOptions(int);
+int readSysctl(char*);
+int receiveClientData(int*, int*, char*, int*, unsigned long long*);
+int parseClientData(char*, int, int*, unsigned long long*);
+bool isTargetFood(foodquery_t*, foodinfo_t*);
 void convertToLowerChar(char*, char*);
+char *getLowerName(char*);
+void buildSortedIndex();
+void insertSortedIndex(foodinfo_t*);
+int findSortedIndex(char*);
+int compareIndexEntry(const void*, const void*);
+void buildExactIndex();
+void freeExactIndex();
+void addExactIndex(char*, foodinfo_t*);
+char *searchExact(char*, int*);
+bool parseCompleteRequest(char*, int*, char**);
+void complete(char*, int, char*, int*);
+long getElapsedUsec(struct timespec*);
+bool parsePageRequest(char*, int, int*, char**, char**);
+char *searchPage(char*, char*, int, int*);
+char *dumpPage(char*, char*, int, int*);
+char *createPageText(int*, int, char*);
+char *createFoodListText(foodinfo_t**, int);
+char *appendFoodText(char*, foodinfo_t*);
+char *handleRequest(char*, int, int*);
+void initializeStatsSocket(int);
+void initializeLocalSocket(char*);
+void acceptClient(int);
+bool enqueueClient(socketInfo_t*);
+void dequeueClient(socketInfo_t*);
+void serveClient(socketInfo_t*);
+void processRequest(clientRequest_t*);
+void finishRequest(clientRequest_t*);
+void finishClient();
+void initializePending();
+void addPending(socketInfo_t*);
+void removePending(pendingClient_t*);
+void dispatchClient(socketInfo_t*);
+void returnClient(socketInfo_t*);
+void acceptReturned();
+void setSocketTimeouts(int);
+bool sendAll(int*, char*, int);
+void countIoError();
+void drainClients();
+bool handOver(int);
+int writeSnapshot(int, int, int);
+int loadSnapshot(int);
+void takeOver(char*);
+void sendBusy(int);
+bool initializeRingWorkers();
+void completeRingOperation(ringWorker_t*, unsigned long, int, unsigned int);
+void acceptRingClient(ringWorker_t*, int, int, unsigned int);
+void receiveRingClient(ringWorker_t*, ringClient_t*, int, unsigned int);
+void serveRingClient(ringWorker_t*, ringClient_t*, int);
+void finishRingSend(ringWorker_t*, ringClient_t*, int);
+void reserveRingSqes(ringWorker_t*, unsigned);
+void submitRingAccept(ringWorker_t*, int);
+void submitRingRecv(ringWorker_t*, ringClient_t*);
+void submitRingSend(ringWorker_t*, ringClient_t*);
+void submitRingClose(ringWorker_t*, ringClient_t*);
+void submitRingTimeout(ringWorker_t*, ringClient_t*, struct __kernel_timespec*, int);
+char *getPeerAddress(socketInfo_t*);
+void startReplication(int, char*);
+bool sendNewFood(int, int, int*);
+void resolvePrimary(char*);
+int syncPrimary();
+int readLine(lineReader_t*, char*, int);
+bool buildSegment();
+segment_t *acquireSegment();
+void releaseSegment(segment_t*);
+bool sendSegmentRows(int*, segment_t*, segmentRange_t*, int, int, int, unsigned long long);
+bool sendFileAll(int*, int, off_t, off_t);
+void initializeDatagramSocket(int);
+void serveDatagram(char*, int, struct sockaddr_in*, socklen_t);
+int createBoundedResponse(char*, int, char*, int, bool);
+void serveShmRequest(int);
+int createBoundedBody(char*, int, char*, int, int*);
 void search(char*, char*, int*, int*, bool);
-bool sendToClient(int*, char*, int);
+bool sendToClient(int*, char*, int, int, unsigned long long);
+unsigned long long getCatalogVersion();
+unsigned int createCatalogId();
+char *createResponseData(char*, int, int, unsigned long long, int*, char**);
 void registerNewFood(char*);
 bool saveFoodInfo();
 void sortFoodInfo();
@@ -113,6 +675,14 @@ void disposeAll();
 /// pthread functions
 void *accepter();
 void *executor();
+void *statsServer();
+void *upgradeServer();
+void *replicator(void*);
+void *follower();
+void *segmentMerger();
+void *datagramServer();
+void *ringWorker(void*);
+void *shmServer(void*);
 
 
 /**
@@ -123,50 +693,213 @@ void *executor();
  *	Check parameters
  *	Create 10 threads (executor) to implement searching and adding food data
  *	Create acceptor thread to listen to client request
+ *	With -U, food info and listening socket are taken over from the running process
+ *	instead of loading csv and opening the port.
+ *	With -p, food info is copied from the primary instead of loading csv, and food info
+ *	added to the primary is followed by follower thread.
+ *	With -f, catalog segment is written and food added by user is merged in it by
+ *	merger thread.
+ *	With -d, UDP requests are answered by datagram thread.
+ *	With -m, requests in shared memory channel are answered by shm threads.
+ *	With -x, clients on the same host can connect by Unix domain socket.
+ *	With -e uring, io_uring workers are created instead of executors and acceptor.
+ *	The blocking backend is used when io_uring is not available or with -u.
  *	
  *	@param argc The number of parameter input by user
  *	@param argv Array that has parameter input by user
  */
+//bench.c includes this file to measure the search path
+#ifndef DISTCOM_NO_MAIN
 int main(int argc, char *argv[])
 {
 	gNewFoodListCount = 0;
+	//replaced by the id of the previous process when taken over
+	gCatalogId = createCatalogId();
 	initializeSignalHandler();
 	checkParameter(argc, argv);
-	gFoodList = readCSV(&gFoodListCount, STR_CSV_FILE_NAME);
-	if(gCSVResult == APPLIB_ERR_OPEN)
+	pthread_mutex_init(&mutex, NULL);
+	pthread_rwlock_init(&indexLock, NULL);
+	pthread_cond_init(&cond, NULL);
+	pthread_mutex_init(&segmentLock, NULL);
+	setMatchKernel(MATCHLIB_KERNEL_AVX2);
+	printf("%s Match kernel: %s \n", STR_PRINT_INFO, getMatchKernelName());
+	if(gTakeOverPath != NULL)
 	{
-		printf("%s File open error. File name = %s\n", STR_PRINT_ERR, STR_CSV_FILE_NAME);
-		exit(EXIT_FAILURE);
+		takeOver(gTakeOverPath);
+	}
+	else if(gPrimaryName != NULL)
+	{
+		//replica: food info is copied from the primary
+		if(syncPrimary() != INT_SYNC_OK)
+		{
+			printf("%s Food info could not be copied from primary %s.\n", STR_PRINT_ERR, gPrimaryName);
+			exit(EXIT_FAILURE);
+		}
+		printf("%s Copied food info from primary %s. %d food info (%d added by user) \n", 
+			STR_PRINT_INFO, gPrimaryName, gFoodListCount + gNewFoodListCount, gNewFoodListCount);
+		initializeSocket(&sockfd, &serverAddr, argv[optind]);
+	}
+	else
+	{
+		gFoodList = readCSV(&gFoodListCount, STR_CSV_FILE_NAME);
+		if(gCSVResult == APPLIB_ERR_OPEN)
+		{
+			printf("%s File open error. File name = %s\n", STR_PRINT_ERR, STR_CSV_FILE_NAME);
+			exit(EXIT_FAILURE);
+		}
+		else if(gCSVResult == APPLIB_ERR_MEMORY)
+		{
+			printf("%s Memory allocation error. File name = %s\n", STR_PRINT_ERR, STR_CSV_FILE_NAME);
+			exit(EXIT_FAILURE);
+		}
+		else printf("%s Load csv complete. \n", STR_PRINT_INFO);
+		buildSortedIndex();
+		initializeSocket(&sockfd, &serverAddr, argv[optind]);
+	}
+	if(gUpgradePath != NULL)
+	{
+		if((gUpgradeSockfd = openHandoffListener(gUpgradePath)) == -1)
+		{
+			printf("%s Upgrade socket %s could not be opened. Error code = %d\n", 
+				STR_PRINT_ERR, gUpgradePath, errno);
+			exit(EXIT_FAILURE);
+		}
+		printf("%s Next process can take over on %s \n", STR_PRINT_INFO, gUpgradePath);
+	}
+	if(gUseDatagram) initializeDatagramSocket(gPortNum);
+	if(gShmName != NULL && gShmFd != -1)
+	{
+		//the channel taken over is mapped as it is, so clients which mapped it keep working
+		if((gShmChannel = mapShmChannel(gShmFd)) == NULL)
+		{
+			printf("%s Shared memory channel %s could not be taken over. Error code = %d\n", 
+				STR_PRINT_ERR, gShmName, errno);
+			exit(EXIT_FAILURE);
+		}
+		printf("%s Server is answering shared memory channel %s..... \n", STR_PRINT_INFO, gShmName);
+	}
+	else if(gShmName != NULL)
+	{
+		if((gShmChannel = createShmChannel(gShmName, &gShmFd)) == NULL)
+		{
+			printf("%s Shared memory channel %s could not be created. Error code = %d\n", 
+				STR_PRINT_ERR, gShmName, errno);
+			exit(EXIT_FAILURE);
+		}
+		printf("%s Server is answering shared memory channel %s..... \n", STR_PRINT_INFO, gShmName);
+	}
+	else if(gShmFd != -1)
+	{
+		//the previous process had the channel but this process does not use it
+		close(gShmFd);
+		gShmFd = -1;
+	}
+	//the socket may have been taken over already
+	if(gLocalPath != NULL && gLocalSockfd == -1) initializeLocalSocket(gLocalPath);
+	if(gSegmentMergeMsec > 0)
+	{
+		if(!buildSegment())
+		{
+			printf("%s Catalog segment %s could not be written. Error code = %d\n", 
+				STR_PRINT_ERR, STR_SEGMENT_FILE_NAME, errno);
+			exit(EXIT_FAILURE);
+		}
+		printf("%s Catalog segment %s: %d food info, merged every %dms \n", 
+			STR_PRINT_INFO, STR_SEGMENT_FILE_NAME, gSegment->count, gSegmentMergeMsec);
 	}
-	else printf("%s Load csv complete. \n", STR_PRINT_INFO);
-	initializeSocket(&sockfd, &serverAddr, argv[1]);
 
+	initializeStats();
+	//log is written by background thread from here
+	fflush(stdout);
+	initializeLog(gLogLevel);
 	//init threads attribute
 	pthread_attr_init(&attr);
-	pthread_mutex_init(&mutex, NULL);
-	sem_init(&empty, 0, INT_MAX_CLIENT_NUMBER);
 	sem_init(&full, 0, 0);
-	
-	int i;
-	//create acceptor thread to listen to client request
-	gClientList = (socketInfo_t *)calloc(INT_MAX_CLIENT_NUMBER, sizeof(socketInfo_t));
-	for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
+	sem_init(&acceptStopped, 0, 0);
+	if(pipe(gWakePipe) == -1)
+	{
+		printf("%s pipe() failed. Error code = %d\n", STR_PRINT_ERR, errno);
+		exit(EXIT_FAILURE);
+	}
+	initializePending();
+	printf("%s Timeout: idle = %dms, read = %dms, write = %dms \n", 
+		STR_PRINT_INFO, gIdleTimeoutMsec, gReadTimeoutMsec, gWriteTimeoutMsec);
+	if(gUseUring && gUpgradeSockfd != -1)
+	{
+		//connections held by io_uring workers cannot be drained for the next process
+		printf("%s io_uring backend is not used with -u. Blocking backend is used. \n", STR_PRINT_INFO);
+		gUseUring = false;
+	}
+	if(gUseUring && !initializeRingWorkers())
 	{
-		gClientList[i].fd = -1;
+		printf("%s io_uring is not available. Error code = %d. Blocking backend is used. \n", 
+			STR_PRINT_ERR, errno);
+		gUseUring = false;
 	}
+	
+	int i;
+	//create queue of clients waiting for executor
+	gClientList = (socketInfo_t *)calloc(gQueueDepth, sizeof(socketInfo_t));
+	gQueueHead = 0;
+	gQueueCount = 0;
+	printf("%s Queue depth = %d, Max queue delay = %dms \n", 
+		STR_PRINT_INFO, gQueueDepth, gMaxQueueDelayMsec);
 
 	//create 10 threads
 	pIdList = (pthread_t *)calloc(INT_MAX_CLIENT_NUMBER, sizeof(pthread_t));
-	for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
+	for(i = 0; !gUseUring && i < INT_MAX_CLIENT_NUMBER; i++)
 	{
 		pthread_create(&pIdList[i], &attr, executor, NULL);
 	}
 	
+	if(gStatsPortNum > 0 || gStatsSockfd != -1)
+	{
+		//stats are served on separate port so that they are available under overload
+		//(the socket may have been taken over already)
+		if(gStatsSockfd == -1) initializeStatsSocket(gStatsPortNum);
+		pthread_create(&statsThread, &attr, statsServer, NULL);
+	}
+	if(gUpgradeSockfd != -1)
+	{
+		pthread_create(&upgradeThread, &attr, upgradeServer, NULL);
+	}
+	if(gPrimaryName != NULL)
+	{
+		//after takeover, follower connects to the primary again from the food info taken over
+		pthread_create(&followerThread, &attr, follower, NULL);
+	}
+	if(gSegmentMergeMsec > 0)
+	{
+		pthread_create(&mergerThread, &attr, segmentMerger, NULL);
+	}
+	if(gUseDatagram)
+	{
+		pthread_create(&datagramThread, &attr, datagramServer, NULL);
+	}
+	for(i = 0; gShmChannel != NULL && i < INT_SHM_SERVER_COUNT; i++)
+	{
+		pthread_create(&shmThreads[i], &attr, shmServer, (void *)(long)i);
+	}
+	
+	if(gUseUring)
+	{
+		//each worker accepts and serves its own connections, the workers never stop
+		printf("%s io_uring backend: %d workers \n", STR_PRINT_INFO, INT_MAX_CLIENT_NUMBER);
+		for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
+		{
+			pthread_create(&gRingWorkers[i].thread, &attr, ringWorker, &gRingWorkers[i]);
+		}
+		pthread_join(gRingWorkers[0].thread, NULL);
+		return 0;
+	}
 	pthread_create(&acceptor, &attr, accepter, NULL);
 	pthread_join(acceptor, NULL);
+	//accepter stops only for upgrade, the process exits when the upgrade completes
+	if(gUpgradeSockfd != -1) pthread_join(upgradeThread, NULL);
 	
 	//disposeAll();
 }
+#endif
 
 /**
  * Implement search and response food data. 
@@ -174,484 +907,3191 @@ int main(int argc, char *argv[])
  */
 void *executor()
 {
-	int i;
-	int length = 0;
-	int hitCount = 0;
-	int clientFd = -1;
-	struct sockaddr_in clientAddr;
-	socklen_t clientSize;
+	socketInfo_t client;
 	
 	while(!gIsCancel)
 	{
 		sem_wait(&full);
-		//mutex lock and copy socket info
-		pthread_mutex_lock(&mutex);
-		for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
-		{
-			if(gClientList[i].fd >= 0)
-			{
-				clientFd = gClientList[i].fd;
-				clientAddr = gClientList[i].addr;
-				clientSize = gClientList[i].size;
-				gClientList[i].fd = -1;
-				break;
-			}
-		}
-		pthread_mutex_unlock(&mutex);
-		
-		//output log
-		printf("[Th %x]%s Connection from %s\n", 
-			(unsigned int)pthread_self(), STR_PRINT_INFO, inet_ntoa(clientAddr.sin_addr));
-		
-		char recvData[INT_MAX_RECV_DATA_SIZE];
-		int recvSize = 0;
-		int type = INT_TYPE_SEARCH;
-		//receive request data
-		if(( type = receiveClientData(&clientFd, &recvSize, recvData)) == -1)
-		{
-			close(clientFd);
-			disposeAll();
-		}
-		char *foodInfo;
-		//when search required
-		if(type == INT_TYPE_SEARCH)
-		{
-			//get all length of found food chars
-			search(recvData, NULL, &length, &hitCount, true);
-			foodInfo = (char *)calloc(length, sizeof(char));
-			//search and get food info
-			search(recvData, foodInfo, &length, &hitCount, false);
-		}
-		else
-		{
-			//when new food info sent from client
-			hitCount = -1;
-			registerNewFood(recvData);
-			foodInfo = STR_ADD_STATUS_SUCCESS;
-		}
-		//send search result/add food info result("success" will be sent when succeed)
-		if(!sendToClient(&clientFd, foodInfo, hitCount))
-		{
-			close(clientFd);
-			disposeAll();
-			exit(EXIT_FAILURE);
-		}
-		if(type == INT_TYPE_SEARCH)
-		{
-			//free memory
-			free(foodInfo);
-			foodInfo = NULL;
-		}
-		close(clientFd);
-		
-		//reset variable for next use
-		clientFd = -1;
-		hitCount = 0;
-		length = 0;
-		sem_post(&empty);
+		dequeueClient(&client);
+		serveClient(&client);
+		finishClient();
 	}
 }
 
 /**
- * Listening to client request.
- *	Wait for client connection with accept() function.
- *	Set client connection info in socket info variable.
+ * Serve single client and close the connection.
+ *	Latency of each stage is recorded in stats.
+ *	When the client asks to keep the connection, it is returned to accepter instead.
  *
+ *	@param client	Socket info of the client
  */
-void *accepter()
+void serveClient(socketInfo_t *client)
 {
-	int i;
-	int newFd;
-	struct sockaddr_in clientAddr;
-	socklen_t size;
-
-	//NOTE: 
-	//	accept() function blocks until connection from a client recieves.
-	//	for every accepted connection, use a sepetate process or thread to serve it.
-	//while(1)
-	while(!gIsCancel)
+	int clientFd = client->fd;
+	struct sockaddr_in clientAddr = client->addr;
+	struct timespec stageStart;
+	
+	//shed the request which has waited too long, the client would have given up
+	long queueUsec = getElapsedUsec(&client->readyTime);
+	statRecord(STAT_STAGE_QUEUE, queueUsec);
+	if(queueUsec > gMaxQueueDelayMsec * 1000L)
 	{
-		sem_wait(&empty);
-		size = sizeof(struct sockaddr_in);
-		//wait for connection from client
-		if ((newFd = accept(sockfd, (struct sockaddr *)&clientAddr, &size)) == -1)
-		{
-			printf("[Th %x]%s accept() error. Error code = %d\n", 
-				(unsigned int)pthread_self(), STR_PRINT_ERR, errno );
-			perror("accept");
-			continue;
-		}
-		//mutex lock before add socket info in shared variable
-		pthread_mutex_lock(&mutex);
-		for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
-		{
-			if(gClientList[i].fd < 0)
-			{
-				gClientList[i].fd = newFd;
-				gClientList[i].addr = clientAddr;
-				gClientList[i].size = size;
-				break;
-			}
-		}
-		pthread_mutex_unlock(&mutex);
-		sem_post(&full);
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Queue delay exceeded. Reject %s", 
+			inet_ntoa(clientAddr.sin_addr));
+		statCount(STAT_COUNT_REJECT_DELAY);
+		sendBusy(clientFd);
+		close(clientFd);
+		return;
 	}
 	
-	close(sockfd);
-	//disposeAll();
-}
-
-/**
- * Write new food info in csv file.
- *	Sort all food info including new food info added by user.
- *	Write all food info in csv file.
- *
- *	@return true: process is complete.
- */
-bool saveFoodInfo()
-{
-	printf("\n");
-	printf("%s %d new food info found.\n", STR_PRINT_INFO, gNewFoodListCount);
-	
-	bool ret = true;
-	if(gNewFoodListCount <= 0) return ret;
-	printf("%s Sort all data.....\n", STR_PRINT_INFO);
-	sortFoodInfo();
-	printf("%s Saving the data in the csv file.....\n", STR_PRINT_INFO);
+	//output log
+	LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Connection from %s", inet_ntoa(clientAddr.sin_addr));
 	
-	//call write function and check the result status
-	writeCSV(STR_CSV_FILE_NAME, gSaveFoodList, gSaveFoodListCount);
-	if(gCSVResult == APPLIB_ERR_OPEN)
+	clientRequest_t request;
+	int recvSize = 0;
+	request.ifVersion = 0;
+	//receive request data
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	request.type = receiveClientData(&clientFd, &recvSize, request.data, &request.option, &request.ifVersion);
+	statRecord(STAT_STAGE_RECV, getElapsedUsec(&stageStart));
+	if(request.type == -1)
 	{
-		printf("%s Save file open error.\n", STR_PRINT_ERR);
-		exit(EXIT_FAILURE);
+		close(clientFd);
+		return;
 	}
-	else if(gCSVResult == APPLIB_ERR_REMOVE)
+	if(request.type == INT_TYPE_REPLICATE)
 	{
-		printf("%s File remove error.\n", STR_PRINT_ERR);
-		exit(EXIT_FAILURE);
+		//the connection is kept by replicator thread
+		startReplication(clientFd, request.data);
+		return;
 	}
-	else if(gCSVResult == APPLIB_ERR_RENAME)
+	processRequest(&request);
+	
+	//send search result/add food info result("success" will be sent when succeed)
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	bool isSent;
+	if(request.hitCount > 0 && request.segment != NULL)
 	{
-		printf("%s File name rename error.\n", STR_PRINT_ERR);
-		exit(EXIT_FAILURE);
+		isSent = sendSegmentRows(&clientFd, request.segment, request.ranges, request.rangeCount, 
+			request.hitCount, request.option, request.version);
 	}
-	
-	printf("%s All food has been saved.\n", STR_PRINT_INFO);
-	
-	return true;
+	else isSent = sendToClient(&clientFd, request.response, request.hitCount, request.option, request.version);
+	statRecord(STAT_STAGE_SEND, getElapsedUsec(&stageStart));
+	//free memory
+	finishRequest(&request);
+	statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&client->acceptTime));
+	//kept-alive connection waits for the next request in accepter
+	if(isSent && (request.option & INT_OPTION_KEEPALIVE)) returnClient(client);
+	else close(clientFd);
 }
 
 /**
- * Sort all food information including new food information added by client.
+ * Search (or add) for the request received and count it in stats.
+ *	Rows found in catalog segment are not copied, they are sent from the segment.
  *
+ *	@param request	Request received (type, option and ifVersion are set)
  */
-void sortFoodInfo()
+void processRequest(clientRequest_t *request)
 {
-	//copy all info to new list.
-	gSaveFoodList = (foodinfo_t **)calloc(gNewFoodListCount + gFoodListCount, sizeof(foodinfo_t));
-	int i, j;
-	int index = 0;
-	for(i = 0; i < gFoodListCount; i++)
-	{
-		gSaveFoodList[index++] = gFoodList[i];
-	}
-	for(i = 0; i < gNewFoodListCount; i++)
+	struct timespec stageStart;
+	int type = request->type;
+	clock_gettime(CLOCK_MONOTONIC, &stageStart);
+	//version is taken before the search, food added during the search changes it next time
+	request->version = getCatalogVersion();
+	request->hitCount = 0;
+	request->segment = NULL;
+	request->rangeCount = 0;
+	if((request->option & INT_OPTION_IF_VERSION) && request->ifVersion == request->version 
+		&& (type == INT_TYPE_SEARCH || type == INT_TYPE_COMPLETE || type == INT_TYPE_PAGE 
+		|| type == INT_TYPE_EXACT))
 	{
-		gSaveFoodList[index++] = gNewFoodList[i];
+		//the client has the same result
+		request->response = (char *)calloc(strlen(STR_STATUS_NOT_MODIFIED) + 1, sizeof(char));
+		strcpy(request->response, STR_STATUS_NOT_MODIFIED);
+		request->hitCount = INT_HIT_COUNT_STATUS;
+		request->option &= ~INT_OPTION_VERSION;
 	}
-	
-	gSaveFoodListCount = gFoodListCount + gNewFoodListCount;
-	char orgLower[INT_MAX_RECV_DATA_SIZE];
-	char newLower[INT_MAX_RECV_DATA_SIZE];
-	int cmpRet = 0;
-	foodinfo_t *temp;
-	
-	//sort
-	for(i = 0; i < gSaveFoodListCount - 1; i++)
+	else if(type == INT_TYPE_SEARCH && gSegmentMergeMsec > 0)
 	{
-		for(j = i + 1; j < gSaveFoodListCount; j++)
-		{
-			convertToLowerChar(gSaveFoodList[i]->name, orgLower);
-			convertToLowerChar(gSaveFoodList[j]->name, newLower);
-			if(strcmp(orgLower, newLower) > 0)
-			{
-				temp = gSaveFoodList[i];
-				gSaveFoodList[i] = gSaveFoodList[j];
-				gSaveFoodList[j] = temp;
-			}
-		}
+		//rows found are sent from catalog segment file without copy
+		foodquery_t query;
+		prepareFoodQuery(&query, request->data);
+		request->segment = acquireSegment();
+		request->rangeCount = findSegmentRows(request->segment, &query, request->ranges, &request->hitCount);
+		request->response = (char *)calloc(1, sizeof(char));
 	}
+	else request->response = handleRequest(request->data, type, &request->hitCount);
+	statRecord(STAT_STAGE_SEARCH, getElapsedUsec(&stageStart));
+	statCount(STAT_COUNT_REQUEST);
+	if(request->hitCount > 0) statCount(STAT_COUNT_HIT);
+	else if(request->hitCount == 0) statCount(STAT_COUNT_MISS);
 }
 
-
 /**
- * Register new food information in gNewFoodList valiable.
+ * Free the response and release the catalog segment of the request.
  *
- *	@param newFood new food information entered by user.
+ *	@param request	Request processed by processRequest()
  */
-void registerNewFood(char* newFood)
+void finishRequest(clientRequest_t *request)
 {
-	foodinfo_t *info = getFoodInfo(newFood);
-	if(gNewFoodList == NULL)
-	{
-		//allocate memory to store when the first information receives
-		pthread_mutex_lock(&mutex);
-		gNewFoodList = (foodinfo_t **)malloc(sizeof(foodinfo_t));
-		gNewFoodList[0] = info;
-		gNewFoodListCount = 1;
-		pthread_mutex_unlock(&mutex);
-	}
-	else
-	{
-		foodinfo_t **temp;
-		pthread_mutex_lock(&mutex);
-		temp = (foodinfo_t **)realloc(gNewFoodList, sizeof(foodinfo_t) * (gNewFoodListCount + 1));
-		if(temp == NULL)
-		{
-			//printf("%s Memory re-allocation error.\n", STR_PRINT_ERR);
-			printf("[Th %x]%s Memory re-allocation error.\n", 
-				(unsigned int)pthread_self(), STR_PRINT_ERR);
-			disposeAll();
-			exit(EXIT_FAILURE);
-		}
-		temp[gNewFoodListCount++] = info;
-		gNewFoodList = temp;
-		pthread_mutex_unlock(&mutex);
-	}
+	if(request->segment != NULL) releaseSegment(request->segment);
+	request->segment = NULL;
+	free(request->response);
+	request->response = NULL;
 }
 
 /**
- * Check parameters.
- *	If inappropriate values are entered, shows error message and exit program.
+ * Implement single request.
  *
- *	@param argc	The number of parameters.
- *	@param argv	Array of parameters.
+ *	@param recvData	Request data (options are already removed)
+ *	@param type		Function type
+ *	@param hitCount	The number of food info found 
+ *					(-1: food added, INT_HIT_COUNT_STATUS: the response is status reply)
+ *	@return Response data (has to be freed by caller)
  */
-void checkParameter(int argc, char** argv)
+char *handleRequest(char *recvData, int type, int *hitCount)
 {
-	if (argc != 2)
+	char *foodInfo;
+	int length = 0;
+	*hitCount = 0;
+	if(type == INT_TYPE_COMPLETE)
 	{
-		printf("Command line parameter error. Usage: ./<This file name> <Port number> \n");
-		exit(EXIT_FAILURE);
+		//autocomplete: response is bounded, so fixed size buffer is used
+		int completeCount;
+		char *prefix;
+		foodInfo = (char *)calloc(INT_MAX_COMPLETE_DATA_SIZE + 1, sizeof(char));
+		if(parseCompleteRequest(recvData, &completeCount, &prefix))
+		{
+			complete(prefix, completeCount, foodInfo, hitCount);
+		}
 	}
-	
+	else if(type == INT_TYPE_PAGE)
+	{
+		//pagination: only the requested page is serialized
+		int pageCount;
+		char *cursor;
+		char *word;
+		if(parsePageRequest(recvData + strlen(STR_CMD_PAGE), INT_MAX_PAGE_COUNT, &pageCount, &cursor, &word)
+			&& word[0] != '\0')
+		{
+			foodInfo = searchPage(word, cursor, pageCount, hitCount);
+		}
+		else foodInfo = (char *)calloc(1, sizeof(char));
+	}
+	else if(type == INT_TYPE_DUMP)
+	{
+		//dump: all food info from the name in the order of the sorted index
+		int dumpCount;
+		char *cursor;
+		char *from;
+		if(parsePageRequest(recvData + strlen(STR_CMD_DUMP), INT_MAX_DUMP_COUNT, &dumpCount, &cursor, &from))
+		{
+			foodInfo = dumpPage(from, cursor, dumpCount, hitCount);
+		}
+		else foodInfo = (char *)calloc(1, sizeof(char));
+	}
+	else if(type == INT_TYPE_EXACT)
+	{
+		//exact match: looked up by perfect hash of the name
+		foodInfo = searchExact(recvData + strlen(STR_CMD_EXACT), hitCount);
+	}
+	else if(type == INT_TYPE_STATS)
+	{
+		foodInfo = (char *)calloc(INT_STAT_TEXT_SIZE, sizeof(char));
+		createStatsText(foodInfo, INT_STAT_TEXT_SIZE);
+		*hitCount = INT_HIT_COUNT_STATUS;
+	}
+	else if(type == INT_TYPE_SEARCH)
+	{
+		//get all length of found food chars
+		search(recvData, NULL, &length, hitCount, true);
+		foodInfo = (char *)calloc(length, sizeof(char));
+		//search and get food info
+		search(recvData, foodInfo, &length, hitCount, false);
+	}
+	else if(gPrimaryName != NULL)
+	{
+		//replica has food info of the primary only
+		foodInfo = (char *)calloc(strlen(STR_ADD_STATUS_READONLY) + 1, sizeof(char));
+		strcpy(foodInfo, STR_ADD_STATUS_READONLY);
+		*hitCount = INT_HIT_COUNT_STATUS;
+	}
+	else
+	{
+		//when new food info sent from client
+		*hitCount = -1;
+		registerNewFood(recvData);
+		foodInfo = (char *)calloc(strlen(STR_ADD_STATUS_SUCCESS) + 1, sizeof(char));
+		strcpy(foodInfo, STR_ADD_STATUS_SUCCESS);
+	}
+	return foodInfo;
+}
+
+/**
+ * Serve stats text on the stats port.
+ *	Each connection gets the stats text and is closed.
+ */
+void *statsServer()
+{
+	int fd;
+	char *text = (char *)calloc(INT_STAT_TEXT_SIZE, sizeof(char));
+	while(!gIsCancel)
+	{
+		if((fd = accept(gStatsSockfd, NULL, NULL)) == -1)
+		{
+			if(errno == EINTR) continue;
+			//errors such as EMFILE last for a while, do not spin on them
+			logError("accept() error on stats port. Error code = %d (%s)", errno, strerror(errno));
+			usleep(INT_STATS_RETRY_MSEC * 1000);
+			continue;
+		}
+		setSocketTimeouts(fd);
+		int length = createStatsText(text, INT_STAT_TEXT_SIZE);
+		send(fd, text, length, MSG_NOSIGNAL);
+		close(fd);
+	}
+	free(text);
+	return NULL;
+}
+
+/**
+ * Wait for the next process on the upgrade socket and hand over this server.
+ *	When the handover completes, this process exits without writing csv file 
+ *	because food info added by user is saved by the next process.
+ */
+void *upgradeServer()
+{
+	int fd;
+	while(!gIsCancel)
+	{
+		if((fd = accept(gUpgradeSockfd, NULL, NULL)) == -1) continue;
+		if(handOver(fd))
+		{
+			logInfo("Handed over to the next process. Exit.");
+			stopLog();
+			close(fd);
+			exit(0);
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+/**
+ * Hand over food info and listening socket to the next process.
+ *	1. Send catalog snapshot. The next process loads it while this process is serving.
+ *	2. Stop accepting and drain clients. New connections wait in the backlog of 
+ *	   the listening socket, so they are not refused. Adds by shared memory are
+ *	   answered with "#tcp" from here, so they are sent to the next process.
+ *	3. Send the listening socket, the shared memory channel and food info added 
+ *	   after the snapshot.
+ *	When the next process fails at any step, this process continues serving.
+ *
+ *	@param fd	Connection from the next process
+ *	@return true: the next process is serving
+ */
+bool handOver(int fd)
+{
+	char text[INT_HANDOFF_TEXT_SIZE];
+	int fds[INT_HANDOFF_MAX_FDS];
+	int snapshotFd;
+	int newCount;
+	bool ret;
+	
+	logInfo("Next process connected. Sending snapshot.");
+	if((snapshotFd = createSnapshotFile("distcom-snapshot")) == -1)
+	{
+		logError("memfd_create() error. Error code = %d (%s)", errno, strerror(errno));
+		return false;
+	}
+	newCount = writeSnapshot(snapshotFd, gFoodListCount, 0);
+	ret = newCount != -1 && sendHandoff(fd, STR_HANDOFF_SNAPSHOT, &snapshotFd, 1);
+	close(snapshotFd);
+	if(!ret || receiveHandoff(fd, text, fds, INT_HANDOFF_MAX_FDS) != 0 
+		|| strcmp(text, STR_HANDOFF_READY) != 0)
+	{
+		logError("Next process failed to load snapshot.");
+		return false;
+	}
+	
+	//shared memory threads check it without lock (see serveShmRequest())
+	__atomic_store_n(&gIsUpgrading, true, __ATOMIC_SEQ_CST);
+	write(gWakePipe[1], "u", 1);
+	sem_wait(&acceptStopped);
+	drainClients();
+	logInfo("Accepting stopped and clients drained. Sending listening socket.");
+	
+	ret = false;
+	if((snapshotFd = createSnapshotFile("distcom-delta")) != -1 
+		&& writeSnapshot(snapshotFd, 0, newCount) != -1)
+	{
+		int count = 0;
+		int flags = 0;
+		fds[count++] = sockfd;
+		fds[count++] = snapshotFd;
+		if(gStatsSockfd != -1)
+		{
+			fds[count++] = gStatsSockfd;
+			flags |= INT_HANDOFF_HAS_STATS;
+		}
+		if(gLocalSockfd != -1)
+		{
+			fds[count++] = gLocalSockfd;
+			flags |= INT_HANDOFF_HAS_LOCAL;
+		}
+		if(gShmFd != -1)
+		{
+			fds[count++] = gShmFd;
+			flags |= INT_HANDOFF_HAS_SHM;
+		}
+		//catalog version continues in the next process, so clients keep their cache
+		pthread_rwlock_rdlock(&indexLock);
+		unsigned int generation = gSortedIndexGeneration;
+		pthread_rwlock_unlock(&indexLock);
+		sprintf(text, "%s%d %d %u %u", STR_HANDOFF_SOCKET, gPortNum, flags, gCatalogId, generation);
+		ret = sendHandoff(fd, text, fds, count)
+			&& receiveHandoff(fd, text, fds, INT_HANDOFF_MAX_FDS) == 0
+			&& strcmp(text, STR_HANDOFF_DONE) == 0;
+	}
+	if(snapshotFd != -1) close(snapshotFd);
+	if(!ret)
+	{
+		logError("Next process failed to take over. Resume accepting.");
+		gIsUpgrading = false;
+		pthread_create(&acceptor, &attr, accepter, NULL);
+	}
+	return ret;
+}
+
+/**
+ * Write food info in snapshot file in the same format as csv file.
+ *	"#snapshot <loaded food count> <added food count>\n" is written at the beginning.
+ *
+ *	@param fd			Snapshot file
+ *	@param loadedCount	The number of food info written from gFoodList
+ *	@param newFrom		The first food info written from gNewFoodList
+ *	@return The number of food info in gNewFoodList when written, -1 when failed
+ */
+int writeSnapshot(int fd, int loadedCount, int newFrom)
+{
+	int i;
+	foodinfo_t *info;
+	FILE *fp = fdopen(dup(fd), STR_FILE_OPEN_MODE_WRITE);
+	if(fp == NULL) return -1;
+	
+	//food info added while writing is sent later, so the count is fixed first
+	pthread_mutex_lock(&mutex);
+	int newTo = gNewFoodListCount;
+	pthread_mutex_unlock(&mutex);
+	fprintf(fp, "%s%d %d\n", STR_SNAPSHOT_HEADER, loadedCount, newTo - newFrom);
+	for(i = 0; i < loadedCount; i++)
+	{
+		info = gFoodList[i];
+		fprintf(fp, "%s,%s,%d,%d,%d,%d,%d\n", info->name, info->measure, info->weight,
+			info->kCal, info->fat, info->carbo, info->protein);
+	}
+	//gNewFoodList may be re-allocated by registerNewFood()
+	pthread_mutex_lock(&mutex);
+	for(i = newFrom; i < newTo; i++)
+	{
+		info = gNewFoodList[i];
+		fprintf(fp, "%s,%s,%d,%d,%d,%d,%d\n", info->name, info->measure, info->weight,
+			info->kCal, info->fat, info->carbo, info->protein);
+	}
+	pthread_mutex_unlock(&mutex);
+	
+	bool isError = ferror(fp);
+	if(fclose(fp) != 0 || isError) return -1;
+	return newTo;
+}
+
+/**
+ * Load food info from snapshot file written by writeSnapshot().
+ *	Loaded food info is stored in gFoodList and the sorted index is built,
+ *	then added food info is registered as if it was added by user.
+ *
+ *	@param fd	Snapshot file
+ *	@return The number of food info loaded, -1 when the file is broken
+ */
+int loadSnapshot(int fd)
+{
+	size_t size;
+	int loadedCount, newCount;
+	int i;
+	char *data = mapSnapshotFile(fd, &size);
+	if(data == NULL) return -1;
+	
+	char *end = data + size;
+	char *line = data;
+	char *lineEnd = (char *)memchr(line, STR_CR[0], end - line);
+	if(lineEnd == NULL || sscanf(line, STR_SNAPSHOT_HEADER "%d %d", &loadedCount, &newCount) != 2)
+	{
+		munmap(data, size);
+		return -1;
+	}
+	if(loadedCount > 0)
+	{
+		gFoodList = (foodinfo_t **)calloc(loadedCount, sizeof(foodinfo_t *));
+	}
+	for(i = 0; i < loadedCount + newCount; i++)
+	{
+		line = lineEnd + 1;
+		if(line >= end || (lineEnd = (char *)memchr(line, STR_CR[0], end - line)) == NULL)
+		{
+			munmap(data, size);
+			return -1;
+		}
+		*lineEnd = '\0';
+		if(i < loadedCount)
+		{
+			if((gFoodList[gFoodListCount] = getFoodInfo(line)) == NULL)
+			{
+				munmap(data, size);
+				return -1;
+			}
+			gFoodListCount++;
+			continue;
+		}
+		//loaded food info has to be indexed before added food info is inserted
+		if(gSortedIndex == NULL) buildSortedIndex();
+		registerNewFood(line);
+	}
+	if(gSortedIndex == NULL) buildSortedIndex();
+	munmap(data, size);
+	return loadedCount + newCount;
+}
+
+/**
+ * Take over food info and listening socket from the process on the upgrade socket.
+ *	The process exits when the handover fails, then the previous process continues serving.
+ *
+ *	@param path	Upgrade socket path of the previous process
+ */
+void takeOver(char *path)
+{
+	char text[INT_HANDOFF_TEXT_SIZE];
+	int fds[INT_HANDOFF_MAX_FDS];
+	int count;
+	int fd;
+	
+	if((fd = connectHandoff(path)) == -1)
+	{
+		printf("%s Could not connect to %s. Error code = %d\n", STR_PRINT_ERR, path, errno);
+		exit(EXIT_FAILURE);
+	}
+	printf("%s Taking over from %s..... \n", STR_PRINT_INFO, path);
+	
+	//load snapshot while the previous process is serving
+	count = receiveHandoff(fd, text, fds, INT_HANDOFF_MAX_FDS);
+	if(count < 1 || strcmp(text, STR_HANDOFF_SNAPSHOT) != 0 || loadSnapshot(fds[0]) == -1)
+	{
+		printf("%s Snapshot could not be loaded.\n", STR_PRINT_ERR);
+		exit(EXIT_FAILURE);
+	}
+	close(fds[0]);
+	printf("%s Load snapshot complete. %d food info (%d added by user) \n", 
+		STR_PRINT_INFO, gFoodListCount + gNewFoodListCount, gNewFoodListCount);
+	
+	//the previous process stops accepting, then sends listening socket and food info added 
+	//after the snapshot
+	sendHandoff(fd, STR_HANDOFF_READY, NULL, 0);
+	count = receiveHandoff(fd, text, fds, INT_HANDOFF_MAX_FDS);
+	if(count < 2 || strncmp(text, STR_HANDOFF_SOCKET, strlen(STR_HANDOFF_SOCKET)) != 0 
+		|| loadSnapshot(fds[1]) == -1)
+	{
+		printf("%s Listening socket could not be taken over.\n", STR_PRINT_ERR);
+		exit(EXIT_FAILURE);
+	}
+	close(fds[1]);
+	sockfd = fds[0];
+	//back log and TCP options of this process are used (listen() again only updates them)
+	startListening(sockfd);
+	int flags = 0;
+	unsigned int catalogId;
+	unsigned int generation;
+	if(sscanf(text + strlen(STR_HANDOFF_SOCKET), "%d %d %u %u", 
+		&gPortNum, &flags, &catalogId, &generation) == 4)
+	{
+		//food info is the same as the previous process when it stopped
+		gCatalogId = catalogId;
+		gSortedIndexGeneration = generation;
+	}
+	int next = 2;
+	if((flags & INT_HANDOFF_HAS_STATS) && next < count) gStatsSockfd = fds[next++];
+	if((flags & INT_HANDOFF_HAS_LOCAL) && next < count) gLocalSockfd = fds[next++];
+	if((flags & INT_HANDOFF_HAS_SHM) && next < count) gShmFd = fds[next++];
+	
+	//the previous process exits after this
+	sendHandoff(fd, STR_HANDOFF_DONE, NULL, 0);
+	close(fd);
+	printf("%s Took over port %d. %d food info \n", STR_PRINT_INFO, gPortNum, 
+		gFoodListCount + gNewFoodListCount);
+}
+
+/**
+ * Start to send food info to the replica connected.
+ *	The connection is served by replicator thread until the replica disconnects.
+ *
+ *	@param fd		Connection from the replica
+ *	@param request	"#replicate <loaded food count> <added food count>"
+ */
+void startReplication(int fd, char *request)
+{
+	pthread_t thread;
+	replica_t *replica = (replica_t *)malloc(sizeof(replica_t));
+	replica->fd = fd;
+	if(sscanf(request + strlen(STR_CMD_REPLICATE), "%d %d", 
+		&replica->loadedCount, &replica->addedCount) != 2)
+	{
+		close(fd);
+		free(replica);
+		return;
+	}
+	if(pthread_create(&thread, &attr, replicator, replica) != 0)
+	{
+		logError("pthread_create() error. Error code = %d (%s)", errno, strerror(errno));
+		close(fd);
+		free(replica);
+		return;
+	}
+	pthread_detach(thread);
+}
+
+/**
+ * Send food info to single replica.
+ *	1. Send snapshot (only food info added after the replica's count when it resumes).
+ *	   "#stale" is sent when the replica has different loaded food info.
+ *	2. Send food info added by user line by line as soon as registered. 
+ *	   "#heartbeat" is sent when nothing is added within the interval.
+ *	The thread ends when the replica disconnects.
+ *
+ *	@param arg	Replica (freed by this thread)
+ */
+void *replicator(void *arg)
+{
+	replica_t *replica = (replica_t *)arg;
+	int fd = replica->fd;
+	int sent;
+	
+	//counts are read in the lock taken by registerNewFood()
+	pthread_mutex_lock(&mutex);
+	int loadedCount = gFoodListCount;
+	int addedCount = gNewFoodListCount;
+	pthread_mutex_unlock(&mutex);
+	if(replica->loadedCount == 0 && replica->addedCount == 0)
+	{
+		sent = writeSnapshot(fd, loadedCount, 0);
+	}
+	else if(replica->loadedCount == loadedCount && replica->addedCount <= addedCount)
+	{
+		sent = writeSnapshot(fd, 0, replica->addedCount);
+	}
+	else
+	{
+		logError("Replica has different food info (%d loaded, %d added).", 
+			replica->loadedCount, replica->addedCount);
+		sendAll(&fd, STR_PAGE_STATUS_STALE, strlen(STR_PAGE_STATUS_STALE));
+		sent = -1;
+	}
+	if(sent != -1)
+	{
+		logInfo("Replica connected. Sending food info added by user from %d.", sent);
+		while(sendNewFood(fd, sent, &sent));
+		logInfo("Replica disconnected.");
+	}
+	close(fd);
+	free(replica);
+	return NULL;
+}
+
+/**
+ * Wait for food info added by user and send it to replica.
+ *	"#heartbeat" is sent when nothing is added within the heartbeat interval.
+ *
+ *	@param fd		Connection to the replica
+ *	@param from		The first food info in gNewFoodList to be sent
+ *	@param sent		The number of food info in gNewFoodList sent to the replica
+ *	@return false: the replica has disconnected
+ */
+bool sendNewFood(int fd, int from, int *sent)
+{
+	int i;
+	foodinfo_t *info;
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += INT_REPLICA_HEARTBEAT_MSEC / 1000;
+	deadline.tv_nsec += (INT_REPLICA_HEARTBEAT_MSEC % 1000) * 1000000L;
+	if(deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	
+	pthread_mutex_lock(&mutex);
+	while(gNewFoodListCount == from)
+	{
+		if(pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT) break;
+	}
+	int to = gNewFoodListCount;
+	//gNewFoodList may be re-allocated by registerNewFood(), so lines are written in the lock
+	int size = (to - from) * (MAX_LINE_BUFFER + 1) + sizeof(STR_REPLICA_HEARTBEAT) + 1;
+	char *data = (char *)malloc(size);
+	int length = 0;
+	for(i = from; i < to; i++)
+	{
+		info = gNewFoodList[i];
+		length += snprintf(data + length, size - length, "%s,%s,%d,%d,%d,%d,%d\n", 
+			info->name, info->measure, info->weight, info->kCal, info->fat, info->carbo, info->protein);
+	}
+	pthread_mutex_unlock(&mutex);
+	if(to == from) length = sprintf(data, "%s\n", STR_REPLICA_HEARTBEAT);
+	
+	bool ret = sendAll(&fd, data, length);
+	free(data);
+	*sent = to;
+	return ret;
+}
+
+/**
+ * Get address of the primary from "<host>:<port>".
+ *	Exit when the address is wrong.
+ *
+ *	@param name	"<host>:<port>" of the primary
+ */
+void resolvePrimary(char *name)
+{
+	char host[INT_MAX_RECV_DATA_SIZE];
+	char *colon = strrchr(name, ':');
+	struct hostent *he;
+	if(colon == NULL || colon - name >= (int)sizeof(host) || atoi(colon + 1) <= 0)
+	{
+		printf("%s", STR_USAGE);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(host, name, colon - name);
+	host[colon - name] = '\0';
+	if((he = gethostbyname(host)) == NULL)
+	{
+		printf("%s Primary %s could not be resolved.\n", STR_PRINT_ERR, host);
+		exit(EXIT_FAILURE);
+	}
+	memset(&gPrimaryAddr, 0, sizeof(gPrimaryAddr));
+	gPrimaryAddr.sin_family = AF_INET;
+	gPrimaryAddr.sin_port = htons(atoi(colon + 1));
+	gPrimaryAddr.sin_addr = *((struct in_addr *)he->h_addr);
+	gPrimaryName = name;
+}
+
+/**
+ * Connect to the primary and get food info this replica does not have.
+ *	The first time, snapshot of all food info is loaded in the same way as takeover.
+ *	After that, only food info added after this replica's count is registered.
+ *	The connection is kept in gPrimaryReader for follower thread.
+ *
+ *	@return INT_SYNC_OK, INT_SYNC_FAILED (retry later) or INT_SYNC_STALE (primary has 
+ *			different food info)
+ */
+int syncPrimary()
+{
+	char line[INT_MAX_RECV_DATA_SIZE];
+	char request[sizeof(STR_CMD_REPLICATE) + INT_MAX_SIZE * 2 + 2];
+	int loadedCount, newCount;
+	int i;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd == -1) return INT_SYNC_FAILED;
+	
+	//nothing arrives within the timeout means the primary has gone (heartbeat is sent)
+	struct timeval timeout;
+	timeout.tv_sec = INT_REPLICA_TIMEOUT_MSEC / 1000;
+	timeout.tv_usec = (INT_REPLICA_TIMEOUT_MSEC % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	pthread_mutex_lock(&mutex);
+	int length = sprintf(request, "%s%d %d", STR_CMD_REPLICATE, gFoodListCount, gNewFoodListCount);
+	pthread_mutex_unlock(&mutex);
+	if(connect(fd, (struct sockaddr *)&gPrimaryAddr, sizeof(gPrimaryAddr)) == -1
+		|| send(fd, request, length, MSG_NOSIGNAL) != length)
+	{
+		close(fd);
+		return INT_SYNC_FAILED;
+	}
+	gPrimaryReader.fd = fd;
+	gPrimaryReader.start = 0;
+	gPrimaryReader.end = 0;
+	
+	if(readLine(&gPrimaryReader, line, sizeof(line)) == -1)
+	{
+		close(fd);
+		gPrimaryReader.fd = -1;
+		return INT_SYNC_FAILED;
+	}
+	if(strcmp(line, STR_PAGE_STATUS_STALE) == 0)
+	{
+		close(fd);
+		gPrimaryReader.fd = -1;
+		return INT_SYNC_STALE;
+	}
+	if(sscanf(line, STR_SNAPSHOT_HEADER "%d %d", &loadedCount, &newCount) != 2)
+	{
+		close(fd);
+		gPrimaryReader.fd = -1;
+		return INT_SYNC_FAILED;
+	}
+	
+	int snapshotFd = -1;
+	FILE *fp = NULL;
+	if(gSortedIndex == NULL)
+	{
+		//the first time: snapshot is loaded at once as the next process does at takeover
+		if((snapshotFd = createSnapshotFile("distcom-replica")) == -1
+			|| (fp = fdopen(dup(snapshotFd), STR_FILE_OPEN_MODE_WRITE)) == NULL)
+		{
+			if(snapshotFd != -1) close(snapshotFd);
+			close(fd);
+			gPrimaryReader.fd = -1;
+			return INT_SYNC_FAILED;
+		}
+		fprintf(fp, "%s\n", line);
+	}
+	for(i = 0; i < loadedCount + newCount; i++)
+	{
+		if(readLine(&gPrimaryReader, line, sizeof(line)) == -1) break;
+		if(fp != NULL) fprintf(fp, "%s\n", line);
+		else registerNewFood(line);
+	}
+	bool isLoaded = i == loadedCount + newCount;
+	if(fp != NULL)
+	{
+		isLoaded = fclose(fp) == 0 && isLoaded && loadSnapshot(snapshotFd) != -1;
+		close(snapshotFd);
+	}
+	if(!isLoaded)
+	{
+		close(fd);
+		gPrimaryReader.fd = -1;
+		return INT_SYNC_FAILED;
+	}
+	return INT_SYNC_OK;
+}
+
+/**
+ * Follow food info added to the primary.
+ *	Each line from the primary is registered as if it was added by user.
+ *	When the connection is lost, connect to the primary again and get only food info 
+ *	added in the meantime. When the primary has different food info, the replica exits.
+ */
+void *follower()
+{
+	char line[INT_MAX_RECV_DATA_SIZE];
+	int ret;
+	while(!gIsCancel)
+	{
+		if(gPrimaryReader.fd != -1 && readLine(&gPrimaryReader, line, sizeof(line)) != -1)
+		{
+			if(strcmp(line, STR_REPLICA_HEARTBEAT) != 0) registerNewFood(line);
+			continue;
+		}
+		if(gPrimaryReader.fd != -1)
+		{
+			logError("Connection to primary %s lost. Reconnecting.", gPrimaryName);
+			close(gPrimaryReader.fd);
+			gPrimaryReader.fd = -1;
+		}
+		while((ret = syncPrimary()) == INT_SYNC_FAILED)
+		{
+			usleep(INT_REPLICA_RETRY_MSEC * 1000);
+		}
+		if(ret == INT_SYNC_STALE)
+		{
+			logError("Primary %s has different food info. Restart this replica.", gPrimaryName);
+			stopLog();
+			exit(EXIT_FAILURE);
+		}
+		logInfo("Following primary %s. %d food info added by user.", gPrimaryName, gNewFoodListCount);
+	}
+	return NULL;
+}
+
+/**
+ * Read single line from the connection.
+ *	The line is cut when it is longer than the buffer.
+ *
+ *	@param reader	Connection and its receive buffer
+ *	@param line		Buffer to store the line (without '\n')
+ *	@param size		The size of line
+ *	@return The length of the line, -1 when the connection is closed or timed out
+ */
+int readLine(lineReader_t *reader, char *line, int size)
+{
+	int length = 0;
+	while(true)
+	{
+		if(reader->start == reader->end)
+		{
+			int recvLen = recv(reader->fd, reader->buf, sizeof(reader->buf), 0);
+			if(recvLen == -1 && errno == EINTR) continue;
+			if(recvLen <= 0) return -1;
+			reader->start = 0;
+			reader->end = recvLen;
+		}
+		char *newLine = (char *)memchr(reader->buf + reader->start, STR_CR[0], reader->end - reader->start);
+		int end = newLine != NULL ? newLine - reader->buf : reader->end;
+		int copyLen = end - reader->start;
+		if(copyLen > size - 1 - length) copyLen = size - 1 - length;
+		memcpy(line + length, reader->buf + reader->start, copyLen);
+		length += copyLen;
+		reader->start = newLine != NULL ? end + 1 : end;
+		if(newLine != NULL)
+		{
+			line[length] = '\0';
+			return length;
+		}
+	}
+}
+
+/**
+ * Listening to client request.
+ *	Wait for client connection and request data with poll() function.
+ *	Accepted connections wait here until the request is readable, so a client which 
+ *	connects and sends nothing does not hold an executor. The client is closed when
+ *	no data arrives within the idle timeout (timer wheel).
+ *	When the queue is full, the client is rejected immediately with "#busy <ms>".
+ *	At upgrade, the accepter is woken up through gWakePipe and stops without closing
+ *	the listening socket, which is handed over to the next process.
+ *
+ */
+void *accepter()
+{
+	int i;
+	socketInfo_t client;
+	pendingClient_t *pending;
+	timerEntry_t *timer;
+
+	//NOTE: 
+	//	poll() blocks until connection from a client recieves, a request arrives,
+	//	an idle deadline comes or accepter is woken up.
+	//	for every readable connection, executor thread serves it.
+	//connections returned while accepter was stopped
+	acceptReturned();
+	//while(1)
+	while(!gIsCancel)
+	{
+		int timeout = getTimerWaitMsec(&gIdleTimers, getMonotonicMsec());
+		if(poll(gPollList, gPollCount, timeout) == -1)
+		{
+			if(errno != EINTR) logError("poll() error. Error code = %d (%s)", errno, strerror(errno));
+			continue;
+		}
+		if(gPollList[1].revents & POLLIN)
+		{
+			char wake[INT_MAX_SIZE];
+			read(gWakePipe[0], wake, sizeof(wake));
+			if(gIsUpgrading) break;
+			acceptReturned();
+		}
+		
+		//pass readable (or closed) connections to executors.
+		//removePending() moves the last entry, so check from the end
+		for(i = gPollCount - 1; i >= gPollFirstClient; i--)
+		{
+			if(gPollList[i].revents == 0) continue;
+			pending = gPendingList[i];
+			client = pending->client;
+			removePending(pending);
+			dispatchClient(&client);
+		}
+		
+		//close connections which sent nothing within the idle timeout
+		for(timer = expireTimers(&gIdleTimers, getMonotonicMsec()); timer != NULL; timer = timer->next)
+		{
+			pending = (pendingClient_t *)timer->data;
+			LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Idle timeout. Close %s", 
+				inet_ntoa(pending->client.addr.sin_addr));
+			//kept-alive connection which is not used any more is not an error
+			if(!pending->client.isReused) statCount(STAT_COUNT_TIMEOUT);
+			close(pending->client.fd);
+			removePending(pending);
+		}
+		
+		if(gPollList[0].revents & POLLIN) acceptClient(sockfd);
+		if(gLocalSockfd != -1 && (gPollList[INT_POLL_LOCAL].revents & POLLIN)) acceptClient(gLocalSockfd);
+	}
+	
+	//connections already accepted are served (recv() is bounded by read timeout)
+	while(gPollCount > gPollFirstClient)
+	{
+		pending = gPendingList[gPollCount - 1];
+		client = pending->client;
+		removePending(pending);
+		//kept-alive connection without request is closed, the client connects again
+		char peek;
+		if(client.isReused && recv(client.fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) <= 0) close(client.fd);
+		else dispatchClient(&client);
+	}
+	if(gIsUpgrading)
+	{
+		sem_post(&acceptStopped);
+		return NULL;
+	}
+	close(sockfd);
+	//disposeAll();
+}
+
+/**
+ * Accept connection and wait for its request.
+ *	The address of Unix domain socket client is not set (logged as 0.0.0.0).
+ *
+ *	@param listenFd	Listening socket (TCP or Unix domain)
+ */
+void acceptClient(int listenFd)
+{
+	int newFd;
+	struct sockaddr_in clientAddr;
+	socketInfo_t client;
+	socklen_t size = sizeof(struct sockaddr_in);
+	memset(&clientAddr, 0, sizeof(clientAddr));
+	//wait for connection from client
+	//(executors receive with socket timeouts, so the socket is left blocking)
+	if ((newFd = accept4(listenFd, (struct sockaddr *)&clientAddr, &size, SOCK_CLOEXEC)) == -1)
+	{
+		logError("accept() error. Error code = %d (%s)", errno, strerror(errno));
+		return;
+	}
+	setClientOptions(newFd);
+	client.fd = newFd;
+	client.addr = clientAddr;
+	client.size = size;
+	client.isReused = false;
+	clock_gettime(CLOCK_MONOTONIC, &client.acceptTime);
+	setSocketTimeouts(newFd);
+	if(gPendingFreeCount == 0)
+	{
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Too many connections. Reject %s", 
+			inet_ntoa(clientAddr.sin_addr));
+		statCount(STAT_COUNT_REJECT_FULL);
+		sendBusy(newFd);
+		close(newFd);
+		return;
+	}
+	addPending(&client);
+}
+
+/**
+ * Pass client to executors. When the queue is full, the client is rejected.
+ *
+ *	@param client	Socket info of the client
+ */
+void dispatchClient(socketInfo_t *client)
+{
+	clock_gettime(CLOCK_MONOTONIC, &client->readyTime);
+	//total time of kept-alive connection is measured from the request
+	if(client->isReused) client->acceptTime = client->readyTime;
+	if(!enqueueClient(client))
+	{
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Queue is full. Reject %s", 
+			inet_ntoa(client->addr.sin_addr));
+		statCount(STAT_COUNT_REJECT_FULL);
+		sendBusy(client->fd);
+		close(client->fd);
+		return;
+	}
+	sem_post(&full);
+}
+
+/**
+ * Return kept-alive connection to accepter to wait for the next request.
+ *	Accepter is woken up when the list was empty.
+ *
+ *	@param client	Socket info of the client
+ */
+void returnClient(socketInfo_t *client)
+{
+	pthread_mutex_lock(&mutex);
+	//accepter has stopped for upgrade, the client connects to the next process again
+	if(gIsUpgrading || gReturnCount == INT_MAX_PENDING_CLIENTS)
+	{
+		pthread_mutex_unlock(&mutex);
+		close(client->fd);
+		return;
+	}
+	gReturnList[gReturnCount] = *client;
+	gReturnList[gReturnCount].isReused = true;
+	bool isWake = gReturnCount++ == 0;
+	pthread_mutex_unlock(&mutex);
+	if(isWake) write(gWakePipe[1], "r", 1);
+}
+
+/**
+ * Move connections returned by executors to the poll list of accepter.
+ *	Called only by accepter.
+ */
+void acceptReturned()
+{
+	int i;
+	pthread_mutex_lock(&mutex);
+	for(i = 0; i < gReturnCount; i++)
+	{
+		if(gPendingFreeCount == 0) close(gReturnList[i].fd);
+		else addPending(&gReturnList[i]);
+	}
+	gReturnCount = 0;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Initialize poll list of accepter and pending client entries.
+ *	gPollList[0] is listening socket, gPollList[1] is wake pipe and gPollList[2] is
+ *	Unix domain listening socket (-x).
+ */
+void initializePending()
+{
+	int i;
+	gPollList = (struct pollfd *)calloc(INT_MAX_PENDING_CLIENTS + 3, sizeof(struct pollfd));
+	gPendingList = (pendingClient_t **)calloc(INT_MAX_PENDING_CLIENTS + 3, sizeof(pendingClient_t *));
+	gPendingFreeList = (pendingClient_t **)calloc(INT_MAX_PENDING_CLIENTS, sizeof(pendingClient_t *));
+	pendingClient_t *entries = (pendingClient_t *)calloc(INT_MAX_PENDING_CLIENTS, sizeof(pendingClient_t));
+	for(i = 0; i < INT_MAX_PENDING_CLIENTS; i++)
+	{
+		gPendingFreeList[i] = &entries[i];
+	}
+	gPendingFreeCount = INT_MAX_PENDING_CLIENTS;
+	gReturnList = (socketInfo_t *)calloc(INT_MAX_PENDING_CLIENTS, sizeof(socketInfo_t));
+	gReturnCount = 0;
+	gPollList[0].fd = sockfd;
+	gPollList[0].events = POLLIN;
+	gPollList[1].fd = gWakePipe[0];
+	gPollList[1].events = POLLIN;
+	if(gLocalSockfd != -1)
+	{
+		gPollList[INT_POLL_LOCAL].fd = gLocalSockfd;
+		gPollList[INT_POLL_LOCAL].events = POLLIN;
+		gPollFirstClient = INT_POLL_LOCAL + 1;
+	}
+	gPollCount = gPollFirstClient;
+	initializeTimerWheel(&gIdleTimers);
+}
+
+/**
+ * Start waiting for request of the client. Caller has to check gPendingFreeCount.
+ *
+ *	@param client	Socket info of the client
+ */
+void addPending(socketInfo_t *client)
+{
+	pendingClient_t *pending = gPendingFreeList[--gPendingFreeCount];
+	pending->client = *client;
+	pending->pollIndex = gPollCount;
+	gPollList[gPollCount].fd = client->fd;
+	gPollList[gPollCount].events = POLLIN;
+	gPollList[gPollCount].revents = 0;
+	gPendingList[gPollCount] = pending;
+	gPollCount++;
+	addTimer(&gIdleTimers, &pending->timer, getMonotonicMsec() + gIdleTimeoutMsec, pending);
+}
+
+/**
+ * Stop waiting for request of the client. The socket is not closed.
+ *	The last entry of gPollList is moved to the removed position.
+ *
+ *	@param pending	Pending client
+ */
+void removePending(pendingClient_t *pending)
+{
+	int last = gPollCount - 1;
+	int index = pending->pollIndex;
+	removeTimer(&gIdleTimers, &pending->timer);
+	gPollList[index] = gPollList[last];
+	gPendingList[index] = gPendingList[last];
+	gPendingList[index]->pollIndex = index;
+	gPollCount--;
+	gPendingFreeList[gPendingFreeCount++] = pending;
+}
+
+/**
+ * Set read and write timeout of client socket.
+ *	recv()/send() fails with EAGAIN when the timeout passes.
+ *
+ *	@param fd	Socket of the client
+ */
+void setSocketTimeouts(int fd)
+{
+	struct timeval timeout;
+	timeout.tv_sec = gReadTimeoutMsec / 1000;
+	timeout.tv_usec = (gReadTimeoutMsec % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	timeout.tv_sec = gWriteTimeoutMsec / 1000;
+	timeout.tv_usec = (gWriteTimeoutMsec % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Add client at the end of the queue.
+ *
+ *	@param client	Socket info of the client
+ *	@return false: The queue is full.
+ */
+bool enqueueClient(socketInfo_t *client)
+{
+	//mutex lock before add socket info in shared variable
+	pthread_mutex_lock(&mutex);
+	if(gQueueCount >= gQueueDepth)
+	{
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+	gClientList[(gQueueHead + gQueueCount) % gQueueDepth] = *client;
+	gQueueCount++;
+	pthread_mutex_unlock(&mutex);
+	return true;
+}
+
+/**
+ * Take the first client from the queue.
+ *	Caller has to wait for "full" semaphore before calling.
+ *
+ *	@param client	Socket info of the client
+ */
+void dequeueClient(socketInfo_t *client)
+{
+	pthread_mutex_lock(&mutex);
+	*client = gClientList[gQueueHead];
+	gQueueHead = (gQueueHead + 1) % gQueueDepth;
+	gQueueCount--;
+	//counted as active in the same lock, so the client is always seen by drainClients()
+	gActiveCount++;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Called when executor has finished the client taken by dequeueClient().
+ */
+void finishClient()
+{
+	pthread_mutex_lock(&mutex);
+	gActiveCount--;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Wait until all queued and in-flight clients are served.
+ *	Accepter has to be stopped before calling. Shared memory requests being served 
+ *	are waited for as well (new adds by shared memory are not answered while upgrading).
+ */
+void drainClients()
+{
+	while(true)
+	{
+		pthread_mutex_lock(&mutex);
+		bool isDrained = gQueueCount == 0 && gActiveCount == 0;
+		pthread_mutex_unlock(&mutex);
+		isDrained = isDrained && __atomic_load_n(&gShmServingCount, __ATOMIC_SEQ_CST) == 0;
+		if(isDrained) return;
+		usleep(INT_DRAIN_CHECK_USEC);
+	}
+}
+
+/**
+ * Send "#busy <retry after milli seconds>" to client.
+ *
+ *	@param fd	Socket of the client
+ */
+void sendBusy(int fd)
+{
+	char data[INT_MAX_SIZE + sizeof(STR_STATUS_BUSY)];
+	int length = sprintf(data, "%s%d", STR_STATUS_BUSY, gMaxQueueDelayMsec);
+	//do not wait for slow client
+	send(fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+	//discard request already received, otherwise close() resets the connection 
+	//and the client may lose the reply
+	char discard[INT_MAX_RECV_DATA_SIZE];
+	while(recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0);
+}
+
+/**
+ * Create io_uring instance and receive buffers of each worker.
+ *	Provided buffer ring (Linux 5.19) is required, multishot accept is supported since
+ *	the same version.
+ *
+ *	@return false: io_uring is not available (errno is set)
+ */
+bool initializeRingWorkers()
+{
+	int i;
+	gRingWorkers = (ringWorker_t *)calloc(INT_MAX_CLIENT_NUMBER, sizeof(ringWorker_t));
+	for(i = 0; i < INT_MAX_CLIENT_NUMBER; i++)
+	{
+		ringWorker_t *worker = &gRingWorkers[i];
+		bool isReady = initializeUring(&worker->uring, INT_RING_ENTRIES) != -1;
+		if(isReady && registerUringBuffers(&worker->uring, &worker->buffers, INT_RING_BUFFER_GROUP, 
+			INT_RING_BUFFER_COUNT, INT_MAX_RECV_DATA_SIZE) == -1)
+		{
+			int error = errno;
+			closeUring(&worker->uring);
+			errno = error;
+			isReady = false;
+		}
+		if(!isReady)
+		{
+			int error = errno;
+			while(--i >= 0)
+			{
+				closeUring(&gRingWorkers[i].uring);
+				freeUringBuffers(&gRingWorkers[i].buffers);
+			}
+			free(gRingWorkers);
+			gRingWorkers = NULL;
+			errno = error;
+			return false;
+		}
+		worker->idleTimeout.tv_sec = gIdleTimeoutMsec / 1000;
+		worker->idleTimeout.tv_nsec = (gIdleTimeoutMsec % 1000) * 1000000L;
+		worker->writeTimeout.tv_sec = gWriteTimeoutMsec / 1000;
+		worker->writeTimeout.tv_nsec = (gWriteTimeoutMsec % 1000) * 1000000L;
+	}
+	return true;
+}
+
+/**
+ * Accept, receive and send by io_uring.
+ *	Operations submitted while handling completions are submitted together with the 
+ *	wait for the next completions, so single system call is made per batch instead of 
+ *	accept/recv/send/close of each request, and no lock is taken between threads.
+ *	The request is served (searched) by the worker itself.
+ *
+ *	@param arg	Worker
+ */
+void *ringWorker(void *arg)
+{
+	ringWorker_t *worker = (ringWorker_t *)arg;
+	struct io_uring_cqe *cqe;
+	submitRingAccept(worker, sockfd);
+	if(gLocalSockfd != -1) submitRingAccept(worker, gLocalSockfd);
+	while(!gIsCancel)
+	{
+		if(submitUring(&worker->uring, 1) == -1 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+		{
+			logError("io_uring_enter() error. Error code = %d (%s)", errno, strerror(errno));
+		}
+		clock_gettime(CLOCK_MONOTONIC, &worker->batchTime);
+		while((cqe = peekUringCqe(&worker->uring)) != NULL)
+		{
+			unsigned long userData = cqe->user_data;
+			int res = cqe->res;
+			unsigned int flags = cqe->flags;
+			seenUringCqe(&worker->uring);
+			completeRingOperation(worker, userData, res, flags);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Handle completion of io_uring operation.
+ *	The connection is freed when it is closed and all its operations have completed.
+ *
+ *	@param worker	Worker
+ *	@param userData	user_data of the operation (connection and INT_RING_OP_*)
+ *	@param res		Result of the operation
+ *	@param flags	Flags of the completion
+ */
+void completeRingOperation(ringWorker_t *worker, unsigned long userData, int res, unsigned int flags)
+{
+	int op = userData & INT_RING_OP_MASK;
+	if(op == INT_RING_OP_ACCEPT)
+	{
+		acceptRingClient(worker, (int)(userData >> INT_RING_OP_BITS), res, flags);
+		return;
+	}
+	ringClient_t *rc = (ringClient_t *)(userData & ~(unsigned long)INT_RING_OP_MASK);
+	rc->inflight--;
+	if(op == INT_RING_OP_RECV) receiveRingClient(worker, rc, res, flags);
+	else if(op == INT_RING_OP_SEND) finishRingSend(worker, rc, res);
+	//close linked to the send which failed is cancelled
+	else if(op == INT_RING_OP_CLOSE && res == -ECANCELED) close(rc->client.fd);
+	//nothing to do for timeout (the operation timed out completes with -ECANCELED)
+	if(rc->isClosed && rc->inflight == 0)
+	{
+		free(rc);
+		worker->clientCount--;
+	}
+}
+
+/**
+ * Start serving the connection accepted by multishot accept.
+ *	Accept is submitted again when it stops (e.g. on error).
+ *
+ *	@param worker	Worker
+ *	@param listenFd	Listening socket (TCP or Unix domain)
+ *	@param res		Socket of the client, or -errno
+ *	@param flags	Flags of the completion
+ */
+void acceptRingClient(ringWorker_t *worker, int listenFd, int res, unsigned int flags)
+{
+	if(!(flags & IORING_CQE_F_MORE)) submitRingAccept(worker, listenFd);
+	if(res < 0)
+	{
+		logError("accept() error. Error code = %d (%s)", -res, strerror(-res));
+		return;
+	}
+	ringClient_t *rc = NULL;
+	if(worker->clientCount >= INT_MAX_PENDING_CLIENTS || (rc = (ringClient_t *)calloc(1, sizeof(ringClient_t))) == NULL)
+	{
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Too many connections. Reject");
+		statCount(STAT_COUNT_REJECT_FULL);
+		sendBusy(res);
+		close(res);
+		return;
+	}
+	worker->clientCount++;
+	setClientOptions(res);
+	rc->client.fd = res;
+	//the address is got only when it is logged (see getPeerAddress())
+	rc->client.size = 0;
+	rc->client.isReused = false;
+	clock_gettime(CLOCK_MONOTONIC, &rc->client.acceptTime);
+	submitRingRecv(worker, rc);
+}
+
+/**
+ * Handle completion of recv.
+ *	The request is copied from the provided buffer and the buffer is returned at once.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ *	@param res		The size received, or -errno (-ECANCELED: idle timeout)
+ *	@param flags	Flags of the completion (buffer ID)
+ */
+void receiveRingClient(ringWorker_t *worker, ringClient_t *rc, int res, unsigned int flags)
+{
+	if(flags & IORING_CQE_F_BUFFER)
+	{
+		int id = flags >> IORING_CQE_BUFFER_SHIFT;
+		if(res > 0) memcpy(rc->request.data, getUringBuffer(&worker->buffers, id), res);
+		returnUringBuffer(&worker->buffers, id);
+	}
+	if(res > 0)
+	{
+		rc->request.data[res] = '\0';
+		serveRingClient(worker, rc, res);
+		return;
+	}
+	if(res == -ENOBUFS)
+	{
+		//all buffers were taken in this batch, the request is still in the socket
+		submitRingRecv(worker, rc);
+		return;
+	}
+	if(res == -ECANCELED)
+	{
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Idle timeout. Close %s", getPeerAddress(&rc->client));
+		//kept-alive connection which is not used any more is not an error
+		if(!rc->client.isReused) statCount(STAT_COUNT_TIMEOUT);
+	}
+	else if(res < 0)
+	{
+		errno = -res;
+		countIoError();
+		logError("recv() error. Error code = %d (%s)", errno, strerror(errno));
+	}
+	//res == 0: client closed the connection (kept-alive connection is closed this way)
+	submitRingClose(worker, rc);
+}
+
+/**
+ * Serve the request received by io_uring worker.
+ *	The response is sent by send linked with close (or recv of the next request on 
+ *	kept-alive connection when the send completes). Rows of catalog segment are sent 
+ *	by blocking sendfile() because io_uring has no sendfile.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ *	@param recvSize	The size of the request
+ */
+void serveRingClient(ringWorker_t *worker, ringClient_t *rc, int recvSize)
+{
+	socketInfo_t *client = &rc->client;
+	clientRequest_t *request = &rc->request;
+	//completions got together are served in turn, the wait is the queue time
+	client->readyTime = worker->batchTime;
+	if(client->isReused) client->acceptTime = client->readyTime;
+	statRecord(STAT_STAGE_QUEUE, getElapsedUsec(&client->readyTime));
+	LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Connection from %s", getPeerAddress(client));
+	
+	request->ifVersion = 0;
+	request->type = parseClientData(request->data, recvSize, &request->option, &request->ifVersion);
+	if(request->type == INT_TYPE_REPLICATE)
+	{
+		//the connection is kept by replicator thread with blocking send
+		setSocketTimeouts(client->fd);
+		startReplication(client->fd, request->data);
+		rc->isClosed = true;
+		return;
+	}
+	processRequest(request);
+	
+	if(request->hitCount > 0 && request->segment != NULL)
+	{
+		struct timespec stageStart;
+		clock_gettime(CLOCK_MONOTONIC, &stageStart);
+		if(!rc->hasTimeouts) setSocketTimeouts(client->fd);
+		rc->hasTimeouts = true;
+		bool isSent = sendSegmentRows(&client->fd, request->segment, request->ranges, 
+			request->rangeCount, request->hitCount, request->option, request->version);
+		statRecord(STAT_STAGE_SEND, getElapsedUsec(&stageStart));
+		finishRequest(request);
+		statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&client->acceptTime));
+		client->isReused = true;
+		if(isSent && (request->option & INT_OPTION_KEEPALIVE)) submitRingRecv(worker, rc);
+		else submitRingClose(worker, rc);
+		return;
+	}
+	if(request->hitCount >= 0) LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Hit = %d", request->hitCount);
+	rc->sendData = createResponseData(request->response, request->hitCount, request->option, 
+		request->version, &rc->sendLength, &rc->sendBuffer);
+	if(rc->sendData == NULL)
+	{
+		finishRequest(request);
+		submitRingClose(worker, rc);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &rc->sendTime);
+	submitRingSend(worker, rc);
+}
+
+/**
+ * Handle completion of send. The response is freed.
+ *	Kept-alive connection waits for the next request, otherwise close is linked.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ *	@param res		The size sent, or -errno (-ECANCELED: write timeout)
+ */
+void finishRingSend(ringWorker_t *worker, ringClient_t *rc, int res)
+{
+	statRecord(STAT_STAGE_SEND, getElapsedUsec(&rc->sendTime));
+	bool isSent = res == rc->sendLength;
+	if(!isSent)
+	{
+		//the rest of the send is retried by kernel (MSG_WAITALL), so short send is an error
+		errno = res == -ECANCELED ? EAGAIN : (res < 0 ? -res : EIO);
+		countIoError();
+		logError("send() error. Error code = %d (%s) Sent = %d/%d", 
+			errno, strerror(errno), res < 0 ? 0 : res, rc->sendLength);
+	}
+	free(rc->sendBuffer);
+	rc->sendBuffer = NULL;
+	finishRequest(&rc->request);
+	statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&rc->client.acceptTime));
+	if(rc->isClosed) return;
+	rc->client.isReused = true;
+	if(isSent) submitRingRecv(worker, rc);
+	else submitRingClose(worker, rc);
+}
+
+/**
+ * Make sure the entries of linked operations are submitted together.
+ *
+ *	@param worker	Worker
+ *	@param count	The number of entries needed
+ */
+void reserveRingSqes(ringWorker_t *worker, unsigned count)
+{
+	while(getUringSpace(&worker->uring) < count)
+	{
+		if(submitUring(&worker->uring, 0) == -1 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+		{
+			logError("io_uring_enter() error. Error code = %d (%s)", errno, strerror(errno));
+		}
+	}
+}
+
+/**
+ * Submit multishot accept (single completion per connection until it stops).
+ *
+ *	@param worker	Worker
+ *	@param listenFd	Listening socket
+ */
+void submitRingAccept(ringWorker_t *worker, int listenFd)
+{
+	reserveRingSqes(worker, 1);
+	struct io_uring_sqe *sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listenFd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = ((unsigned long)listenFd << INT_RING_OP_BITS) | INT_RING_OP_ACCEPT;
+}
+
+/**
+ * Submit recv of the request with idle timeout.
+ *	The buffer is selected from the provided buffers when the request arrives.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ */
+void submitRingRecv(ringWorker_t *worker, ringClient_t *rc)
+{
+	reserveRingSqes(worker, 2);
+	struct io_uring_sqe *sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = rc->client.fd;
+	//keep the last byte for '\0'
+	sqe->len = INT_MAX_RECV_DATA_SIZE - 1;
+	sqe->flags = IOSQE_BUFFER_SELECT | IOSQE_IO_LINK;
+	sqe->buf_group = INT_RING_BUFFER_GROUP;
+	sqe->user_data = (unsigned long)rc | INT_RING_OP_RECV;
+	rc->inflight++;
+	submitRingTimeout(worker, rc, &worker->idleTimeout, 0);
+}
+
+/**
+ * Submit send of the response with write timeout.
+ *	Close is linked unless the connection is kept alive.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection (sendData is set)
+ */
+void submitRingSend(ringWorker_t *worker, ringClient_t *rc)
+{
+	bool isClosing = !(rc->request.option & INT_OPTION_KEEPALIVE);
+	reserveRingSqes(worker, 3);
+	struct io_uring_sqe *sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = rc->client.fd;
+	sqe->addr = (unsigned long)rc->sendData;
+	sqe->len = rc->sendLength;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = (unsigned long)rc | INT_RING_OP_SEND;
+	rc->inflight++;
+	submitRingTimeout(worker, rc, &worker->writeTimeout, isClosing ? IOSQE_IO_LINK : 0);
+	if(!isClosing) return;
+	//runs only when the send succeeds (cancelled otherwise, see completeRingOperation())
+	sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = rc->client.fd;
+	sqe->user_data = (unsigned long)rc | INT_RING_OP_CLOSE;
+	rc->inflight++;
+	rc->isClosed = true;
+}
+
+/**
+ * Submit close of the connection.
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ */
+void submitRingClose(ringWorker_t *worker, ringClient_t *rc)
+{
+	reserveRingSqes(worker, 1);
+	struct io_uring_sqe *sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = rc->client.fd;
+	sqe->user_data = (unsigned long)rc | INT_RING_OP_CLOSE;
+	rc->inflight++;
+	rc->isClosed = true;
+}
+
+/**
+ * Submit timeout linked to the entry just before (the space is reserved by caller).
+ *
+ *	@param worker	Worker
+ *	@param rc		Connection
+ *	@param timeout	Timeout (kept by worker until the entry is submitted)
+ *	@param flags	IOSQE_IO_LINK when the next entry is linked to the operation
+ */
+void submitRingTimeout(ringWorker_t *worker, ringClient_t *rc, struct __kernel_timespec *timeout, int flags)
+{
+	struct io_uring_sqe *sqe = getUringSqe(&worker->uring);
+	sqe->opcode = IORING_OP_LINK_TIMEOUT;
+	sqe->addr = (unsigned long)timeout;
+	sqe->len = 1;
+	sqe->flags = flags;
+	sqe->user_data = (unsigned long)rc | INT_RING_OP_TIMEOUT;
+	rc->inflight++;
+}
+
+/**
+ * Get IP address of the client for log.
+ *	The address is not got by multishot accept, so it is got when it is needed first.
+ *	The address of Unix domain socket client is 0.0.0.0.
+ *
+ *	@param client	Socket info of the client
+ *	@return IP address
+ */
+char *getPeerAddress(socketInfo_t *client)
+{
+	if(client->size == 0)
+	{
+		client->size = sizeof(client->addr);
+		getpeername(client->fd, (struct sockaddr *)&client->addr, &client->size);
+	}
+	return inet_ntoa(client->addr.sin_addr);
+}
+
+/**
+ * Write new food info in csv file.
+ *	Sort all food info including new food info added by user.
+ *	Write all food info in csv file.
+ *
+ *	@return true: process is complete.
+ */
+bool saveFoodInfo()
+{
+	printf("\n");
+	printf("%s %d new food info found.\n", STR_PRINT_INFO, gNewFoodListCount);
+	
+	bool ret = true;
+	if(gNewFoodListCount <= 0) return ret;
+	printf("%s Sort all data.....\n", STR_PRINT_INFO);
+	sortFoodInfo();
+	printf("%s Saving the data in the csv file.....\n", STR_PRINT_INFO);
+	
+	//call write function and check the result status
+	writeCSV(STR_CSV_FILE_NAME, gSaveFoodList, gSaveFoodListCount);
+	if(gCSVResult == APPLIB_ERR_OPEN)
+	{
+		printf("%s Save file open error.\n", STR_PRINT_ERR);
+		exit(EXIT_FAILURE);
+	}
+	else if(gCSVResult == APPLIB_ERR_REMOVE)
+	{
+		printf("%s File remove error.\n", STR_PRINT_ERR);
+		exit(EXIT_FAILURE);
+	}
+	else if(gCSVResult == APPLIB_ERR_RENAME)
+	{
+		printf("%s File name rename error.\n", STR_PRINT_ERR);
+		exit(EXIT_FAILURE);
+	}
+	
+	printf("%s All food has been saved.\n", STR_PRINT_INFO);
+	
+	return true;
+}
+
+/**
+ * Sort all food information including new food information added by client.
+ *
+ */
+void sortFoodInfo()
+{
+	//copy all info to new list.
+	gSaveFoodList = (foodinfo_t **)calloc(gNewFoodListCount + gFoodListCount, sizeof(foodinfo_t *));
+	int i, j;
+	int index = 0;
+	for(i = 0; i < gFoodListCount; i++)
+	{
+		gSaveFoodList[index++] = gFoodList[i];
+	}
+	for(i = 0; i < gNewFoodListCount; i++)
+	{
+		gSaveFoodList[index++] = gNewFoodList[i];
+	}
+	
+	gSaveFoodListCount = gFoodListCount + gNewFoodListCount;
+	char orgLower[INT_MAX_RECV_DATA_SIZE];
+	char newLower[INT_MAX_RECV_DATA_SIZE];
+	int cmpRet = 0;
+	foodinfo_t *temp;
+	
+	//sort
+	for(i = 0; i < gSaveFoodListCount - 1; i++)
+	{
+		for(j = i + 1; j < gSaveFoodListCount; j++)
+		{
+			convertToLowerChar(gSaveFoodList[i]->name, orgLower);
+			convertToLowerChar(gSaveFoodList[j]->name, newLower);
+			if(strcmp(orgLower, newLower) > 0)
+			{
+				temp = gSaveFoodList[i];
+				gSaveFoodList[i] = gSaveFoodList[j];
+				gSaveFoodList[j] = temp;
+			}
+		}
+	}
+}
+
+
+/**
+ * Register new food information in gNewFoodList valiable.
+ *
+ *	@param newFood new food information entered by user.
+ */
+void registerNewFood(char* newFood)
+{
+	foodinfo_t *info = getFoodInfo(newFood);
+	if(info == NULL)
+	{
+		logError("Memory allocation error.");
+		stopLog();
+		disposeAll();
+		exit(EXIT_FAILURE);
+	}
+	if(gNewFoodList == NULL)
+	{
+		//allocate memory to store when the first information receives
+		pthread_mutex_lock(&mutex);
+		gNewFoodList = (foodinfo_t **)malloc(sizeof(foodinfo_t *));
+		gNewFoodList[0] = info;
+		gNewFoodListCount = 1;
+		pthread_mutex_unlock(&mutex);
+	}
+	else
+	{
+		foodinfo_t **temp;
+		pthread_mutex_lock(&mutex);
+		temp = (foodinfo_t **)realloc(gNewFoodList, sizeof(foodinfo_t *) * (gNewFoodListCount + 1));
+		if(temp == NULL)
+		{
+			logError("Memory re-allocation error.");
+			stopLog();
+			disposeAll();
+			exit(EXIT_FAILURE);
+		}
+		temp[gNewFoodListCount++] = info;
+		gNewFoodList = temp;
+		pthread_mutex_unlock(&mutex);
+	}
+	//wake replicator threads up
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	//make new food visible to autocomplete
+	insertSortedIndex(info);
+}
+
+/**
+ * Check parameters.
+ *	If inappropriate values are entered, shows error message and exit program.
+ *
+ *	@param argc	The number of parameters.
+ *	@param argv	Array of parameters.
+ */
+void checkParameter(int argc, char** argv)
+{
+	int opt;
+	while((opt = getopt(argc, argv, STR_OPTIONS)) != -1)
+	{
+		switch(opt)
+		{
+		case 'q':
+			gQueueDepth = atoi(optarg);
+			break;
+		case 'w':
+			gMaxQueueDelayMsec = atoi(optarg);
+			break;
+		case 's':
+			gStatsPortNum = atoi(optarg);
+			break;
+		case 'L':
+			if((gLogLevel = getLogLevel(optarg)) < 0)
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'S':
+			gLogSampleRate = atoi(optarg);
+			break;
+		case 'u':
+			gUpgradePath = optarg;
+			break;
+		case 'U':
+			gTakeOverPath = optarg;
+			break;
+		case 'i':
+			gIdleTimeoutMsec = atoi(optarg);
+			break;
+		case 'r':
+			gReadTimeoutMsec = atoi(optarg);
+			break;
+		case 'o':
+			gWriteTimeoutMsec = atoi(optarg);
+			break;
+		case 'p':
+			resolvePrimary(optarg);
+			break;
+		case 'd':
+			gUseDatagram = true;
+			break;
+		case 'x':
+			gLocalPath = optarg;
+			break;
+		case 'l':
+			gListenBacklog = atoi(optarg);
+			break;
+		case 't':
+			if((gTcpOptions = parseTcpOptions(optarg)) < 0)
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'm':
+			//"/<name>" and "<name>" are the same channel
+			if(optarg[0] == '/') optarg++;
+			if(optarg[0] == '\0' || strchr(optarg, '/') != NULL)
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			gShmName = (char *)calloc(strlen(optarg) + 2, sizeof(char));
+			sprintf(gShmName, "/%s", optarg);
+			break;
+		case 'e':
+			if(strcmp(optarg, STR_BACKEND_URING) == 0) gUseUring = true;
+			else if(strcmp(optarg, STR_BACKEND_POLL) == 0) gUseUring = false;
+			else
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'f':
+			gSegmentMergeMsec = atoi(optarg);
+			if(gSegmentMergeMsec <= 0)
+			{
+				printf("%s", STR_USAGE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			printf("%s", STR_USAGE);
+			exit(EXIT_FAILURE);
+		}
+	}
+	//port number is not needed when the port is taken over
+	int portCount = argc - optind;
+	if (portCount > 1 || (portCount == 0 && gTakeOverPath == NULL)
+		|| gQueueDepth <= 0 || gMaxQueueDelayMsec <= 0 || gLogSampleRate <= 0
+		|| gIdleTimeoutMsec <= 0 || gReadTimeoutMsec <= 0 || gWriteTimeoutMsec <= 0
+		|| gListenBacklog <= 0)
+	{
+		printf("%s", STR_USAGE);
+		exit(EXIT_FAILURE);
+	}
+	if(portCount == 0) return;
+	
+	int i;
+	char *port = argv[optind];
+	//check input data
+	for(i = 0; port[i] != '\0'; i++)
+	{
+		if(!isdigit(*(port + i)))
+		{
+			printf("Command line parameter error: Port number is not digit.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	//if the number is less than 1024
+	if(atoi(port) < 1024)
+	{
+		printf("Note: The port number is in the range of well-known port.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Write catalog segment from the sorted index and use it for searches.
+ *	The index is copied under the read lock and the file is written without the lock.
+ *	Catalog version is changed when the segment is replaced, so the client which has 
+ *	the result of the previous segment ("#if") gets food merged in the new segment.
+ *
+ *	@return false: the file could not be written (the previous segment is used)
+ */
+bool buildSegment()
+{
+	int i;
+	pthread_rwlock_rdlock(&indexLock);
+	int count = gSortedIndexCount;
+	char **lowerNames = (char **)malloc(sizeof(char *) * (count + 1));
+	foodinfo_t **infos = (foodinfo_t **)malloc(sizeof(foodinfo_t *) * (count + 1));
+	for(i = 0; i < count; i++)
+	{
+		lowerNames[i] = gSortedIndex[i].lowerName;
+		infos[i] = gSortedIndex[i].info;
+	}
+	pthread_rwlock_unlock(&indexLock);
+	
+	segment_t *segment = createSegment(STR_SEGMENT_FILE_NAME, lowerNames, infos, count);
+	free(infos);
+	if(segment == NULL)
+	{
+		free(lowerNames);
+		return false;
+	}
+	pthread_rwlock_wrlock(&indexLock);
+	pthread_mutex_lock(&segmentLock);
+	segment_t *previous = gSegment;
+	gSegment = segment;
+	pthread_mutex_unlock(&segmentLock);
+	if(previous != NULL) gSortedIndexGeneration++;
+	pthread_rwlock_unlock(&indexLock);
+	//the previous segment is freed when the last search using it finishes
+	if(previous != NULL) releaseSegment(previous);
+	return true;
+}
+
+/**
+ * Merge food added by user in catalog segment periodically.
+ */
+void *segmentMerger()
+{
+	while(!gIsCancel)
+	{
+		usleep(gSegmentMergeMsec * 1000L);
+		pthread_rwlock_rdlock(&indexLock);
+		//only merger thread replaces gSegment
+		int addedCount = gSortedIndexCount - gSegment->count;
+		pthread_rwlock_unlock(&indexLock);
+		if(addedCount == 0) continue;
+		if(buildSegment())
+		{
+			logInfo("Merged %d food info in catalog segment. %d food info", addedCount, gSegment->count);
+		}
+		else logError("Catalog segment %s could not be written. Error code = %d", STR_SEGMENT_FILE_NAME, errno);
+	}
+	return NULL;
+}
+
+/**
+ * Get catalog segment to be used by search.
+ *
+ *	@return Catalog segment (has to be released by releaseSegment())
+ */
+segment_t *acquireSegment()
+{
+	pthread_mutex_lock(&segmentLock);
+	segment_t *segment = gSegment;
+	segment->refCount++;
+	pthread_mutex_unlock(&segmentLock);
+	return segment;
+}
+
+/**
+ * Release catalog segment. The segment replaced by merger is freed by the last user.
+ *
+ *	@param segment	Catalog segment
+ */
+void releaseSegment(segment_t *segment)
+{
+	pthread_mutex_lock(&segmentLock);
+	bool isUnused = --segment->refCount == 0;
+	pthread_mutex_unlock(&segmentLock);
+	if(isUnused) freeSegment(segment);
+}
+
+/**
+ * Send rows of catalog segment to client.
+ *	Response headers are sent with send() and the rows with sendfile() from page cache.
+ *	TCP_CORK is set while sending so that the headers and rows are sent in full segments.
+ *	The rows are not compressed even if the client accepts compression.
+ *
+ *	@param fd			Socket information
+ *	@param segment		Catalog segment
+ *	@param ranges		Rows found by findSegmentRows()
+ *	@param rangeCount	The number of ranges
+ *	@param hitCount		The number of rows
+ *	@param option		Request option flags
+ *	@param version		Catalog version when the request was handled
+ *	@return true: sent successfully
+ */
+bool sendSegmentRows(int *fd, segment_t *segment, segmentRange_t *ranges, int rangeCount, 
+	int hitCount, int option, unsigned long long version)
+{
+	int i;
+	LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Hit = %d", hitCount);
+	off_t length = 0;
+	for(i = 0; i < rangeCount; i++) length += getSegmentRangeSize(segment, &ranges[i]);
+	
+	char versionHeader[INT_MAX_VERSION_HEADER_SIZE];
+	int versionLength = 0;
+	if(option & INT_OPTION_VERSION)
+	{
+		versionLength = sprintf(versionHeader, "%s%llu\n", STR_VERSION_HEADER, version);
+	}
+	char header[INT_MAX_FRAME_HEADER_SIZE + INT_MAX_VERSION_HEADER_SIZE];
+	int headerLength = 0;
+	if(option & INT_OPTION_KEEPALIVE)
+	{
+		headerLength = sprintf(header, "%s%ld\n", STR_FRAME_HEADER, (long)length + versionLength);
+	}
+	memcpy(header + headerLength, versionHeader, versionLength);
+	headerLength += versionLength;
+	
+	int cork = 1;
+	setsockopt(*fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+	bool ret = headerLength == 0 || sendAll(fd, header, headerLength);
+	for(i = 0; ret && i < rangeCount; i++)
+	{
+		ret = sendFileAll(fd, segment->fd, segment->offsets[ranges[i].first], 
+			getSegmentRangeSize(segment, &ranges[i]));
+	}
+	cork = 0;
+	setsockopt(*fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+	return ret;
+}
+
+/**
+ * Send part of file to client by sendfile() (the same as sendAll() for file).
+ *
+ *	@param fd		Socket information
+ *	@param fileFd	File to be sent
+ *	@param offset	Offset of the data in the file
+ *	@param length	The size of the data
+ *	@return true: sent successfully
+ */
+bool sendFileAll(int *fd, int fileFd, off_t offset, off_t length)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	off_t sent = 0;
+	while(sent < length)
+	{
+		ssize_t sendLen = sendfile(*fd, fileFd, &offset, length - sent);
+		if(sendLen == -1 && errno == EINTR) continue;
+		if(sendLen == 0)
+		{
+			//the file is shorter than the index
+			sendLen = -1;
+			errno = EIO;
+		}
+		if(sendLen != -1 && sent + sendLen < length && getElapsedUsec(&start) > gWriteTimeoutMsec * 1000L)
+		{
+			//client reads too slowly
+			sendLen = -1;
+			errno = EAGAIN;
+		}
+		if(sendLen == -1)
+		{
+			countIoError();
+			logError("sendfile() error. Error code = %d (%s) Sent = %ld/%ld", 
+				errno, strerror(errno), (long)sent, (long)length);
+			return false;
+		}
+		sent += sendLen;
+	}
+	return true;
+}
+
+/**
+ * Open UDP socket on the port number.
+ *	SO_REUSEPORT is set so that the next process (-U) can open the port while this 
+ *	process is running.
+ *
+ *	@param port	Port number
+ */
+void initializeDatagramSocket(int port)
+{
+	struct sockaddr_in addr;
+	int on = 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+	if((gDatagramSockfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1
+		|| setsockopt(gDatagramSockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1
+		|| bind(gDatagramSockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		printf("%s UDP port %d could not be opened. Error code = %d\n", STR_PRINT_ERR, port, errno);
+		perror("bind()");
+		exit(EXIT_FAILURE);
+	}
+	printf("%s Server is answering UDP on port %d..... \n", STR_PRINT_INFO, port);
+}
+
+/**
+ * Answer UDP requests. Each request is single datagram and so is the response.
+ */
+void *datagramServer()
+{
+	char recvData[INT_MAX_RECV_DATA_SIZE];
+	struct sockaddr_in clientAddr;
+	while(!gIsCancel)
+	{
+		socklen_t size = sizeof(clientAddr);
+		//keep the last byte for '\0'
+		int recvSize = recvfrom(gDatagramSockfd, recvData, INT_MAX_RECV_DATA_SIZE - 1, 0, 
+			(struct sockaddr *)&clientAddr, &size);
+		if(recvSize == -1)
+		{
+			if(errno != EINTR) logError("recvfrom() error. Error code = %d (%s)", errno, strerror(errno));
+			continue;
+		}
+		recvData[recvSize] = '\0';
+		serveDatagram(recvData, recvSize, &clientAddr, size);
+	}
+	return NULL;
+}
+
+/**
+ * Answer single UDP request.
+ *	"#tcp" is returned when the response does not fit in a datagram, for adds and the 
+ *	other requests (see createBoundedResponse()).
+ *
+ *	@param recvData		Request data
+ *	@param recvSize		The size of recvData
+ *	@param clientAddr	Client address
+ *	@param addrSize		The size of clientAddr
+ */
+void serveDatagram(char *recvData, int recvSize, struct sockaddr_in *clientAddr, socklen_t addrSize)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	statCount(STAT_COUNT_DATAGRAM);
+	char datagram[INT_MAX_DATAGRAM_SIZE + 1];
+	int length = createBoundedResponse(recvData, recvSize, datagram, INT_MAX_DATAGRAM_SIZE, false);
+	if(length == -1)
+	{
+		statCount(STAT_COUNT_DATAGRAM_TCP);
+		length = sprintf(datagram, "%s", STR_STATUS_USE_TCP);
+	}
+	
+	if(sendto(gDatagramSockfd, datagram, length, 0, (struct sockaddr *)clientAddr, addrSize) == -1)
+	{
+		countIoError();
+		logError("sendto() error. Error code = %d (%s)", errno, strerror(errno));
+	}
+	statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&start));
+}
+
+/**
+ * Answer requests in shared memory channel.
+ *	Requests are checked for a while before sleeping on futex, so the request which
+ *	comes soon after the previous one does not need a system call.
+ *
+ *	@param arg	Thread number (threads start checking from different slots)
+ */
+void *shmServer(void *arg)
+{
 	int i;
-	//check input data
-	for(i = 0; i < argv[1][i] != '\0'; i++)
+	int start = (int)(long)arg * (INT_SHM_SLOT_COUNT / INT_SHM_SERVER_COUNT);
+	while(!gIsCancel)
 	{
-		if(!isdigit(*(argv[1] + i)))
+		//read before checking, waitShmRequest() returns at once when a request is added
+		uint32_t seq = __atomic_load_n(&gShmChannel->requestSeq, __ATOMIC_SEQ_CST);
+		int index = -1;
+		for(i = 0; index == -1 && i < INT_SHM_SPIN_COUNT; i++) index = takeShmRequest(gShmChannel, start);
+		if(index == -1)
 		{
-			printf("Command line parameter error: Port number is not digit.\n");
-			exit(EXIT_FAILURE);
+			waitShmRequest(gShmChannel, seq);
+			continue;
 		}
+		serveShmRequest(index);
+		start = (index + 1) % INT_SHM_SLOT_COUNT;
 	}
-	//if the number is less than 1024
-	if(atoi(argv[1]) < 1024)
+	return NULL;
+}
+
+/**
+ * Answer single request in shared memory channel.
+ *	"#tcp" is returned when the response does not fit in the slot, and for replication.
+ *	Adds are answered with "#tcp" while upgrading as well, so that food info is not added
+ *	after the delta snapshot is written (the client adds it by TCP to the next process).
+ *
+ *	@param index	Slot number
+ */
+void serveShmRequest(int index)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	statCount(STAT_COUNT_SHM);
+	shmSlot_t *slot = &gShmChannel->slots[index];
+	//the request is copied because the client can write in the slot
+	char recvData[INT_MAX_RECV_DATA_SIZE];
+	int recvSize = slot->requestLength;
+	if(recvSize < 0 || recvSize >= INT_MAX_RECV_DATA_SIZE) recvSize = 0;
+	memcpy(recvData, slot->request, recvSize);
+	recvData[recvSize] = '\0';
+	
+	//counted before gIsUpgrading is checked, so handOver() either waits for this request
+	//or this request sees gIsUpgrading
+	__atomic_add_fetch(&gShmServingCount, 1, __ATOMIC_SEQ_CST);
+	bool isAddAllowed = !__atomic_load_n(&gIsUpgrading, __ATOMIC_SEQ_CST);
+	//keep the last byte for '\0'
+	int length = createBoundedResponse(recvData, recvSize, slot->response, INT_SHM_RESPONSE_SIZE - 1, 
+		isAddAllowed);
+	__atomic_sub_fetch(&gShmServingCount, 1, __ATOMIC_SEQ_CST);
+	if(length == -1)
 	{
-		printf("Note: The port number is in the range of well-known port.\n");
+		statCount(STAT_COUNT_SHM_TCP);
+		length = sprintf(slot->response, "%s", STR_STATUS_USE_TCP);
+	}
+	completeShmRequest(gShmChannel, index, length);
+	statRecord(STAT_STAGE_TOTAL, getElapsedUsec(&start));
+}
+
+/**
+ * Create the response which has to fit in the buffer (UDP datagram or shared memory slot).
+ *	Searches, completion and pages are answered ("#if" and "#v" can be used), and the
+ *	other requests except replication as well when isAddAllowed. Responses are not 
+ *	compressed ("#z" is ignored) and not framed ("#k" is ignored).
+ *
+ *	@param recvData		Request data ('\0' terminated, options are removed)
+ *	@param recvSize		The size of recvData
+ *	@param ret			Buffer of the response
+ *	@param size			The size of ret
+ *	@param isAddAllowed	true: adds, stats and dumps are answered as well
+ *	@return The size of the response, -1 when it is larger than size or the request is 
+ *		not answered (send the request by TCP)
+ */
+int createBoundedResponse(char *recvData, int recvSize, char *ret, int size, bool isAddAllowed)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int option;
+	unsigned long long ifVersion = 0;
+	int type = parseClientData(recvData, recvSize, &option, &ifVersion);
+	
+	int length = -1;
+	int hitCount = INT_HIT_COUNT_STATUS;
+	unsigned long long version = getCatalogVersion();
+	bool isReadOnly = type == INT_TYPE_SEARCH || type == INT_TYPE_COMPLETE || type == INT_TYPE_PAGE
+		|| type == INT_TYPE_EXACT;
+	if(type == INT_TYPE_REPLICATE || (!isReadOnly && !isAddAllowed))
+	{
+		//adds are received by TCP so that the client knows the result
+	}
+	else if(isReadOnly && (option & INT_OPTION_IF_VERSION) && ifVersion == version)
+	{
+		length = snprintf(ret, size, "%s", STR_STATUS_NOT_MODIFIED);
+	}
+	else
+	{
+		int headerLength = 0;
+		if(option & INT_OPTION_VERSION) headerLength = snprintf(ret, size, "%s%llu\n", STR_VERSION_HEADER, version);
+		int bodyLength = createBoundedBody(recvData, type, ret + headerLength, size - headerLength, &hitCount);
+		if(bodyLength != -1) length = headerLength + bodyLength;
+	}
+	statRecord(STAT_STAGE_SEARCH, getElapsedUsec(&start));
+	statCount(STAT_COUNT_REQUEST);
+	if(hitCount > 0) statCount(STAT_COUNT_HIT);
+	else if(hitCount == 0) statCount(STAT_COUNT_MISS);
+	return length;
+}
+
+/**
+ * Create the response body of UDP or shared memory request.
+ *	The size of search result is checked before it is created, so the request which
+ *	finds many food does not allocate memory.
+ *
+ *	@param recvData	Request data (options are already removed)
+ *	@param type		Function type
+ *	@param ret		Buffer of the response
+ *	@param size		The size of ret
+ *	@param hitCount	The number of food info found
+ *	@return The size of the response, -1 when it is larger than size
+ */
+int createBoundedBody(char *recvData, int type, char *ret, int size, int *hitCount)
+{
+	int i;
+	int length = 0;
+	*hitCount = 0;
+	if(type == INT_TYPE_SEARCH && gSegmentMergeMsec > 0)
+	{
+		//the same rows as TCP, read from catalog segment
+		foodquery_t query;
+		segmentRange_t ranges[INT_SEGMENT_MAX_RANGES];
+		prepareFoodQuery(&query, recvData);
+		segment_t *segment = acquireSegment();
+		int rangeCount = findSegmentRows(segment, &query, ranges, hitCount);
+		for(i = 0; i < rangeCount; i++) length += getSegmentRangeSize(segment, &ranges[i]);
+		if(length > size) length = -1;
+		else length = 0;
+		for(i = 0; length != -1 && i < rangeCount; i++)
+		{
+			int rangeSize = getSegmentRangeSize(segment, &ranges[i]);
+			if(pread(segment->fd, ret + length, rangeSize, segment->offsets[ranges[i].first]) == rangeSize)
+			{
+				length += rangeSize;
+			}
+			else length = -1;
+		}
+		releaseSegment(segment);
+	}
+	else if(type == INT_TYPE_SEARCH)
+	{
+		//length includes '\0'
+		search(recvData, NULL, &length, hitCount, true);
+		if(length - 1 > size) return -1;
+		ret[0] = '\0';
+		search(recvData, ret, &length, hitCount, false);
+		length = strlen(ret);
+	}
+	else
+	{
+		char *foodInfo = handleRequest(recvData, type, hitCount);
+		length = strlen(foodInfo);
+		if(length <= size) memcpy(ret, foodInfo, length);
+		else length = -1;
+		free(foodInfo);
+	}
+	if(length == -1) return -1;
+	if(*hitCount == 0) length = sprintf(ret, "%s", STR_NO_FOOD_FOUND);
+	return length;
+}
+
+/**
+ * Send data to client.
+ *	When user sends a search word, the function returns the result.
+ *	When user add new food information, the function returns the message "success".
+ *
+ *	When client asks for catalog version, "#version <version>\n" is put before the data.
+ *	When client accepts compression, large data is compressed.
+ *
+ *	@param fd		Socket information
+ *	@param sendData	The data to be sent to client
+ *	@param hitCount	The number of food information found
+ *	@param option	Request option flags
+ *	@param version	Catalog version when the request was handled
+ */
+bool sendToClient(int *fd, char *sendData, int hitCount, int option, unsigned long long version)
+{
+	if(hitCount >= 0)
+	{
+		//display hit count as a log
+		LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Hit = %d", hitCount);
+	}
+	
+	char *buffer;
+	int length;
+	char *data = createResponseData(sendData, hitCount, option, version, &length, &buffer);
+	if(data == NULL) return false;
+	//send data to client
+	bool ret = sendAll(fd, data, length);
+	if(!ret) logDebug("sendToClient() Sent data: \n%s", sendData);
+	free(buffer);
+	return ret;
+}
+
+/**
+ * Create the data sent to client from the response.
+ *	When no food found or new food information has been successfully added, the status
+ *	is sent instead. Catalog version ("#v") is put before the response and compressed
+ *	together. Responses larger than INT_COMPRESS_THRESHOLD are compressed ("#z") unless
+ *	they do not get smaller. On kept-alive connection, "#size <size>\n" is put before 
+ *	all, because the end of the response is not told by closing the connection.
+ *	The data is made in single buffer so that single send() is needed, otherwise the
+ *	data may wait for delayed ack of the header.
+ *
+ *	@param sendData	Response data
+ *	@param hitCount	The number of the food info found
+ *	@param option	Request option flags
+ *	@param version	Catalog version when the request was handled
+ *	@param length	The size of the data
+ *	@param buffer	Buffer of the data (has to be freed by caller, NULL when sendData 
+ *					or status is sent as it is)
+ *	@return Data to be sent, NULL when memory could not be allocated
+ */
+char *createResponseData(char *sendData, int hitCount, int option, unsigned long long version, 
+	int *length, char **buffer)
+{
+	char *data = sendData;
+	if(hitCount == 0) data = STR_NO_FOOD_FOUND;
+	else if(hitCount == -1) data = STR_ADD_STATUS_SUCCESS;
+	int dataLength = strlen(data);
+	*buffer = NULL;
+	*length = dataLength;
+	char versionHeader[INT_MAX_VERSION_HEADER_SIZE];
+	int versionLength = 0;
+	if(option & INT_OPTION_VERSION)
+	{
+		versionLength = sprintf(versionHeader, "%s%llu\n", STR_VERSION_HEADER, version);
+	}
+	int bodyLength = versionLength + dataLength;
+	bool isCompressed = hitCount > 0 && (option & INT_OPTION_COMPRESS) && bodyLength > INT_COMPRESS_THRESHOLD;
+	if(!isCompressed && !(option & (INT_OPTION_VERSION | INT_OPTION_KEEPALIVE))) return data;
+	
+	//headers are put before the body in the space reserved at the beginning
+	int bound = isCompressed ? lzCompressBound(bodyLength) : 0;
+	char *buf = (char *)malloc(INT_MAX_FRAME_HEADER_SIZE + INT_MAX_COMPRESS_HEADER_SIZE + bodyLength + bound);
+	if(buf == NULL) return NULL;
+	char *body = buf + INT_MAX_FRAME_HEADER_SIZE + INT_MAX_COMPRESS_HEADER_SIZE;
+	memcpy(body, versionHeader, versionLength);
+	memcpy(body + versionLength, data, dataLength);
+	if(isCompressed)
+	{
+		char *compressed = body + bodyLength;
+		int compLength = lzCompress(body, bodyLength, compressed, bound);
+		if(compLength > 0 && compLength < bodyLength)
+		{
+			char header[INT_MAX_COMPRESS_HEADER_SIZE];
+			int headerLength = sprintf(header, "%s%d %d\n", STR_COMPRESS_HEADER, bodyLength, compLength);
+			logDebug("createResponseData() %d -> %d bytes", bodyLength, headerLength + compLength);
+			body = compressed - headerLength;
+			memcpy(body, header, headerLength);
+			bodyLength = headerLength + compLength;
+		}
+	}
+	if(option & INT_OPTION_KEEPALIVE)
+	{
+		char header[INT_MAX_FRAME_HEADER_SIZE];
+		int headerLength = sprintf(header, "%s%d\n", STR_FRAME_HEADER, bodyLength);
+		body -= headerLength;
+		memcpy(body, header, headerLength);
+		bodyLength += headerLength;
+	}
+	*buffer = buf;
+	*length = bodyLength;
+	return body;
+}
+
+/**
+ * Get catalog version.
+ *	The version is changed whenever food info is registered. The catalog id is in the
+ *	upper 32 bits, so the version of a restarted server or a replica is not the same as
+ *	the version a client got from another catalog.
+ *
+ *	@return Catalog version
+ */
+unsigned long long getCatalogVersion()
+{
+	pthread_rwlock_rdlock(&indexLock);
+	unsigned long long version = ((unsigned long long)gCatalogId << 32) | gSortedIndexGeneration;
+	pthread_rwlock_unlock(&indexLock);
+	return version;
+}
+
+/**
+ * Create id of the catalog of this process.
+ *
+ *	@return Random id (not 0)
+ */
+unsigned int createCatalogId()
+{
+	unsigned int id = 0;
+	if(getrandom(&id, sizeof(id), GRND_NONBLOCK) != sizeof(id))
+	{
+		//not random enough to be secret, but differs between processes and runs
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		id = (unsigned int)(now.tv_sec ^ now.tv_nsec ^ ((long)getpid() << 16));
+	}
+	return id != 0 ? id : 1;
+}
+
+/**
+ * Send all data to client.
+ *	send() may send a part of data when the client is slow (each send() is bounded
+ *	by SO_SNDTIMEO), so the rest is sent until the write timeout passes in total.
+ *	Errors are logged and counted in stats.
+ *
+ *	@param fd		Socket information
+ *	@param data		The data to be sent
+ *	@param length	The size of data
+ *	@return true: sent successfully
+ */
+bool sendAll(int *fd, char *data, int length)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int sent = 0;
+	while(sent < length)
+	{
+		int sendLen = send(*fd, data + sent, length - sent, 0);
+		if(sendLen == -1 && errno == EINTR) continue;
+		if(sendLen != -1 && sent + sendLen < length && getElapsedUsec(&start) > gWriteTimeoutMsec * 1000L)
+		{
+			//client reads too slowly
+			sendLen = -1;
+			errno = EAGAIN;
+		}
+		if(sendLen == -1)
+		{
+			countIoError();
+			logError("send() error. Error code = %d (%s) Sent = %d/%d", 
+				errno, strerror(errno), sent, length);
+			return false;
+		}
+		sent += sendLen;
+	}
+	return true;
+}
+
+/**
+ * Count recv()/send() error in stats.
+ *	Timeout of SO_RCVTIMEO/SO_SNDTIMEO (EAGAIN) is counted as timeout.
+ */
+void countIoError()
+{
+	if(errno == EAGAIN || errno == EWOULDBLOCK) statCount(STAT_COUNT_TIMEOUT);
+	else statCount(STAT_COUNT_ERROR);
+}
+
+/**
+ * Search and get food information.
+ *	The function sets the number of food information found in hitCount variable.
+ *
+ *	@param searchWord	Search word
+ *	@param ret			Variable to store all food information found
+ *	@param retLength	The number of the characters of the food information.
+ *	@param hitCount		The number of the information found.
+ *	@param needLength	true: The function only set the value into retLength.
+ */
+void search(char *searchWord, char *ret, int *retLength, int *hitCount, bool needLength)
+{
+	int i;
+	int count = 0;
+	foodinfo_t *info;
+	int fullCharLength = 0;
+	foodquery_t query;
+	prepareFoodQuery(&query, searchWord);
+	
+	for(i = 0; i < gFoodListCount; i++)
+	{
+		//search food
+		if(!isTargetFood(&query, gFoodList[i])) continue;
+
+		//increment count
+		count++;
+		info = gFoodList[i];
+		char weight[INT_MAX_SIZE];
+		char kCal[INT_MAX_SIZE];
+		char fat[INT_MAX_SIZE];
+		char carbo[INT_MAX_SIZE];
+		char protein[INT_MAX_SIZE];
+		//convert int into char
+		sprintf(weight,"%d", info->weight);
+		sprintf(kCal,"%d", info->kCal);
+		sprintf(fat,"%d", info->fat);
+		sprintf(carbo,"%d", info->carbo);
+		sprintf(protein,"%d", info->protein);
+
+		fullCharLength += strlen(info->name) + strlen(info->measure) + strlen(weight);
+		fullCharLength += strlen(kCal) + strlen(fat) + strlen(carbo) + strlen(protein);
+		
+		//INT_DEFAULT_SPLIT_COUNT is for separation (comma) between each fields
+		fullCharLength +=  INT_DEFAULT_SPLIT_COUNT;
+		//when the number of chars is required
+		if(needLength) continue;
+
+		//add food info in ret variable
+		createFoodInfoText(ret, info->name, info->measure, weight, kCal, fat, carbo, protein);
+	}
+	if(needLength) *retLength = fullCharLength + 1;
+	
+	*hitCount = count;
+	logDebug("search() needLength(0:false, 1:true) = %d, Hit = %d", needLength, *hitCount);
+	if(!needLength) logDebug("search() Search Result : \n%s", ret);
+}
+
+/**
+ * Compare search word with food name.
+ *
+ *	@param query	Search word prepared by prepareFoodQuery()
+ *	@param info		Single food information
+ *	@return true: The food is to be sent to client.
+ */
+bool isTargetFood(foodquery_t *query, foodinfo_t *info)
+{
+	return matchFoodName(query, info->name);
+}
+
+/**
+ * Convert character to lower case.
+ *
+ *	@param target	The character to be converted.
+ *	@param ret		The character converted to lower case.
+ */
+void convertToLowerChar(char *target, char *ret)
+{
+	int i;
+	for(i = 0; target[i] != '\0'; i++)
+	{
+		ret[i] = tolower(target[i]);
+	}
+	ret[i] = '\0';
+}
+
+/**
+ * Get interned lower case name (the food info of the same name share single string).
+ *	The process exits when no memory is left.
+ *
+ *	@param name	Food name
+ *	@return Lower case name (must not be modified nor freed)
+ */
+char *getLowerName(char *name)
+{
+	char lowerName[strlen(name) + 1];
+	convertToLowerChar(name, lowerName);
+	char *ret = internString(lowerName);
+	if(ret == NULL)
+	{
+		logError("Memory allocation error.");
+		stopLog();
+		disposeAll();
 		exit(EXIT_FAILURE);
 	}
+	return ret;
+}
+
+/**
+ * Build sorted index of the food info loaded from csv file.
+ *	Each entry keeps lower case name so that prefix lookup does not need conversion.
+ */
+void buildSortedIndex()
+{
+	int i;
+	gSortedIndexCapacity = gFoodListCount > INT_INDEX_INITIAL_CAPACITY 
+		? gFoodListCount * 2 : INT_INDEX_INITIAL_CAPACITY;
+	gSortedIndex = (indexEntry_t *)calloc(gSortedIndexCapacity, sizeof(indexEntry_t));
+	for(i = 0; i < gFoodListCount; i++)
+	{
+		gSortedIndex[i].lowerName = getLowerName(gFoodList[i]->name);
+		gSortedIndex[i].info = gFoodList[i];
+	}
+	gSortedIndexCount = gFoodListCount;
+	qsort(gSortedIndex, gSortedIndexCount, sizeof(indexEntry_t), compareIndexEntry);
+	printf("%s Build sorted index complete. \n", STR_PRINT_INFO);
+	buildExactIndex();
+	if(gIsExactHashBuilt) printf("%s Build exact match index complete. %d names \n", STR_PRINT_INFO, gExactHash.count);
+	else printf("%s Exact match index could not be built. Sorted index is used. \n", STR_PRINT_ERR);
+}
+
+/**
+ * Insert single food info in sorted index.
+ *
+ *	@param info	Food info added by user
+ */
+void insertSortedIndex(foodinfo_t *info)
+{
+	char *lowerName = getLowerName(info->name);
+	
+	pthread_rwlock_wrlock(&indexLock);
+	if(gSortedIndexCount >= gSortedIndexCapacity)
+	{
+		indexEntry_t *temp = (indexEntry_t *)realloc(gSortedIndex, 
+			sizeof(indexEntry_t) * gSortedIndexCapacity * 2);
+		if(temp == NULL)
+		{
+			logError("Memory re-allocation error.");
+			pthread_rwlock_unlock(&indexLock);
+			return;
+		}
+		gSortedIndex = temp;
+		gSortedIndexCapacity *= 2;
+	}
+	//insert after the entries which have the same name
+	int pos = findSortedIndex(lowerName);
+	while(pos < gSortedIndexCount && strcmp(gSortedIndex[pos].lowerName, lowerName) == 0) pos++;
+	memmove(&gSortedIndex[pos + 1], &gSortedIndex[pos], 
+		sizeof(indexEntry_t) * (gSortedIndexCount - pos));
+	gSortedIndex[pos].lowerName = lowerName;
+	gSortedIndex[pos].info = info;
+	gSortedIndexCount++;
+	gSortedIndexGeneration++;
+	addExactIndex(lowerName, info);
+	pthread_rwlock_unlock(&indexLock);
+}
+
+/**
+ * Find the first entry whose name is not less than the key (lower bound).
+ *	Caller has to hold indexLock.
+ *
+ *	@param lowerKey	Lower case key
+ *	@return Position in gSortedIndex (gSortedIndexCount when all names are less than the key)
+ */
+int findSortedIndex(char *lowerKey)
+{
+	int low = 0;
+	int high = gSortedIndexCount;
+	while(low < high)
+	{
+		int mid = low + (high - low) / 2;
+		if(strcmp(gSortedIndex[mid].lowerName, lowerKey) < 0) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/**
+ * Compare function for qsort(). Order by lower case name.
+ */
+int compareIndexEntry(const void *a, const void *b)
+{
+	return strcmp(((indexEntry_t *)a)->lowerName, ((indexEntry_t *)b)->lowerName);
+}
+
+/**
+ * Build exact match index (minimal perfect hash of the names in gSortedIndex).
+ *	The same names are next to each other in gSortedIndex, so they are grouped in one scan.
+ *	Caller has to hold indexLock for writing (or no other thread is running).
+ */
+void buildExactIndex()
+{
+	int i;
+	freeExactIndex();
+	gExactNames = (char **)malloc(sizeof(char *) * (gSortedIndexCount + 1));
+	gExactGroups = (exactGroup_t *)malloc(sizeof(exactGroup_t) * (gSortedIndexCount + 1));
+	gExactInfos = (foodinfo_t **)malloc(sizeof(foodinfo_t *) * (gSortedIndexCount + 1));
+	if(gExactNames == NULL || gExactGroups == NULL || gExactInfos == NULL) return;
+	int nameCount = 0;
+	for(i = 0; i < gSortedIndexCount; i++)
+	{
+		gExactInfos[i] = gSortedIndex[i].info;
+		if(nameCount > 0 && strcmp(gExactNames[nameCount - 1], gSortedIndex[i].lowerName) == 0)
+		{
+			gExactGroups[nameCount - 1].count++;
+			continue;
+		}
+		gExactNames[nameCount] = gSortedIndex[i].lowerName;
+		gExactGroups[nameCount].first = i;
+		gExactGroups[nameCount].count = 1;
+		nameCount++;
+	}
+	//food added later is chained, about 2 entries per bucket before the next rebuild
+	gExactOverflowBuckets = 1;
+	while(gExactOverflowBuckets < (nameCount / 4 + INT_EXACT_MIN_OVERFLOW) / 2) gExactOverflowBuckets *= 2;
+	gExactOverflow = (exactOverflow_t **)calloc(gExactOverflowBuckets, sizeof(exactOverflow_t *));
+	gIsExactHashBuilt = gExactOverflow != NULL && buildPerfectHash(&gExactHash, gExactNames, nameCount);
+}
+
+/**
+ * Free exact match index (names and food info are not freed).
+ */
+void freeExactIndex()
+{
+	int i;
+	exactOverflow_t *entry;
+	for(i = 0; gExactOverflow != NULL && i < gExactOverflowBuckets; i++)
+	{
+		while((entry = gExactOverflow[i]) != NULL)
+		{
+			gExactOverflow[i] = entry->next;
+			free(entry);
+		}
+	}
+	free(gExactOverflow);
+	free(gExactNames);
+	free(gExactGroups);
+	free(gExactInfos);
+	freePerfectHash(&gExactHash);
+	gExactOverflow = NULL;
+	gExactNames = NULL;
+	gExactGroups = NULL;
+	gExactInfos = NULL;
+	gExactOverflowCount = 0;
+	gIsExactHashBuilt = false;
 }
 
 /**
- * Send data to client.
- *	When user sends a search word, the function returns the result.
- *	When user add new food information, the function returns the message "success".
+ * Add food info added by user to exact match index.
+ *	The food is chained out of the perfect hash, and the index is rebuilt from gSortedIndex
+ *	when the number of chained food info (not names: food of the same name is counted each
+ *	time) reaches a quarter of the names in the perfect hash plus INT_EXACT_MIN_OVERFLOW
+ *	(the cost of the rebuild is spread over the adds).
+ *	Caller has to hold indexLock for writing (the food is in gSortedIndex already).
  *
- *	@param fd		Socket information
- *	@param sendData	The data to be sent to client
- *	@param hitCount	The number of food information found
+ *	@param lowerName	Lower case name (lowerName of gSortedIndex)
+ *	@param info			Food info added
  */
-bool sendToClient(int *fd, char *sendData, int hitCount)
+void addExactIndex(char *lowerName, foodinfo_t *info)
 {
-	//if(hitCount != -1) printf("%s Hit = %d\n", STR_PRINT_INFO, hitCount);
-	if(hitCount != -1)
+	if(!gIsExactHashBuilt) return;
+	//chained food info is compared with the names in the perfect hash
+	if(gExactOverflowCount >= gExactHash.count / 4 + INT_EXACT_MIN_OVERFLOW)
 	{
-		//display hit count as a log
-		printf("[Th %x]%s Hit = %d\n", 
-			(unsigned int)pthread_self(), STR_PRINT_INFO, hitCount);
+		buildExactIndex();
+		logInfo("Exact match index is rebuilt. %d names", gExactHash.count);
+		return;
 	}
-	
-	bool ret = true;
-	if(hitCount > 0)
+	exactOverflow_t *entry = (exactOverflow_t *)malloc(sizeof(exactOverflow_t));
+	if(entry == NULL)
 	{
-		//send data to client
-		int sendLen = send(*fd, sendData, strlen(sendData), 0);
-		if(sendLen == -1)
+		//the food is found when the index is built next time
+		logError("Memory allocation error.");
+		return;
+	}
+	entry->lowerName = lowerName;
+	entry->info = info;
+	entry->next = NULL;
+	//appended at the end so that the food of the same name is in the order of adds
+	exactOverflow_t **link = &gExactOverflow[hashPerfectKey(lowerName, strlen(lowerName)) & (gExactOverflowBuckets - 1)];
+	while(*link != NULL) link = &(*link)->next;
+	*link = entry;
+	gExactOverflowCount++;
+}
+
+/**
+ * Search food information whose name is the same as the name (case is ignored).
+ *	The name is looked up by perfect hash, then food added after the index was built is
+ *	checked in its chain. When the hash could not be built, sorted index is searched.
+ *
+ *	@param name		Food name
+ *	@param hitCount	The number of food info found
+ *	@return Food information (has to be freed by caller)
+ */
+char *searchExact(char *name, int *hitCount)
+{
+	int i;
+	int length = strlen(name);
+	char lowerName[length + 1];
+	convertToLowerChar(name, lowerName);
+
+	pthread_rwlock_rdlock(&indexLock);
+	foodinfo_t **groupInfos = NULL;
+	int groupCount = 0;
+	exactOverflow_t *chain = NULL;
+	int chainCount = 0;
+	if(gIsExactHashBuilt)
+	{
+		int key = findPerfectHash(&gExactHash, lowerName, length);
+		if(key >= 0)
 		{
-			//error handling and log message on console
-			printf("[Th %x]%s send() error. Error code = %d\n", 
-				(unsigned int)pthread_self(), STR_PRINT_ERR, errno);
-			printf("[Th %x]%s Data Length = %d\n", 
-				(unsigned int)pthread_self(), STR_PRINT_ERR, strlen(sendData));
-			if(gIsDebug) printf("[Th %x][%s} sendToClient() Sent data: \n%s\n", 
-				(unsigned int)pthread_self(), STR_PRINT_DEBUG, sendData);
-			if(errno == EMSGSIZE)
-			{
-				printf("[Th %x]%s The data may be too big to send.\n", 
-					(unsigned int)pthread_self(), STR_PRINT_ERR);
-			}
-			perror("send()");
-			ret = false;
+			groupInfos = gExactInfos + gExactGroups[key].first;
+			groupCount = gExactGroups[key].count;
+		}
+		if(gExactOverflowCount > 0)
+		{
+			chain = gExactOverflow[hashPerfectKey(lowerName, length) & (gExactOverflowBuckets - 1)];
 		}
 	}
 	else
 	{
-		//when no food found or new food information has been successfully added
-		char *data;
-		if(hitCount == 0) data = STR_NO_FOOD_FOUND;
-		else data = STR_ADD_STATUS_SUCCESS;
-		if(send(*fd, data, strlen(data), 0) == -1)
-		{
-			printf("[Th %x]%s send() error. Error code = %d\n", 
-				(unsigned int)pthread_self(), STR_PRINT_ERR, errno);
-			printf("[Th %x]%s No food found.\n", (unsigned int)pthread_self(), STR_PRINT_ERR);
-			perror("send()");
-			ret = false;
-		}
+		int pos = findSortedIndex(lowerName);
+		while(pos + groupCount < gSortedIndexCount 
+			&& strcmp(gSortedIndex[pos + groupCount].lowerName, lowerName) == 0) groupCount++;
+		groupInfos = (foodinfo_t **)malloc(sizeof(foodinfo_t *) * (groupCount + 1));
+		for(i = 0; i < groupCount; i++) groupInfos[i] = gSortedIndex[pos + i].info;
+	}
+	exactOverflow_t *entry;
+	for(entry = chain; entry != NULL; entry = entry->next)
+	{
+		if(strcmp(entry->lowerName, lowerName) == 0) chainCount++;
 	}
+	foodinfo_t **found = (foodinfo_t **)malloc(sizeof(foodinfo_t *) * (groupCount + chainCount + 1));
+	if(groupCount > 0) memcpy(found, groupInfos, sizeof(foodinfo_t *) * groupCount);
+	*hitCount = groupCount;
+	for(entry = chain; entry != NULL; entry = entry->next)
+	{
+		if(strcmp(entry->lowerName, lowerName) == 0) found[(*hitCount)++] = entry->info;
+	}
+	char *ret = createFoodListText(found, *hitCount);
+	if(!gIsExactHashBuilt) free(groupInfos);
+	pthread_rwlock_unlock(&indexLock);
+	free(found);
+	logDebug("searchExact() Hit = %d", *hitCount);
 	return ret;
 }
 
 /**
- * Search and get food information.
- *	The function sets the number of food information found in hitCount variable.
+ * Parse autocomplete request ("#complete <count> <partial name>").
  *
- *	@param searchWord	Search word
- *	@param ret			Variable to store all food information found
- *	@param retLength	The number of the characters of the food information.
- *	@param hitCount		The number of the information found.
- *	@param needLength	true: The function only set the value into retLength.
+ *	@param request	Request data sent by client
+ *	@param count	The number of names to be returned
+ *	@param prefix	Partial food name
+ *	@return true: request is valid
  */
-void search(char *searchWord, char *ret, int *retLength, int *hitCount, bool needLength)
+bool parseCompleteRequest(char *request, int *count, char **prefix)
 {
-	int i;
+	char *p = request + strlen(STR_CMD_COMPLETE);
+	*count = atoi(p);
+	if(*count <= 0) *count = INT_DEFAULT_COMPLETE_COUNT;
+	if(*count > INT_MAX_COMPLETE_COUNT) *count = INT_MAX_COMPLETE_COUNT;
+	
+	//skip count and the following space
+	while(isdigit(*p)) p++;
+	if(*p != STR_SPACE[0]) return false;
+	*prefix = p + 1;
+	return true;
+}
+
+/**
+ * Get the first distinct food names which start with the partial name.
+ *	The word boundary is not checked unlike search().
+ *	The process stops when the number of names reaches maxCount,
+ *	the response reaches INT_MAX_COMPLETE_DATA_SIZE or the time budget runs out.
+ *
+ *	@param prefix	Partial food name
+ *	@param maxCount	Max number of names
+ *	@param ret		Variable to store food names (INT_MAX_COMPLETE_DATA_SIZE + 1 bytes)
+ *	@param hitCount	The number of names stored in ret
+ */
+void complete(char *prefix, int maxCount, char *ret, int *hitCount)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	int prefixLength = strlen(prefix);
+	char lowerPrefix[prefixLength + 1];
+	convertToLowerChar(prefix, lowerPrefix);
+	
 	int count = 0;
-	foodinfo_t *info;
-	int fullCharLength = 0;
+	int length = 0;
+	int checked = 0;
+	char *lastName = NULL;
 	
-	for(i = 0; i < gFoodListCount; i++)
+	pthread_rwlock_rdlock(&indexLock);
+	int i = findSortedIndex(lowerPrefix);
+	for(; i < gSortedIndexCount && count < maxCount; i++)
 	{
-		//search food
-		if(!isTargetFood(searchWord, gFoodList[i])) continue;
-
-		//increment count
+		indexEntry_t *entry = &gSortedIndex[i];
+		if(strncmp(entry->lowerName, lowerPrefix, prefixLength) != 0) break;
+		//check time budget every 64 entries
+		if((++checked & 63) == 0 && getElapsedUsec(&start) > INT_COMPLETE_BUDGET_USEC) break;
+		//names are sorted, so the same name is always next to each other
+		if(lastName != NULL && strcmp(lastName, entry->lowerName) == 0) continue;
+		
+		int nameLength = strlen(entry->info->name);
+		if(length + nameLength + 1 > INT_MAX_COMPLETE_DATA_SIZE) break;
+		memcpy(ret + length, entry->info->name, nameLength);
+		length += nameLength;
+		ret[length++] = STR_CR[0];
+		lastName = entry->lowerName;
 		count++;
-		info = gFoodList[i];
-		char weight[INT_MAX_SIZE];
-		char kCal[INT_MAX_SIZE];
-		char fat[INT_MAX_SIZE];
-		char carbo[INT_MAX_SIZE];
-		char protein[INT_MAX_SIZE];
-		//convert int into char
-		sprintf(weight,"%d", info->weight);
-		sprintf(kCal,"%d", info->kCal);
-		sprintf(fat,"%d", info->fat);
-		sprintf(carbo,"%d", info->carbo);
-		sprintf(protein,"%d", info->protein);
+	}
+	pthread_rwlock_unlock(&indexLock);
+	ret[length] = '\0';
+	
+	*hitCount = count;
+	logDebug("complete() Hit = %d, Time = %ldus", *hitCount, getElapsedUsec(&start));
+}
 
-		fullCharLength += strlen(info->name) + strlen(info->measure) + strlen(weight);
-		fullCharLength += strlen(kCal) + strlen(fat) + strlen(carbo) + strlen(protein);
-		
-		//INT_DEFAULT_SPLIT_COUNT is for separation (comma) between each fields
-		fullCharLength +=  INT_DEFAULT_SPLIT_COUNT;
-		//when the number of chars is required
-		if(needLength) continue;
+/**
+ * Parse arguments of pagination/dump request ("<limit> <cursor> <food name>").
+ *	The food name may be empty.
+ *
+ *	@param request	Request data after "#page "/"#dump "
+ *	@param maxCount	Max number of food info in a page
+ *	@param count	The number of food info in a page
+ *	@param cursor	Cursor returned with the previous page ("-" for the first page)
+ *	@param word		Search word
+ *	@return true: request is valid
+ */
+bool parsePageRequest(char *request, int maxCount, int *count, char **cursor, char **word)
+{
+	char *p = request;
+	*count = atoi(p);
+	if(*count <= 0) *count = INT_DEFAULT_PAGE_COUNT;
+	if(*count > maxCount) *count = maxCount;
+	
+	while(isdigit(*p)) p++;
+	if(*p != STR_SPACE[0]) return false;
+	*cursor = ++p;
+	if((p = strchr(p, STR_SPACE[0])) == NULL) return false;
+	*p = '\0';
+	*word = p + 1;
+	return true;
+}
 
-		//add food info in ret variable
-		createFoodInfoText(ret, info->name, info->measure, weight, kCal, fat, carbo, protein);
+/**
+ * Search and get a single page of food information.
+ *	Food info is returned in the order of the sorted index.
+ *	When more food info is left, "#next <cursor>" is appended at the end of the page.
+ *	The cursor is the position of the next matched food in the sorted index, 
+ *	so the next page starts from the position without scanning the previous pages.
+ *	The cursor becomes stale when new food is added.
+ *
+ *	@param searchWord	Search word
+ *	@param cursor		Cursor returned with the previous page ("-" for the first page)
+ *	@param maxCount		Max number of food information in the page
+ *	@param hitCount		The number of the information in the page
+ *	@return Food information in the page (has to be freed by caller)
+ */
+char *searchPage(char *searchWord, char *cursor, int maxCount, int *hitCount)
+{
+	//all matched food starts with the search word without the last comma
+	foodquery_t query;
+	prepareFoodQuery(&query, searchWord);
+	
+	int positions[maxCount + 1];
+	int count = 0;
+	int i;
+	unsigned int position;
+	unsigned int generation;
+	char *ret;
+	
+	pthread_rwlock_rdlock(&indexLock);
+	if(strcmp(cursor, STR_PAGE_FIRST) == 0)
+	{
+		i = findSortedIndex(query.word);
 	}
-	if(needLength) *retLength = fullCharLength + 1;
+	else if(sscanf(cursor, "%x.%x", &position, &generation) == 2 
+		&& generation == gSortedIndexGeneration && position <= (unsigned int)gSortedIndexCount)
+	{
+		i = position;
+	}
+	else
+	{
+		pthread_rwlock_unlock(&indexLock);
+		ret = (char *)calloc(strlen(STR_PAGE_STATUS_STALE) + 1, sizeof(char));
+		strcpy(ret, STR_PAGE_STATUS_STALE);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return ret;
+	}
+	
+	//find one more food than the page size to know whether the next page exists
+	for(; i < gSortedIndexCount && count <= maxCount; i++)
+	{
+		if(strncmp(gSortedIndex[i].lowerName, query.word, query.length) != 0) break;
+		if(isTargetFood(&query, gSortedIndex[i].info)) positions[count++] = i;
+	}
+	bool hasNext = count > maxCount;
+	if(hasNext) count = maxCount;
+	char next[INT_MAX_CURSOR_SIZE];
+	if(hasNext) snprintf(next, sizeof(next), "%x.%x", positions[count], gSortedIndexGeneration);
+	ret = createPageText(positions, count, hasNext ? next : NULL);
+	pthread_rwlock_unlock(&indexLock);
 	
 	*hitCount = count;
-	if(gIsDebug) printf("[Th %x]%s search() needLength(0:false, 1:true) = %d, Hit = %d\n", 
-		(unsigned int)pthread_self(), STR_PRINT_DEBUG, needLength, *hitCount);
-	if(gIsDebug) printf("[Th %x]%s search() Search Result : \n%s\n", 
-		(unsigned int)pthread_self(), STR_PRINT_DEBUG, ret);
+	logDebug("searchPage() Hit = %d, Next = %d", *hitCount, hasNext);
+	return ret;
 }
 
 /**
- * Compare search word with food name.
+ * Get a single page of all food information whose lower case name is not less than 
+ *	the name given, in the order of the sorted index.
+ *	Router reads a range of names with this to move food between shards.
+ *	The cursor is the number of food of the name given which were already read, and 
+ *	"#next <cursor> <name>" is returned with the name of the next food, so the next 
+ *	page is asked from the name. Food added with the same name is inserted after 
+ *	the existing one, so the cursor never becomes stale while food is added.
  *
- *	@param searchWord	Search word sent by client
- *	@param info			Single food information
- *	@return true: The food is to be sent to client.
+ *	@param from		Name to start from (empty: the first food)
+ *	@param cursor	The number of food of the name to skip ("-" for the first page)
+ *	@param maxCount	Max number of food information in the page
+ *	@param hitCount	The number of the information in the page
+ *	@return Food information in the page (has to be freed by caller)
  */
-bool isTargetFood(char *searchWord, foodinfo_t *info)
+char *dumpPage(char *from, char *cursor, int maxCount, int *hitCount)
 {
-	char word[strlen(searchWord) + 1];
-	char name[strlen(info->name) + 1];
-	convertToLowerChar(searchWord, word);
-	convertToLowerChar(info->name, name);
+	char lowerFrom[strlen(from) + 1];
+	convertToLowerChar(from, lowerFrom);
+	
+	int positions[maxCount];
+	int count = 0;
+	int i;
+	bool isFirst = strcmp(cursor, STR_PAGE_FIRST) == 0;
+	char *end = cursor;
+	long skip = isFirst ? 0 : strtol(cursor, &end, 10);
+	char *ret;
 	
-	//compare the number of chars and the first character of the search word and the food name
-	if(strlen(word) > strlen(name) || word[0] != (name)[0])
+	if(!isFirst && (end == cursor || *end != '\0' || skip < 0))
 	{
-		return false;
+		ret = (char *)calloc(strlen(STR_PAGE_STATUS_STALE) + 1, sizeof(char));
+		strcpy(ret, STR_PAGE_STATUS_STALE);
+		*hitCount = INT_HIT_COUNT_STATUS;
+		return ret;
 	}
 	
-	int wordLength = strlen(word);
-	int nameLength = strlen(name);
+	pthread_rwlock_rdlock(&indexLock);
+	i = findSortedIndex(lowerFrom);
+	for(; skip > 0 && i < gSortedIndexCount && strcmp(gSortedIndex[i].lowerName, lowerFrom) == 0; skip--)
+	{
+		i++;
+	}
+	for(; i < gSortedIndexCount && count < maxCount; i++)
+	{
+		positions[count++] = i;
+	}
 	
-	//check if the last char is a comma or a space
-	if(word[wordLength - 1] == STR_COMMA[0])
+	char *next = NULL;
+	if(i < gSortedIndexCount)
 	{
-		//replace with '\0'
-		word[wordLength - 1] = '\0';
-		wordLength = strlen(word);
+		//food of the same name before the next food is skipped by the next page
+		char *name = gSortedIndex[i].lowerName;
+		int first = i;
+		while(first > 0 && strcmp(gSortedIndex[first - 1].lowerName, name) == 0) first--;
+		next = (char *)calloc(INT_MAX_CURSOR_SIZE + strlen(name) + 1, sizeof(char));
+		sprintf(next, "%d %s", i - first, name);
 	}
+	ret = createPageText(positions, count, next);
+	pthread_rwlock_unlock(&indexLock);
+	free(next);
 	
-	//when the last char in the search word is a space
-	if(word[wordLength - 1] == STR_SPACE[0])
+	*hitCount = count;
+	logDebug("dumpPage() Hit = %d", *hitCount);
+	return ret;
+}
+
+/**
+ * Serialize food information in a page. Caller has to hold indexLock.
+ *
+ *	@param positions	Positions of food information in gSortedIndex
+ *	@param count		The number of positions
+ *	@param next			Cursor of the next page (NULL: no next page)
+ *	@return Food information and "#next <cursor>" (has to be freed by caller)
+ */
+char *createPageText(int *positions, int count, char *next)
+{
+	int length = strlen(STR_PAGE_NEXT) + (next != NULL ? strlen(next) : 0) + 2;
+	int i;
+	foodinfo_t *info;
+	for(i = 0; i < count; i++)
 	{
-		if(strncmp(name, word, wordLength) == 0)
-		{
-			return true;
-		}
+		info = gSortedIndex[positions[i]].info;
+		length += strlen(info->name) + strlen(info->measure) + INT_MAX_SIZE * 5 + INT_DEFAULT_SPLIT_COUNT;
 	}
-	else
+	char *ret = (char *)calloc(length, sizeof(char));
+	char *p = ret;
+	for(i = 0; i < count; i++)
 	{
-		//when the number of chars of the search word and that of the name is the same
-		if((wordLength == nameLength) && (strcmp(word, name) == 0) )
-		{
-			return true;
-		}
-		else if(nameLength > wordLength && strncmp(name, word, wordLength) == 0)
-		{
-			//When the number of char of food name is bigger than that of the search word,
-			//check the char of the food name at "searchWordLength" element
-			//
-			//E.g. 
-			//	searchWord is "apricots" check the next char of "s" in the food name 
-			//	to ignore other kind of food such as "ApricotsJam".
-			//
-			//	If the next char is a comma or a space, the food has to be displayed.
-			//	If it is anything else, the food should not be displayed.
-			if(name[wordLength] == STR_SPACE[0] || name[wordLength] == STR_COMMA[0])
-			{
-				return true;
-			}
-		}
+		p = appendFoodText(p, gSortedIndex[positions[i]].info);
 	}
-	
-	return false;
+	if(next != NULL)
+	{
+		sprintf(p, "%s%s\n", STR_PAGE_NEXT, next);
+	}
+	return ret;
 }
 
 /**
- * Convert character to lower case.
+ * Serialize food information in a list.
  *
- *	@param target	The character to be converted.
- *	@param ret		The character converted to lower case.
+ *	@param infos	Food information
+ *	@param count	The number of food information
+ *	@return Food information (has to be freed by caller)
  */
-void convertToLowerChar(char *target, char *ret)
+char *createFoodListText(foodinfo_t **infos, int count)
 {
+	int length = 1;
 	int i;
-	for(i = 0; i < strlen(target); i++)
+	for(i = 0; i < count; i++)
 	{
-		ret[i] = tolower(target[i]);
+		length += strlen(infos[i]->name) + strlen(infos[i]->measure) + INT_MAX_SIZE * 5 + INT_DEFAULT_SPLIT_COUNT;
 	}
-	ret[i] = '\0';
+	char *ret = (char *)calloc(length, sizeof(char));
+	char *p = ret;
+	for(i = 0; i < count; i++)
+	{
+		p = appendFoodText(p, infos[i]);
+	}
+	return ret;
+}
+
+/**
+ * Write single food information as a line at the end of the text.
+ *
+ *	@param p	The end of the text ('\0')
+ *	@param info	Food information
+ *	@return The end of the line written
+ */
+char *appendFoodText(char *p, foodinfo_t *info)
+{
+	char number[5][INT_MAX_SIZE];
+	sprintf(number[0], "%d", info->weight);
+	sprintf(number[1], "%d", info->kCal);
+	sprintf(number[2], "%d", info->fat);
+	sprintf(number[3], "%d", info->carbo);
+	sprintf(number[4], "%d", info->protein);
+	//append at the end of the previous line, not the end of the whole text
+	createFoodInfoText(p, info->name, info->measure, number[0], number[1], number[2], 
+		number[3], number[4]);
+	return p + strlen(p);
+}
+
+/**
+ * Get elapsed time from start.
+ *
+ *	@param start	Start time (CLOCK_MONOTONIC)
+ *	@return Elapsed time in micro seconds
+ */
+long getElapsedUsec(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
 }
 
 /**
@@ -660,46 +4100,117 @@ void convertToLowerChar(char *target, char *ret)
  *	@param newFd	Socket information
  *	@param recvSize	The size of received data.
  *	@param recvData	Received data
+ *	@param option	Request option flags (options are removed from recvData)
+ *	@param ifVersion	Catalog version of "#if <version>"
  *	@return Function type
  */
-int receiveClientData(int *newFd, int *recvSize, char *recvData)
+int receiveClientData(int *newFd, int *recvSize, char *recvData, int *option, unsigned long long *ifVersion)
 {
-	int ret = INT_TYPE_SEARCH;
 	//*recvSize = recv(*newFd, recvData, strlen(recvData) + 1, 0);
-	*recvSize = recv(*newFd, recvData, INT_MAX_RECV_DATA_SIZE, 0);
+	//keep the last byte for '\0'
+	*recvSize = recv(*newFd, recvData, INT_MAX_RECV_DATA_SIZE - 1, 0);
 	if(*recvSize == -1)
 	{
-		//error handling
-		printf("[Th %x]%s recv() error. Error code = %d\n", 
-			(unsigned int)pthread_self(), STR_PRINT_ERR, errno);
-		if(recvSize != NULL)
+		//error handling (EAGAIN: client sent nothing within read timeout)
+		countIoError();
+		logError("recv() error. Error code = %d (%s)", errno, strerror(errno));
+		return -1;
+	}
+	if(*recvSize == 0)
+	{
+		//client closed the connection (kept-alive connection is closed this way)
+		return -1;
+	}
+	recvData[*recvSize] = '\0';
+	return parseClientData(recvData, *recvSize, option, ifVersion);
+}
+
+/**
+ * Remove request options and get the function type of the request.
+ *
+ *	@param recvData		Request data ('\0' terminated, options are removed)
+ *	@param recvSize		The size of the request received (for log)
+ *	@param option		Request option flags
+ *	@param ifVersion	Catalog version of "#if <version>"
+ *	@return Function type
+ */
+int parseClientData(char *recvData, int recvSize, int *option, unsigned long long *ifVersion)
+{
+	int ret = INT_TYPE_SEARCH;
+	*option = 0;
+	while(true)
+	{
+		int optionLength;
+		if(strncmp(recvData, STR_OPT_COMPRESS, strlen(STR_OPT_COMPRESS)) == 0)
 		{
-			printf("[Th %x]%s recvSize = %d\n", (unsigned int)pthread_self(), STR_PRINT_ERR, *recvSize);
+			*option |= INT_OPTION_COMPRESS;
+			optionLength = strlen(STR_OPT_COMPRESS);
 		}
-		if(recvData != NULL)
+		else if(strncmp(recvData, STR_OPT_KEEPALIVE, strlen(STR_OPT_KEEPALIVE)) == 0)
 		{
-			printf("[Th %x]%s recvData = \n%s\n", (unsigned int)pthread_self(), STR_PRINT_ERR, recvData);
+			*option |= INT_OPTION_KEEPALIVE;
+			optionLength = strlen(STR_OPT_KEEPALIVE);
 		}
-		perror("recv()");
-		return -1;
+		else if(strncmp(recvData, STR_OPT_VERSION, strlen(STR_OPT_VERSION)) == 0)
+		{
+			*option |= INT_OPTION_VERSION;
+			optionLength = strlen(STR_OPT_VERSION);
+		}
+		else if(strncmp(recvData, STR_OPT_IF_VERSION, strlen(STR_OPT_IF_VERSION)) == 0
+			&& sscanf(recvData + strlen(STR_OPT_IF_VERSION), "%llu %n", ifVersion, &optionLength) == 1)
+		{
+			//"#if" also stamps the response so that the client can keep the new version
+			*option |= INT_OPTION_VERSION | INT_OPTION_IF_VERSION;
+			optionLength += strlen(STR_OPT_IF_VERSION);
+		}
+		else break;
+		memmove(recvData, recvData + optionLength, strlen(recvData) - optionLength + 1);
 	}
 	char *splitChar;
-	char *temp;
 	//if '\n' is detected, that means add new food data
-	if(strchr(recvData, '\n') != NULL)
+	if((splitChar = strchr(recvData, '\n')) != NULL)
 	{
-		strcpy(temp, recvData);
-		splitChar = strtok(temp, STR_CR);
-		recvData = splitChar;
+		//cut off the trailing "\na"
+		*splitChar = '\0';
 		ret = INT_TYPE_ADD;
 	}
+	else if(strncmp(recvData, STR_CMD_COMPLETE, strlen(STR_CMD_COMPLETE)) == 0)
+	{
+		ret = INT_TYPE_COMPLETE;
+	}
+	else if(strncmp(recvData, STR_CMD_PAGE, strlen(STR_CMD_PAGE)) == 0)
+	{
+		ret = INT_TYPE_PAGE;
+	}
+	else if(strncmp(recvData, STR_CMD_DUMP, strlen(STR_CMD_DUMP)) == 0)
+	{
+		ret = INT_TYPE_DUMP;
+	}
+	else if(strncmp(recvData, STR_CMD_EXACT, strlen(STR_CMD_EXACT)) == 0)
+	{
+		ret = INT_TYPE_EXACT;
+	}
+	else if(strcmp(recvData, STR_CMD_STATS) == 0)
+	{
+		ret = INT_TYPE_STATS;
+	}
+	else if(strncmp(recvData, STR_CMD_REPLICATE, strlen(STR_CMD_REPLICATE)) == 0)
+	{
+		ret = INT_TYPE_REPLICATE;
+	}
 	
 	char *typeName;
 	if(ret == INT_TYPE_SEARCH) typeName = "Search";
+	else if(ret == INT_TYPE_COMPLETE) typeName = "Complete";
+	else if(ret == INT_TYPE_PAGE) typeName = "Page";
+	else if(ret == INT_TYPE_EXACT) typeName = "Exact";
+	else if(ret == INT_TYPE_STATS) typeName = "Stats";
+	else if(ret == INT_TYPE_DUMP) typeName = "Dump";
+	else if(ret == INT_TYPE_REPLICATE) typeName = "Replicate";
 	else typeName = "Add";
 	//output log
-	printf("[Th %x]%s Received data(length) = %s(%d) Type: %s\n", 
-		(unsigned int)pthread_self(), STR_PRINT_INFO, recvData, *recvSize, typeName);
+	LOG_SAMPLED(LOG_LEVEL_INFO, gLogSampleRate, "Received data(length) = %s(%d) Type: %s", 
+		recvData, recvSize, typeName);
 	
 	return ret;
 }
@@ -717,13 +4228,16 @@ void initializeSocket(int *sockfd, struct sockaddr_in *serverAddr, char *port)
 	serverAddr->sin_port = htons(gPortNum);
 	serverAddr->sin_addr.s_addr = INADDR_ANY;
 
-	if ((*sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+	if ((*sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
 	{
 		printf("%s socket() failed. Error code = %d\n", STR_PRINT_ERR, errno);
 		perror("socket()");
 		disposeAll();
 		exit(EXIT_FAILURE);
 	}
+	//the port can be bound again while connections of the previous server are in TIME_WAIT
+	int on = 1;
+	setsockopt(*sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 	if (bind(*sockfd, (struct sockaddr *)serverAddr, sizeof(struct sockaddr)) == -1)
 	{
 		//if the port is in use
@@ -751,7 +4265,7 @@ void initializeSocket(int *sockfd, struct sockaddr_in *serverAddr, char *port)
 		}
 	}
 	//start to listen
-	if (listen(*sockfd, BACKLOG) == -1)
+	if (startListening(*sockfd) == -1)
 	{
 		printf("%s listen() failed. Error code = %d\n", STR_PRINT_ERR, errno);
 		perror("listen()");
@@ -763,13 +4277,165 @@ void initializeSocket(int *sockfd, struct sockaddr_in *serverAddr, char *port)
 	printf("%s Server is lisning on port %d..... \n", STR_PRINT_INFO, gPortNum);
 }
 
+/**
+ * Parse TCP options of -t.
+ *
+ *	@param list	Options separated by ',' ("none": no option)
+ *	@return Option flags (INT_TCP_*), -1 when the list has unknown option
+ */
+int parseTcpOptions(char *list)
+{
+	int options = 0;
+	char buf[strlen(list) + 1];
+	char *savePtr;
+	strcpy(buf, list);
+	char *name = strtok_r(buf, ",", &savePtr);
+	for(; name != NULL; name = strtok_r(NULL, ",", &savePtr))
+	{
+		if(strcmp(name, STR_TCP_FASTOPEN) == 0) options |= INT_TCP_FASTOPEN;
+		else if(strcmp(name, STR_TCP_DEFER_ACCEPT) == 0) options |= INT_TCP_DEFER_ACCEPT;
+		else if(strcmp(name, STR_TCP_NODELAY) == 0) options |= INT_TCP_NODELAY;
+		else if(strcmp(name, STR_TCP_QUICKACK) == 0) options |= INT_TCP_QUICKACK;
+		else if(strcmp(name, STR_TCP_NONE) != 0) return -1;
+	}
+	return options;
+}
+
+/**
+ * Set TCP options of listening socket and start to listen with gListenBacklog.
+ *	- fastopen: the request in SYN is received with the connection, so the response is 
+ *	  sent one round trip earlier (the client has to have a cookie of this server)
+ *	- defer: accept() returns when the request has arrived, so accepter and io_uring 
+ *	  workers do not wait for the first byte of connections (bounded by the idle timeout)
+ *	- nodelay: accepted sockets inherit TCP_NODELAY, so response written by several
+ *	  send() is not delayed
+ *	Options not supported by the kernel are ignored.
+ *
+ *	@param fd	Listening socket (TCP)
+ *	@return 0, -1 when listen() failed (errno is set)
+ */
+int startListening(int fd)
+{
+	int on = (gTcpOptions & INT_TCP_NODELAY) ? 1 : 0;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	int deferSec = (gTcpOptions & INT_TCP_DEFER_ACCEPT) ? (gIdleTimeoutMsec + 999) / 1000 : 0;
+	setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferSec, sizeof(deferSec));
+	int queueLength = 0;
+	if(gTcpOptions & INT_TCP_FASTOPEN)
+	{
+		queueLength = gListenBacklog < INT_MAX_FASTOPEN_QUEUE ? gListenBacklog : INT_MAX_FASTOPEN_QUEUE;
+	}
+	if(setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &queueLength, sizeof(queueLength)) == -1)
+	{
+		queueLength = 0;
+	}
+	if(listen(fd, gListenBacklog) == -1) return -1;
+
+	int maxBacklog = readSysctl("/proc/sys/net/core/somaxconn");
+	printf("%s Back log = %d%s, TCP options: fastopen = %d, defer = %ds, nodelay = %d, quickack = %d \n", 
+		STR_PRINT_INFO, gListenBacklog, maxBacklog > 0 && maxBacklog < gListenBacklog ? " (capped by somaxconn)" : "",
+		queueLength, deferSec, on, (gTcpOptions & INT_TCP_QUICKACK) ? 1 : 0);
+	int fastOpen = readSysctl(STR_FASTOPEN_SYSCTL);
+	if(queueLength > 0 && fastOpen >= 0 && !(fastOpen & 0x02))
+	{
+		printf("%s TCP Fast Open is not enabled for servers by %s (%d). Set it to 3 to use it. \n", 
+			STR_PRINT_INFO, STR_FASTOPEN_SYSCTL, fastOpen);
+	}
+	return 0;
+}
+
+/**
+ * Set TCP options of accepted client (TCP_QUICKACK is not inherited from listening socket).
+ *	setsockopt() fails without effect on Unix domain socket.
+ *
+ *	@param fd	Socket of the client
+ */
+void setClientOptions(int fd)
+{
+	int on = 1;
+	if(gTcpOptions & INT_TCP_QUICKACK) setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
+
+/**
+ * Read integer from /proc/sys.
+ *
+ *	@param path	Path of the setting
+ *	@return The value, -1 when it could not be read
+ */
+int readSysctl(char *path)
+{
+	int value = -1;
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL) return -1;
+	if(fscanf(fp, "%d", &value) != 1) value = -1;
+	fclose(fp);
+	return value;
+}
+
+
+/**
+ * Initialize Unix domain listening socket.
+ *	The file left by the previous process is removed.
+ *
+ *	@param path	Socket path
+ */
+void initializeLocalSocket(char *path)
+{
+	struct sockaddr_un addr;
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		printf("%s Unix domain socket path is too long. Path = %s\n", STR_PRINT_ERR, path);
+		exit(EXIT_FAILURE);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if((gLocalSockfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+		|| bind(gLocalSockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+		|| listen(gLocalSockfd, gListenBacklog) == -1)
+	{
+		printf("%s Unix domain socket %s could not be opened. Error code = %d\n", STR_PRINT_ERR, path, errno);
+		perror("bind()");
+		exit(EXIT_FAILURE);
+	}
+	printf("%s Server is listening on %s..... \n", STR_PRINT_INFO, path);
+}
+
+/**
+ * Initialize socket of stats port.
+ *
+ *	@param port	Port number
+ */
+void initializeStatsSocket(int port)
+{
+	struct sockaddr_in addr;
+	int on = 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+	
+	if((gStatsSockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1
+		|| setsockopt(gStatsSockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1
+		|| bind(gStatsSockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+		|| listen(gStatsSockfd, BACKLOG) == -1)
+	{
+		printf("%s Stats port %d could not be opened. Error code = %d\n", STR_PRINT_ERR, port, errno);
+		perror("stats socket");
+		disposeAll();
+		exit(EXIT_FAILURE);
+	}
+	printf("%s Stats are served on port %d..... \n", STR_PRINT_INFO, port);
+}
 
 /**
  * Initialize signal handler.
  */
 void initializeSignalHandler()
 {
-	if(signal(SIGINT, sigHandler) == SIG_ERR)
+	//send() to the client which has closed connection must not kill the server
+	if(signal(SIGINT, sigHandler) == SIG_ERR || signal(SIGPIPE, SIG_IGN) == SIG_ERR)
 	{
 		printf("%s signal() failed. \n", STR_PRINT_ERR);
 		exit(EXIT_FAILURE);
@@ -782,7 +4448,12 @@ void initializeSignalHandler()
  */
 void sigHandler()
 {
-	if(!saveFoodInfo())
+	//write buffered log before the last messages
+	stopLog();
+	//the channel is created again by the next start
+	if(gShmName != NULL) shm_unlink(gShmName);
+	//replica does not write csv file, food info is saved by the primary
+	if(gPrimaryName == NULL && !saveFoodInfo())
 	{
 		//printf("%s New food info could not write in the csv.\n", STR_PRINT_ERR);
 	}
@@ -816,6 +4487,11 @@ void disposeAll()
 	gFoodList = NULL;
 	free(gClientList);
 	free(gNewFoodList);
+	freeExactIndex();
+	free(gSortedIndex);
+	freeInternTable();
+	gSortedIndex = NULL;
+	gSortedIndexCount = 0;
 	gClientList = NULL;
 	gNewFoodList = NULL;
 	
@@ -823,6 +4499,7 @@ void disposeAll()
 	pthread_attr_destroy(&attr);
 	pthread_cond_destroy(&cond);
 	pthread_mutex_destroy(&mutex);
+	pthread_rwlock_destroy(&indexLock);
 	
 	printf("Done. \n");
 }
@@ -834,16 +4511,9 @@ void dispose(foodinfo_t *info)
 {
 	if(info != NULL)
 	{
-		if(info->name != NULL)
-		{
-			free(info->name);
-			info->name = NULL;
-		}
-		if(info->measure != NULL)
-		{
-			free(info->measure);
-			info->measure = NULL;
-		}
+		//name and measure are interned, they are freed by freeInternTable()
+		info->name = NULL;
+		info->measure = NULL;
 	}
 	free(info);
 	info = NULL;
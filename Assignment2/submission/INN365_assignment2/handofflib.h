@@ -0,0 +1,194 @@
+#ifndef HANDOFFLIB_H
+#define HANDOFFLIB_H
+
+//memfd_create() needs _GNU_SOURCE defined before the first system header is included
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// Max number of file descriptors passed in single message
+#define INT_HANDOFF_MAX_FDS 5
+/// Max size of text passed with file descriptors
+#define INT_HANDOFF_TEXT_SIZE 128
+/// Backlog of control socket
+#define INT_HANDOFF_BACKLOG 1
+
+/// ----- Function definitions
+int openHandoffListener(char*);
+int connectHandoff(char*);
+bool sendHandoff(int, char*, int*, int);
+int receiveHandoff(int, char*, int*, int);
+int createSnapshotFile(char*);
+char *mapSnapshotFile(int, size_t*);
+
+
+/**
+ * Create Unix domain socket which waits for the next process.
+ *	A file left by the previous process is removed.
+ *
+ *	@param path	Socket path
+ *	@return Socket, -1 when failed
+ */
+int openHandoffListener(char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+	if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) return -1;
+	unlink(path);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+		|| listen(fd, INT_HANDOFF_BACKLOG) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Connect to the socket created by openHandoffListener().
+ *
+ *	@param path	Socket path
+ *	@return Socket, -1 when failed
+ */
+int connectHandoff(char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+	if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) return -1;
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Send text and file descriptors (SCM_RIGHTS) in single message.
+ *	The receiver gets its own copy of each descriptor, so the sender may close them.
+ *
+ *	@param sock		Unix domain socket
+ *	@param text		Text sent with the descriptors (up to INT_HANDOFF_TEXT_SIZE - 1 bytes)
+ *	@param fds		File descriptors
+ *	@param fdCount	The number of fds (0 - INT_HANDOFF_MAX_FDS)
+ *	@return true: sent successfully
+ */
+bool sendHandoff(int sock, char *text, int *fds, int fdCount)
+{
+	char control[CMSG_SPACE(sizeof(int) * INT_HANDOFF_MAX_FDS)];
+	struct iovec iov;
+	struct msghdr msg;
+	if(fdCount > INT_HANDOFF_MAX_FDS) return false;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = text;
+	iov.iov_len = strlen(text) + 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if(fdCount > 0)
+	{
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdCount);
+	}
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)iov.iov_len;
+}
+
+/**
+ * Receive message sent by sendHandoff().
+ *
+ *	@param sock		Unix domain socket
+ *	@param text		Buffer to store the text (INT_HANDOFF_TEXT_SIZE bytes)
+ *	@param fds		Buffer to store the descriptors (INT_HANDOFF_MAX_FDS entries)
+ *	@param maxFds	The size of fds
+ *	@return The number of descriptors received, -1 when the connection is closed or failed
+ */
+int receiveHandoff(int sock, char *text, int *fds, int maxFds)
+{
+	char control[CMSG_SPACE(sizeof(int) * INT_HANDOFF_MAX_FDS)];
+	struct iovec iov;
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = text;
+	iov.iov_len = INT_HANDOFF_TEXT_SIZE - 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t length = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	if(length <= 0) return -1;
+	text[length] = '\0';
+
+	int count = 0;
+	struct cmsghdr *cmsg;
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+		int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int *received = (int *)CMSG_DATA(cmsg);
+		int i;
+		for(i = 0; i < n; i++)
+		{
+			//descriptors which do not fit are not used
+			if(count < maxFds) fds[count++] = received[i];
+			else close(received[i]);
+		}
+	}
+	return count;
+}
+
+/**
+ * Create anonymous in-memory file to pass data to another process.
+ *
+ *	@param name	Name shown in /proc (for debugging only)
+ *	@return File descriptor, -1 when failed
+ */
+int createSnapshotFile(char *name)
+{
+	return memfd_create(name, MFD_CLOEXEC);
+}
+
+/**
+ * Map whole file in memory. The mapping is private, so the contents may be modified
+ *	without changing the file.
+ *
+ *	@param fd	File descriptor
+ *	@param size	The size of the file
+ *	@return Mapped address (munmap() with size), NULL when failed or the file is empty
+ */
+char *mapSnapshotFile(int fd, size_t *size)
+{
+	struct stat st;
+	if(fstat(fd, &st) == -1) return NULL;
+	*size = st.st_size;
+	if(*size == 0) return NULL;
+	char *data = (char *)mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if(data == MAP_FAILED) return NULL;
+	return data;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef INTERNLIB_H
+#define INTERNLIB_H
+
+//Interned strings: the same text is stored once and shared by all users.
+//Strings are packed in large blocks and never freed one by one (freeInternTable() frees all).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/// Initial number of slots of the intern table (power of 2)
+#define INT_INTERN_INITIAL_CAPACITY 1024
+/// Size of single block of strings (longer strings have their own block)
+#define INT_INTERN_BLOCK_SIZE 65536
+
+/// Block of interned strings
+typedef struct internBlock internBlock_t;
+struct internBlock
+{
+	internBlock_t *next;
+	/// bytes used in data
+	int used;
+	int size;
+	char data[];
+};
+
+/// Slot of intern table
+typedef struct internSlot internSlot_t;
+struct internSlot
+{
+	/// hash of the string (most of the different strings are skipped without reading them)
+	unsigned int hash;
+	/// interned string (NULL: empty slot)
+	char *text;
+};
+
+/// Table of interned strings (open addressing, half of the slots are empty at most)
+typedef struct internTable internTable_t;
+struct internTable
+{
+	internSlot_t *slots;
+	/// the number of slots (power of 2)
+	int capacity;
+	/// the number of strings
+	int count;
+	/// the number of bytes of strings (including '\0')
+	long bytes;
+	/// the block being filled (the head of the list of blocks)
+	internBlock_t *blocks;
+	pthread_mutex_t lock;
+};
+
+/// Intern table shared by getFoodInfo() and the sorted index
+internTable_t gInternTable = {NULL, 0, 0, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+/// ----- Function definitions
+unsigned int hashInternString(const char*, int);
+char *internString(const char*);
+bool growInternTable(internTable_t*);
+char *storeInternString(internTable_t*, const char*, int);
+void freeInternTable();
+
+
+/**
+ * Hash string (8 bytes at a time).
+ *
+ *	@param text		String
+ *	@param length	Length of the string
+ *	@return Hash
+ */
+unsigned int hashInternString(const char *text, int length)
+{
+	unsigned long long hash = 0x9e3779b97f4a7c15ULL ^ (unsigned long long)length;
+	unsigned long long word;
+	int i;
+	for(i = 0; i + 8 <= length; i += 8)
+	{
+		memcpy(&word, text + i, 8);
+		hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+	word = 0;
+	memcpy(&word, text + i, length - i);
+	hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+	return (unsigned int)(hash ^ (hash >> 32));
+}
+
+/**
+ * Get interned string of the text. Thread safe.
+ *
+ *	@param text	String
+ *	@return Interned string which has the same text (must not be modified nor freed),
+ *			NULL when no memory is left
+ */
+char *internString(const char *text)
+{
+	internTable_t *table = &gInternTable;
+	int length = strlen(text);
+	unsigned int hash = hashInternString(text, length);
+	pthread_mutex_lock(&table->lock);
+	if((table->count + 1) * 2 > table->capacity && !growInternTable(table))
+	{
+		pthread_mutex_unlock(&table->lock);
+		return NULL;
+	}
+	unsigned int mask = table->capacity - 1;
+	unsigned int i = hash & mask;
+	while(table->slots[i].text != NULL)
+	{
+		if(table->slots[i].hash == hash && strcmp(table->slots[i].text, text) == 0)
+		{
+			pthread_mutex_unlock(&table->lock);
+			return table->slots[i].text;
+		}
+		i = (i + 1) & mask;
+	}
+	char *ret = storeInternString(table, text, length);
+	if(ret == NULL)
+	{
+		pthread_mutex_unlock(&table->lock);
+		return NULL;
+	}
+	table->slots[i].hash = hash;
+	table->slots[i].text = ret;
+	table->count++;
+	pthread_mutex_unlock(&table->lock);
+	return ret;
+}
+
+/**
+ * Double the slots of the table (lock is held by caller).
+ *
+ *	@param table	Intern table
+ *	@return false: no memory (the table is not changed)
+ */
+bool growInternTable(internTable_t *table)
+{
+	int capacity = table->capacity > 0 ? table->capacity * 2 : INT_INTERN_INITIAL_CAPACITY;
+	internSlot_t *slots = (internSlot_t *)calloc(capacity, sizeof(internSlot_t));
+	if(slots == NULL) return false;
+	int i;
+	for(i = 0; i < table->capacity; i++)
+	{
+		if(table->slots[i].text == NULL) continue;
+		unsigned int j = table->slots[i].hash & (capacity - 1);
+		while(slots[j].text != NULL) j = (j + 1) & (capacity - 1);
+		slots[j] = table->slots[i];
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+	return true;
+}
+
+/**
+ * Copy the text in the block being filled (lock is held by caller).
+ *
+ *	@param table	Intern table
+ *	@param text		String
+ *	@param length	Length of the string
+ *	@return Copy of the text, NULL when no memory is left
+ */
+char *storeInternString(internTable_t *table, const char *text, int length)
+{
+	internBlock_t *block = table->blocks;
+	if(block == NULL || block->used + length + 1 > block->size)
+	{
+		int size = length + 1 > INT_INTERN_BLOCK_SIZE ? length + 1 : INT_INTERN_BLOCK_SIZE;
+		block = (internBlock_t *)malloc(sizeof(internBlock_t) + size);
+		if(block == NULL) return NULL;
+		block->used = 0;
+		block->size = size;
+		if(length + 1 < INT_INTERN_BLOCK_SIZE || table->blocks == NULL)
+		{
+			block->next = table->blocks;
+			table->blocks = block;
+		}
+		else
+		{
+			//long string does not replace the block being filled
+			block->next = table->blocks->next;
+			table->blocks->next = block;
+		}
+	}
+	char *ret = block->data + block->used;
+	memcpy(ret, text, length + 1);
+	block->used += length + 1;
+	table->bytes += length + 1;
+	return ret;
+}
+
+/**
+ * Free all interned strings. Strings got from internString() must not be used after this.
+ */
+void freeInternTable()
+{
+	internTable_t *table = &gInternTable;
+	pthread_mutex_lock(&table->lock);
+	while(table->blocks != NULL)
+	{
+		internBlock_t *next = table->blocks->next;
+		free(table->blocks);
+		table->blocks = next;
+	}
+	free(table->slots);
+	table->slots = NULL;
+	table->capacity = 0;
+	table->count = 0;
+	table->bytes = 0;
+	pthread_mutex_unlock(&table->lock);
+}
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef LOGLIB_H
+#define LOGLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/// Log level: error
+#define LOG_LEVEL_ERROR 0
+/// Log level: info
+#define LOG_LEVEL_INFO 1
+/// Log level: debug
+#define LOG_LEVEL_DEBUG 2
+/// Max number of threads which write log
+#define INT_LOG_MAX_THREADS 64
+/// The number of messages buffered per thread (power of 2)
+#define INT_LOG_RING_SIZE 1024
+/// Max size of single message
+#define INT_LOG_MESSAGE_SIZE 256
+/// Sleep time of writer thread when no message is buffered (micro seconds)
+#define INT_LOG_WRITER_SLEEP_USEC 5000
+
+/// Single message
+typedef struct logMessage logMessage_t;
+struct logMessage
+{
+	int length;
+	char text[INT_LOG_MESSAGE_SIZE];
+};
+
+/// Message buffer of single thread.
+/// The owner thread only writes head and the writer thread only writes tail.
+typedef struct logRing logRing_t;
+struct logRing
+{
+	uint64_t head;
+	uint64_t tail;
+	logMessage_t message[INT_LOG_RING_SIZE];
+};
+
+/// Level names used in log header
+char *STR_LOG_LEVEL_NAME[] = {"[error]", "[info ]", "[debug]"};
+
+/// Messages at this level or lower are written
+int gLogLevel = LOG_LEVEL_INFO;
+/// Buffers of all threads
+logRing_t *gLogRing[INT_LOG_MAX_THREADS];
+/// The number of buffers used
+int gLogRingCount;
+/// Indexes of buffers released by exited threads (reused by the next threads)
+int gLogFreeRing[INT_LOG_MAX_THREADS];
+/// The number of indexes in gLogFreeRing
+int gLogFreeRingCount;
+/// Lock of gLogFreeRing
+pthread_mutex_t gLogFreeRingLock = PTHREAD_MUTEX_INITIALIZER;
+/// Key whose destructor releases the buffer when the thread exits (value: index + 1)
+pthread_key_t gLogRingKey;
+/// gLogRingKey is created once
+pthread_once_t gLogRingKeyOnce = PTHREAD_ONCE_INIT;
+/// The number of messages dropped because buffer was full or not available
+uint64_t gLogDropCount;
+/// true: writer thread is running
+bool gIsLogRunning;
+/// Writer thread
+pthread_t gLogWriter;
+/// Buffer of current thread
+__thread logRing_t *tLogRing;
+
+/// ----- Function definitions
+void initializeLog(int);
+void logWrite(int, const char*, ...);
+int logFlush();
+void stopLog();
+void *logWriter();
+int getLogLevel(char*);
+void createLogRingKey();
+void releaseLogRing(void*);
+
+/// Write message when the level is enabled (arguments are not evaluated otherwise)
+#define LOG(level, ...) do { if((level) <= gLogLevel) logWrite((level), __VA_ARGS__); } while(0)
+#define logError(...) LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define logInfo(...) LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define logDebug(...) LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+/// Write only one in every "rate" messages of this call site
+#define LOG_SAMPLED(level, rate, ...) do { \
+	static unsigned int sampleCount; \
+	if((level) <= gLogLevel && __atomic_fetch_add(&sampleCount, 1, __ATOMIC_RELAXED) % (rate) == 0) \
+		logWrite((level), __VA_ARGS__); \
+	} while(0)
+
+
+/**
+ * Initialize log and start writer thread.
+ *
+ *	@param level	LOG_LEVEL_*
+ */
+void initializeLog(int level)
+{
+	gLogLevel = level;
+	gIsLogRunning = true;
+	pthread_create(&gLogWriter, NULL, logWriter, NULL);
+}
+
+/**
+ * Convert level name (error, info, debug) to LOG_LEVEL_*.
+ *
+ *	@return LOG_LEVEL_*, -1 when the name is unknown
+ */
+int getLogLevel(char *name)
+{
+	if(strcmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+	if(strcmp(name, "info") == 0) return LOG_LEVEL_INFO;
+	if(strcmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+	return -1;
+}
+
+/**
+ * Get buffer of current thread. At the first call, a buffer released by an exited thread
+ *	is reused or a new buffer is allocated.
+ *
+ *	@return Buffer, NULL when no more buffer can be allocated
+ */
+static logRing_t *getLogRing()
+{
+	if(tLogRing == NULL)
+	{
+		int slot = -1;
+		pthread_once(&gLogRingKeyOnce, createLogRingKey);
+		if(__atomic_load_n(&gLogFreeRingCount, __ATOMIC_RELAXED) > 0)
+		{
+			pthread_mutex_lock(&gLogFreeRingLock);
+			if(gLogFreeRingCount > 0) slot = gLogFreeRing[--gLogFreeRingCount];
+			pthread_mutex_unlock(&gLogFreeRingLock);
+		}
+		if(slot == -1)
+		{
+			//the count is not increased by threads which get no buffer
+			int count = __atomic_load_n(&gLogRingCount, __ATOMIC_RELAXED);
+			do
+			{
+				if(count >= INT_LOG_MAX_THREADS) return NULL;
+			} while(!__atomic_compare_exchange_n(&gLogRingCount, &count, count + 1, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+			slot = count;
+		}
+		if(gLogRing[slot] == NULL)
+		{
+			logRing_t *ring = (logRing_t *)calloc(1, sizeof(logRing_t));
+			if(ring == NULL)
+			{
+				//the index is tried again by the next thread
+				releaseLogRing((void *)(long)(slot + 1));
+				return NULL;
+			}
+			__atomic_store_n(&gLogRing[slot], ring, __ATOMIC_RELEASE);
+		}
+		//messages left by the previous owner are still written by writer thread
+		tLogRing = gLogRing[slot];
+		pthread_setspecific(gLogRingKey, (void *)(long)(slot + 1));
+	}
+	return tLogRing;
+}
+
+/**
+ * Create the key which releases the buffer at thread exit (called once).
+ */
+void createLogRingKey()
+{
+	pthread_key_create(&gLogRingKey, releaseLogRing);
+}
+
+/**
+ * Give the buffer of the exiting thread back for the next thread (key destructor).
+ *
+ *	@param value	Index of the buffer + 1
+ */
+void releaseLogRing(void *value)
+{
+	pthread_mutex_lock(&gLogFreeRingLock);
+	gLogFreeRing[gLogFreeRingCount++] = (int)(long)value - 1;
+	pthread_mutex_unlock(&gLogFreeRingLock);
+}
+
+/**
+ * Buffer single message. The message is written by writer thread later.
+ *	The caller never blocks: when the buffer is full or the thread has no buffer
+ *	(too many threads, no memory), the message is dropped and counted.
+ *	"[Th <thread id>][<level>] " is added at the beginning and "\n" at the end.
+ *
+ *	@param level	LOG_LEVEL_*
+ *	@param format	printf format
+ */
+void logWrite(int level, const char *format, ...)
+{
+	va_list args;
+	if(!gIsLogRunning)
+	{
+		//writer is not running: write directly
+		printf("[Th %x]%s ", (unsigned int)pthread_self(), STR_LOG_LEVEL_NAME[level]);
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+		printf("\n");
+		return;
+	}
+
+	logRing_t *ring = getLogRing();
+	uint64_t head = ring != NULL ? ring->head : 0;
+	if(ring == NULL || head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= INT_LOG_RING_SIZE)
+	{
+		__atomic_fetch_add(&gLogDropCount, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	logMessage_t *message = &ring->message[head & (INT_LOG_RING_SIZE - 1)];
+	int length = snprintf(message->text, INT_LOG_MESSAGE_SIZE, "[Th %x]%s ",
+		(unsigned int)pthread_self(), STR_LOG_LEVEL_NAME[level]);
+	va_start(args, format);
+	length += vsnprintf(message->text + length, INT_LOG_MESSAGE_SIZE - length, format, args);
+	va_end(args);
+	//long message is cut off
+	if(length > INT_LOG_MESSAGE_SIZE - 2) length = INT_LOG_MESSAGE_SIZE - 2;
+	message->text[length++] = '\n';
+	message->length = length;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write all buffered messages to stdout. Called only by writer thread
+ *	(or after writer thread stopped).
+ *
+ *	@return The number of messages written
+ */
+int logFlush()
+{
+	int i;
+	int written = 0;
+	static uint64_t reportedDropCount;
+	int count = __atomic_load_n(&gLogRingCount, __ATOMIC_RELAXED);
+	if(count > INT_LOG_MAX_THREADS) count = INT_LOG_MAX_THREADS;
+	for(i = 0; i < count; i++)
+	{
+		logRing_t *ring = __atomic_load_n(&gLogRing[i], __ATOMIC_ACQUIRE);
+		if(ring == NULL) continue;
+		uint64_t tail = ring->tail;
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		for(; tail < head; tail++)
+		{
+			logMessage_t *message = &ring->message[tail & (INT_LOG_RING_SIZE - 1)];
+			fwrite(message->text, 1, message->length, stdout);
+			written++;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	uint64_t dropCount = __atomic_load_n(&gLogDropCount, __ATOMIC_RELAXED);
+	if(dropCount != reportedDropCount)
+	{
+		printf("[log  ]%s %lu messages dropped.\n", STR_LOG_LEVEL_NAME[LOG_LEVEL_ERROR],
+			(unsigned long)(dropCount - reportedDropCount));
+		reportedDropCount = dropCount;
+	}
+	if(written > 0) fflush(stdout);
+	return written;
+}
+
+/**
+ * Writer thread. Drain buffers of all threads.
+ */
+void *logWriter()
+{
+	while(__atomic_load_n(&gIsLogRunning, __ATOMIC_RELAXED))
+	{
+		if(logFlush() == 0) usleep(INT_LOG_WRITER_SLEEP_USEC);
+	}
+	return NULL;
+}
+
+/**
+ * Stop writer thread and write the rest of messages.
+ */
+void stopLog()
+{
+	if(!gIsLogRunning) return;
+	__atomic_store_n(&gIsLogRunning, false, __ATOMIC_RELAXED);
+	if(!pthread_equal(pthread_self(), gLogWriter)) pthread_join(gLogWriter, NULL);
+	logFlush();
+	fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include "applib.h"
+#include "lzlib.h"
+
+/// Default csv file name
+#define STR_CSV_FILE_NAME "calories.csv"
+/// Max int size
+#define INT_MAX_SIZE 10
+/// Min measuring time of each data (nano seconds)
+#define DOUBLE_BENCH_MIN_TIME 2e8
+
+/// ----- Function definitions
+char *createResponse(foodinfo_t**, int, char);
+void benchData(char*, char*);
+double getTimeNsec();
+
+
+/**
+ * Main function.
+ *	Build search responses from catalog data and measure compression ratio
+ *	and throughput of lzlib.h.
+ *	Responses are all food info (the broadest search) and food info
+ *	starting with each letter of the alphabet.
+ *
+ *	@param argc The number of parameter input by user
+ *	@param argv Array that has parameter input by user (csv file name)
+ */
+int main(int argc, char *argv[])
+{
+	int count = 0;
+	char *fileName = argc > 1 ? argv[1] : STR_CSV_FILE_NAME;
+	foodinfo_t **list = readCSV(&count, fileName);
+	if(gCSVResult == APPLIB_ERR_OPEN)
+	{
+		printf("File open error. File name = %s\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("# lzbench file=%s rows=%d\n", fileName, count);
+	char *response = createResponse(list, count, '\0');
+	benchData("all", response);
+	free(response);
+
+	char letter;
+	char label[8];
+	for(letter = 'a'; letter <= 'z'; letter++)
+	{
+		response = createResponse(list, count, letter);
+		//responses too small to be compressed by the server are ignored
+		if(strlen(response) > 1024)
+		{
+			sprintf(label, "%c*", letter);
+			benchData(label, response);
+		}
+		free(response);
+	}
+	return 0;
+}
+
+/**
+ * Measure compression ratio and throughput of single response.
+ *
+ *	@param label	Label of the data
+ *	@param data		Response text
+ */
+void benchData(char *label, char *data)
+{
+	int length = strlen(data);
+	int bound = lzCompressBound(length);
+	char *comp = (char *)malloc(bound);
+	char *decomp = (char *)malloc(length + 1);
+	int compLength = 0;
+	int loop = 0;
+
+	double start = getTimeNsec();
+	double elapsed;
+	do
+	{
+		compLength = lzCompress(data, length, comp, bound);
+		loop++;
+	} while((elapsed = getTimeNsec() - start) < DOUBLE_BENCH_MIN_TIME);
+	double compSpeed = (double)length * loop / elapsed * 1e3;
+
+	loop = 0;
+	start = getTimeNsec();
+	do
+	{
+		if(lzDecompress(comp, compLength, decomp, length) != length || memcmp(data, decomp, length) != 0)
+		{
+			printf("roundtrip error: %s\n", label);
+			exit(EXIT_FAILURE);
+		}
+		loop++;
+	} while((elapsed = getTimeNsec() - start) < DOUBLE_BENCH_MIN_TIME);
+	double decompSpeed = (double)length * loop / elapsed * 1e3;
+
+	printf("data=%s bytes=%d compressed=%d ratio=%.2f compress_MBps=%.0f decompress_MBps=%.0f\n",
+		label, length, compLength, (double)length / compLength, compSpeed, decompSpeed);
+	free(comp);
+	free(decomp);
+}
+
+/**
+ * Create response text in the same format as the server.
+ *
+ *	@param list		Food info
+ *	@param count	The number of food info
+ *	@param letter	The first letter of food name ('\0': all food info)
+ *	@return Response text (has to be freed by caller)
+ */
+char *createResponse(foodinfo_t **list, int count, char letter)
+{
+	int i;
+	int size = 0;
+	for(i = 0; i < count; i++)
+	{
+		size += strlen(list[i]->name) + strlen(list[i]->measure) + INT_MAX_SIZE * 5 + INT_DEFAULT_SPLIT_COUNT;
+	}
+	char *ret = (char *)calloc(size + 1, sizeof(char));
+	char *p = ret;
+	for(i = 0; i < count; i++)
+	{
+		foodinfo_t *info = list[i];
+		if(letter != '\0' && tolower(info->name[0]) != letter) continue;
+		p += sprintf(p, "%s,%s,%d,%d,%d,%d,%d\n", info->name, info->measure, info->weight,
+			info->kCal, info->fat, info->carbo, info->protein);
+	}
+	return ret;
+}
+
+/**
+ * Get monotonic time.
+ *
+ *	@return Time in nano seconds
+ */
+double getTimeNsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
@@ -0,0 +1,233 @@
+#ifndef LZLIB_H
+#define LZLIB_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/// Hash table size of compressor (2^LZ_HASH_LOG entries)
+#define LZ_HASH_LOG 12
+/// Min match length
+#define LZ_MIN_MATCH 4
+/// Max distance of match
+#define LZ_MAX_DISTANCE 65535
+/// The last bytes which are always literals (block format rule)
+#define LZ_LAST_LITERALS 5
+/// The last match must start before this number of bytes from the end
+#define LZ_MATCH_LIMIT 12
+/// Literal/match length stored in token
+#define LZ_RUN_MASK 15
+/// Skip acceleration: step grows by 1 every 2^LZ_SKIP_TRIGGER bytes without match
+#define LZ_SKIP_TRIGGER 6
+/// Compression status: destination buffer is too small or source is corrupted
+#define LZ_ERR_BUFFER -1
+
+/// ----- Function definitions
+int lzCompressBound(int);
+int lzCompress(const char*, int, char*, int);
+int lzDecompress(const char*, int, char*, int);
+
+
+/**
+ * Get the max size of compressed data.
+ *
+ *	@param srcLength	The size of the data to be compressed
+ *	@return Buffer size needed by lzCompress()
+ */
+int lzCompressBound(int srcLength)
+{
+	return srcLength + srcLength / 255 + 16;
+}
+
+/**
+ * Read 4 bytes (unaligned).
+ */
+static inline uint32_t lzRead32(const char *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+/**
+ * Hash 4 bytes.
+ */
+static inline int lzHash(uint32_t sequence)
+{
+	return (int)((sequence * 2654435761u) >> (32 - LZ_HASH_LOG));
+}
+
+/**
+ * Write length which does not fit in token (255 per byte).
+ *
+ *	@return Next write position, NULL when buffer is too small
+ */
+static inline char *lzWriteLength(char *op, char *opEnd, int length)
+{
+	while(length >= 255)
+	{
+		if(op >= opEnd) return NULL;
+		*op++ = (char)255;
+		length -= 255;
+	}
+	if(op >= opEnd) return NULL;
+	*op++ = (char)length;
+	return op;
+}
+
+/**
+ * Write a sequence (literals and a match).
+ *	When matchLength is 0, only literals are written (the last sequence).
+ *
+ *	@return Next write position, NULL when buffer is too small
+ */
+static char *lzWriteSequence(char *op, char *opEnd, const char *literal, int literalLength,
+	int offset, int matchLength)
+{
+	if(op >= opEnd) return NULL;
+	char *token = op++;
+	int code = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+	*token = (char)(((literalLength >= LZ_RUN_MASK ? LZ_RUN_MASK : literalLength) << 4)
+		| (code >= LZ_RUN_MASK ? LZ_RUN_MASK : code));
+	if(literalLength >= LZ_RUN_MASK)
+	{
+		if((op = lzWriteLength(op, opEnd, literalLength - LZ_RUN_MASK)) == NULL) return NULL;
+	}
+	if(opEnd - op < literalLength) return NULL;
+	memcpy(op, literal, literalLength);
+	op += literalLength;
+	if(matchLength == 0) return op;
+
+	if(opEnd - op < 2) return NULL;
+	*op++ = (char)(offset & 0xFF);
+	*op++ = (char)(offset >> 8);
+	if(code >= LZ_RUN_MASK)
+	{
+		if((op = lzWriteLength(op, opEnd, code - LZ_RUN_MASK)) == NULL) return NULL;
+	}
+	return op;
+}
+
+/**
+ * Compress data (LZ4 block format).
+ *
+ *	@param src			Data to be compressed
+ *	@param srcLength	The size of src
+ *	@param dst			Buffer to store compressed data
+ *	@param dstCapacity	The size of dst (lzCompressBound() is always enough)
+ *	@return The size of compressed data, LZ_ERR_BUFFER when dst is too small
+ */
+int lzCompress(const char *src, int srcLength, char *dst, int dstCapacity)
+{
+	int table[1 << LZ_HASH_LOG];
+	char *op = dst;
+	char *opEnd = dst + dstCapacity;
+	int ip = 0;
+	int anchor = 0;
+	int limit = srcLength - LZ_MATCH_LIMIT;
+	int matchEnd = srcLength - LZ_LAST_LITERALS;
+
+	memset(table, 0xFF, sizeof(table));
+	while(ip < limit)
+	{
+		uint32_t sequence = lzRead32(src + ip);
+		int h = lzHash(sequence);
+		int ref = table[h];
+		table[h] = ip;
+		if(ref < 0 || ip - ref > LZ_MAX_DISTANCE || lzRead32(src + ref) != sequence)
+		{
+			//no match: skip faster on data which does not compress
+			ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+			continue;
+		}
+
+		//extend match backwards and forwards
+		while(ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+		{
+			ip--;
+			ref--;
+		}
+		int length = LZ_MIN_MATCH;
+		while(ip + length < matchEnd && src[ip + length] == src[ref + length]) length++;
+
+		op = lzWriteSequence(op, opEnd, src + anchor, ip - anchor, ip - ref, length);
+		if(op == NULL) return LZ_ERR_BUFFER;
+		ip += length;
+		anchor = ip;
+		//register the position just before the next search
+		if(ip - 2 < limit) table[lzHash(lzRead32(src + ip - 2))] = ip - 2;
+	}
+
+	op = lzWriteSequence(op, opEnd, src + anchor, srcLength - anchor, 0, 0);
+	if(op == NULL) return LZ_ERR_BUFFER;
+	return (int)(op - dst);
+}
+
+/**
+ * Decompress data (LZ4 block format).
+ *
+ *	@param src			Compressed data
+ *	@param srcLength	The size of src
+ *	@param dst			Buffer to store decompressed data
+ *	@param dstCapacity	The size of dst
+ *	@return The size of decompressed data, LZ_ERR_BUFFER when dst is too small or src is corrupted
+ */
+int lzDecompress(const char *src, int srcLength, char *dst, int dstCapacity)
+{
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *ipEnd = ip + srcLength;
+	char *op = dst;
+	char *opEnd = dst + dstCapacity;
+
+	while(ip < ipEnd)
+	{
+		int token = *ip++;
+		int length = token >> 4;
+		if(length == LZ_RUN_MASK)
+		{
+			int add;
+			do
+			{
+				if(ip >= ipEnd) return LZ_ERR_BUFFER;
+				add = *ip++;
+				length += add;
+			} while(add == 255);
+		}
+		if(ipEnd - ip < length || opEnd - op < length) return LZ_ERR_BUFFER;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+		//the last sequence has no match
+		if(ip >= ipEnd) break;
+
+		if(ipEnd - ip < 2) return LZ_ERR_BUFFER;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > op - dst) return LZ_ERR_BUFFER;
+		length = (token & LZ_RUN_MASK);
+		if(length == LZ_RUN_MASK)
+		{
+			int add;
+			do
+			{
+				if(ip >= ipEnd) return LZ_ERR_BUFFER;
+				add = *ip++;
+				length += add;
+			} while(add == 255);
+		}
+		length += LZ_MIN_MATCH;
+		if(opEnd - op < length) return LZ_ERR_BUFFER;
+		//match may overlap the output, so copy byte by byte when offset is small
+		char *match = op - offset;
+		if(offset >= length) memcpy(op, match, length);
+		else
+		{
+			int i;
+			for(i = 0; i < length; i++) op[i] = match[i];
+		}
+		op += length;
+	}
+	return (int)(op - dst);
+}
+
+#endif
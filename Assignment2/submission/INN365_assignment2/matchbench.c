@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include "applib.h"
+#include "matchlib.h"
+
+/// The number of food names generated
+#define INT_BENCH_NAME_COUNT 100000
+/// The number of times all names are matched
+#define INT_BENCH_REPEAT 20
+/// Character: " " (space)
+#define STR_SPACE " "
+
+/// Words used to generate food names
+char *gBenchWords[] = {
+	"apple", "apricots", "banana", "bread", "butter", "cheese", "chicken", "chocolate",
+	"cream", "egg", "flour", "juice", "milk", "oatmeal", "pie", "raw", "dried", "canned",
+	"frozen", "whole", "white", "cheddar", "roasted", "salted", "unsalted", "sweetened"
+};
+/// Search words
+char *gBenchSearchWords[] = {
+	"apple", "Apricots", "bread,", "cheese ", "chocolate cream", "x",
+	"whole white roasted salted unsalted"
+};
+
+/// ----- Function definitions
+bool isTargetFoodLegacy(char*, foodinfo_t*);
+void convertToLowerCharLegacy(char*, char*);
+char **createNames(int);
+double benchLegacy(char*, foodinfo_t*, int);
+double benchKernel(int, char*, foodinfo_t*, int, int*);
+double getTimeNsec();
+
+
+/**
+ * Main function.
+ *	Compare matching time of the previous isTargetFood() and matchFoodName()
+ *	with scalar, SSE2 and AVX2 kernels.
+ *	The hit count of every kernel is checked against the previous implementation.
+ */
+int main(void)
+{
+	int i, j, k;
+	int count = INT_BENCH_NAME_COUNT;
+	char **names = createNames(count);
+	foodinfo_t *list = (foodinfo_t *)calloc(count, sizeof(foodinfo_t));
+	for(i = 0; i < count; i++)
+	{
+		list[i].name = names[i];
+	}
+	int kernels[] = {MATCHLIB_KERNEL_SCALAR, MATCHLIB_KERNEL_SSE2, MATCHLIB_KERNEL_AVX2};
+
+	printf("# matchbench names=%d repeat=%d (ns per name)\n", count, INT_BENCH_REPEAT);
+	for(i = 0; i < (int)(sizeof(gBenchSearchWords) / sizeof(char *)); i++)
+	{
+		char *word = gBenchSearchWords[i];
+		int legacyHit = 0;
+		int hit;
+		for(j = 0; j < count; j++)
+		{
+			if(isTargetFoodLegacy(word, &list[j])) legacyHit++;
+		}
+		double legacy = benchLegacy(word, list, count);
+		printf("word=\"%s\" legacy=%.1f", word, legacy);
+		for(k = 0; k < 3; k++)
+		{
+			double ns = benchKernel(kernels[k], word, list, count, &hit);
+			printf(" %s=%.1f", getMatchKernelName(), ns);
+			//check result is the same as the previous implementation
+			//(SIMD kernels have their own page boundary and tail handling)
+			if(hit != legacyHit)
+			{
+				printf("\nmismatch: word=\"%s\" kernel=%s legacy=%d new=%d\n", 
+					word, getMatchKernelName(), legacyHit, hit);
+				exit(EXIT_FAILURE);
+			}
+		}
+		printf(" hit=%d\n", legacyHit);
+	}
+	return 0;
+}
+
+/**
+ * Measure the previous isTargetFood().
+ *
+ *	@return Time per name (nano seconds)
+ */
+double benchLegacy(char *word, foodinfo_t *list, int count)
+{
+	int i, r;
+	volatile int hit = 0;
+	double start = getTimeNsec();
+	for(r = 0; r < INT_BENCH_REPEAT; r++)
+	{
+		for(i = 0; i < count; i++)
+		{
+			if(isTargetFoodLegacy(word, &list[i])) hit++;
+		}
+	}
+	return (getTimeNsec() - start) / ((double)count * INT_BENCH_REPEAT);
+}
+
+/**
+ * Measure matchFoodName() with the kernel.
+ *
+ *	@param hitCount	The number of names matched
+ *	@return Time per name (nano seconds)
+ */
+double benchKernel(int kernel, char *word, foodinfo_t *list, int count, int *hitCount)
+{
+	int i, r;
+	int hit = 0;
+	setMatchKernel(kernel);
+	double start = getTimeNsec();
+	for(r = 0; r < INT_BENCH_REPEAT; r++)
+	{
+		//word is prepared per search as the server does
+		foodquery_t query;
+		prepareFoodQuery(&query, word);
+		hit = 0;
+		for(i = 0; i < count; i++)
+		{
+			if(matchFoodName(&query, list[i].name)) hit++;
+		}
+	}
+	*hitCount = hit;
+	return (getTimeNsec() - start) / ((double)count * INT_BENCH_REPEAT);
+}
+
+/**
+ * Create food names from gBenchWords.
+ *
+ *	@param count	The number of names
+ *	@return Array of names
+ */
+char **createNames(int count)
+{
+	int i, j;
+	int wordCount = sizeof(gBenchWords) / sizeof(char *);
+	char **names = (char **)calloc(count, sizeof(char *));
+	char buf[MAX_LINE_BUFFER];
+	srand(365);
+	for(i = 0; i < count; i++)
+	{
+		int parts = 1 + rand() % 5;
+		buf[0] = '\0';
+		for(j = 0; j < parts; j++)
+		{
+			if(j == 1 && rand() % 2 == 0) strcat(buf, ", ");
+			else if(j > 0) strcat(buf, " ");
+			strcat(buf, gBenchWords[rand() % wordCount]);
+		}
+		buf[0] = toupper(buf[0]);
+		names[i] = (char *)calloc(strlen(buf) + 1, sizeof(char));
+		strcpy(names[i], buf);
+	}
+	return names;
+}
+
+/**
+ * Get monotonic time.
+ *
+ *	@return Time in nano seconds
+ */
+double getTimeNsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * isTargetFood() before matchlib.h (reference implementation).
+ */
+bool isTargetFoodLegacy(char *searchWord, foodinfo_t *info)
+{
+	char word[strlen(searchWord) + 1];
+	char name[strlen(info->name) + 1];
+	convertToLowerCharLegacy(searchWord, word);
+	convertToLowerCharLegacy(info->name, name);
+
+	if(strlen(word) > strlen(name) || word[0] != (name)[0])
+	{
+		return false;
+	}
+
+	int wordLength = strlen(word);
+	int nameLength = strlen(name);
+
+	if(word[wordLength - 1] == STR_COMMA[0])
+	{
+		word[wordLength - 1] = '\0';
+		wordLength = strlen(word);
+	}
+
+	if(word[wordLength - 1] == STR_SPACE[0])
+	{
+		if(strncmp(name, word, wordLength) == 0)
+		{
+			return true;
+		}
+	}
+	else
+	{
+		if((wordLength == nameLength) && (strcmp(word, name) == 0) )
+		{
+			return true;
+		}
+		else if(nameLength > wordLength && strncmp(name, word, wordLength) == 0)
+		{
+			if(name[wordLength] == STR_SPACE[0] || name[wordLength] == STR_COMMA[0])
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ * convertToLowerChar() before matchlib.h (reference implementation).
+ */
+void convertToLowerCharLegacy(char *target, char *ret)
+{
+	int i;
+	for(i = 0; i < (int)strlen(target); i++)
+	{
+		ret[i] = tolower(target[i]);
+	}
+	ret[i] = '\0';
+}
@@ -0,0 +1,247 @@
+#ifndef MATCHLIB_H
+#define MATCHLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+/// SSE2/AVX2 kernels are available
+#define MATCHLIB_X86
+#endif
+
+/// Max length of search word
+#define MAX_QUERY_LENGTH 512
+/// Padding after search word so that vector load never reads out of the buffer
+#define INT_QUERY_PADDING 32
+/// Page size used to check if vector load crosses page boundary
+#define INT_MATCH_PAGE_SIZE 4096
+/// Matching kernel: scalar
+#define MATCHLIB_KERNEL_SCALAR 0
+/// Matching kernel: SSE2
+#define MATCHLIB_KERNEL_SSE2 1
+/// Matching kernel: AVX2
+#define MATCHLIB_KERNEL_AVX2 2
+
+/// Search word prepared for matching (converted once per search)
+typedef struct foodQuery foodquery_t;
+struct foodQuery
+{
+	/// lower case search word without the last comma (zero padded)
+	char word[MAX_QUERY_LENGTH + INT_QUERY_PADDING];
+	/// the number of chars of word
+	int length;
+	/// true: the search word ends with a space (any name which starts with the word matches)
+	bool isPrefixOnly;
+	/// true: the search word ended with a comma (the name must be longer than the word)
+	bool hasComma;
+};
+
+/// Case-insensitive prefix compare kernel
+typedef bool (*matchPrefixFunc_t)(const char*, const char*, int);
+
+/// ----- Function definitions
+void prepareFoodQuery(foodquery_t*, const char*);
+bool matchFoodName(const foodquery_t*, const char*);
+bool matchPrefixScalar(const char*, const char*, int);
+bool matchPrefixResolve(const char*, const char*, int);
+void setMatchKernel(int);
+const char *getMatchKernelName();
+
+/// Kernel used by matchFoodName() (resolved at the first call)
+matchPrefixFunc_t gMatchPrefix = matchPrefixResolve;
+/// Kernel type selected
+int gMatchKernel = MATCHLIB_KERNEL_SCALAR;
+
+
+/**
+ * Prepare search word for matching.
+ *	The word is converted to lower case once so that each food name is compared
+ *	without conversion and copy.
+ *
+ *	@param query		Prepared search word
+ *	@param searchWord	Search word sent by client
+ */
+void prepareFoodQuery(foodquery_t *query, const char *searchWord)
+{
+	int i;
+	memset(query, 0, sizeof(foodquery_t));
+	for(i = 0; searchWord[i] != '\0' && i < MAX_QUERY_LENGTH; i++)
+	{
+		query->word[i] = tolower((unsigned char)searchWord[i]);
+	}
+	query->length = i;
+
+	//the last comma is ignored, but the name must have more chars than the word
+	if(query->length > 0 && query->word[query->length - 1] == ',')
+	{
+		query->word[--query->length] = '\0';
+		query->hasComma = true;
+	}
+	if(query->length > 0 && query->word[query->length - 1] == ' ')
+	{
+		query->isPrefixOnly = true;
+	}
+}
+
+/**
+ * Compare prepared search word with food name.
+ *	The name matches when it starts with the word and the next char of the name is
+ *	the end, a space or a comma (E.g. "apricots" matches "Apricots, raw" but not "ApricotsJam").
+ *	When the word ends with a space, any name which starts with the word matches.
+ *
+ *	@param query	Prepared search word
+ *	@param name		Food name
+ *	@return true: The food is to be sent to client.
+ */
+bool matchFoodName(const foodquery_t *query, const char *name)
+{
+	if(query->length == 0) return false;
+	//the first character is checked before calling kernel
+	if(query->word[0] != tolower((unsigned char)name[0])) return false;
+	if(!gMatchPrefix(name, query->word, query->length)) return false;
+
+	//name has at least query->length chars here
+	char next = name[query->length];
+	if(query->hasComma && next == '\0') return false;
+	if(query->isPrefixOnly) return true;
+	return next == '\0' || next == ' ' || next == ',';
+}
+
+/**
+ * Case-insensitive prefix compare (scalar).
+ *	'\0' in the name never matches the word, so the name length is not needed.
+ *
+ *	@param name			Food name
+ *	@param lowerWord	Lower case search word
+ *	@param length		The number of chars of lowerWord
+ *	@return true: The name starts with the word.
+ */
+bool matchPrefixScalar(const char *name, const char *lowerWord, int length)
+{
+	int i;
+	for(i = 0; i < length; i++)
+	{
+		char c = name[i];
+		if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		if(c != lowerWord[i]) return false;
+	}
+	return true;
+}
+
+#ifdef MATCHLIB_X86
+/// Kernels read past the end of the name (in the same page), so AddressSanitizer is disabled
+#define MATCHLIB_NO_ASAN __attribute__((no_sanitize_address))
+
+/**
+ * Check if vector load from the address does not cross page boundary.
+ *	Reading past the end of the name is safe as long as it stays in the same page.
+ */
+static inline bool isSafeLoad(const char *address, int size)
+{
+	return ((uintptr_t)address & (INT_MATCH_PAGE_SIZE - 1)) <= (uintptr_t)(INT_MATCH_PAGE_SIZE - size);
+}
+
+/**
+ * Case-insensitive prefix compare (SSE2, 16 chars at once).
+ */
+MATCHLIB_NO_ASAN
+bool matchPrefixSse2(const char *name, const char *lowerWord, int length)
+{
+	//'A'..'Z' are shifted to -128..-103 (signed) to check the range with a single compare
+	const __m128i shift = _mm_set1_epi8((char)(0x80 - 'A'));
+	const __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+	const __m128i caseBit = _mm_set1_epi8(0x20);
+	int i;
+	for(i = 0; i < length; i += 16)
+	{
+		if(!isSafeLoad(name + i, 16))
+		{
+			return matchPrefixScalar(name + i, lowerWord + i, length - i);
+		}
+		__m128i chars = _mm_loadu_si128((const __m128i *)(name + i));
+		__m128i word = _mm_loadu_si128((const __m128i *)(lowerWord + i));
+		__m128i isUpper = _mm_cmplt_epi8(_mm_add_epi8(chars, shift), limit);
+		__m128i lower = _mm_or_si128(chars, _mm_and_si128(isUpper, caseBit));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(lower, word));
+		unsigned int need = length - i >= 16 ? 0xFFFF : (1u << (length - i)) - 1;
+		if((mask & need) != need) return false;
+	}
+	return true;
+}
+
+/**
+ * Case-insensitive prefix compare (AVX2, 32 chars at once).
+ */
+__attribute__((target("avx2"))) MATCHLIB_NO_ASAN
+bool matchPrefixAvx2(const char *name, const char *lowerWord, int length)
+{
+	const __m256i shift = _mm256_set1_epi8((char)(0x80 - 'A'));
+	const __m256i limit = _mm256_set1_epi8((char)(0x80 + 26));
+	const __m256i caseBit = _mm256_set1_epi8(0x20);
+	int i;
+	for(i = 0; i < length; i += 32)
+	{
+		if(!isSafeLoad(name + i, 32))
+		{
+			return matchPrefixScalar(name + i, lowerWord + i, length - i);
+		}
+		__m256i chars = _mm256_loadu_si256((const __m256i *)(name + i));
+		__m256i word = _mm256_loadu_si256((const __m256i *)(lowerWord + i));
+		__m256i isUpper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(chars, shift));
+		__m256i lower = _mm256_or_si256(chars, _mm256_and_si256(isUpper, caseBit));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lower, word));
+		unsigned int need = length - i >= 32 ? 0xFFFFFFFFu : (1u << (length - i)) - 1;
+		if((mask & need) != need) return false;
+	}
+	return true;
+}
+#endif
+
+/**
+ * Select matching kernel.
+ *
+ *	@param kernel	MATCHLIB_KERNEL_SCALAR, MATCHLIB_KERNEL_SSE2 or MATCHLIB_KERNEL_AVX2
+ */
+void setMatchKernel(int kernel)
+{
+	gMatchKernel = MATCHLIB_KERNEL_SCALAR;
+	gMatchPrefix = matchPrefixScalar;
+#ifdef MATCHLIB_X86
+	if(kernel == MATCHLIB_KERNEL_AVX2 && __builtin_cpu_supports("avx2"))
+	{
+		gMatchKernel = MATCHLIB_KERNEL_AVX2;
+		gMatchPrefix = matchPrefixAvx2;
+	}
+	else if(kernel >= MATCHLIB_KERNEL_SSE2 && __builtin_cpu_supports("sse2"))
+	{
+		gMatchKernel = MATCHLIB_KERNEL_SSE2;
+		gMatchPrefix = matchPrefixSse2;
+	}
+#endif
+}
+
+/**
+ * Select the fastest kernel supported by CPU and compare.
+ *	Called only at the first match.
+ */
+bool matchPrefixResolve(const char *name, const char *lowerWord, int length)
+{
+	setMatchKernel(MATCHLIB_KERNEL_AVX2);
+	return gMatchPrefix(name, lowerWord, length);
+}
+
+/**
+ * Get the name of kernel selected.
+ */
+const char *getMatchKernelName()
+{
+	if(gMatchKernel == MATCHLIB_KERNEL_AVX2) return "avx2";
+	if(gMatchKernel == MATCHLIB_KERNEL_SSE2) return "sse2";
+	return "scalar";
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef PHASHLIB_H
+#define PHASHLIB_H
+
+//Minimal perfect hash of a fixed set of strings (hash and displace).
+//Each key is in its own slot, so lookup reads single seed and single slot.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/// Average number of keys per bucket (larger: less memory, slower build)
+#define INT_PHASH_BUCKET_SIZE 4
+/// Max number of seeds tried for single bucket
+#define INT_PHASH_MAX_SEED 0x00ffffff
+/// Seed flag: the rest of the seed is the slot of the single key in the bucket
+#define INT_PHASH_DIRECT 0x80000000u
+
+/// Slot of single key
+typedef struct phashSlot phashSlot_t;
+struct phashSlot
+{
+	/// lower bits of the hash of the key (most of the keys not in the set are rejected
+	/// without reading the key)
+	unsigned int fingerprint;
+	/// index of the key given to buildPerfectHash()
+	int value;
+};
+
+/// Minimal perfect hash
+typedef struct perfectHash perfectHash_t;
+struct perfectHash
+{
+	/// the number of keys (and slots)
+	int count;
+	int bucketCount;
+	/// seed of each bucket (INT_PHASH_DIRECT: the slot itself)
+	unsigned int *seeds;
+	phashSlot_t *slots;
+	/// keys given to buildPerfectHash() (not copied, kept by the caller)
+	char **keys;
+};
+
+/// ----- Function definitions
+unsigned long long hashPerfectKey(const char*, int);
+unsigned long long mixPerfectHash(unsigned long long);
+int getPerfectBucket(perfectHash_t*, unsigned long long);
+int getPerfectSlot(perfectHash_t*, unsigned long long, unsigned int);
+bool buildPerfectHash(perfectHash_t*, char**, int);
+int findPerfectHash(perfectHash_t*, const char*, int);
+void freePerfectHash(perfectHash_t*);
+
+
+/**
+ * Hash string (8 bytes at a time).
+ *
+ *	@param key		Key
+ *	@param length	Length of the key
+ *	@return 64 bit hash
+ */
+unsigned long long hashPerfectKey(const char *key, int length)
+{
+	unsigned long long hash = 0x9e3779b97f4a7c15ULL ^ (unsigned long long)length;
+	unsigned long long word;
+	int i;
+	for(i = 0; i + 8 <= length; i += 8)
+	{
+		memcpy(&word, key + i, 8);
+		hash = mixPerfectHash(hash ^ word);
+	}
+	word = 0;
+	memcpy(&word, key + i, length - i);
+	return mixPerfectHash(hash ^ word);
+}
+
+/**
+ * Mix bits of hash (finalizer of MurmurHash3).
+ *
+ *	@param hash	Hash
+ *	@return Mixed hash
+ */
+unsigned long long mixPerfectHash(unsigned long long hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/**
+ * Get bucket of the key from the upper bits of its hash.
+ *
+ *	@param ph	Perfect hash
+ *	@param hash	Hash of the key
+ *	@return Bucket
+ */
+int getPerfectBucket(perfectHash_t *ph, unsigned long long hash)
+{
+	return (int)(((hash >> 32) * (unsigned long long)ph->bucketCount) >> 32);
+}
+
+/**
+ * Get slot of the key displaced by the seed of its bucket.
+ *
+ *	@param ph	Perfect hash
+ *	@param hash	Hash of the key
+ *	@param seed	Seed of the bucket
+ *	@return Slot
+ */
+int getPerfectSlot(perfectHash_t *ph, unsigned long long hash, unsigned int seed)
+{
+	if(seed & INT_PHASH_DIRECT) return (int)(seed & ~INT_PHASH_DIRECT);
+	unsigned long long mixed = mixPerfectHash(hash ^ ((unsigned long long)seed * 0x9e3779b97f4a7c15ULL));
+	return (int)(((mixed & 0xffffffffULL) * (unsigned long long)ph->count) >> 32);
+}
+
+/**
+ * Build minimal perfect hash of the keys.
+ *	Keys are split into buckets, and from the largest bucket, a seed which puts all keys of
+ *	the bucket in free slots is searched. Buckets of single key take the free slots left
+ *	(the slot is stored as the seed), so the last slots are not searched by seeds.
+ *
+ *	@param ph		Perfect hash
+ *	@param keys		Keys (different from each other, kept until freePerfectHash())
+ *	@param count	The number of keys
+ *	@return false: failed (no memory, the same key or no seed is found), ph is empty
+ */
+bool buildPerfectHash(perfectHash_t *ph, char **keys, int count)
+{
+	int i, j;
+	memset(ph, 0, sizeof(perfectHash_t));
+	ph->keys = keys;
+	if(count <= 0) return true;
+	ph->count = count;
+	ph->bucketCount = (count + INT_PHASH_BUCKET_SIZE - 1) / INT_PHASH_BUCKET_SIZE;
+	ph->seeds = (unsigned int *)calloc(ph->bucketCount, sizeof(unsigned int));
+	ph->slots = (phashSlot_t *)malloc(sizeof(phashSlot_t) * count);
+	unsigned long long *hashes = (unsigned long long *)malloc(sizeof(unsigned long long) * count);
+	//keys of each bucket are listed in bucketKeys from bucketStart[bucket]
+	int *bucketStart = (int *)calloc(ph->bucketCount + 1, sizeof(int));
+	int *bucketKeys = (int *)malloc(sizeof(int) * count);
+	int *order = (int *)malloc(sizeof(int) * ph->bucketCount);
+	bool *isUsed = (bool *)calloc(count, sizeof(bool));
+	bool ret = ph->seeds != NULL && ph->slots != NULL && hashes != NULL && bucketStart != NULL
+		&& bucketKeys != NULL && order != NULL && isUsed != NULL;
+
+	for(i = 0; ret && i < count; i++)
+	{
+		hashes[i] = hashPerfectKey(keys[i], strlen(keys[i]));
+		bucketStart[getPerfectBucket(ph, hashes[i]) + 1]++;
+	}
+	int maxSize = 0;
+	for(i = 0; ret && i < ph->bucketCount; i++)
+	{
+		if(bucketStart[i + 1] > maxSize) maxSize = bucketStart[i + 1];
+		bucketStart[i + 1] += bucketStart[i];
+	}
+	//order of buckets from the largest (counting sort by size)
+	int *sizeStart = (int *)calloc(maxSize + 2, sizeof(int));
+	int *fill = (int *)calloc(ph->bucketCount, sizeof(int));
+	ret = ret && sizeStart != NULL && fill != NULL;
+	for(i = 0; ret && i < count; i++)
+	{
+		int bucket = getPerfectBucket(ph, hashes[i]);
+		bucketKeys[bucketStart[bucket] + fill[bucket]++] = i;
+	}
+	for(i = 0; ret && i < ph->bucketCount; i++) sizeStart[maxSize - (bucketStart[i + 1] - bucketStart[i]) + 1]++;
+	for(i = 0; ret && i <= maxSize; i++) sizeStart[i + 1] += sizeStart[i];
+	for(i = 0; ret && i < ph->bucketCount; i++)
+	{
+		order[sizeStart[maxSize - (bucketStart[i + 1] - bucketStart[i])]++] = i;
+	}
+
+	int freeSlot = 0;
+	int slots[maxSize > 0 ? maxSize : 1];
+	for(i = 0; ret && i < ph->bucketCount; i++)
+	{
+		int bucket = order[i];
+		int size = bucketStart[bucket + 1] - bucketStart[bucket];
+		int *members = bucketKeys + bucketStart[bucket];
+		if(size == 0) break;
+		if(size == 1)
+		{
+			while(isUsed[freeSlot]) freeSlot++;
+			ph->seeds[bucket] = INT_PHASH_DIRECT | freeSlot;
+			isUsed[freeSlot] = true;
+			ph->slots[freeSlot].fingerprint = (unsigned int)hashes[members[0]];
+			ph->slots[freeSlot].value = members[0];
+			continue;
+		}
+		unsigned int seed;
+		for(seed = 0; seed <= INT_PHASH_MAX_SEED; seed++)
+		{
+			for(j = 0; j < size; j++)
+			{
+				slots[j] = getPerfectSlot(ph, hashes[members[j]], seed);
+				if(isUsed[slots[j]]) break;
+				//keys of the same bucket are marked at once to detect collision between them
+				isUsed[slots[j]] = true;
+			}
+			if(j == size) break;
+			while(--j >= 0) isUsed[slots[j]] = false;
+		}
+		if(seed > INT_PHASH_MAX_SEED)
+		{
+			ret = false;
+			break;
+		}
+		ph->seeds[bucket] = seed;
+		for(j = 0; j < size; j++)
+		{
+			ph->slots[slots[j]].fingerprint = (unsigned int)hashes[members[j]];
+			ph->slots[slots[j]].value = members[j];
+		}
+	}
+	free(hashes);
+	free(bucketStart);
+	free(bucketKeys);
+	free(order);
+	free(isUsed);
+	free(sizeStart);
+	free(fill);
+	if(!ret) freePerfectHash(ph);
+	return ret;
+}
+
+/**
+ * Find the key.
+ *
+ *	@param ph		Perfect hash
+ *	@param key		Key
+ *	@param length	Length of the key
+ *	@return Index of the key given to buildPerfectHash(), -1 when it is not in the keys
+ */
+int findPerfectHash(perfectHash_t *ph, const char *key, int length)
+{
+	if(ph->count == 0) return -1;
+	unsigned long long hash = hashPerfectKey(key, length);
+	phashSlot_t *slot = &ph->slots[getPerfectSlot(ph, hash, ph->seeds[getPerfectBucket(ph, hash)])];
+	if(slot->fingerprint != (unsigned int)hash || strcmp(ph->keys[slot->value], key) != 0) return -1;
+	return slot->value;
+}
+
+/**
+ * Free perfect hash (keys are not freed).
+ *
+ *	@param ph	Perfect hash
+ */
+void freePerfectHash(perfectHash_t *ph)
+{
+	free(ph->seeds);
+	free(ph->slots);
+	memset(ph, 0, sizeof(perfectHash_t));
+}
+
+#endif
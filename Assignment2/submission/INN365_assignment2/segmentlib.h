@@ -0,0 +1,208 @@
+#ifndef SEGMENTLIB_H
+#define SEGMENTLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "applib.h"
+#include "matchlib.h"
+
+/// Max number of row ranges matched by single search word (see findSegmentRows())
+#define INT_SEGMENT_MAX_RANGES 2
+/// Suffix of the file being written ("<path>.<pid>"), renamed to <path> when complete
+#define STR_SEGMENT_TEMP_FORMAT "%s.%d"
+/// Max length of ".<pid>" and '\0'
+#define INT_SEGMENT_MAX_PID_SIZE 16
+
+/// Catalog segment: food info sorted by lower case name and serialized in the response format.
+/// Rows matched by a search word are contiguous, so they are sent from the file as they are.
+typedef struct catalogSegment segment_t;
+struct catalogSegment
+{
+	/// segment file (read only)
+	int fd;
+	/// the number of rows
+	int count;
+	/// lower case name of each row (the strings are not freed with the segment)
+	char **lowerNames;
+	/// offset of each row in the file ([count] is the size of the file)
+	off_t *offsets;
+	/// the number of users (the segment is freed when it becomes 0)
+	int refCount;
+};
+
+/// Rows [first, last) of catalog segment
+typedef struct segmentRange segmentRange_t;
+struct segmentRange
+{
+	int first;
+	int last;
+};
+
+/// ----- Function definitions
+segment_t *createSegment(char*, char**, foodinfo_t**, int);
+void freeSegment(segment_t*);
+int findSegmentRows(segment_t*, const foodquery_t*, segmentRange_t*, int*);
+int findSegmentBound(segment_t*, const char*, int, bool);
+off_t getSegmentRangeSize(segment_t*, segmentRange_t*);
+
+
+/**
+ * Write catalog segment file and create its row index.
+ *	The file is written under a temporary name and renamed, so the file being served
+ *	by other processes is never changed.
+ *
+ *	@param path			Segment file name
+ *	@param lowerNames	Lower case names in sorted order (kept by the segment)
+ *	@param infos		Food info of each name
+ *	@param count		The number of food info
+ *	@return Catalog segment (refCount is 1), NULL when the file could not be written
+ */
+segment_t *createSegment(char *path, char **lowerNames, foodinfo_t **infos, int count)
+{
+	int i;
+	char tempPath[strlen(path) + INT_SEGMENT_MAX_PID_SIZE];
+	sprintf(tempPath, STR_SEGMENT_TEMP_FORMAT, path, getpid());
+	FILE *fp = fopen(tempPath, "w");
+	if(fp == NULL) return NULL;
+
+	off_t *offsets = (off_t *)malloc(sizeof(off_t) * (count + 1));
+	off_t offset = 0;
+	for(i = 0; i < count; i++)
+	{
+		//the same format as search() sends
+		offsets[i] = offset;
+		foodinfo_t *info = infos[i];
+		offset += fprintf(fp, "%s,%s,%d,%d,%d,%d,%d\n", info->name, info->measure,
+			info->weight, info->kCal, info->fat, info->carbo, info->protein);
+	}
+	offsets[count] = offset;
+	int fd = -1;
+	//the file is opened before rename so that the file of another process is not opened
+	if(fclose(fp) != 0 || (fd = open(tempPath, O_RDONLY | O_CLOEXEC)) == -1
+		|| rename(tempPath, path) == -1)
+	{
+		if(fd != -1) close(fd);
+		unlink(tempPath);
+		free(offsets);
+		return NULL;
+	}
+
+	segment_t *segment = (segment_t *)malloc(sizeof(segment_t));
+	segment->fd = fd;
+	segment->count = count;
+	segment->lowerNames = lowerNames;
+	segment->offsets = offsets;
+	segment->refCount = 1;
+	return segment;
+}
+
+/**
+ * Close segment file and free the index.
+ *
+ *	@param segment	Catalog segment
+ */
+void freeSegment(segment_t *segment)
+{
+	close(segment->fd);
+	free(segment->lowerNames);
+	free(segment->offsets);
+	free(segment);
+}
+
+/**
+ * Find the rows matched by the search word (the same rule as matchFoodName()).
+ *	Names are sorted by lower case, so the names equal to the word and the names
+ *	which continue with ' ' come first, and the names which continue with ',' follow
+ *	after a gap (E.g. "apple", "apple pie", "apple's", "apple, raw").
+ *	A word which ends with a space matches all names which start with the word.
+ *
+ *	@param segment	Catalog segment
+ *	@param query	Search word prepared by prepareFoodQuery()
+ *	@param ranges	Rows found (INT_SEGMENT_MAX_RANGES entries)
+ *	@param hitCount	The number of rows found
+ *	@return The number of ranges
+ */
+int findSegmentRows(segment_t *segment, const foodquery_t *query, segmentRange_t *ranges, int *hitCount)
+{
+	int i;
+	int length = query->length;
+	int count = 0;
+	char key[MAX_QUERY_LENGTH + 2];
+	*hitCount = 0;
+	if(length == 0) return 0;
+	memcpy(key, query->word, length);
+	key[length] = '\0';
+
+	//the word ended with a comma does not match the same name
+	int first = query->hasComma ? findSegmentBound(segment, key, length + 1, true)
+		: findSegmentBound(segment, key, length, false);
+	if(query->isPrefixOnly)
+	{
+		ranges[0].first = first;
+		ranges[0].last = findSegmentBound(segment, key, length, true);
+		count = 1;
+	}
+	else
+	{
+		key[length] = ' ';
+		ranges[0].first = first;
+		ranges[0].last = findSegmentBound(segment, key, length + 1, true);
+		key[length] = ',';
+		ranges[1].first = findSegmentBound(segment, key, length + 1, false);
+		ranges[1].last = findSegmentBound(segment, key, length + 1, true);
+		count = 2;
+	}
+
+	//remove empty ranges
+	int used = 0;
+	for(i = 0; i < count; i++)
+	{
+		if(ranges[i].first >= ranges[i].last) continue;
+		*hitCount += ranges[i].last - ranges[i].first;
+		ranges[used++] = ranges[i];
+	}
+	return used;
+}
+
+/**
+ * Find the first row whose name compared with the key in the first length chars is
+ * not less than (isUpper: greater than) the key.
+ *
+ *	@param segment	Catalog segment
+ *	@param key		Lower case key
+ *	@param length	The number of chars compared (the key may contain '\0')
+ *	@param isUpper	false: lower bound, true: upper bound
+ *	@return Row number (segment->count when not found)
+ */
+int findSegmentBound(segment_t *segment, const char *key, int length, bool isUpper)
+{
+	int low = 0;
+	int high = segment->count;
+	while(low < high)
+	{
+		int mid = low + (high - low) / 2;
+		int cmp = strncmp(segment->lowerNames[mid], key, length);
+		if(cmp < 0 || (isUpper && cmp == 0)) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/**
+ * Get the size of rows in the segment file.
+ *
+ *	@param segment	Catalog segment
+ *	@param range	Rows
+ *	@return The size of the rows (bytes)
+ */
+off_t getSegmentRangeSize(segment_t *segment, segmentRange_t *range)
+{
+	return segment->offsets[range->last] - segment->offsets[range->first];
+}
+
+#endif
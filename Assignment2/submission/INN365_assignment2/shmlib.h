@@ -0,0 +1,443 @@
+#ifndef SHMLIB_H
+#define SHMLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <linux/futex.h>
+
+/// Magic number at the beginning of the channel ("DCSH")
+#define INT_SHM_MAGIC 0x48534344
+/// Layout version of the channel (server and clients have to be the same)
+#define INT_SHM_LAYOUT_VERSION 2
+/// The number of request slots (max number of requests in progress at once)
+#define INT_SHM_SLOT_COUNT 64
+/// Max size of request (including '\0')
+#define INT_SHM_REQUEST_SIZE 512
+/// Max size of response (including '\0'). Larger responses are "#tcp".
+#define INT_SHM_RESPONSE_SIZE 65536
+/// The number of times the state is checked before sleeping on futex
+#define INT_SHM_SPIN_COUNT 200
+/// Max time client waits for the response (milli seconds)
+#define INT_SHM_TIMEOUT_MSEC 5000
+
+/// Slot state: not used
+#define INT_SHM_SLOT_FREE 0
+/// Slot state: client is writing the request
+#define INT_SHM_SLOT_CLAIMED 1
+/// Slot state: request is ready for server
+#define INT_SHM_SLOT_REQUEST 2
+/// Slot state: server is serving the request
+#define INT_SHM_SLOT_SERVING 3
+/// Slot state: response is ready for client
+#define INT_SHM_SLOT_RESPONSE 4
+/// Slot state: client has given up, server frees the slot when the response is written
+#define INT_SHM_SLOT_ABANDONED 5
+
+/// Single request and its response. The state moves
+/// FREE -> CLAIMED -> REQUEST -> SERVING -> RESPONSE -> FREE by compare and swap,
+/// so the slot is owned by one side at a time without lock.
+/// A client that dies in CLAIMED or before taking the RESPONSE leaves the slot behind;
+/// such slots are freed by reclaimShmSlots() when the owner process no longer exists.
+/// The owner is checked by pid, so clients have to be in the same pid namespace as each
+/// other, and a slot of a client that dies between claiming it and writing ownerPid is
+/// not reclaimed until the server restarts.
+typedef struct shmSlot shmSlot_t;
+struct shmSlot
+{
+	/// INT_SHM_SLOT_* (futex word client waits on)
+	uint32_t state;
+	/// 1: client is sleeping on state (server wakes it)
+	uint32_t isClientWaiting;
+	/// pid of the client which claimed the slot (0: not written yet or free)
+	int32_t ownerPid;
+	int32_t requestLength;
+	int32_t responseLength;
+	char request[INT_SHM_REQUEST_SIZE];
+	char response[INT_SHM_RESPONSE_SIZE];
+} __attribute__((aligned(64)));
+
+/// Shared memory channel (POSIX shared memory object created by server)
+typedef struct shmChannel shmChannel_t;
+struct shmChannel
+{
+	/// INT_SHM_MAGIC (written last by server)
+	uint32_t magic;
+	uint32_t layoutVersion;
+	/// incremented for every request (futex word servers wait on)
+	uint32_t requestSeq;
+	/// the number of server threads sleeping on requestSeq
+	uint32_t serverWaiters;
+	shmSlot_t slots[INT_SHM_SLOT_COUNT];
+};
+
+/// ----- Function definitions
+shmChannel_t *createShmChannel(char*, int*);
+int takeShmRequest(shmChannel_t*, int);
+void waitShmRequest(shmChannel_t*, uint32_t);
+void completeShmRequest(shmChannel_t*, int, int);
+shmChannel_t *openShmChannel(char*);
+shmChannel_t *mapShmChannel(int);
+int requestShmChannel(shmChannel_t*, char*, char*, int);
+shmSlot_t *claimShmSlot(shmChannel_t*, int);
+int reclaimShmSlots(shmChannel_t*);
+void freeShmSlot(shmSlot_t*);
+void closeShmChannel(shmChannel_t*);
+long callShmFutex(uint32_t*, int, uint32_t, struct timespec*);
+
+
+/**
+ * Create shared memory channel (used by server).
+ *	The object left by the previous process is replaced.
+ *
+ *	@param name		Name of POSIX shared memory object ("/<name>")
+ *	@param objectFd	Descriptor of the object is stored here, so that it can be handed over
+ *					to the next server (NULL: closed)
+ *	@return Channel, NULL when failed (errno is set)
+ */
+shmChannel_t *createShmChannel(char *name, int *objectFd)
+{
+	int fd;
+	shm_unlink(name);
+	if((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600)) == -1) return NULL;
+	if(ftruncate(fd, sizeof(shmChannel_t)) == -1)
+	{
+		int error = errno;
+		close(fd);
+		shm_unlink(name);
+		errno = error;
+		return NULL;
+	}
+	shmChannel_t *channel = (shmChannel_t *)mmap(NULL, sizeof(shmChannel_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if(channel == MAP_FAILED)
+	{
+		int error = errno;
+		close(fd);
+		shm_unlink(name);
+		errno = error;
+		return NULL;
+	}
+	if(objectFd != NULL) *objectFd = fd;
+	else close(fd);
+	//the object is zero filled (all slots are free)
+	channel->layoutVersion = INT_SHM_LAYOUT_VERSION;
+	__atomic_store_n(&channel->magic, INT_SHM_MAGIC, __ATOMIC_RELEASE);
+	return channel;
+}
+
+/**
+ * Take a request ready for server.
+ *
+ *	@param channel	Channel
+ *	@param start	Slot to be checked first (server threads start from different slots)
+ *	@return Slot number (the state is SERVING), -1 when no request is ready
+ */
+int takeShmRequest(shmChannel_t *channel, int start)
+{
+	int i;
+	for(i = 0; i < INT_SHM_SLOT_COUNT; i++)
+	{
+		int index = (start + i) % INT_SHM_SLOT_COUNT;
+		uint32_t expected = INT_SHM_SLOT_REQUEST;
+		if(__atomic_load_n(&channel->slots[index].state, __ATOMIC_RELAXED) == INT_SHM_SLOT_REQUEST
+			&& __atomic_compare_exchange_n(&channel->slots[index].state, &expected, INT_SHM_SLOT_SERVING,
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			return index;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Sleep until a request is added (used by server after takeShmRequest() found nothing).
+ *	Returns at once when a request has been added since seq was read.
+ *
+ *	@param channel	Channel
+ *	@param seq		requestSeq read before takeShmRequest()
+ */
+void waitShmRequest(shmChannel_t *channel, uint32_t seq)
+{
+	__atomic_fetch_add(&channel->serverWaiters, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&channel->requestSeq, __ATOMIC_SEQ_CST) == seq)
+	{
+		callShmFutex(&channel->requestSeq, FUTEX_WAIT, seq, NULL);
+	}
+	__atomic_fetch_sub(&channel->serverWaiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Pass the response written in the slot to client (used by server).
+ *	The slot abandoned by client is freed.
+ *
+ *	@param channel	Channel
+ *	@param index	Slot number got by takeShmRequest()
+ *	@param length	The size of the response in slot->response
+ */
+void completeShmRequest(shmChannel_t *channel, int index, int length)
+{
+	shmSlot_t *slot = &channel->slots[index];
+	slot->responseLength = length;
+	uint32_t expected = INT_SHM_SLOT_SERVING;
+	if(!__atomic_compare_exchange_n(&slot->state, &expected, INT_SHM_SLOT_RESPONSE,
+		false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	{
+		freeShmSlot(slot);
+		return;
+	}
+	if(__atomic_load_n(&slot->isClientWaiting, __ATOMIC_SEQ_CST))
+	{
+		callShmFutex(&slot->state, FUTEX_WAKE, 1, NULL);
+	}
+}
+
+/**
+ * Open shared memory channel created by server (used by client).
+ *
+ *	@param name	Name of POSIX shared memory object ("/<name>")
+ *	@return Channel, NULL when failed (errno is set, EPROTO: different layout)
+ */
+shmChannel_t *openShmChannel(char *name)
+{
+	int fd;
+	if((fd = shm_open(name, O_RDWR | O_CLOEXEC, 0)) == -1) return NULL;
+	shmChannel_t *channel = mapShmChannel(fd);
+	int error = errno;
+	close(fd);
+	errno = error;
+	return channel;
+}
+
+/**
+ * Map shared memory channel from the descriptor of the object.
+ *	Used by client, and by server which took over the channel from the previous server
+ *	(the object is not created again, so clients which mapped it keep working).
+ *
+ *	@param fd	Descriptor of POSIX shared memory object (not closed)
+ *	@return Channel, NULL when failed (errno is set, EPROTO: different layout)
+ */
+shmChannel_t *mapShmChannel(int fd)
+{
+	struct stat st;
+	if(fstat(fd, &st) == -1 || st.st_size != sizeof(shmChannel_t))
+	{
+		errno = EPROTO;
+		return NULL;
+	}
+	shmChannel_t *channel = (shmChannel_t *)mmap(NULL, sizeof(shmChannel_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if(channel == MAP_FAILED) return NULL;
+	if(__atomic_load_n(&channel->magic, __ATOMIC_ACQUIRE) != INT_SHM_MAGIC
+		|| channel->layoutVersion != INT_SHM_LAYOUT_VERSION)
+	{
+		munmap(channel, sizeof(shmChannel_t));
+		errno = EPROTO;
+		return NULL;
+	}
+	return channel;
+}
+
+/**
+ * Send request to server by shared memory and wait for the response (used by client).
+ *	The request is the same as the one sent by socket. The response is the same as
+ *	UDP: not compressed ("#z" is ignored), and "#tcp" when it is larger than the slot.
+ *	Kept-alive connection is not needed ("#k" is ignored).
+ *
+ *	@param channel	Channel
+ *	@param request	Request ('\0' terminated)
+ *	@param response	Buffer of the response ('\0' terminated)
+ *	@param size		The size of response (INT_SHM_RESPONSE_SIZE is enough)
+ *	@return The size of the response, -1 when failed (errno is set, EBUSY: all slots
+ *		are in use, EMSGSIZE: the request or response is too large, ETIMEDOUT: server
+ *		did not answer)
+ *	When all slots are in use, slots left by dead clients are reclaimed and tried again.
+ */
+int requestShmChannel(shmChannel_t *channel, char *request, char *response, int size)
+{
+	int i;
+	int length = strlen(request);
+	if(length >= INT_SHM_REQUEST_SIZE)
+	{
+		errno = EMSGSIZE;
+		return -1;
+	}
+	//threads start from different slots
+	int start = (unsigned int)syscall(SYS_gettid) % INT_SHM_SLOT_COUNT;
+	shmSlot_t *slot = claimShmSlot(channel, start);
+	if(slot == NULL && reclaimShmSlots(channel) > 0) slot = claimShmSlot(channel, start);
+	if(slot == NULL)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	__atomic_store_n(&slot->ownerPid, (int32_t)getpid(), __ATOMIC_RELEASE);
+	memcpy(slot->request, request, length + 1);
+	slot->requestLength = length;
+	slot->isClientWaiting = 0;
+	__atomic_store_n(&slot->state, INT_SHM_SLOT_REQUEST, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&channel->requestSeq, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&channel->serverWaiters, __ATOMIC_SEQ_CST) > 0)
+	{
+		callShmFutex(&channel->requestSeq, FUTEX_WAKE, 1, NULL);
+	}
+
+	//spin shortly, the response of small request comes before sleeping is worth
+	uint32_t state = INT_SHM_SLOT_REQUEST;
+	for(i = 0; i < INT_SHM_SPIN_COUNT && state != INT_SHM_SLOT_RESPONSE; i++)
+	{
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+	}
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += INT_SHM_TIMEOUT_MSEC / 1000;
+	deadline.tv_nsec += (INT_SHM_TIMEOUT_MSEC % 1000) * 1000000L;
+	while(state != INT_SHM_SLOT_RESPONSE)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long remainNsec = (deadline.tv_sec - now.tv_sec) * 1000000000L + deadline.tv_nsec - now.tv_nsec;
+		if(remainNsec <= 0)
+		{
+			//the server frees the slot when it finishes the request
+			uint32_t expected = INT_SHM_SLOT_REQUEST;
+			__atomic_store_n(&slot->ownerPid, 0, __ATOMIC_SEQ_CST);
+			if(!__atomic_compare_exchange_n(&slot->state, &expected, INT_SHM_SLOT_FREE,
+				false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			{
+				expected = INT_SHM_SLOT_SERVING;
+				if(!__atomic_compare_exchange_n(&slot->state, &expected, INT_SHM_SLOT_ABANDONED,
+					false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+				{
+					//the response has just come
+					state = INT_SHM_SLOT_RESPONSE;
+					break;
+				}
+			}
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		struct timespec timeout;
+		timeout.tv_sec = remainNsec / 1000000000L;
+		timeout.tv_nsec = remainNsec % 1000000000L;
+		__atomic_store_n(&slot->isClientWaiting, 1, __ATOMIC_SEQ_CST);
+		state = __atomic_load_n(&slot->state, __ATOMIC_SEQ_CST);
+		if(state != INT_SHM_SLOT_RESPONSE) callShmFutex(&slot->state, FUTEX_WAIT, state, &timeout);
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+	}
+
+	int ret = slot->responseLength;
+	if(ret < size)
+	{
+		memcpy(response, slot->response, ret);
+		response[ret] = '\0';
+	}
+	else
+	{
+		errno = EMSGSIZE;
+		ret = -1;
+	}
+	freeShmSlot(slot);
+	return ret;
+}
+
+/**
+ * Claim a free slot (used by client).
+ *
+ *	@param channel	Channel
+ *	@param start	Slot to be checked first
+ *	@return Slot (the state is CLAIMED), NULL when all slots are in use
+ */
+shmSlot_t *claimShmSlot(shmChannel_t *channel, int start)
+{
+	int i;
+	for(i = 0; i < INT_SHM_SLOT_COUNT; i++)
+	{
+		shmSlot_t *candidate = &channel->slots[(start + i) % INT_SHM_SLOT_COUNT];
+		uint32_t expected = INT_SHM_SLOT_FREE;
+		if(__atomic_compare_exchange_n(&candidate->state, &expected, INT_SHM_SLOT_CLAIMED,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			return candidate;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Free the slots left by clients which died in CLAIMED or before taking the RESPONSE.
+ *	Slots whose owner is not written yet (ownerPid 0) are kept.
+ *
+ *	@param channel	Channel
+ *	@return The number of slots freed
+ */
+int reclaimShmSlots(shmChannel_t *channel)
+{
+	int i;
+	int ret = 0;
+	for(i = 0; i < INT_SHM_SLOT_COUNT; i++)
+	{
+		shmSlot_t *slot = &channel->slots[i];
+		uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		if(state != INT_SHM_SLOT_CLAIMED && state != INT_SHM_SLOT_RESPONSE) continue;
+		pid_t owner = __atomic_load_n(&slot->ownerPid, __ATOMIC_ACQUIRE);
+		//EPERM: the process exists but belongs to another user
+		if(owner <= 0 || kill(owner, 0) == 0 || errno != ESRCH) continue;
+		//the slot may have been freed and claimed again since the state was read
+		if(__atomic_compare_exchange_n(&slot->ownerPid, &owner, 0,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+			&& __atomic_compare_exchange_n(&slot->state, &state, INT_SHM_SLOT_FREE,
+				false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		{
+			ret++;
+		}
+	}
+	return ret;
+}
+
+/**
+ * Free the slot (the owner is cleared first, so the slot is not reclaimed twice).
+ *
+ *	@param slot	Slot
+ */
+void freeShmSlot(shmSlot_t *slot)
+{
+	__atomic_store_n(&slot->ownerPid, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slot->state, INT_SHM_SLOT_FREE, __ATOMIC_RELEASE);
+}
+
+/**
+ * Close shared memory channel opened by openShmChannel(), mapShmChannel() or createShmChannel().
+ *
+ *	@param channel	Channel
+ */
+void closeShmChannel(shmChannel_t *channel)
+{
+	munmap(channel, sizeof(shmChannel_t));
+}
+
+/**
+ * Call futex (shared between processes, so FUTEX_PRIVATE_FLAG is not used).
+ *
+ *	@param addr		Futex word
+ *	@param op		FUTEX_WAIT or FUTEX_WAKE
+ *	@param val		Expected value (FUTEX_WAIT) or the number of waiters woken (FUTEX_WAKE)
+ *	@param timeout	Relative timeout of FUTEX_WAIT (NULL: no timeout)
+ *	@return Result of futex
+ */
+long callShmFutex(uint32_t *addr, int op, uint32_t val, struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef STATLIB_H
+#define STATLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/// Max number of threads which record stats
+#define INT_STAT_MAX_THREADS 64
+/// The number of histogram buckets (bucket i counts values < 2^i micro seconds,
+/// the last bucket counts all values above, written as le="+Inf")
+#define INT_STAT_BUCKET_COUNT 24
+/// Max size of stats text
+#define INT_STAT_TEXT_SIZE 32768
+
+/// Stage of request: waiting in accept queue
+#define STAT_STAGE_QUEUE 0
+/// Stage of request: receiveClientData()
+#define STAT_STAGE_RECV 1
+/// Stage of request: search/add
+#define STAT_STAGE_SEARCH 2
+/// Stage of request: sendToClient()
+#define STAT_STAGE_SEND 3
+/// Stage of request: from accept to the end of send
+#define STAT_STAGE_TOTAL 4
+/// The number of stages
+#define INT_STAT_STAGE_COUNT 5
+
+/// Counter: requests handled
+#define STAT_COUNT_REQUEST 0
+/// Counter: requests which found food
+#define STAT_COUNT_HIT 1
+/// Counter: requests which found no food
+#define STAT_COUNT_MISS 2
+/// Counter: clients rejected because the queue is full
+#define STAT_COUNT_REJECT_FULL 3
+/// Counter: clients rejected because they waited too long
+#define STAT_COUNT_REJECT_DELAY 4
+/// Counter: recv()/send() errors
+#define STAT_COUNT_ERROR 5
+/// Counter: connections closed by timeout
+#define STAT_COUNT_TIMEOUT 6
+/// Counter: requests received by UDP
+#define STAT_COUNT_DATAGRAM 7
+/// Counter: UDP requests answered "use TCP"
+#define STAT_COUNT_DATAGRAM_TCP 8
+/// Counter: requests received by shared memory channel
+#define STAT_COUNT_SHM 9
+/// Counter: shared memory requests answered "use TCP"
+#define STAT_COUNT_SHM_TCP 10
+/// The number of counters
+#define INT_STAT_COUNTER_COUNT 11
+
+/// Latency histogram
+typedef struct statHistogram statHistogram_t;
+struct statHistogram
+{
+	uint64_t bucket[INT_STAT_BUCKET_COUNT];
+	uint64_t count;
+	uint64_t sum;
+};
+
+/// Stats of single thread.
+/// Only the owner thread writes, so no lock is needed (readers use atomic load).
+typedef struct threadStats threadStats_t;
+struct threadStats
+{
+	uint64_t counter[INT_STAT_COUNTER_COUNT];
+	statHistogram_t stage[INT_STAT_STAGE_COUNT];
+	/// padding to keep each thread on its own cache line
+	char padding[64];
+};
+
+/// Stage names used in stats text
+char *STR_STAT_STAGE_NAME[] = {"queue", "recv", "search", "send", "total"};
+/// Counter names used in stats text
+char *STR_STAT_COUNTER_NAME[] = {
+	"requests_total", "hits_total", "misses_total", "rejects_queue_full_total",
+	"rejects_queue_delay_total", "errors_total", "timeouts_total", "datagrams_total",
+	"datagrams_use_tcp_total", "shm_requests_total", "shm_use_tcp_total"
+};
+
+/// Stats of all threads
+threadStats_t gThreadStats[INT_STAT_MAX_THREADS];
+/// The number of slots used in gThreadStats
+int gThreadStatsCount;
+/// Time when stats started (CLOCK_MONOTONIC)
+struct timespec gStatStartTime;
+/// Stats slot of current thread
+__thread threadStats_t *tStats;
+
+/// ----- Function definitions
+void initializeStats();
+threadStats_t *getThreadStats();
+void statCount(int);
+void statRecord(int, long);
+int createStatsText(char*, int);
+
+
+/**
+ * Initialize stats. Called once before threads start.
+ */
+void initializeStats()
+{
+	memset(gThreadStats, 0, sizeof(gThreadStats));
+	gThreadStatsCount = 0;
+	clock_gettime(CLOCK_MONOTONIC, &gStatStartTime);
+}
+
+/**
+ * Get stats slot of current thread. A slot is assigned at the first call.
+ *	When all slots are used, the last slot is shared (counts may be lost).
+ *
+ *	@return Stats of current thread
+ */
+threadStats_t *getThreadStats()
+{
+	if(tStats == NULL)
+	{
+		int slot = __atomic_fetch_add(&gThreadStatsCount, 1, __ATOMIC_RELAXED);
+		if(slot >= INT_STAT_MAX_THREADS) slot = INT_STAT_MAX_THREADS - 1;
+		tStats = &gThreadStats[slot];
+	}
+	return tStats;
+}
+
+/**
+ * Increment counter of current thread.
+ *
+ *	@param counter	STAT_COUNT_*
+ */
+void statCount(int counter)
+{
+	__atomic_fetch_add(&getThreadStats()->counter[counter], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Record latency of a stage in histogram of current thread.
+ *
+ *	@param stage	STAT_STAGE_*
+ *	@param usec		Latency (micro seconds)
+ */
+void statRecord(int stage, long usec)
+{
+	statHistogram_t *histogram = &getThreadStats()->stage[stage];
+	int bucket = 0;
+	if(usec < 0) usec = 0;
+	while(bucket < INT_STAT_BUCKET_COUNT - 1 && usec >= (1L << bucket)) bucket++;
+	__atomic_fetch_add(&histogram->bucket[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->sum, (uint64_t)usec, __ATOMIC_RELAXED);
+}
+
+/**
+ * Get the upper bound of the bucket where the quantile falls.
+ *
+ *	@param histogram	Histogram summed over threads
+ *	@param quantile		0.0 - 1.0
+ *	@return Upper bound (micro seconds), 0 when no value is recorded
+ */
+static uint64_t getQuantile(statHistogram_t *histogram, double quantile)
+{
+	int i;
+	uint64_t rank = (uint64_t)(histogram->count * quantile);
+	uint64_t seen = 0;
+	if(histogram->count == 0) return 0;
+	for(i = 0; i < INT_STAT_BUCKET_COUNT; i++)
+	{
+		seen += histogram->bucket[i];
+		if(seen > rank) return 1UL << i;
+	}
+	return 1UL << (INT_STAT_BUCKET_COUNT - 1);
+}
+
+/**
+ * Create stats text summed over all threads.
+ *	Format is one "<name>{<labels>} <value>" per line (Prometheus text format),
+ *	so it can be scraped and diffed. Histogram bucket "le" is in micro seconds.
+ *
+ *	@param ret	Buffer to store the text
+ *	@param size	The size of ret
+ *	@return The length of the text
+ */
+int createStatsText(char *ret, int size)
+{
+	int i, j, k;
+	uint64_t counter[INT_STAT_COUNTER_COUNT];
+	statHistogram_t stage[INT_STAT_STAGE_COUNT];
+	memset(counter, 0, sizeof(counter));
+	memset(stage, 0, sizeof(stage));
+
+	int threads = __atomic_load_n(&gThreadStatsCount, __ATOMIC_RELAXED);
+	if(threads > INT_STAT_MAX_THREADS) threads = INT_STAT_MAX_THREADS;
+	for(i = 0; i < threads; i++)
+	{
+		threadStats_t *stats = &gThreadStats[i];
+		for(j = 0; j < INT_STAT_COUNTER_COUNT; j++)
+		{
+			counter[j] += __atomic_load_n(&stats->counter[j], __ATOMIC_RELAXED);
+		}
+		for(j = 0; j < INT_STAT_STAGE_COUNT; j++)
+		{
+			for(k = 0; k < INT_STAT_BUCKET_COUNT; k++)
+			{
+				stage[j].bucket[k] += __atomic_load_n(&stats->stage[j].bucket[k], __ATOMIC_RELAXED);
+			}
+			stage[j].count += __atomic_load_n(&stats->stage[j].count, __ATOMIC_RELAXED);
+			stage[j].sum += __atomic_load_n(&stats->stage[j].sum, __ATOMIC_RELAXED);
+		}
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int length = snprintf(ret, size, "distcom_uptime_seconds %ld\n", now.tv_sec - gStatStartTime.tv_sec);
+	for(j = 0; j < INT_STAT_COUNTER_COUNT && length < size; j++)
+	{
+		length += snprintf(ret + length, size - length, "distcom_%s %lu\n",
+			STR_STAT_COUNTER_NAME[j], (unsigned long)counter[j]);
+	}
+	for(j = 0; j < INT_STAT_STAGE_COUNT && length < size; j++)
+	{
+		uint64_t cumulative = 0;
+		char *name = STR_STAT_STAGE_NAME[j];
+		for(k = 0; k < INT_STAT_BUCKET_COUNT - 1 && length < size; k++)
+		{
+			cumulative += stage[j].bucket[k];
+			length += snprintf(ret + length, size - length,
+				"distcom_stage_usec_bucket{stage=\"%s\",le=\"%lu\"} %lu\n",
+				name, 1UL << k, (unsigned long)cumulative);
+		}
+		if(length >= size) break;
+		cumulative += stage[j].bucket[k];
+		length += snprintf(ret + length, size - length,
+			"distcom_stage_usec_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n",
+			name, (unsigned long)cumulative);
+		if(length >= size) break;
+		length += snprintf(ret + length, size - length,
+			"distcom_stage_usec_count{stage=\"%s\"} %lu\n"
+			"distcom_stage_usec_sum{stage=\"%s\"} %lu\n"
+			"distcom_stage_usec{stage=\"%s\",quantile=\"0.5\"} %lu\n"
+			"distcom_stage_usec{stage=\"%s\",quantile=\"0.99\"} %lu\n",
+			name, (unsigned long)stage[j].count, name, (unsigned long)stage[j].sum,
+			name, (unsigned long)getQuantile(&stage[j], 0.5),
+			name, (unsigned long)getQuantile(&stage[j], 0.99));
+	}
+	if(length >= size) length = size - 1;
+	return length;
+}
+
+#endif
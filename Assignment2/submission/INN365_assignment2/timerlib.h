@@ -0,0 +1,163 @@
+#ifndef TIMERLIB_H
+#define TIMERLIB_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+/// The number of slots in timer wheel (power of 2)
+#define INT_TIMER_SLOT_COUNT 512
+/// Time of single slot (milli seconds)
+#define INT_TIMER_TICK_MSEC 10
+
+/// Single timer. Embedded in the object which has the deadline.
+typedef struct timerEntry timerEntry_t;
+struct timerEntry
+{
+	timerEntry_t *prev;
+	timerEntry_t *next;
+	/// tick when the timer expires
+	long long expireTick;
+	/// object which has the deadline
+	void *data;
+	/// true: the timer is in the wheel
+	bool isActive;
+};
+
+/// Hashed timer wheel. A timer is stored in the slot of (expire tick % slot count),
+/// so add/remove is O(1) and only one slot is checked per tick.
+/// Timers further than one round stay in the slot until their round comes.
+typedef struct timerWheel timerWheel_t;
+struct timerWheel
+{
+	timerEntry_t *slot[INT_TIMER_SLOT_COUNT];
+	/// the last tick processed
+	long long currentTick;
+	/// the number of timers in the wheel
+	int count;
+};
+
+/// ----- Function definitions
+long long getMonotonicMsec();
+void initializeTimerWheel(timerWheel_t*);
+void addTimer(timerWheel_t*, timerEntry_t*, long long, void*);
+void removeTimer(timerWheel_t*, timerEntry_t*);
+timerEntry_t *expireTimers(timerWheel_t*, long long);
+int getTimerWaitMsec(timerWheel_t*, long long);
+
+
+/**
+ * Get monotonic time.
+ *
+ *	@return Time in milli seconds (CLOCK_MONOTONIC)
+ */
+long long getMonotonicMsec()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * Initialize timer wheel.
+ */
+void initializeTimerWheel(timerWheel_t *wheel)
+{
+	int i;
+	for(i = 0; i < INT_TIMER_SLOT_COUNT; i++)
+	{
+		wheel->slot[i] = NULL;
+	}
+	wheel->currentTick = getMonotonicMsec() / INT_TIMER_TICK_MSEC;
+	wheel->count = 0;
+}
+
+/**
+ * Add timer in wheel.
+ *
+ *	@param wheel		Timer wheel
+ *	@param entry		Timer (must not be in the wheel)
+ *	@param expireMsec	Time when the timer expires (getMonotonicMsec())
+ *	@param data			Object which has the deadline
+ */
+void addTimer(timerWheel_t *wheel, timerEntry_t *entry, long long expireMsec, void *data)
+{
+	//round up so that the timer never expires early
+	entry->expireTick = (expireMsec + INT_TIMER_TICK_MSEC - 1) / INT_TIMER_TICK_MSEC;
+	if(entry->expireTick <= wheel->currentTick) entry->expireTick = wheel->currentTick + 1;
+	entry->data = data;
+	timerEntry_t **head = &wheel->slot[entry->expireTick & (INT_TIMER_SLOT_COUNT - 1)];
+	entry->prev = NULL;
+	entry->next = *head;
+	if(*head != NULL) (*head)->prev = entry;
+	*head = entry;
+	entry->isActive = true;
+	wheel->count++;
+}
+
+/**
+ * Remove timer from wheel. Nothing happens when the timer is not in the wheel.
+ */
+void removeTimer(timerWheel_t *wheel, timerEntry_t *entry)
+{
+	if(!entry->isActive) return;
+	if(entry->prev != NULL) entry->prev->next = entry->next;
+	else wheel->slot[entry->expireTick & (INT_TIMER_SLOT_COUNT - 1)] = entry->next;
+	if(entry->next != NULL) entry->next->prev = entry->prev;
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->isActive = false;
+	wheel->count--;
+}
+
+/**
+ * Advance wheel to current time and take expired timers out of the wheel.
+ *
+ *	@param wheel	Timer wheel
+ *	@param nowMsec	Current time (getMonotonicMsec())
+ *	@return List of expired timers linked by "next", NULL when no timer expired
+ */
+timerEntry_t *expireTimers(timerWheel_t *wheel, long long nowMsec)
+{
+	timerEntry_t *expired = NULL;
+	long long nowTick = nowMsec / INT_TIMER_TICK_MSEC;
+	//all slots are checked at most once even after a long pause
+	if(nowTick - wheel->currentTick > INT_TIMER_SLOT_COUNT)
+	{
+		wheel->currentTick = nowTick - INT_TIMER_SLOT_COUNT;
+	}
+	while(wheel->currentTick < nowTick && wheel->count > 0)
+	{
+		wheel->currentTick++;
+		timerEntry_t *entry = wheel->slot[wheel->currentTick & (INT_TIMER_SLOT_COUNT - 1)];
+		while(entry != NULL)
+		{
+			timerEntry_t *next = entry->next;
+			if(entry->expireTick <= nowTick)
+			{
+				removeTimer(wheel, entry);
+				entry->next = expired;
+				expired = entry;
+			}
+			entry = next;
+		}
+	}
+	wheel->currentTick = nowTick;
+	return expired;
+}
+
+/**
+ * Get time until the next tick to be checked, used as poll() timeout.
+ *
+ *	@param wheel	Timer wheel
+ *	@param nowMsec	Current time (getMonotonicMsec())
+ *	@return Time in milli seconds, -1 when the wheel is empty
+ */
+int getTimerWaitMsec(timerWheel_t *wheel, long long nowMsec)
+{
+	if(wheel->count == 0) return -1;
+	long long wait = (wheel->currentTick + 1) * INT_TIMER_TICK_MSEC - nowMsec;
+	return wait > 0 ? (int)wait : 0;
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef URINGLIB_H
+#define URINGLIB_H
+
+//io_uring is used by system calls directly, liburing is not needed
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/// Setup flags tried first (retried without flags on the kernel which does not know them)
+#define INT_URING_SETUP_FLAGS IORING_SETUP_COOP_TASKRUN
+
+/// Single io_uring instance (submission and completion queues shared with kernel)
+typedef struct uring uring_t;
+struct uring
+{
+	int fd;
+	/// the number of submission queue entries
+	unsigned sqEntries;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned sqMask;
+	struct io_uring_sqe *sqes;
+	/// tail including the entries not submitted yet (written to sqTail by submitUring())
+	unsigned sqLocalTail;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe *cqes;
+	/// mapped queues (single mapping of both rings, and entries)
+	void *ringMemory;
+	size_t ringSize;
+	size_t sqesSize;
+};
+
+/// Buffers provided to kernel. recv with IOSQE_BUFFER_SELECT takes one when data arrives,
+/// so idle connections do not hold buffers.
+typedef struct uringBuffers uringBuffers_t;
+struct uringBuffers
+{
+	/// ring of buffers shared with kernel
+	struct io_uring_buf_ring *ring;
+	size_t ringSize;
+	/// tail of ring (buffers returned to kernel)
+	unsigned short tail;
+	char *data;
+	/// the number of buffers (power of 2)
+	int count;
+	/// the size of each buffer
+	int size;
+};
+
+/// ----- Function definitions
+int initializeUring(uring_t*, unsigned);
+void closeUring(uring_t*);
+struct io_uring_sqe *getUringSqe(uring_t*);
+unsigned getUringSpace(uring_t*);
+int submitUring(uring_t*, unsigned);
+struct io_uring_cqe *peekUringCqe(uring_t*);
+void seenUringCqe(uring_t*);
+int registerUringBuffers(uring_t*, uringBuffers_t*, int, int, int);
+void freeUringBuffers(uringBuffers_t*);
+char *getUringBuffer(uringBuffers_t*, int);
+void returnUringBuffer(uringBuffers_t*, int);
+
+
+/**
+ * Create io_uring instance and map its queues.
+ *	IORING_FEAT_SINGLE_MMAP (Linux 5.4) is required.
+ *
+ *	@param uring	io_uring instance
+ *	@param entries	The number of submission queue entries
+ *	@return 0, -1 when failed (errno is set, ENOSYS: io_uring is not supported)
+ */
+int initializeUring(uring_t *uring, unsigned entries)
+{
+	unsigned i;
+	struct io_uring_params params;
+	memset(uring, 0, sizeof(uring_t));
+	memset(&params, 0, sizeof(params));
+	params.flags = INT_URING_SETUP_FLAGS;
+	uring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(uring->fd == -1 && errno == EINVAL)
+	{
+		memset(&params, 0, sizeof(params));
+		uring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	}
+	if(uring->fd == -1) return -1;
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		close(uring->fd);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	uring->ringSize = sqSize > cqSize ? sqSize : cqSize;
+	uring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	uring->ringMemory = mmap(NULL, uring->ringSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if(uring->ringMemory == MAP_FAILED)
+	{
+		close(uring->fd);
+		return -1;
+	}
+	uring->sqes = (struct io_uring_sqe *)mmap(NULL, uring->sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+	if(uring->sqes == MAP_FAILED)
+	{
+		munmap(uring->ringMemory, uring->ringSize);
+		close(uring->fd);
+		return -1;
+	}
+
+	char *ring = (char *)uring->ringMemory;
+	uring->sqEntries = params.sq_entries;
+	uring->sqHead = (unsigned *)(ring + params.sq_off.head);
+	uring->sqTail = (unsigned *)(ring + params.sq_off.tail);
+	uring->sqMask = *(unsigned *)(ring + params.sq_off.ring_mask);
+	uring->sqLocalTail = *uring->sqTail;
+	uring->cqHead = (unsigned *)(ring + params.cq_off.head);
+	uring->cqTail = (unsigned *)(ring + params.cq_off.tail);
+	uring->cqMask = *(unsigned *)(ring + params.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+	//entry i is always in slot i, so the array is written only once
+	unsigned *array = (unsigned *)(ring + params.sq_off.array);
+	for(i = 0; i < params.sq_entries; i++) array[i] = i;
+	return 0;
+}
+
+/**
+ * Unmap queues and close io_uring instance.
+ *	Provided buffers are not freed (the instance is closed only when it is not used).
+ *
+ *	@param uring	io_uring instance
+ */
+void closeUring(uring_t *uring)
+{
+	munmap(uring->sqes, uring->sqesSize);
+	munmap(uring->ringMemory, uring->ringSize);
+	close(uring->fd);
+}
+
+/**
+ * Get the next submission queue entry (cleared).
+ *	The entry is submitted by the next submitUring().
+ *
+ *	@param uring	io_uring instance
+ *	@return Submission queue entry, NULL when the queue is full (call submitUring())
+ */
+struct io_uring_sqe *getUringSqe(uring_t *uring)
+{
+	unsigned head = __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE);
+	if(uring->sqLocalTail - head >= uring->sqEntries) return NULL;
+	struct io_uring_sqe *sqe = &uring->sqes[uring->sqLocalTail & uring->sqMask];
+	uring->sqLocalTail++;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+/**
+ * Get the number of submission queue entries which can be got by getUringSqe().
+ *	Linked entries have to be submitted together, so check the space before the first.
+ *
+ *	@param uring	io_uring instance
+ *	@return The number of free entries
+ */
+unsigned getUringSpace(uring_t *uring)
+{
+	return uring->sqEntries - (uring->sqLocalTail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Submit entries got by getUringSqe() and wait for completions.
+ *	Submission and waiting are done by single system call.
+ *
+ *	@param uring		io_uring instance
+ *	@param waitCount	The number of completions to wait for (0: do not wait)
+ *	@return The number of entries submitted, -1 when failed (errno is set)
+ */
+int submitUring(uring_t *uring, unsigned waitCount)
+{
+	__atomic_store_n(uring->sqTail, uring->sqLocalTail, __ATOMIC_RELEASE);
+	unsigned submitCount = uring->sqLocalTail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE);
+	unsigned flags = waitCount > 0 ? IORING_ENTER_GETEVENTS : 0;
+	return syscall(__NR_io_uring_enter, uring->fd, submitCount, waitCount, flags, NULL, 0);
+}
+
+/**
+ * Get the first completion queue entry which has not been seen.
+ *	Call seenUringCqe() after reading the entry.
+ *
+ *	@param uring	io_uring instance
+ *	@return Completion queue entry, NULL when there is nothing completed
+ */
+struct io_uring_cqe *peekUringCqe(uring_t *uring)
+{
+	unsigned head = *uring->cqHead;
+	if(head == __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE)) return NULL;
+	return &uring->cqes[head & uring->cqMask];
+}
+
+/**
+ * Release the entry got by peekUringCqe() to kernel.
+ *
+ *	@param uring	io_uring instance
+ */
+void seenUringCqe(uring_t *uring)
+{
+	__atomic_store_n(uring->cqHead, *uring->cqHead + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Register ring of provided buffers (Linux 5.19) and provide all buffers.
+ *
+ *	@param uring	io_uring instance
+ *	@param buffers	Provided buffers
+ *	@param group	Buffer group ID (buf_group of recv)
+ *	@param count	The number of buffers (power of 2, max 32768)
+ *	@param size		The size of each buffer
+ *	@return 0, -1 when failed (errno is set)
+ */
+int registerUringBuffers(uring_t *uring, uringBuffers_t *buffers, int group, int count, int size)
+{
+	int i;
+	struct io_uring_buf_reg reg;
+	memset(buffers, 0, sizeof(uringBuffers_t));
+	buffers->count = count;
+	buffers->size = size;
+	//the ring has to be page aligned
+	buffers->ringSize = count * sizeof(struct io_uring_buf);
+	buffers->ring = (struct io_uring_buf_ring *)mmap(NULL, buffers->ringSize, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(buffers->ring == MAP_FAILED) return -1;
+	if((buffers->data = (char *)malloc((size_t)count * size)) == NULL)
+	{
+		munmap(buffers->ring, buffers->ringSize);
+		return -1;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long)buffers->ring;
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if(syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+	{
+		int error = errno;
+		munmap(buffers->ring, buffers->ringSize);
+		free(buffers->data);
+		errno = error;
+		return -1;
+	}
+	for(i = 0; i < count; i++) returnUringBuffer(buffers, i);
+	return 0;
+}
+
+/**
+ * Free provided buffers. The io_uring instance has to be closed first.
+ *
+ *	@param buffers	Provided buffers
+ */
+void freeUringBuffers(uringBuffers_t *buffers)
+{
+	munmap(buffers->ring, buffers->ringSize);
+	free(buffers->data);
+}
+
+/**
+ * Get buffer selected by kernel (ID is in the upper bits of cqe->flags).
+ *
+ *	@param buffers	Provided buffers
+ *	@param id		Buffer ID
+ *	@return Buffer
+ */
+char *getUringBuffer(uringBuffers_t *buffers, int id)
+{
+	return buffers->data + (size_t)id * buffers->size;
+}
+
+/**
+ * Provide the buffer to kernel again.
+ *
+ *	@param buffers	Provided buffers
+ *	@param id		Buffer ID
+ */
+void returnUringBuffer(uringBuffers_t *buffers, int id)
+{
+	struct io_uring_buf *buf = &buffers->ring->bufs[buffers->tail & (buffers->count - 1)];
+	buf->addr = (unsigned long)getUringBuffer(buffers, id);
+	buf->len = buffers->size;
+	buf->bid = id;
+	buffers->tail++;
+	__atomic_store_n(&buffers->ring->tail, buffers->tail, __ATOMIC_RELEASE);
+}
+
+#endif